@@ -0,0 +1,188 @@
+// Throughput and latency of run_classifier_batch() over a set of archived
+// frames, against one run_classifier() call per frame. Batches run on the
+// calling thread, sharded over worker threads, and pipelined (the calling
+// thread quantizes while the workers invoke). Also checks every mode returns
+// the same detections as run_classifier().
+//
+// Latency is per batch call: a frame is only returned once its batch is.
+//
+// Native build, from the repository root:
+//   cmake -S . -B build && cmake --build build --target bench_classifier_batch
+//
+// Usage: bench_classifier_batch [frames] [batch size] [threads]
+
+#include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#define BENCH_DEFAULT_FRAMES 64
+#define BENCH_DEFAULT_BATCH 16
+#define BENCH_FRAME_BYTES (EI_CLASSIFIER_INPUT_WIDTH * EI_CLASSIFIER_INPUT_HEIGHT * 3)
+
+struct BenchMode
+{
+    const char *name;
+    bool batch;
+    uint32_t threads;
+    bool pipeline;
+};
+
+struct BenchResult
+{
+    double imagesPerSecond;
+    double p50Us;
+    double p99Us;
+    bool same;
+};
+
+static std::vector<uint8_t> frames;
+static std::vector<ei_impulse_result_bounding_box_t> expectedBoxes;
+static std::vector<uint32_t> expectedCounts;
+
+static void makeFrames(int count)
+{
+    frames.resize((size_t)count * BENCH_FRAME_BYTES);
+    srand(42);
+    for (int f = 0; f < count; f++) {
+        uint8_t *frame = &frames[(size_t)f * BENCH_FRAME_BYTES];
+        for (size_t i = 0; i < BENCH_FRAME_BYTES; i++) {
+            size_t x = (i / 3) % EI_CLASSIFIER_INPUT_WIDTH;
+            size_t y = (i / 3) / EI_CLASSIFIER_INPUT_WIDTH;
+            frame[i] = f % 2 ? (uint8_t)(rand() & 0xff)
+                             : (uint8_t)((x * (f + 1) + y * (f + 3) + ((x / 8 + y / 8) & 1) * 90) & 0xff);
+        }
+    }
+}
+
+static signal_t frameSignal(int f)
+{
+    signal_t signal;
+    const uint8_t *frame = &frames[(size_t)f * BENCH_FRAME_BYTES];
+
+    signal.total_length = EI_CLASSIFIER_INPUT_WIDTH * EI_CLASSIFIER_INPUT_HEIGHT;
+    signal.get_data = [frame](size_t offset, size_t length, float *out) {
+        const uint8_t *px = frame + offset * 3;
+        for (size_t i = 0; i < length; i++, px += 3)
+            out[i] = (px[0] << 16) + (px[1] << 8) + px[2];
+        return 0;
+    };
+    return signal;
+}
+
+static bool sameDetections(const ei_impulse_result_t &result, int f)
+{
+    if (result.bounding_boxes_count != expectedCounts[f])
+        return false;
+    for (uint32_t i = 0; i < result.bounding_boxes_count; i++) {
+        const ei_impulse_result_bounding_box_t &a = result.bounding_boxes[i];
+        const ei_impulse_result_bounding_box_t &b = expectedBoxes[(size_t)f * EI_CLASSIFIER_OBJECT_DETECTION_COUNT + i];
+        if (a.label != b.label || a.x != b.x || a.y != b.y || a.width != b.width || a.height != b.height ||
+            a.value != b.value)
+            return false;
+    }
+    return true;
+}
+
+static bool runMode(const BenchMode &mode, int frameCount, int batchSize, BenchResult &res)
+{
+    std::vector<signal_t> signals(batchSize);
+    std::vector<ei_impulse_result_t> results(batchSize);
+    std::vector<ei_impulse_result_bounding_box_t> boxes((size_t)batchSize * EI_CLASSIFIER_OBJECT_DETECTION_COUNT);
+    std::vector<double> times;
+    std::unique_ptr<ei_impulse_scratch_t> scratch(new ei_impulse_scratch_t());
+    ei_impulse_batch_config_t config = { 0 };
+
+    config.threads = mode.threads;
+    config.pipeline = mode.pipeline;
+    config.bounding_boxes = boxes.data();
+    config.bounding_boxes_per_result = EI_CLASSIFIER_OBJECT_DETECTION_COUNT;
+
+    res.same = true;
+    auto benchStart = std::chrono::steady_clock::now();
+    for (int first = 0; first < frameCount; first += batchSize) {
+        int count = std::min(batchSize, frameCount - first);
+        for (int i = 0; i < count; i++)
+            signals[i] = frameSignal(first + i);
+
+        auto start = std::chrono::steady_clock::now();
+        if (mode.batch) {
+            if (run_classifier_batch(&ei_default_impulse, signals.data(), results.data(), count, &config) != EI_IMPULSE_OK)
+                return false;
+        }
+        else {
+            for (int i = 0; i < count; i++) {
+                if (run_classifier(&ei_default_impulse, &signals[i], &results[i], &boxes[(size_t)i * EI_CLASSIFIER_OBJECT_DETECTION_COUNT],
+                                   EI_CLASSIFIER_OBJECT_DETECTION_COUNT, scratch.get()) != EI_IMPULSE_OK)
+                    return false;
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+
+        for (int i = 0; i < count; i++)
+            res.same = res.same && sameDetections(results[i], first + i);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - benchStart).count();
+
+    std::sort(times.begin(), times.end());
+    res.imagesPerSecond = frameCount / seconds;
+    res.p50Us = times[times.size() / 2];
+    res.p99Us = times[std::min(times.size() - 1, (size_t)(times.size() * 0.99))];
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int frameCount = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_FRAMES;
+    int batchSize = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_BATCH;
+    uint32_t threads = argc > 3 ? (uint32_t)atoi(argv[3]) : std::max(2u, std::thread::hardware_concurrency());
+    int mismatches = 0;
+
+    if (frameCount <= 0 || batchSize <= 0 || threads == 0) {
+        fprintf(stderr, "usage: %s [frames] [batch size] [threads]\n", argv[0]);
+        return 1;
+    }
+
+    makeFrames(frameCount);
+    expectedBoxes.resize((size_t)frameCount * EI_CLASSIFIER_OBJECT_DETECTION_COUNT);
+    expectedCounts.resize(frameCount);
+    for (int f = 0; f < frameCount; f++) {
+        signal_t signal = frameSignal(f);
+        ei_impulse_result_t result;
+        if (run_classifier(&ei_default_impulse, &signal, &result, &expectedBoxes[(size_t)f * EI_CLASSIFIER_OBJECT_DETECTION_COUNT],
+                           EI_CLASSIFIER_OBJECT_DETECTION_COUNT, nullptr) != EI_IMPULSE_OK) {
+            fprintf(stderr, "run_classifier failed\n");
+            return 1;
+        }
+        expectedCounts[f] = result.bounding_boxes_count;
+    }
+
+    const BenchMode modes[] = {
+        { "single", false, 0, false },
+        { "batch", true, 0, false },
+        { "sharded", true, threads, false },
+        { "pipelined", true, threads, true },
+    };
+
+    printf("%d frames, batches of %d, %u threads (%u cores)\n", frameCount, batchSize, threads,
+           std::thread::hardware_concurrency());
+    printf("%-10s %10s %12s %12s %6s\n", "mode", "images/s", "p50_us", "p99_us", "same");
+    for (const BenchMode &mode : modes) {
+        BenchResult res;
+        if (!runMode(mode, frameCount, batchSize, res)) {
+            fprintf(stderr, "%s failed\n", mode.name);
+            return 1;
+        }
+        if (!res.same)
+            mismatches++;
+        printf("%-10s %10.1f %12.0f %12.0f %6s\n", mode.name, res.imagesPerSecond, res.p50Us, res.p99Us,
+               res.same ? "yes" : "NO");
+    }
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,206 @@
+// Command-to-handler latency and heap traffic of the serial command
+// dispatcher, driven through a fake Stream on the host. Also checks that every
+// line reaches the right handler with the right arguments, exits non-zero if
+// one does not.
+//
+// Native build, from the repository root:
+//   cmake -S . -B build && cmake --build build --target bench_command_dispatch
+//
+// Usage: bench_command_dispatch [lines]
+
+#include "CommandHandler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#define BENCH_DEFAULT_LINES 100000
+
+// Heap accounting, counts every allocation of the process
+static size_t heapAllocs = 0;
+
+void *operator new(size_t size)
+{
+    heapAllocs++;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+// Serial port fed from a byte script, everything written is kept
+class FakeStream : public Stream
+{
+  public:
+    const char *input = nullptr;
+    size_t inputLength = 0;
+    size_t inputPos = 0;
+    std::string output;
+
+    void feed(const char *data, size_t length)
+    {
+        input = data;
+        inputLength = length;
+        inputPos = 0;
+    }
+
+    int available() override { return (int)(inputLength - inputPos); }
+
+    int read() override
+    {
+        return inputPos < inputLength ? (uint8_t)input[inputPos++] : -1;
+    }
+
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        output.append((const char *)buffer, size);
+        return size;
+    }
+};
+
+static int lastRoute = -1;
+static char lastArgs[COMMAND_BUFFER_SIZE];
+static size_t dispatched = 0;
+
+template <int N> static void handler(const CommandArgs &args)
+{
+    lastRoute = N;
+    memcpy(lastArgs, args.data, args.length + 1);
+    dispatched++;
+}
+
+static const CommandFunction handlers[MAX_COMMANDS] = {
+    handler<0>,  handler<1>,  handler<2>,  handler<3>,  handler<4>,
+    handler<5>,  handler<6>,  handler<7>,  handler<8>,  handler<9>,
+    handler<10>, handler<11>, handler<12>, handler<13>, handler<14>,
+    handler<15>, handler<16>, handler<17>, handler<18>, handler<19>};
+
+// The routes of the firmware first, filled up to MAX_COMMANDS
+static const char *routeNames[MAX_COMMANDS] = {
+    "HELLO",     "INIT",      "READY",     "STATUS",    "CAPTURE",
+    "FISH_INFO", "CALIBRATE", "RESET",     "SLEEP",     "WAKE",
+    "LED_ON",    "LED_OFF",   "SET_TEMP",  "SET_PH",    "SET_TURB",
+    "SET_LEVEL", "GET_TEMP",  "GET_PH",    "GET_TURB",  "GET_LEVEL"};
+
+struct Case
+{
+    const char *line;
+    int route;
+    const char *args;
+};
+
+static const Case cases[] = {
+    {"HELLO\n", 0, ""},
+    {"  capture  \r\n", 4, ""},
+    {"status\n", 3, ""},
+    {"set_temp 24.5\n", 12, "24.5"},
+    {"Fish_Info salmon 206.00\r\n", 5, "SALMON 206.00"},
+    {"GET_LEVEL\n", 19, ""},
+    {"UNKNOWN 1\n", -1, ""},
+    {"\n", -1, ""},
+    {"HELLO_WORLD\n", -1, ""},
+    // longer than the buffer, dropped as a whole
+    {"CAPTURE 0123456789012345678901234567890123456789012345678901234567890123456789\n", -1,
+     ""},
+    {"READY\n", 2, ""},
+};
+
+static bool checkCases(CommandHandler &handler, FakeStream &stream)
+{
+    bool ok = true;
+
+    for (const Case &c : cases) {
+        lastRoute = -1;
+        lastArgs[0] = '\0';
+        stream.feed(c.line, strlen(c.line));
+        handler.handleIncomingCommand();
+        if (lastRoute != c.route || (c.route >= 0 && strcmp(lastArgs, c.args) != 0)) {
+            fprintf(stderr, "FAIL %-20.20s route %d args '%s', expected %d '%s'\n", c.line,
+                    lastRoute, lastArgs, c.route, c.args);
+            ok = false;
+        }
+    }
+
+    stream.output.clear();
+    handler.sendCommand("STATUS", "3");
+    handler.sendCommand("READY");
+    if (stream.output != "STATUS 3\r\nREADY\r\n") {
+        fprintf(stderr, "FAIL sendCommand wrote '%s'\n", stream.output.c_str());
+        ok = false;
+    }
+    return ok;
+}
+
+// One line per route, fed byte by byte through the handler
+static double timeRoute(CommandHandler &handler, FakeStream &stream, const char *line,
+                        int lines, size_t &allocs)
+{
+    size_t length = strlen(line);
+    std::vector<double> times;
+
+    times.reserve(lines);
+    heapAllocs = 0;
+    for (int i = 0; i < lines; i++) {
+        stream.feed(line, length);
+        auto start = std::chrono::steady_clock::now();
+        handler.handleIncomingCommand();
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+    }
+    allocs = heapAllocs;
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+int main(int argc, char **argv)
+{
+    int lines = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_LINES;
+    FakeStream stream;
+    CommandHandler handler(stream);
+
+    if (lines <= 0) {
+        fprintf(stderr, "usage: %s [lines]\n", argv[0]);
+        return 1;
+    }
+    for (int i = 0; i < MAX_COMMANDS; i++) {
+        if (!handler.registerRoute(routeNames[i], handlers[i])) {
+            fprintf(stderr, "registerRoute(%s) failed\n", routeNames[i]);
+            return 1;
+        }
+    }
+    if (handler.registerRoute("hello", handlers[0]) || handler.registerRoute("EXTRA", handlers[0])) {
+        fprintf(stderr, "registerRoute accepted a duplicate or a route past MAX_COMMANDS\n");
+        return 1;
+    }
+    if (!checkCases(handler, stream))
+        return 1;
+
+    const char *timed[] = {"HELLO\n", "capture\n", "GET_LEVEL 1\n", "NOPE\n"};
+    printf("%d lines per command, %d routes\n", lines, MAX_COMMANDS);
+    printf("%-14s %10s %12s\n", "line", "p50_ns", "allocs");
+    for (const char *line : timed) {
+        size_t allocs = 0;
+        double p50 = timeRoute(handler, stream, line, lines, allocs);
+        printf("%-14.*s %10.1f %12zu\n", (int)strlen(line) - 1, line, p50, allocs);
+        if (allocs != 0) {
+            fprintf(stderr, "FAIL dispatch allocated\n");
+            return 1;
+        }
+    }
+    return 0;
+}
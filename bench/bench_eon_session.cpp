@@ -0,0 +1,149 @@
+// Per-frame latency and heap churn of the EON model, with the model
+// re-initialised on every frame (previous behaviour) and with a persistent
+// session (arena resident between frames). Allocations and frees per frame
+// balance in both modes, the arena only shows up in the bytes of the
+// per-frame mode, as the session allocates it once during warm-up.
+//
+// Native build, from the repository root:
+//   cmake -S . -B build && cmake --build build --target bench_eon_session
+//
+// Usage: bench_eon_session [frames]
+
+#include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#if EI_CLASSIFIER_TFLITE_EON_PERSISTENT_SESSION != 1
+#error "Build with -DEI_CLASSIFIER_TFLITE_EON_PERSISTENT_SESSION=1"
+#endif
+
+#define BENCH_WARMUP_FRAMES 3
+#define BENCH_DEFAULT_FRAMES 50
+
+// Heap accounting, overrides the weak allocators of the porting layer
+static size_t heapAllocs = 0;
+static size_t heapFrees = 0;
+static size_t heapBytes = 0;
+
+// keeps the returned pointer 16-byte aligned
+#define HEAP_HEADER_SIZE 16
+
+void *ei_malloc(size_t size)
+{
+    uint8_t *p = (uint8_t *)malloc(size + HEAP_HEADER_SIZE);
+    if (!p)
+        return nullptr;
+    *(size_t *)p = size;
+    heapAllocs++;
+    heapBytes += size;
+    return p + HEAP_HEADER_SIZE;
+}
+
+void *ei_calloc(size_t nitems, size_t size)
+{
+    void *p = ei_malloc(nitems * size);
+    if (p)
+        memset(p, 0, nitems * size);
+    return p;
+}
+
+void ei_free(void *ptr)
+{
+    if (!ptr)
+        return;
+    heapFrees++;
+    free((uint8_t *)ptr - HEAP_HEADER_SIZE);
+}
+
+static uint8_t frame[EI_CLASSIFIER_INPUT_WIDTH * EI_CLASSIFIER_INPUT_HEIGHT * 3];
+
+static int getFrameData(size_t offset, size_t length, float *out)
+{
+    size_t px = offset * 3;
+
+    for (size_t i = 0; i < length; i++, px += 3)
+        out[i] = (frame[px] << 16) + (frame[px + 1] << 8) + frame[px + 2];
+    return 0;
+}
+
+struct BenchResult
+{
+    double meanUs;
+    double p50Us;
+    double p99Us;
+    double allocsPerFrame;
+    double freesPerFrame;
+    double bytesPerFrame;
+};
+
+static bool runBench(int frames, bool persistent, BenchResult &res)
+{
+    signal_t signal;
+    ei_impulse_result_t result;
+    std::vector<double> times;
+
+    signal.total_length = EI_CLASSIFIER_INPUT_WIDTH * EI_CLASSIFIER_INPUT_HEIGHT;
+    signal.get_data = &getFrameData;
+    ei_tflite_eon_session_release();
+    for (int i = 0; i < BENCH_WARMUP_FRAMES + frames; i++) {
+        if (i == BENCH_WARMUP_FRAMES)
+            heapAllocs = heapFrees = heapBytes = 0;
+        for (size_t px = 0; px < sizeof(frame); px++)
+            frame[px] = (uint8_t)((px * 37 + i * 11) & 0xff);
+
+        auto start = std::chrono::steady_clock::now();
+        if (run_classifier(&signal, &result, false) != EI_IMPULSE_OK)
+            return false;
+        if (!persistent)
+            ei_tflite_eon_session_release();
+        auto end = std::chrono::steady_clock::now();
+
+        if (i >= BENCH_WARMUP_FRAMES)
+            times.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    }
+    ei_tflite_eon_session_release();
+
+    std::sort(times.begin(), times.end());
+    res.meanUs = 0;
+    for (double t : times)
+        res.meanUs += t;
+    res.meanUs /= times.size();
+    res.p50Us = times[times.size() / 2];
+    res.p99Us = times[std::min(times.size() - 1, (size_t)(times.size() * 0.99))];
+    res.allocsPerFrame = (double)heapAllocs / frames;
+    res.freesPerFrame = (double)heapFrees / frames;
+    res.bytesPerFrame = (double)heapBytes / frames;
+    return true;
+}
+
+static void printResult(const char *name, const BenchResult &res)
+{
+    printf("%-12s %10.1f %10.1f %10.1f %12.1f %12.1f %14.0f\n", name, res.meanUs, res.p50Us, res.p99Us,
+           res.allocsPerFrame, res.freesPerFrame, res.bytesPerFrame);
+}
+
+int main(int argc, char **argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_FRAMES;
+    BenchResult perFrame;
+    BenchResult session;
+
+    if (frames <= 0) {
+        fprintf(stderr, "usage: %s [frames]\n", argv[0]);
+        return 1;
+    }
+    if (!runBench(frames, false, perFrame) || !runBench(frames, true, session)) {
+        fprintf(stderr, "run_classifier failed\n");
+        return 1;
+    }
+    printf("%d frames, %dx%d input\n", frames, EI_CLASSIFIER_INPUT_WIDTH, EI_CLASSIFIER_INPUT_HEIGHT);
+    printf("%-12s %10s %10s %10s %12s %12s %14s\n", "mode", "mean_us", "p50_us", "p99_us", "allocs/frame",
+           "frees/frame", "bytes/frame");
+    printResult("per-frame", perFrame);
+    printResult("session", session);
+    return 0;
+}
@@ -0,0 +1,192 @@
+// Golden check of the model output: runs the impulse over fixed synthetic
+// frames (all black, all white, gradients, checkerboards, noise and bright
+// blobs) and hashes the logits of the last layer and the decoded bounding
+// boxes of every frame. The hash must match BENCH_GOLDEN_HASH, the output of
+// the reference build, so a kernel, planner or decoder change that moves a
+// single logit fails it.
+//
+// Built three times, all must match:
+//   bench_golden            the default build (depth-first, uint8 input)
+//   bench_golden_layerwise  EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST=0
+//   bench_golden_int8       EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT=0
+// so a pixel u fed as uint8 u must give the same bytes as int8 u - 128.
+//
+// Native build, from the repository root:
+//   cmake -S . -B build && cmake --build build --target bench_golden bench_golden_layerwise bench_golden_int8
+//
+// Usage: bench_golden [-v]
+//   -v  hash of every frame, to find the first one that moved
+
+#include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+#include "tflite-model/tflite_learn_4_compiled.h"
+
+#include <cstdio>
+#include <cstring>
+
+// the logits are read from the resident model after run_classifier()
+#if EI_CLASSIFIER_TFLITE_EON_PERSISTENT_SESSION != 1 || EI_CLASSIFIER_FOMO_LOGIT_DECODE != 1
+#error "Build with -DEI_CLASSIFIER_TFLITE_EON_PERSISTENT_SESSION=1 -DEI_CLASSIFIER_FOMO_LOGIT_DECODE=1"
+#endif
+
+// FNV-1a of the logits and boxes of all BENCH_FRAMES frames
+#define BENCH_GOLDEN_HASH 0x355c762fu
+#define BENCH_FRAMES 20
+#define BENCH_MAX_BOXES 64
+
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+static uint8_t frame[EI_CLASSIFIER_INPUT_WIDTH * EI_CLASSIFIER_INPUT_HEIGHT * 3];
+static ei_impulse_result_bounding_box_t boxes[BENCH_MAX_BOXES];
+static ei_impulse_scratch_t scratch;
+
+static int getFrameData(size_t offset, size_t length, float *out)
+{
+    size_t px = offset * 3;
+
+    for (size_t i = 0; i < length; i++, px += 3)
+        out[i] = (frame[px] << 16) + (frame[px + 1] << 8) + frame[px + 2];
+    return 0;
+}
+
+// xorshift32, not rand(), so the frames are the same on every libc
+static uint32_t nextRandom(uint32_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Seeds of the blob frames, ones the model finds an object in, so the decoder
+// output is checked as well
+static const uint32_t blobSeeds[] = { 142, 167, 179, 182 };
+
+static void makeFrame(int k)
+{
+    const int width = EI_CLASSIFIER_INPUT_WIDTH;
+    const int height = EI_CLASSIFIER_INPUT_HEIGHT;
+    uint32_t seed = k % 5 == 4 ? blobSeeds[k / 5] : (uint32_t)k;
+    uint32_t state = 0x9e3779b9u * (seed + 1);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t *px = &frame[(y * width + x) * 3];
+            for (int c = 0; c < 3; c++) {
+                int v;
+                switch (k % 5) {
+                    case 0: // all black, then all white
+                        v = k == 0 ? 0 : k == 5 ? 255 : (k * 13) & 0xff;
+                        break;
+                    case 1: // gradients
+                        v = x * (k + 1) + y * (c + 1) * (k / 5 + 1);
+                        break;
+                    case 2: // checkerboards
+                        v = (((x / (k / 5 + 2)) + (y / (k / 5 + 2))) & 1) ? 220 - c * 20 : 30 + c * 10;
+                        break;
+                    case 3: // noise
+                        v = (int)(nextRandom(state) >> 24);
+                        break;
+                    default: // bright blobs on a dark background
+                        v = 20 + c * 5;
+                        break;
+                }
+                px[c] = (uint8_t)v;
+            }
+        }
+    }
+
+    if (k % 5 == 4) {
+        for (int blob = 0; blob < 4; blob++) {
+            int size = 6 + (int)(nextRandom(state) % 12);
+            int bx = (int)(nextRandom(state) % (width - size));
+            int by = (int)(nextRandom(state) % (height - size));
+            uint8_t color[3] = { (uint8_t)(nextRandom(state) >> 24), (uint8_t)(nextRandom(state) >> 24),
+                                 (uint8_t)(nextRandom(state) >> 24) };
+            for (int y = by; y < by + size; y++) {
+                for (int x = bx; x < bx + size; x++) {
+                    memcpy(&frame[(y * width + x) * 3], color, 3);
+                }
+            }
+        }
+    }
+}
+
+static uint32_t hashBytes(uint32_t hash, const void *data, size_t length)
+{
+    const uint8_t *p = (const uint8_t *)data;
+
+    for (size_t i = 0; i < length; i++) {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// Logits of the last layer and the boxes decoded from them
+static uint32_t hashOutput(uint32_t hash, const ei_impulse_result_t &result)
+{
+    TfLiteTensor logits;
+
+    // the decoder ran the softmax on the logits itself, its output tensor is not written
+    tflite_learn_4_softmax_logits(true, &logits, nullptr);
+    hash = hashBytes(hash, logits.data.raw, logits.bytes);
+
+    hash = hashBytes(hash, &result.bounding_boxes_count, sizeof(result.bounding_boxes_count));
+    for (uint32_t i = 0; i < result.bounding_boxes_count; i++) {
+        const ei_impulse_result_bounding_box_t &box = result.bounding_boxes[i];
+        hash = hashBytes(hash, box.label, strlen(box.label));
+        hash = hashBytes(hash, &box.value, sizeof(box.value));
+        hash = hashBytes(hash, &box.x, sizeof(box.x));
+        hash = hashBytes(hash, &box.y, sizeof(box.y));
+        hash = hashBytes(hash, &box.width, sizeof(box.width));
+        hash = hashBytes(hash, &box.height, sizeof(box.height));
+    }
+    return hash;
+}
+
+int main(int argc, char **argv)
+{
+    bool verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+    uint32_t hash = FNV_OFFSET;
+    uint32_t detections = 0;
+
+    if (argc > 2 || (argc == 2 && !verbose)) {
+        fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+        return 1;
+    }
+
+    printf("model: %s, %s input\n",
+           EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1 ? "depth-first" : "layer by layer",
+           EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT == 1 ? "uint8" : "int8");
+
+    for (int k = 0; k < BENCH_FRAMES; k++) {
+        makeFrame(k);
+
+        signal_t signal;
+        signal.total_length = EI_CLASSIFIER_INPUT_WIDTH * EI_CLASSIFIER_INPUT_HEIGHT;
+        signal.get_data = &getFrameData;
+
+        ei_impulse_result_t result;
+        EI_IMPULSE_ERROR res = run_classifier(&ei_default_impulse, &signal, &result, boxes, BENCH_MAX_BOXES, &scratch);
+        if (res != EI_IMPULSE_OK) {
+            fprintf(stderr, "frame %d: run_classifier failed (%d)\n", k, res);
+            return 1;
+        }
+
+        uint32_t frameHash = hashOutput(FNV_OFFSET, result);
+        hash = hashOutput(hash, result);
+        detections += result.bounding_boxes_count;
+        if (verbose) {
+            printf("frame %2d  %08x  %u boxes\n", k, frameHash, result.bounding_boxes_count);
+        }
+    }
+
+    printf("%d frames, %u boxes, hash %08x\n", BENCH_FRAMES, detections, hash);
+    if (hash != BENCH_GOLDEN_HASH) {
+        printf("golden: MISMATCH, expected %08x\n", BENCH_GOLDEN_HASH);
+        return 1;
+    }
+    printf("golden: identical\n");
+    return 0;
+}
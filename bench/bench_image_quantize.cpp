@@ -0,0 +1,142 @@
+// Image quantization kernels (RGB888 -> int8 model input), scalar reference
+// against the vectorised kernels this CPU runs, at the model input size and
+// at a QVGA camera frame. Also checks both produce the same bytes.
+//
+// Native build, from the repository root:
+//   cmake -S . -B build && cmake --build build --target bench_image_quantize
+// (the AVX2 kernels are picked at runtime, -DEI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD=0
+// limits them to the build target, -DEIDSP_IMAGE_QUANTIZE_SIMD=0 forces scalar)
+//
+// Usage: bench_image_quantize [iterations]
+
+#include "edge-impulse-sdk/dsp/image/quantize.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace ei::image::quantize;
+
+#define BENCH_DEFAULT_ITERATIONS 200
+
+struct FrameSize
+{
+    const char *name;
+    size_t width;
+    size_t height;
+};
+
+struct KernelCase
+{
+    const char *name;
+    bool gray;
+    scaling_t scaling;
+    float scale;
+    float zeroPoint;
+};
+
+static const FrameSize frameSizes[] = {
+    { "96x96", 96, 96 },
+    { "320x240", 320, 240 },
+};
+
+static const KernelCase kernelCases[] = {
+    { "rgb sub128", false, SCALING_DIV_255, 0.003921568859368563f, -128 },
+    { "gray sub128", true, SCALING_DIV_255, 0.003921568859368563f, -128 },
+    { "rgb 0..1", false, SCALING_DIV_255, 0.0078125f, 0 },
+    { "rgb torch", false, SCALING_TORCH, 0.0186584f, -14 },
+    { "rgb -128..127", false, SCALING_MIN128_127, 1.0f, 0 },
+};
+
+static void runScalar(const KernelCase &k, const uint8_t *in, int8_t *out, size_t pixels)
+{
+    if (k.gray) {
+        scalar::rgb888_to_gray_sub128(in, out, pixels);
+        return;
+    }
+    if (is_sub128(k.scaling, k.scale, k.zeroPoint)) {
+        scalar::bytes_sub128(in, out, pixels * 3);
+        return;
+    }
+    switch (k.scaling) {
+        case SCALING_TORCH:
+            scalar::rgb888_to_i8<SCALING_TORCH>(in, out, pixels, k.scale, k.zeroPoint);
+            break;
+        case SCALING_MIN128_127:
+            scalar::rgb888_to_i8<SCALING_MIN128_127>(in, out, pixels, k.scale, k.zeroPoint);
+            break;
+        default:
+            scalar::rgb888_to_i8<SCALING_DIV_255>(in, out, pixels, k.scale, k.zeroPoint);
+            break;
+    }
+}
+
+static void runKernel(const KernelCase &k, const uint8_t *in, int8_t *out, size_t pixels)
+{
+    if (k.gray)
+        rgb888_to_gray_i8(in, out, pixels, k.scaling, k.scale, k.zeroPoint);
+    else
+        rgb888_to_i8(in, out, pixels, k.scaling, k.scale, k.zeroPoint);
+}
+
+// median ns per pixel over the iterations
+template <typename F>
+static double timeNsPerPixel(int iterations, size_t pixels, F fn)
+{
+    std::vector<double> times;
+
+    for (int i = 0; i < iterations; i++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::nano>(end - start).count() / pixels);
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_ITERATIONS;
+    int mismatches = 0;
+
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    printf("kernels: %s, %d iterations\n", simd_name(), iterations);
+    printf("%-8s %-14s %12s %12s %8s %6s\n", "frame", "kernel", "scalar_ns/px", "simd_ns/px", "speedup", "same");
+    for (const FrameSize &f : frameSizes) {
+        size_t pixels = f.width * f.height;
+        std::vector<uint8_t> frame(pixels * 3);
+        std::vector<int8_t> expected(pixels * 3);
+        std::vector<int8_t> actual(pixels * 3);
+
+        srand(42);
+        for (uint8_t &b : frame)
+            b = (uint8_t)(rand() & 0xff);
+
+        for (const KernelCase &k : kernelCases) {
+            size_t values = k.gray ? pixels : pixels * 3;
+
+            runScalar(k, frame.data(), expected.data(), pixels);
+            runKernel(k, frame.data(), actual.data(), pixels);
+            bool same = memcmp(expected.data(), actual.data(), values) == 0;
+            if (!same)
+                mismatches++;
+
+            double scalarNs = timeNsPerPixel(iterations, pixels,
+                                             [&]() { runScalar(k, frame.data(), expected.data(), pixels); });
+            double simdNs = timeNsPerPixel(iterations, pixels,
+                                           [&]() { runKernel(k, frame.data(), actual.data(), pixels); });
+
+            printf("%-8s %-14s %12.3f %12.3f %7.1fx %6s\n", f.name, k.name, scalarNs, simdNs, scalarNs / simdNs,
+                   same ? "yes" : "NO");
+        }
+    }
+    return mismatches ? 1 : 0;
+}
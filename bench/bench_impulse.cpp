@@ -0,0 +1,288 @@
+// Whole-impulse benchmark for the native build: feeds JPEG/PPM fixtures
+// through run_classifier() and prints the DSP, inference and
+// post-processing times as JSON, one document per run, so performance can
+// be tracked per commit. Without fixtures a set of synthetic frames is used.
+//
+// Fixtures of any size are resized to the model input with the resize mode
+// of the impulse, like the camera frames on the device.
+//
+// Native build, from the repository root:
+//   cmake -S . -B build && cmake --build build --target bench_impulse
+//
+// Usage: bench_impulse [-n runs] [fixture.jpg|fixture.ppm ...]
+
+#include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+#include "edge-impulse-sdk/dsp/image/processing.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if BENCH_HAVE_JPEG
+#include <jpeglib.h>
+#endif
+
+#define BENCH_DEFAULT_RUNS 20
+#define BENCH_WARMUP_RUNS 2
+#define BENCH_SYNTHETIC_FRAMES 4
+
+struct Fixture
+{
+    std::string name;
+    int width;
+    int height;
+    std::vector<uint8_t> rgb;   // as loaded
+    std::vector<uint8_t> input; // resized to the model input
+};
+
+struct Stats
+{
+    double mean;
+    double p50;
+    double p99;
+    double min;
+    double max;
+};
+
+static bool endsWith(const std::string &s, const char *suffix)
+{
+    size_t n = strlen(suffix);
+    if (s.size() < n)
+        return false;
+    for (size_t i = 0; i < n; i++) {
+        if (tolower(s[s.size() - n + i]) != suffix[i])
+            return false;
+    }
+    return true;
+}
+
+// binary PPM (P6), 8 bits per channel
+static bool loadPpm(const char *path, Fixture &fixture)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    char magic[3] = { 0 };
+    int maxval = 0;
+    bool ok = fscanf(f, "%2s", magic) == 1 && strcmp(magic, "P6") == 0;
+    // skips comments between the header fields
+    for (int field = 0; ok && field < 3; field++) {
+        int c;
+        while ((c = fgetc(f)) != EOF && (isspace(c) || c == '#')) {
+            if (c == '#') {
+                while ((c = fgetc(f)) != EOF && c != '\n') {
+                }
+            }
+        }
+        ungetc(c, f);
+        int *value = field == 0 ? &fixture.width : field == 1 ? &fixture.height : &maxval;
+        ok = fscanf(f, "%d", value) == 1;
+    }
+    ok = ok && maxval == 255 && fixture.width > 0 && fixture.height > 0 && fgetc(f) != EOF;
+    if (ok) {
+        fixture.rgb.resize((size_t)fixture.width * fixture.height * 3);
+        ok = fread(fixture.rgb.data(), 1, fixture.rgb.size(), f) == fixture.rgb.size();
+    }
+    fclose(f);
+    return ok;
+}
+
+#if BENCH_HAVE_JPEG
+static bool loadJpeg(const char *path, Fixture &fixture)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    jpeg_decompress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_stdio_src(&cinfo, f);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+
+    fixture.width = cinfo.output_width;
+    fixture.height = cinfo.output_height;
+    fixture.rgb.resize((size_t)fixture.width * fixture.height * 3);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = &fixture.rgb[(size_t)cinfo.output_scanline * fixture.width * 3];
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    fclose(f);
+    return true;
+}
+#endif
+
+static bool loadFixture(const char *path, Fixture &fixture)
+{
+    std::string name(path);
+
+    fixture.name = name.substr(name.find_last_of('/') + 1);
+    if (endsWith(name, ".ppm"))
+        return loadPpm(path, fixture);
+#if BENCH_HAVE_JPEG
+    if (endsWith(name, ".jpg") || endsWith(name, ".jpeg"))
+        return loadJpeg(path, fixture);
+#endif
+    fprintf(stderr, "unsupported fixture %s\n", path);
+    return false;
+}
+
+static void makeSyntheticFixture(int k, Fixture &fixture)
+{
+    fixture.name = "synthetic-" + std::to_string(k);
+    fixture.width = 320;
+    fixture.height = 240;
+    fixture.rgb.resize((size_t)fixture.width * fixture.height * 3);
+    srand(k * 7919 + 1);
+    for (size_t i = 0; i < fixture.rgb.size(); i++) {
+        size_t x = (i / 3) % fixture.width;
+        size_t y = (i / 3) / fixture.width;
+        fixture.rgb[i] = k % 2 ? (uint8_t)(rand() & 0xff)
+                               : (uint8_t)((x * (k + 1) + y * (k + 3) + ((x / 16 + y / 16) & 1) * 90) & 0xff);
+    }
+}
+
+// in place, like the camera frame buffer on the device: the crop of
+// FIT_SHORTEST is written to the destination before it is interpolated
+static bool resizeFixture(Fixture &fixture)
+{
+    const size_t inputSize = EI_CLASSIFIER_INPUT_WIDTH * EI_CLASSIFIER_INPUT_HEIGHT * 3;
+
+    fixture.input = fixture.rgb;
+    if (fixture.width == EI_CLASSIFIER_INPUT_WIDTH && fixture.height == EI_CLASSIFIER_INPUT_HEIGHT)
+        return true;
+    fixture.input.resize(std::max(fixture.input.size(), inputSize));
+    if (ei::image::processing::resize_image_using_mode(fixture.input.data(), fixture.width, fixture.height,
+                                                        fixture.input.data(), EI_CLASSIFIER_INPUT_WIDTH,
+                                                        EI_CLASSIFIER_INPUT_HEIGHT, 3, EI_CLASSIFIER_RESIZE_MODE) != 0)
+        return false;
+    fixture.input.resize(inputSize);
+    return true;
+}
+
+static Stats stats(std::vector<double> values)
+{
+    Stats s;
+
+    std::sort(values.begin(), values.end());
+    s.mean = 0;
+    for (double v : values)
+        s.mean += v;
+    s.mean /= values.size();
+    s.p50 = values[values.size() / 2];
+    s.p99 = values[std::min(values.size() - 1, (size_t)(values.size() * 0.99))];
+    s.min = values.front();
+    s.max = values.back();
+    return s;
+}
+
+static void printStats(const char *name, const Stats &s, bool last)
+{
+    printf("      \"%s\": { \"mean\": %.1f, \"p50\": %.1f, \"p99\": %.1f, \"min\": %.1f, \"max\": %.1f }%s\n", name,
+           s.mean, s.p50, s.p99, s.min, s.max, last ? "" : ",");
+}
+
+int main(int argc, char **argv)
+{
+    int runs = BENCH_DEFAULT_RUNS;
+    std::vector<Fixture> fixtures;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+            continue;
+        }
+        Fixture fixture;
+        if (!loadFixture(argv[i], fixture)) {
+            fprintf(stderr, "failed to load %s\n", argv[i]);
+            return 1;
+        }
+        fixtures.push_back(fixture);
+    }
+    if (runs <= 0) {
+        fprintf(stderr, "usage: %s [-n runs] [fixture.jpg|fixture.ppm ...]\n", argv[0]);
+        return 1;
+    }
+    if (fixtures.empty()) {
+        for (int k = 0; k < BENCH_SYNTHETIC_FRAMES; k++) {
+            Fixture fixture;
+            makeSyntheticFixture(k, fixture);
+            fixtures.push_back(fixture);
+        }
+    }
+
+    printf("{\n");
+    printf("  \"model\": { \"project_id\": %d, \"deploy_version\": %d, \"input\": \"%dx%d\", \"labels\": %d },\n",
+           EI_CLASSIFIER_PROJECT_ID, EI_CLASSIFIER_PROJECT_DEPLOY_VERSION, EI_CLASSIFIER_INPUT_WIDTH,
+           EI_CLASSIFIER_INPUT_HEIGHT, EI_CLASSIFIER_LABEL_COUNT);
+    printf("  \"runs\": %d,\n", runs);
+    printf("  \"fixtures\": [\n");
+
+    std::vector<double> allDsp, allClassification, allPostprocessing;
+    for (size_t f = 0; f < fixtures.size(); f++) {
+        Fixture &fixture = fixtures[f];
+        if (!resizeFixture(fixture)) {
+            fprintf(stderr, "failed to resize %s\n", fixture.name.c_str());
+            return 1;
+        }
+
+        const uint8_t *input = fixture.input.data();
+        signal_t signal;
+        signal.total_length = EI_CLASSIFIER_INPUT_WIDTH * EI_CLASSIFIER_INPUT_HEIGHT;
+        signal.get_data = [input](size_t offset, size_t length, float *out) {
+            const uint8_t *px = input + offset * 3;
+            for (size_t i = 0; i < length; i++, px += 3)
+                out[i] = (px[0] << 16) + (px[1] << 8) + px[2];
+            return 0;
+        };
+
+        std::vector<double> dsp, classification, postprocessing;
+        uint32_t detections = 0;
+        for (int r = 0; r < BENCH_WARMUP_RUNS + runs; r++) {
+            ei_impulse_result_t result = { 0 };
+            EI_IMPULSE_ERROR res = run_classifier(&signal, &result, false);
+            if (res != EI_IMPULSE_OK) {
+                fprintf(stderr, "run_classifier failed on %s (%d)\n", fixture.name.c_str(), res);
+                return 1;
+            }
+            if (r < BENCH_WARMUP_RUNS)
+                continue;
+            dsp.push_back((double)result.timing.dsp_us);
+            classification.push_back((double)result.timing.classification_us);
+            postprocessing.push_back((double)result.timing.postprocessing_us);
+            detections = 0;
+            for (uint32_t i = 0; i < result.bounding_boxes_count; i++)
+                detections += result.bounding_boxes[i].value > 0;
+        }
+        allDsp.insert(allDsp.end(), dsp.begin(), dsp.end());
+        allClassification.insert(allClassification.end(), classification.begin(), classification.end());
+        allPostprocessing.insert(allPostprocessing.end(), postprocessing.begin(), postprocessing.end());
+
+        printf("    {\n");
+        printf("      \"name\": \"%s\", \"width\": %d, \"height\": %d, \"detections\": %u,\n", fixture.name.c_str(),
+               fixture.width, fixture.height, detections);
+        printStats("dsp_us", stats(dsp), false);
+        printStats("classification_us", stats(classification), false);
+        printStats("postprocessing_us", stats(postprocessing), true);
+        printf("    }%s\n", f + 1 < fixtures.size() ? "," : "");
+    }
+
+    printf("  ],\n");
+    printf("  \"total\": {\n");
+    printStats("dsp_us", stats(allDsp), false);
+    printStats("classification_us", stats(allClassification), false);
+    printStats("postprocessing_us", stats(allPostprocessing), true);
+    printf("  }\n");
+    printf("}\n");
+    return 0;
+}
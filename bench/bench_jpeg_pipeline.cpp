@@ -0,0 +1,400 @@
+// JPEG frame -> model input, the full-frame path (decode the whole QVGA frame
+// to RGB888, crop_and_interpolate_rgb888 in place, quantize) against the
+// streaming path (decode a band of MCU rows at a time, resize_stream_t,
+// quantize every output row into the input tensor).
+//
+// Golden check: the streaming resize must produce the same bytes as
+// resize_image_using_mode for every resize mode and MCU height, with row
+// buffers from ei_malloc and from a caller's buffer (which must not touch the
+// heap), and both paths must give the same classifier output.
+//
+// libjpeg stands in for the ESP32 decoder: scanlines are decoded a band at a
+// time and handed to the stream as 16 pixel wide blocks, like MCUs.
+//
+// Native build, from the repository root:
+//   cmake -S . -B build && cmake --build build --target bench_jpeg_pipeline
+//
+// Usage: bench_jpeg_pipeline [frames] [file.jpg]
+
+#include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+#include "edge-impulse-sdk/dsp/image/processing.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <jpeglib.h>
+
+#define BENCH_DEFAULT_FRAMES 20
+#define BENCH_FRAME_COLS 320
+#define BENCH_FRAME_ROWS 240
+#define BENCH_JPEG_QUALITY 80
+#define BENCH_MCU_COLS 16
+
+using namespace ei::image::processing;
+
+// Heap accounting, overrides the weak allocators of the porting layer
+static size_t heapInUse = 0;
+static size_t heapPeak = 0;
+static size_t heapAllocs = 0;
+
+// keeps the returned pointer 16-byte aligned
+#define HEAP_HEADER_SIZE 16
+
+void *ei_malloc(size_t size)
+{
+    uint8_t *p = (uint8_t *)malloc(size + HEAP_HEADER_SIZE);
+    if (!p)
+        return nullptr;
+    *(size_t *)p = size;
+    heapAllocs++;
+    heapInUse += size;
+    heapPeak = std::max(heapPeak, heapInUse);
+    return p + HEAP_HEADER_SIZE;
+}
+
+void *ei_calloc(size_t nitems, size_t size)
+{
+    void *p = ei_malloc(nitems * size);
+    if (p)
+        memset(p, 0, nitems * size);
+    return p;
+}
+
+void ei_free(void *ptr)
+{
+    if (!ptr)
+        return;
+    uint8_t *p = (uint8_t *)ptr - HEAP_HEADER_SIZE;
+    heapInUse -= *(size_t *)p;
+    free(p);
+}
+
+// Synthetic QVGA scene, encoded with libjpeg
+static std::vector<uint8_t> makeJpeg(int seed)
+{
+    std::vector<uint8_t> rgb(BENCH_FRAME_COLS * BENCH_FRAME_ROWS * 3);
+
+    for (int y = 0; y < BENCH_FRAME_ROWS; y++) {
+        for (int x = 0; x < BENCH_FRAME_COLS; x++) {
+            uint8_t *p = &rgb[(y * BENCH_FRAME_COLS + x) * 3];
+            int dx = x - (80 + seed * 37) % BENCH_FRAME_COLS;
+            int dy = y - (60 + seed * 23) % BENCH_FRAME_ROWS;
+            bool blob = dx * dx + dy * dy < 40 * 40;
+            p[0] = blob ? 230 : (uint8_t)(x * 255 / BENCH_FRAME_COLS);
+            p[1] = blob ? 120 : (uint8_t)(y * 255 / BENCH_FRAME_ROWS);
+            p[2] = (uint8_t)((x ^ y) * (seed + 1));
+        }
+    }
+
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    unsigned char *out = nullptr;
+    unsigned long outSize = 0;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &out, &outSize);
+    cinfo.image_width = BENCH_FRAME_COLS;
+    cinfo.image_height = BENCH_FRAME_ROWS;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, BENCH_JPEG_QUALITY, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = &rgb[cinfo.next_scanline * BENCH_FRAME_COLS * 3];
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    std::vector<uint8_t> jpeg(out, out + outSize);
+    free(out);
+    return jpeg;
+}
+
+static std::vector<uint8_t> readFile(const char *path)
+{
+    std::vector<uint8_t> data;
+    FILE *f = fopen(path, "rb");
+
+    if (!f)
+        return data;
+    fseek(f, 0, SEEK_END);
+    data.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    if (fread(data.data(), 1, data.size(), f) != data.size())
+        data.clear();
+    fclose(f);
+    return data;
+}
+
+// Full-frame reference: the whole frame in RGB888
+static bool decodeFull(const std::vector<uint8_t> &jpeg, std::vector<uint8_t> &rgb, int &width, int &height)
+{
+    jpeg_decompress_struct cinfo;
+    jpeg_error_mgr jerr;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, jpeg.data(), jpeg.size());
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+    width = cinfo.output_width;
+    height = cinfo.output_height;
+    rgb.resize((size_t)width * height * 3);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = &rgb[(size_t)cinfo.output_scanline * width * 3];
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+struct StreamJob
+{
+    const std::vector<uint8_t> *jpeg;
+    int mcuRows;
+    int mode;
+    int dstWidth;
+    int dstHeight;
+    std::vector<uint8_t> *resized; // copy of the output rows, may be null
+    std::vector<uint8_t> *buffer; // row buffers of the stream, null to allocate them
+    ei::ei_image_row_writer_t writeRow;
+    void *sink;
+    size_t decoderBytes; // band + block buffers the decoder needs
+};
+
+static int captureRow(void *ctx, int y, const uint8_t *row)
+{
+    StreamJob *job = (StreamJob *)ctx;
+
+    if (job->resized)
+        memcpy(job->resized->data() + (size_t)y * job->dstWidth * 3, row, job->dstWidth * 3);
+    return job->writeRow ? job->writeRow(job->sink, y, row) : 0;
+}
+
+// Streaming path: a band of MCU rows at a time, pushed as MCU sized blocks
+static int decodeStream(StreamJob *job)
+{
+    jpeg_decompress_struct cinfo;
+    jpeg_error_mgr jerr;
+    resize_stream_t stream;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, job->jpeg->data(), job->jpeg->size());
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+
+    int width = cinfo.output_width;
+    int res = resize_stream_init(&stream, width, cinfo.output_height, job->dstWidth, job->dstHeight, 3, job->mode,
+                                 job->mcuRows, &captureRow, job, job->buffer ? job->buffer->data() : nullptr,
+                                 job->buffer ? job->buffer->size() : 0);
+    std::vector<uint8_t> band((size_t)width * job->mcuRows * 3);
+    std::vector<uint8_t> block(BENCH_MCU_COLS * job->mcuRows * 3);
+    job->decoderBytes = band.size() + block.size();
+
+    while (res == EIDSP_OK && cinfo.output_scanline < cinfo.output_height) {
+        int y = cinfo.output_scanline;
+        int rows = 0;
+        while (rows < job->mcuRows && cinfo.output_scanline < cinfo.output_height) {
+            JSAMPROW row = &band[(size_t)rows * width * 3];
+            rows += jpeg_read_scanlines(&cinfo, &row, 1);
+        }
+        for (int x = 0; x < width && res == EIDSP_OK; x += BENCH_MCU_COLS) {
+            int w = std::min(BENCH_MCU_COLS, width - x);
+            for (int r = 0; r < rows; r++)
+                memcpy(&block[r * w * 3], &band[((size_t)r * width + x) * 3], w * 3);
+            res = resize_stream_push_block(&stream, x, y, w, rows, block.data());
+        }
+    }
+    if (res == EIDSP_OK)
+        res = resize_stream_finish(&stream);
+
+    resize_stream_free(&stream);
+    jpeg_abort_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return res;
+}
+
+static int produceFromJpeg(void *ctx, ei::ei_image_row_writer_t writeRow, void *sink)
+{
+    StreamJob *job = (StreamJob *)ctx;
+
+    job->writeRow = writeRow;
+    job->sink = sink;
+    return decodeStream(job);
+}
+
+// Resized bytes of both paths, for every mode and MCU height
+static int checkResize(const std::vector<uint8_t> &jpeg, int dstWidth, int dstHeight)
+{
+    static const int modes[] = { EI_CLASSIFIER_RESIZE_FIT_SHORTEST, EI_CLASSIFIER_RESIZE_FIT_LONGEST,
+                                 EI_CLASSIFIER_RESIZE_SQUASH };
+    static const int mcuHeights[] = { 8, 16 };
+    int mismatches = 0;
+    std::vector<uint8_t> frame;
+    int width, height;
+
+    decodeFull(jpeg, frame, width, height);
+    for (int mode : modes) {
+        std::vector<uint8_t> expected((size_t)width * height * 3);
+        if (mode == EI_CLASSIFIER_RESIZE_FIT_SHORTEST) {
+            // in place on the frame, as the camera code did
+            expected = frame;
+            crop_and_interpolate_rgb888(expected.data(), width, height, expected.data(), dstWidth, dstHeight);
+        }
+        else {
+            resize_image_using_mode(frame.data(), width, height, expected.data(), dstWidth, dstHeight, 3, mode);
+        }
+
+        for (int mcuRows : mcuHeights) {
+            std::vector<uint8_t> buffer(
+                resize_stream_buffer_size(width, height, dstWidth, dstHeight, 3, mode, mcuRows));
+            for (int own = 0; own < 2; own++) {
+                std::vector<uint8_t> resized((size_t)dstWidth * dstHeight * 3);
+                StreamJob job = { &jpeg, mcuRows, mode, dstWidth, dstHeight, &resized, own ? nullptr : &buffer,
+                                  nullptr, nullptr, 0 };
+                size_t allocs = heapAllocs;
+                int res = decodeStream(&job);
+                bool same = res == EIDSP_OK && memcmp(resized.data(), expected.data(), resized.size()) == 0;
+                if (!same || (!own && heapAllocs != allocs)) {
+                    printf("resize mismatch: mode %d, %dx%d -> %dx%d, mcu rows %d, %s row buffers (res %d, %zu "
+                           "allocs)\n", mode, width, height, dstWidth, dstHeight, mcuRows,
+                           own ? "allocated" : "caller's", res, heapAllocs - allocs);
+                    mismatches++;
+                }
+            }
+        }
+    }
+    return mismatches;
+}
+
+static bool sameResult(const ei_impulse_result_t &a, const ei_impulse_result_t &b)
+{
+#if EI_CLASSIFIER_OBJECT_DETECTION == 1
+    if (a.bounding_boxes_count != b.bounding_boxes_count)
+        return false;
+    for (uint32_t i = 0; i < a.bounding_boxes_count; i++) {
+        const ei_impulse_result_bounding_box_t &x = a.bounding_boxes[i];
+        const ei_impulse_result_bounding_box_t &y = b.bounding_boxes[i];
+        if (strcmp(x.label, y.label) != 0 || x.x != y.x || x.y != y.y || x.width != y.width ||
+            x.height != y.height || x.value != y.value)
+            return false;
+    }
+#else
+    for (uint16_t i = 0; i < EI_CLASSIFIER_LABEL_COUNT; i++) {
+        if (a.classification[i].value != b.classification[i].value)
+            return false;
+    }
+#endif
+    return true;
+}
+
+static double median(std::vector<double> &v)
+{
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+int main(int argc, char **argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_FRAMES;
+    std::vector<std::vector<uint8_t>> jpegs;
+    int mismatches = 0;
+
+    if (frames <= 0) {
+        fprintf(stderr, "usage: %s [frames] [file.jpg]\n", argv[0]);
+        return 1;
+    }
+    if (argc > 2) {
+        jpegs.push_back(readFile(argv[2]));
+        if (jpegs[0].empty()) {
+            fprintf(stderr, "can't read %s\n", argv[2]);
+            return 1;
+        }
+    }
+    else {
+        for (int i = 0; i < 4; i++)
+            jpegs.push_back(makeJpeg(i));
+    }
+
+    for (const std::vector<uint8_t> &jpeg : jpegs) {
+        mismatches += checkResize(jpeg, EI_CLASSIFIER_INPUT_WIDTH, EI_CLASSIFIER_INPUT_HEIGHT);
+        mismatches += checkResize(jpeg, 64, 48);
+    }
+
+    std::vector<double> fullUs, streamUs, fullPreUs, streamPreUs;
+    size_t fullPeak = 0, streamPeak = 0, decoderBytes = 0;
+
+    for (int i = 0; i < frames; i++) {
+        const std::vector<uint8_t> &jpeg = jpegs[i % jpegs.size()];
+        ei_impulse_result_t fullResult, streamResult;
+
+        // full frame: the whole RGB888 frame is held (previously ei_camera_capture's snapshot_buf)
+        auto start = std::chrono::steady_clock::now();
+        std::vector<uint8_t> frame;
+        int width, height;
+        decodeFull(jpeg, frame, width, height);
+        crop_and_interpolate_rgb888(frame.data(), width, height, frame.data(), EI_CLASSIFIER_INPUT_WIDTH,
+                                    EI_CLASSIFIER_INPUT_HEIGHT);
+        ei::image_signal_t image = { frame.data(), EI_CLASSIFIER_INPUT_WIDTH, EI_CLASSIFIER_INPUT_HEIGHT, 0,
+                                     ei::EI_IMAGE_SIGNAL_RGB888 };
+        EI_IMPULSE_ERROR fullErr = run_classifier_image_buffer(&image, &fullResult, false);
+        auto mid = std::chrono::steady_clock::now();
+        fullPeak = std::max(fullPeak, frame.size());
+
+        // streaming: rows go from the decoder through the resizer into the input tensor
+        StreamJob job = { &jpeg, 16, EI_CLASSIFIER_RESIZE_MODE, EI_CLASSIFIER_INPUT_WIDTH, EI_CLASSIFIER_INPUT_HEIGHT,
+                          nullptr, nullptr, nullptr, nullptr, 0 };
+        ei::image_stream_t imageStream = { &produceFromJpeg, &job, EI_CLASSIFIER_INPUT_WIDTH,
+                                           EI_CLASSIFIER_INPUT_HEIGHT, ei::EI_IMAGE_SIGNAL_RGB888 };
+        size_t heapBefore = heapInUse;
+        heapPeak = heapInUse;
+        EI_IMPULSE_ERROR streamErr = run_classifier_image_stream(&imageStream, &streamResult, false);
+        auto end = std::chrono::steady_clock::now();
+        // the model arena is resident in both paths, only count what the frame needs
+        streamPeak = std::max(streamPeak, heapPeak - heapBefore);
+        decoderBytes = job.decoderBytes;
+
+        // decode + crop + resize only
+        auto preStart = std::chrono::steady_clock::now();
+        decodeFull(jpeg, frame, width, height);
+        crop_and_interpolate_rgb888(frame.data(), width, height, frame.data(), EI_CLASSIFIER_INPUT_WIDTH,
+                                    EI_CLASSIFIER_INPUT_HEIGHT);
+        auto preMid = std::chrono::steady_clock::now();
+        job.writeRow = nullptr;
+        decodeStream(&job);
+        auto preEnd = std::chrono::steady_clock::now();
+        fullPreUs.push_back(std::chrono::duration<double, std::micro>(preMid - preStart).count());
+        streamPreUs.push_back(std::chrono::duration<double, std::micro>(preEnd - preMid).count());
+
+        if (fullErr != EI_IMPULSE_OK || streamErr != EI_IMPULSE_OK) {
+            fprintf(stderr, "run_classifier failed (%d, %d)\n", fullErr, streamErr);
+            return 1;
+        }
+        if (!sameResult(fullResult, streamResult)) {
+            printf("result mismatch on frame %d\n", i);
+            mismatches++;
+        }
+        fullUs.push_back(std::chrono::duration<double, std::micro>(mid - start).count());
+        streamUs.push_back(std::chrono::duration<double, std::micro>(end - mid).count());
+    }
+    ei_tflite_eon_session_release();
+
+    printf("%d frames, %zu byte JPEG -> %dx%d input\n", frames, jpegs[0].size(), EI_CLASSIFIER_INPUT_WIDTH,
+           EI_CLASSIFIER_INPUT_HEIGHT);
+    printf("%-12s %12s %16s %16s\n", "path", "p50_us", "preprocess_us", "frame_bytes");
+    printf("%-12s %12.1f %16.1f %16zu\n", "full-frame", median(fullUs), median(fullPreUs), fullPeak);
+    printf("%-12s %12.1f %16.1f %16zu\n", "streaming", median(streamUs), median(streamPreUs),
+           streamPeak + decoderBytes);
+    printf("golden: %s\n", mismatches ? "MISMATCH" : "identical");
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+// Per-layer profile of the EON compiled graph: runs the impulse over
+// synthetic frames with an ei::LayerProfiler attached to the model and prints
+// the time, MACs and arena usage of each of its layers.
+//
+// Needs the profiler compiled into the model (EI_CLASSIFIER_TFLITE_EON_PROFILE=1,
+// the default of the native build):
+//   cmake -S . -B build && cmake --build build --target bench_layer_profile
+//
+// Usage: bench_layer_profile [-n runs] [--csv | --trace]
+//   (default)  one row per layer, summed over all runs
+//   --csv      one row per layer per run
+//   --trace    Chrome trace event JSON, for chrome://tracing or Perfetto
+
+#include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+#include "edge-impulse-sdk/classifier/ei_layer_profiler.h"
+#include "tflite-model/tflite_learn_4_compiled.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#define BENCH_DEFAULT_RUNS 20
+#define BENCH_WARMUP_RUNS 2
+#define BENCH_FRAME_BYTES (EI_CLASSIFIER_INPUT_WIDTH * EI_CLASSIFIER_INPUT_HEIGHT * 3)
+
+static ei::LayerProfiler profiler;
+
+int main(int argc, char **argv)
+{
+    int runs = BENCH_DEFAULT_RUNS;
+    bool csv = false;
+    bool trace = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else if (strcmp(argv[i], "--trace") == 0)
+            trace = true;
+        else
+            runs = 0;
+    }
+    if (runs <= 0 || (csv && trace)) {
+        fprintf(stderr, "usage: %s [-n runs] [--csv | --trace]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<uint8_t> frame(BENCH_FRAME_BYTES);
+    srand(42);
+    for (size_t i = 0; i < frame.size(); i++)
+        frame[i] = (uint8_t)(rand() & 0xff);
+
+    const uint8_t *input = frame.data();
+    signal_t signal;
+    signal.total_length = EI_CLASSIFIER_INPUT_WIDTH * EI_CLASSIFIER_INPUT_HEIGHT;
+    signal.get_data = [input](size_t offset, size_t length, float *out) {
+        const uint8_t *px = input + offset * 3;
+        for (size_t i = 0; i < length; i++, px += 3)
+            out[i] = (px[0] << 16) + (px[1] << 8) + px[2];
+        return 0;
+    };
+
+    if (tflite_learn_4_set_profiler(&profiler) != kTfLiteOk)
+        return 1;
+
+    for (int r = 0; r < BENCH_WARMUP_RUNS + runs; r++) {
+        if (r == BENCH_WARMUP_RUNS)
+            profiler.ClearEvents();
+        ei_impulse_result_t result = { 0 };
+        if (run_classifier(&signal, &result, false) != EI_IMPULSE_OK) {
+            fprintf(stderr, "run_classifier failed\n");
+            return 1;
+        }
+    }
+    tflite_learn_4_set_profiler(nullptr);
+
+    if (profiler.GetDroppedEventCount() > 0) {
+        fprintf(stderr, "%lu events dropped, only the last %lu are reported (EI_LAYER_PROFILER_MAX_EVENTS)\n",
+                (unsigned long)profiler.GetDroppedEventCount(), (unsigned long)profiler.GetEventCount());
+    }
+
+    if (csv)
+        profiler.LogCsv();
+    else if (trace)
+        profiler.LogChromeTrace();
+    else
+        profiler.LogLayerTotalsCsv();
+    return 0;
+}
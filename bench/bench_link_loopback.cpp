@@ -0,0 +1,421 @@
+// Serial link to the controller over a pseudo terminal: the firmware side
+// (CommandHandler) runs on the slave end, a controller written against
+// LinkProtocol.hpp on the master end. Negotiates the binary link after
+// HELLO/READY, checks framing, CRC and sequence handling and when the link
+// falls back to text, then compares the bytes and link time per frame of a
+// full detection list in binary frames with the same list as text lines.
+// Exits non-zero if a check fails.
+//
+// Native build, from the repository root:
+//   cmake -S . -B build && cmake --build build --target bench_link_loopback
+//
+// Usage: bench_link_loopback [frames] [detections]
+
+#include "CommandHandler.hpp"
+#include "LinkProtocol.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define BENCH_DEFAULT_FRAMES 200
+#define BENCH_DEFAULT_DETECTIONS 10
+#define BENCH_TIMEOUT_MS 1000
+#define BENCH_FAST_BAUD 921600
+
+// Stream over a file descriptor, non-blocking reads
+class FdStream : public Stream
+{
+  public:
+    explicit FdStream(int fd) : fd(fd) {}
+
+    int handle() const { return fd; }
+
+    int available() override
+    {
+        int count = 0;
+        return ioctl(fd, FIONREAD, &count) == 0 ? count : 0;
+    }
+
+    int read() override
+    {
+        uint8_t byte;
+        return ::read(fd, &byte, 1) == 1 ? byte : -1;
+    }
+
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        size_t done = 0;
+        while (done < size) {
+            ssize_t n = ::write(fd, buffer + done, size - done);
+            if (n <= 0)
+                break;
+            done += n;
+        }
+        return done;
+    }
+
+  private:
+    int fd;
+};
+
+struct Detection
+{
+    char label[16];
+    float value;
+    uint32_t x, y, width, height;
+};
+
+static CommandHandler *device = nullptr;
+static bool deviceSynced = false;
+static int detectionCount = BENCH_DEFAULT_DETECTIONS;
+static std::vector<Detection> detections;
+
+static void onHello(const CommandArgs &)
+{
+    device->sendCommand("READY");
+    deviceSynced = true;
+}
+
+static void onStatus(const CommandArgs &)
+{
+    device->sendCommand("STATUS", "3");
+}
+
+// Same negotiation as handleLink() in src/main.cpp, a pty has no baud rate
+static void onLink(const CommandArgs &args)
+{
+    bool enable = strcmp(args.data, "OFF") != 0;
+    uint32_t baud = enable ? strtoul(args.data, nullptr, 10) : LINK_TEXT_BAUD;
+
+    if (!deviceSynced || !linkBaudSupported(baud)) {
+        device->sendCommand("LINK_FAIL");
+        return;
+    }
+    char value[12];
+    snprintf(value, sizeof(value), "%lu", (unsigned long)baud);
+    device->sendCommand("LINK_OK", value);
+    device->setBinary(enable);
+}
+
+// Like handleCapture() in src/main.cpp: every box in one frame, then the
+// nutrition info of the first one
+static void onCapture(const CommandArgs &)
+{
+    uint8_t payload[LINK_MAX_PAYLOAD];
+    size_t length = 1;
+
+    payload[0] = 0;
+    for (const Detection &d : detections) {
+        size_t size = linkPutDetection(payload + length, sizeof(payload) - length, d.label,
+                                       d.value, d.x, d.y, d.width, d.height);
+        if (size == 0)
+            break;
+        length += size;
+        payload[0]++;
+    }
+    device->sendFrame(LINK_MSG_DETECTIONS, payload, length);
+
+    char info[COMMAND_BUFFER_SIZE];
+    snprintf(info, sizeof(info), "%s %.2f", detections[0].label, 206.0f);
+    device->sendCommand("FISH_INFO", info);
+}
+
+// Controller end of the link
+struct Controller
+{
+    int fd;
+    LinkFrameDecoder decoder;
+    uint8_t txSeq = 0;
+    std::string line;
+    std::vector<std::string> lines;
+    std::vector<std::vector<uint8_t>> frames;
+    std::vector<uint8_t> frameTypes;
+    std::vector<uint8_t> frameSeqs;
+    size_t bytesIn = 0;
+
+    void sendText(const char *text) { (void)!::write(fd, text, strlen(text)); }
+
+    void sendFrame(uint8_t type, const char *payload, bool corrupt = false)
+    {
+        uint8_t frame[LINK_FRAME_OVERHEAD + LINK_MAX_PAYLOAD];
+        size_t length = strlen(payload);
+        uint16_t crc = linkFrameHeader(type, txSeq++, (uint16_t)length, frame);
+        memcpy(frame + 5, payload, length);
+        crc = linkCrc16(crc, frame + 5, length);
+        if (corrupt)
+            crc ^= 0x0100;
+        frame[5 + length] = (uint8_t)(crc & 0xff);
+        frame[6 + length] = (uint8_t)(crc >> 8);
+        (void)!::write(fd, frame, length + LINK_FRAME_OVERHEAD);
+    }
+
+    void receive()
+    {
+        uint8_t buffer[512];
+        ssize_t n;
+        while ((n = ::read(fd, buffer, sizeof(buffer))) > 0) {
+            bytesIn += n;
+            for (ssize_t i = 0; i < n; i++) {
+                uint8_t byte = buffer[i];
+                if (!decoder.idle() || byte == LINK_FRAME_START) {
+                    if (decoder.push(byte) == LinkFrameDecoder::LINK_FRAME_OK) {
+                        frameTypes.push_back(decoder.type());
+                        frameSeqs.push_back(decoder.seq());
+                        frames.emplace_back(decoder.payload(),
+                                            decoder.payload() + decoder.length());
+                    }
+                } else if (byte == '\n') {
+                    if (!line.empty() && line.back() == '\r')
+                        line.pop_back();
+                    lines.push_back(line);
+                    line.clear();
+                } else {
+                    line += (char)byte;
+                }
+            }
+        }
+    }
+};
+
+// Runs both ends until the controller holds the expected number of lines and
+// frames, or the timeout
+static bool pump(Controller &controller, FdStream &deviceStream, size_t lines, size_t frames)
+{
+    auto start = std::chrono::steady_clock::now();
+    while (controller.lines.size() < lines || controller.frames.size() < frames) {
+        device->handleIncomingCommand();
+        controller.receive();
+        if (std::chrono::steady_clock::now() - start >
+            std::chrono::milliseconds(BENCH_TIMEOUT_MS))
+            return false;
+        struct pollfd fds[2] = {{controller.fd, POLLIN, 0}, {deviceStream.handle(), POLLIN, 0}};
+        poll(fds, 2, 1);
+    }
+    return controller.lines.size() == lines && controller.frames.size() == frames;
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    if (!ok) {
+        fprintf(stderr, "FAIL %s\n", what);
+        failures++;
+    }
+}
+
+static uint16_t getU16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+// The first detections, as many as fit in a frame
+static bool checkDetections(const std::vector<uint8_t> &payload)
+{
+    size_t pos = 1;
+    if (payload.empty() || payload[0] == 0 || payload[0] > detections.size())
+        return false;
+    for (size_t i = 0; i < payload[0]; i++) {
+        const Detection &d = detections[i];
+        size_t labelLength = payload[pos++];
+        if (labelLength != strlen(d.label) || memcmp(&payload[pos], d.label, labelLength) != 0)
+            return false;
+        pos += labelLength;
+        if (payload[pos++] != (uint8_t)(d.value * 255.0f + 0.5f))
+            return false;
+        if (getU16(&payload[pos]) != d.x || getU16(&payload[pos + 2]) != d.y ||
+            getU16(&payload[pos + 4]) != d.width || getU16(&payload[pos + 6]) != d.height)
+            return false;
+        pos += 8;
+    }
+    return pos == payload.size();
+}
+
+static double linkMs(size_t bytes, uint32_t baud)
+{
+    // 8N1, ten bits per byte
+    return bytes * 10.0 * 1000.0 / baud;
+}
+
+int main(int argc, char **argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_FRAMES;
+    detectionCount = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_DETECTIONS;
+
+    if (frames <= 0 || detectionCount <= 0) {
+        fprintf(stderr, "usage: %s [frames] [detections]\n", argv[0]);
+        return 1;
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        perror("posix_openpt");
+        return 1;
+    }
+    int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (slave < 0) {
+        perror("open pty slave");
+        return 1;
+    }
+    struct termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    fcntl(slave, F_SETFL, fcntl(slave, F_GETFL) | O_NONBLOCK);
+
+    FdStream deviceStream(slave);
+    CommandHandler handler(deviceStream);
+    device = &handler;
+    handler.registerRoute("HELLO", onHello);
+    handler.registerRoute("STATUS", onStatus);
+    handler.registerRoute("LINK", onLink);
+    handler.registerRoute("CAPTURE", onCapture);
+
+    for (int i = 0; i < detectionCount; i++) {
+        Detection d;
+        snprintf(d.label, sizeof(d.label), "%s", (i & 1) ? "plastic" : "salmon");
+        d.value = 0.5f + 0.04f * (i % 12);
+        d.x = 8 * (i % 12);
+        d.y = 8 * ((i * 5) % 12);
+        d.width = 8;
+        d.height = 8;
+        detections.push_back(d);
+    }
+
+    Controller controller;
+    controller.fd = master;
+
+    // Text until negotiated, LINK is refused before HELLO
+    controller.sendText("LINK 921600\n");
+    check(pump(controller, deviceStream, 1, 0) && controller.lines[0] == "LINK_FAIL",
+          "LINK before HELLO is refused");
+    controller.sendText("HELLO\n");
+    check(pump(controller, deviceStream, 2, 0) && controller.lines[1] == "READY", "HELLO/READY");
+    controller.sendText("LINK 12345\n");
+    check(pump(controller, deviceStream, 3, 0) && controller.lines[2] == "LINK_FAIL",
+          "unsupported baud rate is refused");
+
+    controller.sendText("LINK 921600\n");
+    check(pump(controller, deviceStream, 4, 0) && controller.lines[3] == "LINK_OK 921600" &&
+              handler.isBinary(),
+          "LINK 921600 switches to binary");
+
+    // Commands in frames, answers in frames with consecutive seq
+    controller.sendFrame(LINK_MSG_COMMAND, "capture");
+    check(pump(controller, deviceStream, 4, 2), "CAPTURE frame answered with two frames");
+    if (controller.frames.size() == 2) {
+        check(controller.frameTypes[0] == LINK_MSG_DETECTIONS &&
+                  checkDetections(controller.frames[0]),
+              "detection list round trip");
+        check(controller.frameTypes[1] == LINK_MSG_COMMAND &&
+                  std::string(controller.frames[1].begin(), controller.frames[1].end()) ==
+                      "FISH_INFO salmon 206.00",
+              "FISH_INFO as command frame");
+        check(controller.frameSeqs[0] == 0 && controller.frameSeqs[1] == 1, "sequence numbers");
+    }
+
+    // A corrupted frame is dropped, text commands still work
+    controller.sendFrame(LINK_MSG_COMMAND, "STATUS", true);
+    controller.sendText("STATUS\n");
+    check(pump(controller, deviceStream, 4, 3) && handler.link().badFrames() == 1,
+          "corrupted frame dropped, text STATUS answered");
+    if (controller.frames.size() == 3)
+        check(std::string(controller.frames[2].begin(), controller.frames[2].end()) == "STATUS 3",
+              "STATUS reply");
+
+    // A skipped seq is counted
+    controller.txSeq++;
+    controller.sendFrame(LINK_MSG_COMMAND, "STATUS");
+    check(pump(controller, deviceStream, 4, 4) && handler.link().lostFrames() == 2,
+          "lost frames counted (corrupted and skipped)");
+
+    // Back to text without a valid frame for LINK_IDLE_TIMEOUT_MS, or after
+    // LINK_BAD_FRAME_BURST bad frames in a row (times are made up)
+    LinkWatchdog watchdog;
+    watchdog.start(handler.link(), 0);
+    check(!watchdog.expired(handler.link(), LINK_IDLE_TIMEOUT_MS - 1) &&
+              watchdog.expired(handler.link(), LINK_IDLE_TIMEOUT_MS),
+          "link times out without valid frames");
+    controller.sendFrame(LINK_MSG_COMMAND, "STATUS");
+    check(pump(controller, deviceStream, 4, 5) &&
+              !watchdog.expired(handler.link(), LINK_IDLE_TIMEOUT_MS) &&
+              !watchdog.expired(handler.link(), 2 * LINK_IDLE_TIMEOUT_MS - 1),
+          "a valid frame restarts the timeout");
+    for (int i = 0; i < LINK_BAD_FRAME_BURST - 1; i++)
+        controller.sendFrame(LINK_MSG_COMMAND, "STATUS", true);
+    controller.sendText("STATUS\n");
+    check(pump(controller, deviceStream, 4, 6) && !watchdog.expired(handler.link(), LINK_IDLE_TIMEOUT_MS),
+          "bad frames below the burst are tolerated");
+    controller.sendFrame(LINK_MSG_COMMAND, "STATUS", true);
+    controller.sendText("STATUS\n");
+    check(pump(controller, deviceStream, 4, 7) && watchdog.expired(handler.link(), LINK_IDLE_TIMEOUT_MS),
+          "a burst of bad frames drops the link");
+
+    // Per-frame traffic
+    controller.frames.clear();
+    controller.frameTypes.clear();
+    controller.frameSeqs.clear();
+    controller.bytesIn = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++) {
+        controller.sendFrame(LINK_MSG_COMMAND, "CAPTURE");
+        if (!pump(controller, deviceStream, 4, 2 * (i + 1))) {
+            check(false, "CAPTURE round trip");
+            break;
+        }
+    }
+    double roundTripUs =
+        std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start)
+            .count() /
+        frames;
+    check(controller.decoder.badFrames() == 0 && controller.decoder.lostFrames() == 0,
+          "no bad or lost frames from the device");
+    for (size_t i = 0; i < controller.frames.size(); i += 2)
+        if (!checkDetections(controller.frames[i])) {
+            check(false, "detection lists under load");
+            break;
+        }
+
+    controller.sendFrame(LINK_MSG_COMMAND, "LINK OFF");
+    check(pump(controller, deviceStream, 4, 2 * frames + 1) && !handler.isBinary(),
+          "LINK OFF back to text");
+
+    // Text size of the same frame: every box that fit as its own line
+    int inFrame = controller.frames.empty() ? 0 : controller.frames[0][0];
+    size_t textBytes = strlen("FISH_INFO salmon 206.00\r\n");
+    for (int i = 0; i < inFrame; i++) {
+        const Detection &d = detections[i];
+        char text[128];
+        textBytes += snprintf(text, sizeof(text), "DETECTION %s %.2f %u %u %u %u\r\n", d.label,
+                              d.value, d.x, d.y, d.width, d.height);
+    }
+
+    double binaryBytes = (double)controller.bytesIn / frames;
+    printf("%d frames, %d detections per frame (%d in a frame)\n", frames, detectionCount,
+           inFrame);
+    printf("%-8s %12s %14s %14s\n", "link", "bytes/frame", "ms@115200", "ms@921600");
+    printf("%-8s %12zu %14.2f %14.2f\n", "text", textBytes, linkMs(textBytes, LINK_TEXT_BAUD),
+           linkMs(textBytes, BENCH_FAST_BAUD));
+    printf("%-8s %12.0f %14.2f %14.2f\n", "binary", binaryBytes,
+           linkMs(binaryBytes, LINK_TEXT_BAUD), linkMs(binaryBytes, BENCH_FAST_BAUD));
+    printf("pty round trip %.1f us per frame\n", roundTripUs);
+
+    close(slave);
+    close(master);
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
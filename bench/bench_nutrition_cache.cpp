@@ -0,0 +1,355 @@
+// Nutrition lookups straight from the API against NutritionCache, with a
+// local HTTP stand-in for the API on 127.0.0.1 (GET /search/<label>, answers
+// {"calories": N} after a delay, 404 for labels it does not know). The fetch
+// is a plain HTTP GET and parses the answer like APIHandler::fetchData.
+//
+// Also checks TTL expiry with background revalidation, persistence through
+// save()/load(), and that stale values are served while the API is down.
+// Exits non-zero if a check fails.
+//
+// Native build, from the repository root:
+//   cmake -S . -B build && cmake --build build --target bench_nutrition_cache
+//
+// Usage: bench_nutrition_cache [-n lookups] [-d api_delay_ms]
+
+#include "NutritionCache.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#define BENCH_DEFAULT_LOOKUPS 100
+#define BENCH_DEFAULT_DELAY_MS 50
+#define BENCH_TTL_MS 100
+
+static const char *const labels[] = {"bluedory", "discobass", "unknown_fish"};
+static const size_t labelCount = sizeof(labels) / sizeof(labels[0]);
+
+// ------- HTTP stand-in for the API ----------------------------------------- //
+
+class StandInApi
+{
+  public:
+    std::atomic<uint32_t> requests;
+    std::atomic<bool> down;
+    int delayMs;
+
+    StandInApi() : requests(0), down(false), delayMs(0), listenFd(-1), port(0), stopping(false) {}
+
+    ~StandInApi()
+    {
+        stopping = true;
+        if (server.joinable())
+            server.join();
+        if (listenFd >= 0)
+            close(listenFd);
+    }
+
+    bool start()
+    {
+        sockaddr_in addr = {};
+        socklen_t length = sizeof(addr);
+
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listenFd < 0 || bind(listenFd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listenFd, 16) != 0 ||
+            getsockname(listenFd, (sockaddr *)&addr, &length) != 0)
+            return false;
+        port = ntohs(addr.sin_port);
+        server = std::thread(&StandInApi::serve, this);
+        return true;
+    }
+
+    uint16_t listenPort() const { return port; }
+
+    // calories as the API has them, per 100 g
+    void set(const std::string &label, int calories)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        foods[label] = calories;
+    }
+
+  private:
+    int listenFd;
+    uint16_t port;
+    std::atomic<bool> stopping;
+    std::thread server;
+    std::mutex mutex;
+    std::map<std::string, int> foods;
+
+    void serve()
+    {
+        while (!stopping) {
+            pollfd pfd = {listenFd, POLLIN, 0};
+            if (poll(&pfd, 1, 20) <= 0)
+                continue;
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0)
+                continue;
+            answer(fd);
+            close(fd);
+        }
+    }
+
+    void answer(int fd)
+    {
+        std::string request;
+        char buf[512];
+        while (request.find("\r\n\r\n") == std::string::npos) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n <= 0)
+                return;
+            request.append(buf, n);
+        }
+        requests++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+
+        std::string status = "404 Not Found";
+        std::string body = "{\"detail\": \"Not Found\"}";
+        const char *prefix = "GET /search/";
+        if (down) {
+            status = "503 Service Unavailable";
+            body = "";
+        } else if (request.compare(0, strlen(prefix), prefix) == 0) {
+            std::string label = request.substr(strlen(prefix), request.find(' ', strlen(prefix)) - strlen(prefix));
+            std::lock_guard<std::mutex> lock(mutex);
+            auto food = foods.find(label);
+            if (food != foods.end()) {
+                status = "200 OK";
+                body = "{\"name\": \"" + label + "\", \"calories\": " + std::to_string(food->second) + "}";
+            }
+        }
+
+        std::string response = "HTTP/1.1 " + status + "\r\nContent-Type: application/json\r\nContent-Length: " +
+                               std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        if (write(fd, response.data(), response.size()) < 0)
+            perror("write");
+    }
+};
+
+// GET /search/<label>, the calories divided by 100 like
+// APIHandler::_parseCalories, true on 200 only
+static bool httpFetch(void *ctx, const char *label, float *calories)
+{
+    StandInApi *api = (StandInApi *)ctx;
+    sockaddr_in addr = {};
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(api->listenPort());
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return false;
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return false;
+    }
+
+    std::string request = std::string("GET /search/") + label +
+                          " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+    std::string response;
+    char buf[512];
+    ssize_t n;
+    if (write(fd, request.data(), request.size()) == (ssize_t)request.size()) {
+        while ((n = read(fd, buf, sizeof(buf))) > 0)
+            response.append(buf, n);
+    }
+    close(fd);
+
+    int code = 0;
+    if (sscanf(response.c_str(), "HTTP/1.%*d %d", &code) != 1 || code != 200)
+        return false;
+    size_t field = response.find("\"calories\":");
+    if (field == std::string::npos)
+        return false;
+    *calories = strtof(response.c_str() + field + strlen("\"calories\":"), nullptr) / 100;
+    return true;
+}
+
+// ------- Checks ------------------------------------------------------------ //
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                                                           \
+    do {                                                                                                           \
+        if (!(cond)) {                                                                                             \
+            printf("FAIL " __VA_ARGS__);                                                                           \
+            printf("\n");                                                                                          \
+            failures++;                                                                                            \
+        }                                                                                                          \
+    } while (0)
+
+static double nowMs()
+{
+    return stageMicros() / 1000.0;
+}
+
+struct LookupRun
+{
+    std::vector<double> ms;
+    uint32_t requests;
+    uint32_t failed;
+};
+
+// lookups cycling through the labels, timed one by one
+static LookupRun runLookups(StandInApi &api, NutritionCache *cache, int lookups)
+{
+    LookupRun run = {};
+    uint32_t before = api.requests;
+
+    for (int i = 0; i < lookups; i++) {
+        float calories;
+        const char *label = labels[i % 2];
+        double start = nowMs();
+        bool ok = cache ? cache->lookup(label, &calories) : httpFetch(&api, label, &calories);
+        run.ms.push_back(nowMs() - start);
+        if (!ok)
+            run.failed++;
+    }
+    run.requests = api.requests - before;
+    return run;
+}
+
+static void printRun(const char *name, LookupRun &run)
+{
+    std::sort(run.ms.begin(), run.ms.end());
+    double p50 = run.ms[run.ms.size() / 2];
+    double p99 = run.ms[std::min(run.ms.size() - 1, (size_t)(run.ms.size() * 0.99))];
+    printf("%-12s %10.3f %10.3f %10u %8u\n", name, p50, p99, run.requests, run.failed);
+}
+
+// Waits for the background task to get through its queue
+static bool waitRevalidations(NutritionCache &cache, uint32_t count)
+{
+    nutrition_cache_stats_t stats;
+    for (int i = 0; i < 200; i++) {
+        cache.stats(stats);
+        if (stats.revalidations >= count)
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    int lookups = BENCH_DEFAULT_LOOKUPS;
+    int delayMs = BENCH_DEFAULT_DELAY_MS;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "-n") == 0) {
+            lookups = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "-d") == 0) {
+            delayMs = atoi(argv[++i]);
+        } else {
+            lookups = 0;
+            break;
+        }
+    }
+    if (lookups <= 0 || delayMs < 0) {
+        fprintf(stderr, "usage: %s [-n lookups] [-d api_delay_ms]\n", argv[0]);
+        return 1;
+    }
+
+    StandInApi api;
+    api.delayMs = delayMs;
+    api.set("bluedory", 206);
+    api.set("discobass", 97);
+    if (!api.start()) {
+        perror("stand-in API");
+        return 1;
+    }
+    const nutrition_source_t source = {httpFetch, &api};
+    float calories = 0;
+
+    // Straight from the API, then through a cold cache
+    LookupRun uncached = runLookups(api, nullptr, lookups);
+    NutritionCache cache;
+    CHECK(cache.start(source), "cache start");
+    LookupRun cached = runLookups(api, &cache, lookups);
+    CHECK(uncached.requests == (uint32_t)lookups, "uncached: %u requests for %d lookups", uncached.requests,
+          lookups);
+    CHECK(cached.requests == 2, "cached: %u requests for 2 labels", cached.requests);
+    CHECK(cached.failed == 0 && uncached.failed == 0, "failed lookups");
+    CHECK(cache.lookup("bluedory", &calories) && calories == 2.06f, "bluedory is %.2f", calories);
+
+    // A label the API does not know is not cached, asked again every time
+    uint32_t before = api.requests;
+    CHECK(!cache.lookup("unknown_fish", &calories) && !cache.lookup("unknown_fish", &calories),
+          "unknown_fish looked up");
+    CHECK(api.requests - before == 2, "unknown_fish: %u requests", api.requests - before);
+    cache.stop();
+
+    // Warm, expire, change on the server: the stale value is served at once
+    // and replaced in the background
+    NutritionCache expiring;
+    CHECK(expiring.start(source, BENCH_TTL_MS), "expiring cache start");
+    CHECK(expiring.warm(labels, labelCount) == 2, "warm");
+    uint32_t generation = expiring.generation();
+    std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_TTL_MS + 20));
+    api.set("bluedory", 150);
+    double start = nowMs();
+    CHECK(expiring.lookup("bluedory", &calories) && calories == 2.06f, "stale bluedory is %.2f", calories);
+    double staleMs = nowMs() - start;
+    CHECK(staleMs < delayMs / 2.0 + 1, "stale lookup took %.3f ms", staleMs);
+    CHECK(waitRevalidations(expiring, 1), "no revalidation");
+    CHECK(expiring.lookup("bluedory", &calories) && calories == 1.5f, "revalidated bluedory is %.2f", calories);
+    CHECK(expiring.generation() != generation, "generation did not change");
+
+    // While the API is down stale values are still served, and each label is
+    // asked again only after NUTRITION_RETRY_MS
+    std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_TTL_MS + 20));
+    api.down = true;
+    before = api.requests;
+    for (int i = 0; i < 20; i++)
+        CHECK(expiring.lookup("discobass", &calories) && calories == 0.97f, "discobass while down");
+    std::this_thread::sleep_for(std::chrono::milliseconds(delayMs + 50));
+    CHECK(api.requests - before == 1, "%u requests for discobass while down", api.requests - before);
+    CHECK(!expiring.lookup("salmon", &calories), "salmon looked up while down");
+    api.down = false;
+
+    // Saved and loaded into a new cache, a reboot: served before any request
+    char text[NUTRITION_CACHE_SIZE * (NUTRITION_LABEL_SIZE + 16)];
+    size_t length = expiring.save(text, sizeof(text));
+    CHECK(length > 0, "save");
+    CHECK(expiring.save(text, 8) == 0, "save into a short buffer");
+    length = expiring.save(text, sizeof(text));
+    expiring.stop();
+
+    NutritionCache rebooted;
+    CHECK(rebooted.start(source), "rebooted cache start");
+    CHECK(rebooted.load(text, length) == 2, "load: %s", text);
+    before = api.requests;
+    start = nowMs();
+    CHECK(rebooted.lookup("bluedory", &calories) && calories == 1.5f, "loaded bluedory is %.2f", calories);
+    CHECK(rebooted.lookup("discobass", &calories) && calories == 0.97f, "loaded discobass is %.2f", calories);
+    double loadedMs = nowMs() - start;
+    CHECK(loadedMs < delayMs / 2.0 + 1, "loaded lookups took %.3f ms", loadedMs);
+    CHECK(rebooted.warm(labels, labelCount) == 2, "warm after load");
+    CHECK(waitRevalidations(rebooted, 2), "loaded entries not revalidated");
+    CHECK(api.requests - before == 3, "%u requests after load", api.requests - before);
+    CHECK(rebooted.load("\n bad\nno_value \nx 1\n", 20) == 1, "malformed lines");
+    rebooted.stop();
+
+    printf("%d lookups of 2 labels, API answers after %d ms\n", lookups, delayMs);
+    printf("%-12s %10s %10s %10s %8s\n", "mode", "p50_ms", "p99_ms", "requests", "failed");
+    printRun("uncached", uncached);
+    printRun("cached", cached);
+    printf("stale hit %.3f ms, warm start from saved entries %.3f ms for 2 lookups\n", staleMs, loadedMs);
+    printf("checks: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,494 @@
+// Capture -> infer -> lookup, run the way handleCapture used to (each request
+// blocks the main loop through all its attempts) and through
+// DetectionPipeline on std::thread stages. Prints throughput, request latency
+// and how long the main loop was blocked at most.
+//
+// Frames come from fixture files (or synthetic frames), resized to the model
+// input and handed out at the camera frame rate, copied into a FramePool slot
+// like the camera JPEG on the device; inference is the real model;
+// the nutrition lookup is a sleep with jitter standing in for the HTTP request.
+// Synthetic frames hold no fish, so every hit-every-th frame without a
+// detection gets a stand-in one to exercise the lookup stage. The hits go by
+// frame number, and the pipeline hands frames to requests in another order
+// than the blocking loop, so the two runs do not end with the same statuses:
+// throughput is counted in requests that got FISH_INFO.
+//
+// Native build, from the repository root:
+//   cmake -S . -B build && cmake --build build --target bench_pipeline
+//
+// Usage: bench_pipeline [-n requests] [-f fps] [-l lookup_ms] [-h hit_every]
+//                       [fixture.ppm|fixture.jpg ...]
+
+#include "DetectionPipeline.hpp"
+#include "FramePool.hpp"
+
+#include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+#include "edge-impulse-sdk/dsp/image/processing.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if BENCH_HAVE_JPEG
+#include <jpeglib.h>
+#endif
+
+#define BENCH_DEFAULT_REQUESTS 40
+#define BENCH_DEFAULT_FPS 25
+#define BENCH_DEFAULT_LOOKUP_MS 60
+#define BENCH_DEFAULT_HIT_EVERY 3
+#define BENCH_SYNTHETIC_FRAMES 4
+// same as EI_CAMERA_POOL_SLOTS of the firmware
+#define BENCH_POOL_SLOTS (PIPELINE_FRAME_SLOTS + 2)
+#define BENCH_POOL_WAIT_MS 1000
+
+struct Frame
+{
+    int width;
+    int height;
+    std::vector<uint8_t> rgb;
+};
+
+static std::vector<Frame> frames;
+static int framePeriodUs = 1000000 / BENCH_DEFAULT_FPS;
+static int lookupMs = BENCH_DEFAULT_LOOKUP_MS;
+static int hitEvery = BENCH_DEFAULT_HIT_EVERY;
+
+// Frame source state of the capture stage
+static std::mutex sourceMutex;
+static uint64_t nextFrameUs = 0;
+static uint32_t frameCounter = 0;
+static std::unique_ptr<FramePool> framePool;
+
+static std::atomic<uint32_t> inferCount(0);
+static std::atomic<uint32_t> lookupCount(0);
+
+static bool endsWith(const std::string &s, const char *suffix)
+{
+    size_t n = strlen(suffix);
+    if (s.size() < n)
+        return false;
+    for (size_t i = 0; i < n; i++) {
+        if (tolower(s[s.size() - n + i]) != suffix[i])
+            return false;
+    }
+    return true;
+}
+
+// binary PPM (P6), 8 bits per channel, without comments
+static bool loadPpm(const char *path, Frame &frame)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    int maxval = 0;
+    bool ok = fscanf(f, "P6 %d %d %d", &frame.width, &frame.height, &maxval) == 3 && maxval == 255 &&
+              frame.width > 0 && frame.height > 0 && fgetc(f) != EOF;
+    if (ok) {
+        frame.rgb.resize((size_t)frame.width * frame.height * 3);
+        ok = fread(frame.rgb.data(), 1, frame.rgb.size(), f) == frame.rgb.size();
+    }
+    fclose(f);
+    return ok;
+}
+
+#if BENCH_HAVE_JPEG
+static bool loadJpeg(const char *path, Frame &frame)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    jpeg_decompress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_stdio_src(&cinfo, f);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+
+    frame.width = cinfo.output_width;
+    frame.height = cinfo.output_height;
+    frame.rgb.resize((size_t)frame.width * frame.height * 3);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = &frame.rgb[(size_t)cinfo.output_scanline * frame.width * 3];
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    fclose(f);
+    return true;
+}
+#endif
+
+static bool loadFrame(const char *path, Frame &frame)
+{
+    if (endsWith(path, ".ppm"))
+        return loadPpm(path, frame);
+#if BENCH_HAVE_JPEG
+    if (endsWith(path, ".jpg") || endsWith(path, ".jpeg"))
+        return loadJpeg(path, frame);
+#endif
+    fprintf(stderr, "unsupported fixture %s\n", path);
+    return false;
+}
+
+static void makeSyntheticFrame(int k, Frame &frame)
+{
+    frame.width = 320;
+    frame.height = 240;
+    frame.rgb.resize((size_t)frame.width * frame.height * 3);
+    for (size_t i = 0; i < frame.rgb.size(); i++) {
+        size_t x = (i / 3) % frame.width;
+        size_t y = (i / 3) / frame.width;
+        frame.rgb[i] = (uint8_t)((x * (k + 1) + y * (k + 3) + ((x / 16 + y / 16) & 1) * 90) & 0xff);
+    }
+}
+
+// to the model input, like the camera stream does on the device
+static bool resizeFrame(Frame &frame)
+{
+    const size_t inputSize = EI_CLASSIFIER_INPUT_WIDTH * EI_CLASSIFIER_INPUT_HEIGHT * 3;
+
+    if (frame.width == EI_CLASSIFIER_INPUT_WIDTH && frame.height == EI_CLASSIFIER_INPUT_HEIGHT)
+        return true;
+    frame.rgb.resize(std::max(frame.rgb.size(), inputSize));
+    if (ei::image::processing::resize_image_using_mode(frame.rgb.data(), frame.width, frame.height,
+                                                        frame.rgb.data(), EI_CLASSIFIER_INPUT_WIDTH,
+                                                        EI_CLASSIFIER_INPUT_HEIGHT, 3, EI_CLASSIFIER_RESIZE_MODE) != 0)
+        return false;
+    frame.rgb.resize(inputSize);
+    frame.width = EI_CLASSIFIER_INPUT_WIDTH;
+    frame.height = EI_CLASSIFIER_INPUT_HEIGHT;
+    return true;
+}
+
+// ------- Stages ------------------------------------------------------------ //
+
+// A new frame every frame period, like the sensor
+static bool fileCapture(void *, pipeline_frame_t *frame)
+{
+    uint64_t readyUs;
+    uint32_t index;
+    {
+        std::lock_guard<std::mutex> lock(sourceMutex);
+        uint64_t now = stageMicros();
+        readyUs = std::max(now, nextFrameUs);
+        nextFrameUs = readyUs + framePeriodUs;
+        index = frameCounter++;
+    }
+    uint64_t now = stageMicros();
+    if (readyUs > now)
+        std::this_thread::sleep_for(std::chrono::microseconds(readyUs - now));
+
+    uint8_t *slot = framePool->acquire(BENCH_POOL_WAIT_MS);
+    if (!slot)
+        return false;
+    const Frame &source = frames[index % frames.size()];
+    memcpy(slot, source.rgb.data(), source.rgb.size());
+    // the frame number rides along after the pixels, for the stand-in hits
+    memcpy(slot + source.rgb.size(), &index, sizeof(index));
+    frame->data = slot;
+    frame->length = source.rgb.size();
+    frame->width = source.width;
+    frame->height = source.height;
+    frame->handle = slot;
+    return true;
+}
+
+static void fileRelease(void *, pipeline_frame_t *frame)
+{
+    if (!framePool->release((uint8_t *)frame->handle))
+        fprintf(stderr, "FAIL frame released twice or not from the pool\n");
+}
+
+static bool modelInfer(void *, const pipeline_frame_t *frame, pipeline_detection_t *detections, uint32_t *count)
+{
+    ei::image_signal_t image;
+    image.buffer = frame->data;
+    image.width = frame->width;
+    image.height = frame->height;
+    image.stride = 0;
+    image.format = ei::EI_IMAGE_SIGNAL_RGB888;
+
+    ei_impulse_result_t result;
+    inferCount++;
+    *count = 0;
+    if (run_classifier_image_buffer(&image, &result, false) != EI_IMPULSE_OK)
+        return false;
+
+#if EI_CLASSIFIER_OBJECT_DETECTION == 1
+    for (uint32_t i = 0; i < result.bounding_boxes_count && *count < PIPELINE_MAX_DETECTIONS; i++) {
+        const ei_impulse_result_bounding_box_t &bb = result.bounding_boxes[i];
+        if (bb.value == 0)
+            continue;
+        pipeline_detection_t &d = detections[(*count)++];
+        snprintf(d.label, sizeof(d.label), "%s", bb.label);
+        d.value = bb.value;
+        d.x = bb.x;
+        d.y = bb.y;
+        d.width = bb.width;
+        d.height = bb.height;
+    }
+#endif
+
+    uint32_t index = 0;
+    if (frame->handle)
+        memcpy(&index, frame->data + frame->length, sizeof(index));
+    if (*count == 0 && hitEvery > 0 && index % hitEvery == (uint32_t)hitEvery - 1) {
+        pipeline_detection_t &d = detections[(*count)++];
+        snprintf(d.label, sizeof(d.label), "stand-in");
+        d.value = 0.5f;
+        d.x = d.y = 0;
+        d.width = d.height = 8;
+    }
+    return true;
+}
+
+// 0.5x to 1.5x the lookup time, every 16th one 3x
+static bool sleepLookup(void *, const char *, float *calories)
+{
+    uint32_t n = lookupCount++;
+    uint32_t jitter = (n * 2654435761u) >> 24;
+    int us = lookupMs * 1000 / 2 + (int)((uint64_t)lookupMs * 1000 * jitter / 256);
+    if (n % 16 == 15)
+        us = lookupMs * 3000;
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+    *calories = 100.0f;
+    return true;
+}
+
+static const pipeline_stages_t stages = {fileCapture, fileRelease, modelInfer, sleepLookup, nullptr};
+
+// ------- Runs -------------------------------------------------------------- //
+
+struct RunResult
+{
+    double seconds;
+    std::vector<double> latencyMs;
+    double loopBlockMaxMs;
+    int statuses[PIPELINE_AI_FAIL + 1];
+    uint32_t frames;
+    frame_pool_stats_t pool;
+};
+
+static bool resetSource()
+{
+    std::lock_guard<std::mutex> lock(sourceMutex);
+    nextFrameUs = 0;
+    frameCounter = 0;
+    framePool.reset(new FramePool);
+    return framePool->init(BENCH_POOL_SLOTS, frames[0].rgb.size() + sizeof(uint32_t));
+}
+
+// A slot released twice must not go back to the free slots a second time,
+// two later acquires would get the same buffer
+static bool checkDoubleRelease()
+{
+    FramePool pool;
+    if (!pool.init(3, 64))
+        return false;
+
+    uint8_t *kept = pool.acquire(0);
+    uint8_t *slot = pool.acquire(0);
+    bool ok = kept && slot && pool.release(slot) && !pool.release(slot);
+    uint8_t *first = pool.acquire(0);
+    uint8_t *second = pool.acquire(0);
+    ok = ok && first && second && first != second && !pool.acquire(0);
+
+    frame_pool_stats_t stats;
+    pool.stats(stats);
+    ok = ok && stats.inUse == 3;
+    if (!ok)
+        fprintf(stderr, "FAIL a slot released twice was handed out twice\n");
+    return ok;
+}
+
+// The old handleCapture: every attempt in turn on the calling thread
+static bool runBlocking(int requests, RunResult &run)
+{
+    pipeline_detection_t detections[PIPELINE_MAX_DETECTIONS];
+
+    run = RunResult();
+    if (!resetSource()) {
+        fprintf(stderr, "frame pool allocation failed\n");
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < requests; r++) {
+        uint64_t begin = stageMicros();
+        pipeline_status_t status = PIPELINE_NOT_RECOG;
+        for (int attempt = 1; attempt <= PIPELINE_MAX_ATTEMPTS; attempt++) {
+            pipeline_frame_t frame;
+            uint32_t count = 0;
+            if (!fileCapture(nullptr, &frame)) {
+                run.statuses[PIPELINE_CAPTURE_FAIL]++;
+                continue;
+            }
+            bool ok = modelInfer(nullptr, &frame, detections, &count);
+            fileRelease(nullptr, &frame);
+            if (!ok) {
+                run.statuses[PIPELINE_AI_FAIL]++;
+                continue;
+            }
+            if (count > 0) {
+                float calories;
+                status = sleepLookup(nullptr, detections[0].label, &calories) ? PIPELINE_FISH_INFO
+                                                                               : PIPELINE_LOOKUP_FAIL;
+                break;
+            }
+        }
+        run.statuses[status]++;
+        double ms = (stageMicros() - begin) / 1000.0;
+        run.latencyMs.push_back(ms);
+        run.loopBlockMaxMs = std::max(run.loopBlockMaxMs, ms);
+    }
+    run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    run.frames = frameCounter;
+    framePool->stats(run.pool);
+    return true;
+}
+
+// Requests submitted as soon as the pipeline takes them
+static bool runPipeline(int requests, RunResult &run)
+{
+    DetectionPipeline pipeline;
+    std::vector<int> finals(requests, 0);
+    pipeline_result_t result;
+    int submitted = 0;
+    int finished = 0;
+
+    run = RunResult();
+    if (!resetSource()) {
+        fprintf(stderr, "frame pool allocation failed\n");
+        return false;
+    }
+    if (!pipeline.start(stages)) {
+        fprintf(stderr, "pipeline start failed\n");
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    while (finished < requests) {
+        uint64_t begin = stageMicros();
+        while (submitted < requests && pipeline.submit())
+            submitted++;
+        while (pipeline.poll(result)) {
+            run.statuses[result.status]++;
+            if (!result.final)
+                continue;
+            if (result.job >= (uint32_t)requests || finals[result.job]++) {
+                fprintf(stderr, "FAIL unexpected final result for request %u\n", result.job);
+                return false;
+            }
+            run.latencyMs.push_back(result.totalUs / 1000.0);
+            finished++;
+        }
+        run.loopBlockMaxMs = std::max(run.loopBlockMaxMs, (stageMicros() - begin) / 1000.0);
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    pipeline.stop();
+    run.frames = frameCounter;
+    framePool->stats(run.pool);
+    if (run.pool.inUse != 0) {
+        fprintf(stderr, "FAIL %u frame pool slots not released\n", run.pool.inUse);
+        return false;
+    }
+    return true;
+}
+
+static void printRun(const char *name, RunResult &run)
+{
+    std::sort(run.latencyMs.begin(), run.latencyMs.end());
+    double p50 = run.latencyMs[run.latencyMs.size() / 2];
+    double p99 = run.latencyMs[std::min(run.latencyMs.size() - 1, (size_t)(run.latencyMs.size() * 0.99))];
+
+    printf("%-10s %8.2f %8.1f %10.1f %10.1f %10.2f %8u %6d %6d\n", name,
+           run.statuses[PIPELINE_FISH_INFO] / run.seconds, run.frames / run.seconds, p50, p99, run.loopBlockMaxMs, run.frames, run.statuses[PIPELINE_FISH_INFO],
+           run.statuses[PIPELINE_NOT_RECOG]);
+}
+
+int main(int argc, char **argv)
+{
+    int requests = BENCH_DEFAULT_REQUESTS;
+    int fps = BENCH_DEFAULT_FPS;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "-n") == 0) {
+            requests = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "-f") == 0) {
+            fps = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "-l") == 0) {
+            lookupMs = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "-h") == 0) {
+            hitEvery = atoi(argv[++i]);
+        } else {
+            Frame frame;
+            if (!loadFrame(argv[i], frame))
+                return 1;
+            frames.push_back(frame);
+        }
+    }
+    if (requests <= 0 || fps <= 0 || lookupMs < 0 || hitEvery < 0) {
+        fprintf(stderr, "usage: %s [-n requests] [-f fps] [-l lookup_ms] [-h hit_every] [fixture ...]\n",
+                argv[0]);
+        return 1;
+    }
+    framePeriodUs = 1000000 / fps;
+    for (int k = 0; frames.empty() && k < BENCH_SYNTHETIC_FRAMES; k++) {
+        Frame frame;
+        makeSyntheticFrame(k, frame);
+        frames.push_back(frame);
+    }
+    for (Frame &frame : frames) {
+        if (!resizeFrame(frame)) {
+            fprintf(stderr, "resize failed\n");
+            return 1;
+        }
+    }
+
+    // warm up the model session
+    pipeline_detection_t detections[PIPELINE_MAX_DETECTIONS];
+    pipeline_frame_t warmup = {frames[0].rgb.data(), frames[0].rgb.size(), (uint32_t)frames[0].width,
+                               (uint32_t)frames[0].height, nullptr};
+    uint32_t count;
+    if (!modelInfer(nullptr, &warmup, detections, &count)) {
+        fprintf(stderr, "run_classifier_image_buffer failed\n");
+        return 1;
+    }
+
+    RunResult blocking, pipelined;
+    if (!checkDoubleRelease() || !runBlocking(requests, blocking) || !runPipeline(requests, pipelined))
+        return 1;
+
+    printf("%d requests, %d fps camera, %d ms lookup, stand-in hit every %d frames\n", requests, fps, lookupMs,
+           hitEvery);
+    printf("%-10s %8s %8s %10s %10s %10s %8s %6s %6s\n", "mode", "info/s", "frames/s", "p50_ms", "p99_ms",
+           "loop_ms", "frames", "info", "norec");
+    printRun("blocking", blocking);
+    printRun("pipeline", pipelined);
+
+    printf("\nframe pool, %u slots of %zu bytes\n", pipelined.pool.slots, framePool->slotSize());
+    printf("%-10s %8s %8s %8s %8s %12s %12s\n", "mode", "acquires", "peak", "waits", "timeouts", "wait_max_us",
+           "wait_mean_us");
+    const char *names[] = {"blocking", "pipeline"};
+    const RunResult *runs[] = {&blocking, &pipelined};
+    for (int i = 0; i < 2; i++) {
+        const frame_pool_stats_t &p = runs[i]->pool;
+        printf("%-10s %8u %8u %8u %8u %12u %12.0f\n", names[i], p.acquires, p.peakInUse, p.waits, p.timeouts,
+               p.waitMaxUs, p.waits ? (double)p.waitTotalUs / p.waits : 0.0);
+    }
+    return 0;
+}
@@ -0,0 +1,325 @@
+// AVX2 / AVX-VNNI int8 conv and depthwise conv kernels, and the packed 1x1
+// conv kernels (with and without a residual ADD in their output stage), against
+// the reference kernels: checks the outputs are identical on random shapes and
+// quantization parameters, then times the conv layers of the model.
+//
+// Native build, from the repository root:
+//   cmake -S . -B build && cmake --build build --target bench_x86_conv
+//
+// Usage: bench_x86_conv [random cases] [timing runs]
+
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/integer_ops/conv.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/integer_ops/depthwise_conv.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/integer_ops/pointwise_conv.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/reference/integer_ops/add.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <vector>
+
+#define BENCH_DEFAULT_CASES 2000
+#define BENCH_DEFAULT_RUNS 50
+
+using tflite::RuntimeShape;
+using tflite::optimized_ops::X86Simd;
+
+// run() kernel ids besides the X86Simd values: the reference kernel, and the
+// packed 1x1 kernels (portable, AVX2, AVX-VNNI)
+#define KERNEL_REFERENCE -1
+#define KERNEL_PACKED 10
+
+struct Layer
+{
+    const char *name;
+    bool depthwise;
+    int height, width, inputDepth, outputDepth;
+    int filterHeight, filterWidth, stride, dilation, padHeight, padWidth;
+};
+
+// conv and depthwise conv layers of the FOMO model (tflite_learn_4)
+static const Layer modelLayers[] = {
+    { "conv 3x3/2 3->16", false, 96, 96, 3, 16, 3, 3, 2, 1, 0, 0 },
+    { "dw 3x3 16", true, 48, 48, 16, 16, 3, 3, 1, 1, 1, 1 },
+    { "conv 1x1 16->8", false, 48, 48, 16, 8, 1, 1, 1, 1, 0, 0 },
+    { "conv 1x1 8->48", false, 48, 48, 8, 48, 1, 1, 1, 1, 0, 0 },
+    { "dw 3x3/2 48", true, 49, 49, 48, 48, 3, 3, 2, 1, 0, 0 },
+    { "conv 1x1 48->8", false, 24, 24, 48, 8, 1, 1, 1, 1, 0, 0 },
+    { "conv 1x1 8->48", false, 24, 24, 8, 48, 1, 1, 1, 1, 0, 0 },
+    { "dw 3x3 48", true, 24, 24, 48, 48, 3, 3, 1, 1, 1, 1 },
+    { "conv 1x1 96->96", false, 12, 12, 96, 96, 1, 1, 1, 1, 0, 0 },
+};
+
+struct Case
+{
+    Layer layer;
+    int32_t inputOffset, outputOffset, activationMin, activationMax;
+    bool bias;
+    // 1x1 conv followed by reference_integer_ops::Add(addParams, residual, conv output)
+    bool residualAdd = false;
+    tflite::ArithmeticParams addParams;
+    std::vector<int8_t> input, filter, residual;
+    std::vector<int32_t> biasData, multiplier, shift;
+    std::vector<uint8_t> packedBuffer;
+    tflite::optimized_integer_ops::PointwiseConvPacked packed;
+};
+
+static bool pointwise(const Layer &l)
+{
+    return !l.depthwise && l.filterHeight == 1 && l.filterWidth == 1 && l.padHeight == 0 && l.padWidth == 0;
+}
+
+static int randomInt(int lo, int hi)
+{
+    return lo + rand() % (hi - lo + 1);
+}
+
+static int outputSize(int in, int filter, int stride, int dilation, int pad)
+{
+    int effective = (filter - 1) * dilation + 1;
+    return (in + 2 * pad - effective) / stride + 1;
+}
+
+static void fillCase(Case &c)
+{
+    const Layer &l = c.layer;
+    c.input.resize((size_t)l.height * l.width * l.inputDepth);
+    for (int8_t &v : c.input)
+        v = (int8_t)randomInt(-128, 127);
+    c.filter.resize((size_t)l.filterHeight * l.filterWidth * l.outputDepth * (l.depthwise ? 1 : l.inputDepth));
+    for (int8_t &v : c.filter)
+        v = (int8_t)randomInt(-127, 127);
+    c.biasData.resize(l.outputDepth);
+    c.multiplier.resize(l.outputDepth);
+    c.shift.resize(l.outputDepth);
+    for (int i = 0; i < l.outputDepth; i++) {
+        c.biasData[i] = randomInt(-20000, 20000);
+        c.multiplier[i] = (1 << 30) + randomInt(0, (1 << 30) - 1);
+        c.shift[i] = randomInt(-12, 1);
+    }
+    if (pointwise(l)) {
+        c.packedBuffer.resize(tflite::optimized_integer_ops::PointwiseConvPackedBytes(l.inputDepth, l.outputDepth));
+        tflite::optimized_integer_ops::PackPointwiseConv(c.filter.data(), c.bias ? c.biasData.data() : nullptr,
+                                                         c.inputOffset, l.inputDepth, l.outputDepth,
+                                                         c.packedBuffer.data(), &c.packed);
+    }
+    if (c.residualAdd) {
+        int outH = outputSize(l.height, l.filterHeight, l.stride, l.dilation, l.padHeight);
+        int outW = outputSize(l.width, l.filterWidth, l.stride, l.dilation, l.padWidth);
+        c.residual.resize((size_t)outH * outW * l.outputDepth);
+        for (int8_t &v : c.residual)
+            v = (int8_t)randomInt(-128, 127);
+        tflite::ArithmeticParams &p = c.addParams;
+        p = {};
+        p.left_shift = 20;
+        p.input1_offset = randomInt(-127, 128);
+        p.input2_offset = randomInt(-127, 128);
+        p.output_offset = randomInt(-128, 127);
+        p.input1_multiplier = (1 << 30) + randomInt(0, (1 << 30) - 1);
+        p.input2_multiplier = (1 << 30) + randomInt(0, (1 << 30) - 1);
+        p.output_multiplier = (1 << 30) + randomInt(0, (1 << 30) - 1);
+        p.input1_shift = randomInt(-3, 0);
+        p.input2_shift = randomInt(-3, 0);
+        p.output_shift = randomInt(-22, -18);
+        p.quantized_activation_min = randomInt(-128, 0);
+        p.quantized_activation_max = randomInt(0, 127);
+    }
+}
+
+static RuntimeShape shape(std::initializer_list<int32_t> dims)
+{
+    std::vector<int32_t> d(dims);
+    return RuntimeShape((int)d.size(), d.data());
+}
+
+static void run(const Case &c, std::vector<int8_t> &output, int kernel)
+{
+    const Layer &l = c.layer;
+    int outH = outputSize(l.height, l.filterHeight, l.stride, l.dilation, l.padHeight);
+    int outW = outputSize(l.width, l.filterWidth, l.stride, l.dilation, l.padWidth);
+    RuntimeShape inputShape = shape({ 1, l.height, l.width, l.inputDepth });
+    RuntimeShape outputShape = shape({ 1, outH, outW, l.outputDepth });
+    RuntimeShape biasShape = shape({ l.outputDepth });
+    const int32_t *bias = c.bias ? c.biasData.data() : nullptr;
+    const tflite::ArithmeticParams *addParams = c.residualAdd ? &c.addParams : nullptr;
+    output.assign((size_t)outH * outW * l.outputDepth, 0);
+
+    if (l.depthwise) {
+        tflite::DepthwiseParams params = {};
+        params.input_offset = c.inputOffset;
+        params.output_offset = c.outputOffset;
+        params.stride_width = params.stride_height = l.stride;
+        params.dilation_width_factor = params.dilation_height_factor = l.dilation;
+        params.padding_values.width = l.padWidth;
+        params.padding_values.height = l.padHeight;
+        params.depth_multiplier = 1;
+        params.quantized_activation_min = c.activationMin;
+        params.quantized_activation_max = c.activationMax;
+        RuntimeShape filterShape = shape({ 1, l.filterHeight, l.filterWidth, l.outputDepth });
+        if (kernel == KERNEL_REFERENCE)
+            tflite::reference_integer_ops::DepthwiseConvPerChannel(
+                params, c.multiplier.data(), c.shift.data(), inputShape, c.input.data(), filterShape,
+                c.filter.data(), biasShape, bias, outputShape, output.data());
+        else
+            tflite::optimized_integer_ops::DepthwiseConvPerChannel(
+                params, c.multiplier.data(), c.shift.data(), inputShape, c.input.data(), filterShape,
+                c.filter.data(), biasShape, bias, outputShape, output.data(), (X86Simd)kernel);
+    }
+    else {
+        tflite::ConvParams params = {};
+        params.input_offset = c.inputOffset;
+        params.output_offset = c.outputOffset;
+        params.stride_width = params.stride_height = l.stride;
+        params.dilation_width_factor = params.dilation_height_factor = l.dilation;
+        params.padding_values.width = l.padWidth;
+        params.padding_values.height = l.padHeight;
+        params.quantized_activation_min = c.activationMin;
+        params.quantized_activation_max = c.activationMax;
+        RuntimeShape filterShape = shape({ l.outputDepth, l.filterHeight, l.filterWidth, l.inputDepth });
+        if (kernel == KERNEL_PACKED)
+            tflite::optimized_integer_ops::PointwiseConvPerChannelPortable(
+                c.packed, params, c.multiplier.data(), c.shift.data(), inputShape, c.input.data(), outputShape,
+                output.data(), tflite::optimized_integer_ops::PointwiseRequantize(), addParams, c.residual.data());
+        else if (kernel == KERNEL_PACKED + (int)X86Simd::kAvx2)
+            tflite::optimized_integer_ops::PointwiseConvPerChannelX86<false>(
+                c.packed, params, c.multiplier.data(), c.shift.data(), inputShape, c.input.data(), outputShape,
+                output.data(), addParams, c.residual.data());
+        else if (kernel == KERNEL_PACKED + (int)X86Simd::kAvxVnni)
+            tflite::optimized_integer_ops::PointwiseConvPerChannelX86<true>(
+                c.packed, params, c.multiplier.data(), c.shift.data(), inputShape, c.input.data(), outputShape,
+                output.data(), addParams, c.residual.data());
+        else if (kernel == KERNEL_REFERENCE)
+            tflite::reference_integer_ops::ConvPerChannel(
+                params, c.multiplier.data(), c.shift.data(), inputShape, c.input.data(), filterShape,
+                c.filter.data(), biasShape, bias, outputShape, output.data());
+        else
+            tflite::optimized_integer_ops::ConvPerChannel(
+                params, c.multiplier.data(), c.shift.data(), inputShape, c.input.data(), filterShape,
+                c.filter.data(), biasShape, bias, outputShape, output.data(), (X86Simd)kernel);
+        // the unfused kernels run the ADD as a separate pass
+        if (c.residualAdd && kernel < KERNEL_PACKED) {
+            std::vector<int8_t> conv = output;
+            tflite::reference_integer_ops::Add(c.addParams, outputShape, c.residual.data(), outputShape,
+                                               conv.data(), outputShape, output.data());
+        }
+    }
+}
+
+// Kernels to check a case against the reference with
+static std::vector<int> caseKernels(const Case &c, const std::vector<int> &simdKernels)
+{
+    std::vector<int> kernels = simdKernels;
+    if (pointwise(c.layer)) {
+        kernels.push_back(KERNEL_PACKED);
+        for (int kernel : simdKernels)
+            kernels.push_back(KERNEL_PACKED + kernel);
+    }
+    return kernels;
+}
+
+static double timeUs(const Case &c, int kernel, int runs)
+{
+    std::vector<int8_t> output;
+    std::vector<double> times;
+    for (int r = 0; r < runs; r++) {
+        auto start = std::chrono::steady_clock::now();
+        run(c, output, kernel);
+        times.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+int main(int argc, char **argv)
+{
+    int cases = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_CASES;
+    int runs = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_RUNS;
+    X86Simd simd = tflite::optimized_ops::GetX86Simd();
+    std::vector<int> kernels;
+
+    if (simd == X86Simd::kNone) {
+        fprintf(stderr, "CPU has no AVX2\n");
+        return 1;
+    }
+    kernels.push_back((int)X86Simd::kAvx2);
+    if (simd == X86Simd::kAvxVnni)
+        kernels.push_back((int)X86Simd::kAvxVnni);
+
+    srand(1);
+    int mismatches = 0;
+    for (int i = 0; i < cases; i++) {
+        Case c;
+        Layer &l = c.layer;
+        l.name = "random";
+        l.depthwise = rand() % 2;
+        l.filterHeight = randomInt(1, 5);
+        l.filterWidth = randomInt(1, 5);
+        l.stride = randomInt(1, 3);
+        l.dilation = randomInt(1, 2);
+        l.padHeight = randomInt(0, l.filterHeight - 1);
+        l.padWidth = randomInt(0, l.filterWidth - 1);
+        if (!l.depthwise && rand() % 3 == 0) {
+            l.filterHeight = l.filterWidth = 1;
+            l.padHeight = l.padWidth = 0;
+        }
+        l.height = randomInt((l.filterHeight - 1) * l.dilation + 1, 20);
+        l.width = randomInt((l.filterWidth - 1) * l.dilation + 1, 20);
+        l.inputDepth = randomInt(1, 70);
+        l.outputDepth = l.depthwise ? l.inputDepth : randomInt(1, 70);
+        c.inputOffset = randomInt(-127, 128);
+        c.outputOffset = randomInt(-128, 127);
+        c.activationMin = randomInt(-128, 0);
+        c.activationMax = randomInt(0, 127);
+        c.bias = rand() % 4 != 0;
+        c.residualAdd = pointwise(l) && rand() % 2;
+        fillCase(c);
+
+        std::vector<int8_t> expected, actual;
+        run(c, expected, KERNEL_REFERENCE);
+        for (int kernel : caseKernels(c, kernels)) {
+            run(c, actual, kernel);
+            if (actual != expected) {
+                if (mismatches++ < 10)
+                    fprintf(stderr, "mismatch: %s kernel %d, %dx%dx%d -> %d, filter %dx%d stride %d dilation %d pad %d,%d\n",
+                            l.depthwise ? "depthwise" : c.residualAdd ? "conv + add" : "conv", kernel, l.height, l.width, l.inputDepth,
+                            l.outputDepth, l.filterHeight, l.filterWidth, l.stride, l.dilation, l.padHeight,
+                            l.padWidth);
+            }
+        }
+    }
+    printf("%d random cases, %d mismatches (%s)\n", cases, mismatches,
+           simd == X86Simd::kAvxVnni ? "AVX2 and AVX-VNNI" : "AVX2");
+
+    printf("%-20s %10s %10s %10s %10s %10s %10s %6s\n", "layer", "ref_us", "avx2_us", "vnni_us", "packed_us",
+           "pk_avx2_us", "pk_vnni_us", "same");
+    for (const Layer &layer : modelLayers) {
+        Case c;
+        c.layer = layer;
+        c.inputOffset = 128;
+        c.outputOffset = -128;
+        c.activationMin = -128;
+        c.activationMax = 127;
+        c.bias = true;
+        fillCase(c);
+
+        std::vector<int8_t> expected, actual;
+        bool same = true;
+        run(c, expected, KERNEL_REFERENCE);
+        for (int kernel : caseKernels(c, kernels)) {
+            run(c, actual, kernel);
+            same = same && actual == expected;
+        }
+        if (!same)
+            mismatches++;
+        bool vnni = kernels.size() > 1;
+        bool packed = pointwise(layer);
+        printf("%-20s %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %6s\n", layer.name,
+               timeUs(c, KERNEL_REFERENCE, runs), timeUs(c, (int)X86Simd::kAvx2, runs),
+               vnni ? timeUs(c, (int)X86Simd::kAvxVnni, runs) : 0, packed ? timeUs(c, KERNEL_PACKED, runs) : 0,
+               packed ? timeUs(c, KERNEL_PACKED + (int)X86Simd::kAvx2, runs) : 0,
+               packed && vnni ? timeUs(c, KERNEL_PACKED + (int)X86Simd::kAvxVnni, runs) : 0, same ? "yes" : "NO");
+    }
+    return mismatches ? 1 : 0;
+}
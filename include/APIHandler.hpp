@@ -16,6 +16,8 @@ class APIHandler
 
     api_response_code_t pingAPI();
 
+    // Prints nothing, it runs on the pipeline and revalidation tasks and the
+    // serial link belongs to loop(). The caller gets the error code.
     api_response_code_t fetchData(const String &name, float &result);
 
   private:
@@ -1,43 +1,98 @@
 #ifndef COMMAND_HANDLER_HPP
 #define COMMAND_HANDLER_HPP
 
+#ifdef ARDUINO
 #include <Arduino.h>
+#else
+#include "HostStream.hpp"
+#endif
+
+#include "LinkProtocol.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
 
 // Define the maximum number of commands and buffer size
 #define MAX_COMMANDS 20
 #define COMMAND_BUFFER_SIZE 64
+// Longest command name, including the terminator
+#define COMMAND_NAME_SIZE 16
+// Slots of the route hash table, a power of two well above MAX_COMMANDS
+#define COMMAND_TABLE_SIZE 64
+
+// Non-owning view of the arguments of a command, points into the command
+// buffer (null-terminated) and is only valid until the handler returns
+struct CommandArgs {
+    const char *data;
+    size_t length;
+
+    bool isEmpty() const { return length == 0; }
+};
 
 // Define a type for command handler functions
-typedef void (*CommandFunction)(const String &);
+typedef void (*CommandFunction)(const CommandArgs &);
 
 class CommandHandler
 {
   private:
+    // Route names are trimmed and uppercased once, when registered
     struct CommandRoute {
-        String command;
+        char command[COMMAND_NAME_SIZE];
+        uint8_t length;
+        uint32_t hash;
         CommandFunction handler;
     };
 
     CommandRoute routes[MAX_COMMANDS];
     int numRoutes;
 
+    // Open addressing on the route hash, index into routes or -1
+    int8_t table[COMMAND_TABLE_SIZE];
+
     Stream &serial;
 
     // Buffer for accumulating incoming command data
     char commandBuffer[COMMAND_BUFFER_SIZE];
     int bufferIndex;
+    // Set when a line overflows the buffer, the rest of it is dropped
+    bool discardLine;
+
+    // Binary framing (LinkProtocol.hpp), text lines are still accepted
+    LinkFrameDecoder linkDecoder;
+    bool binary;
+    uint8_t txSeq;
+
+    void writeFrame(uint8_t type, const uint8_t *const *parts,
+                    const size_t *lengths, int count);
+
+    const CommandRoute *findRoute(const char *command, size_t length,
+                                  uint32_t hash) const;
+    void dispatch(char *line, size_t length);
 
   public:
     CommandHandler(Stream &serialStream);
 
-    // Register a command and its handler
-    bool registerRoute(const String &command, CommandFunction handler);
+    // Register a command and its handler, fails if the table is full, the
+    // name is empty, too long, contains a space or is already registered
+    bool registerRoute(const char *command, CommandFunction handler);
 
     // Parse and execute an incoming command (non-blocking)
     void handleIncomingCommand();
 
-    // Send a command with optional arguments
-    void sendCommand(const String &command, const String &args = "");
+    // Send a command with optional arguments, as a LINK_MSG_COMMAND frame
+    // once the link is binary
+    void sendCommand(const char *command, const char *args = nullptr);
+
+    // Switch the link to binary frames (text lines are still read) or back
+    void setBinary(bool enable);
+    bool isBinary() const { return binary; }
+
+    // Send a frame of any type, fails in text mode or if the payload is
+    // longer than LINK_MAX_PAYLOAD
+    bool sendFrame(uint8_t type, const uint8_t *payload, size_t length);
+
+    // Receive statistics of the binary link
+    const LinkFrameDecoder &link() const { return linkDecoder; }
 };
 
 #endif
@@ -0,0 +1,142 @@
+#ifndef DETECTION_PIPELINE_HPP
+#define DETECTION_PIPELINE_HPP
+
+#include "StageRuntime.hpp"
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// CAPTURE requests in flight, a further one is refused until a result is
+// polled
+#define PIPELINE_MAX_JOBS 4
+// Captured frames waiting for inference, on top of the one being inferred
+// (double buffering with the camera's two frame buffers)
+#define PIPELINE_FRAME_SLOTS 1
+// Frames tried per request before it ends without a detection
+#define PIPELINE_MAX_ATTEMPTS 5
+#define PIPELINE_MAX_DETECTIONS 10
+#define PIPELINE_LABEL_SIZE 24
+
+// A captured frame, handle belongs to the frame source
+typedef struct {
+    const uint8_t *data;
+    size_t length;
+    uint32_t width;
+    uint32_t height;
+    void *handle;
+} pipeline_frame_t;
+
+typedef struct {
+    char label[PIPELINE_LABEL_SIZE];
+    float value;
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+} pipeline_detection_t;
+
+typedef enum {
+    PIPELINE_FISH_INFO,    // Final, calories of the first detection
+    PIPELINE_LOOKUP_FAIL,  // Final, detected but the lookup failed
+    PIPELINE_NOT_RECOG,    // Final, nothing detected in any attempt
+    PIPELINE_CAPTURE_FAIL, // An attempt could not capture a frame
+    PIPELINE_AI_FAIL,      // An attempt failed to run the model
+} pipeline_status_t;
+
+typedef struct {
+    uint32_t job;
+    pipeline_status_t status;
+    bool final;
+    uint8_t attempt;
+    float calories;
+    // Time spent in each stage by the last attempt and from submit() to the
+    // final result (stageMicros)
+    uint64_t submittedUs;
+    uint32_t captureUs;
+    uint32_t inferUs;
+    uint32_t lookupUs;
+    uint32_t totalUs;
+    uint32_t detectionCount;
+    pipeline_detection_t detections[PIPELINE_MAX_DETECTIONS];
+} pipeline_result_t;
+
+// The work of each stage, called from the stage tasks with ctx
+typedef struct {
+    // Grabs a frame, false if the camera failed
+    bool (*capture)(void *ctx, pipeline_frame_t *frame);
+    // Gives a frame back to the source once inference is done with it
+    void (*release)(void *ctx, pipeline_frame_t *frame);
+    // Runs the model on a frame and fills in the detections, false if the
+    // model failed
+    bool (*infer)(void *ctx, const pipeline_frame_t *frame,
+                  pipeline_detection_t *detections, uint32_t *count);
+    // Nutrition lookup of a label, false if it failed
+    bool (*lookup)(void *ctx, const char *label, float *calories);
+    void *ctx;
+} pipeline_stages_t;
+
+// Capture, inference and lookup on their own tasks, connected by bounded
+// queues. submit() and poll() are for one task only (the main loop) and never
+// block; results of the attempts of a request come back as they happen, the
+// last one with final set.
+class DetectionPipeline
+{
+  public:
+    DetectionPipeline();
+    ~DetectionPipeline();
+
+    // Creates the queues and starts the stage tasks, once
+    bool start(const pipeline_stages_t &stages);
+
+    // Stops the stage tasks, requests in flight are dropped
+    void stop();
+
+    // Queues a capture request, false if PIPELINE_MAX_JOBS are in flight
+    bool submit(uint32_t *job = nullptr);
+
+    // Takes the next result, false if there is none yet
+    bool poll(pipeline_result_t &result);
+
+    uint32_t inFlight() const { return jobsInFlight; }
+
+  private:
+    struct Job {
+        uint32_t id;
+        uint8_t attempt;
+        uint64_t submittedUs;
+    };
+
+    struct CapturedFrame {
+        Job job;
+        uint32_t captureUs;
+        pipeline_frame_t frame;
+    };
+
+    pipeline_stages_t stages;
+    std::atomic<bool> running;
+    uint32_t nextJob;
+    uint32_t jobsInFlight;
+
+    StageQueue jobs;
+    StageQueue frames;
+    StageQueue lookups;
+    StageQueue results;
+
+    StageTask captureTask;
+    StageTask inferTask;
+    StageTask lookupTask;
+
+    static void captureMain(void *arg);
+    static void inferMain(void *arg);
+    static void lookupMain(void *arg);
+
+    bool sendWhileRunning(StageQueue &queue, const void *item);
+    void attemptFailed(const Job &job, pipeline_result_t &result);
+    void finish(pipeline_result_t &result);
+
+    DetectionPipeline(const DetectionPipeline &) = delete;
+    DetectionPipeline &operator=(const DetectionPipeline &) = delete;
+};
+
+#endif
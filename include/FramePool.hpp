@@ -0,0 +1,72 @@
+#ifndef FRAME_POOL_HPP
+#define FRAME_POOL_HPP
+
+#include "StageRuntime.hpp"
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// One bit per slot in the map of the slots that are out
+#define FRAME_POOL_MAX_SLOTS 32
+
+typedef struct {
+    uint32_t slots;
+    uint32_t inUse;
+    uint32_t peakInUse;
+    uint32_t acquires;
+    // Acquires that found no free slot, and those that gave up waiting
+    uint32_t waits;
+    uint32_t timeouts;
+    uint32_t waitMaxUs;
+    uint64_t waitTotalUs;
+} frame_pool_stats_t;
+
+// A fixed number of equally sized frame buffers, allocated once with
+// stageAllocBuffer (PSRAM on the ESP32) and reused for every frame. A slot
+// belongs to whoever acquired it until it is released, which may be on
+// another task: the frame source acquires it, the stage that is done with the
+// frame releases it.
+class FramePool
+{
+  public:
+    FramePool();
+    ~FramePool();
+
+    // Allocates the slots, once, up to FRAME_POOL_MAX_SLOTS
+    bool init(size_t slotCount, size_t slotSize);
+
+    // A free slot, waiting up to timeoutMs for one, nullptr on timeout
+    uint8_t *acquire(uint32_t timeoutMs);
+
+    // Gives a slot back, false if it is not one of the pool's or is not out
+    // (released twice)
+    bool release(uint8_t *slot);
+
+    size_t slotSize() const { return size; }
+
+    void stats(frame_pool_stats_t &stats) const;
+
+  private:
+    uint8_t *memory;
+    size_t count;
+    size_t size;
+    StageQueue freeSlots;
+    // Bit i set while slot i is out
+    std::atomic<uint32_t> outSlots;
+
+    std::atomic<uint32_t> inUse;
+    std::atomic<uint32_t> peakInUse;
+    std::atomic<uint32_t> acquires;
+    std::atomic<uint32_t> waits;
+    std::atomic<uint32_t> timeouts;
+    std::atomic<uint32_t> waitMaxUs;
+    std::atomic<uint64_t> waitTotalUs;
+
+    void acquired(uint8_t *slot);
+
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+};
+
+#endif
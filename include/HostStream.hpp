@@ -0,0 +1,19 @@
+#ifndef HOST_STREAM_HPP
+#define HOST_STREAM_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Stand-in for the Arduino Stream on host builds (see bench/), only the part
+// of the interface CommandHandler uses
+class Stream
+{
+  public:
+    virtual ~Stream() = default;
+
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+};
+
+#endif
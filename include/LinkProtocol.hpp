@@ -0,0 +1,140 @@
+#ifndef LINK_PROTOCOL_HPP
+#define LINK_PROTOCOL_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary framing of the serial link to the controller, negotiated with the
+// text command LINK <baud> once the link is synced (HELLO/READY):
+//
+//   0xA5 | type | seq | length (u16 LE) | payload | CRC16 (u16 LE)
+//
+// The CRC (CCITT, polynomial 0x1021, initial value 0xFFFF) covers type, seq,
+// length and payload. Each side numbers its frames with its own seq, the
+// receiver counts the frames it missed. Bytes outside a frame are still read
+// as text commands, the start byte never occurs in them.
+
+#define LINK_FRAME_START 0xA5
+#define LINK_FRAME_OVERHEAD 7
+#define LINK_MAX_PAYLOAD 256
+
+// Baud rate of the text link, before and after the binary one
+#define LINK_TEXT_BAUD 115200
+
+// The binary link falls back to text at LINK_TEXT_BAUD without a valid frame
+// from the controller for this long (it keeps the link alive with STATUS), or
+// after this many bad frames in a row, e.g. when the controller was reset to
+// the text baud rate
+#define LINK_IDLE_TIMEOUT_MS 10000
+#define LINK_BAD_FRAME_BURST 8
+
+typedef enum {
+    // Payload is a command line as sent in text mode, without the newline
+    LINK_MSG_COMMAND = 0x01,
+    // Payload is a detection list, see linkPutDetection
+    LINK_MSG_DETECTIONS = 0x02,
+} link_msg_t;
+
+uint16_t linkCrc16(uint16_t crc, const uint8_t *data, size_t length);
+
+// Whether the binary link may run at this baud rate
+bool linkBaudSupported(uint32_t baud);
+
+// Writes the frame header to out (5 bytes) and returns its CRC, to be
+// continued over the payload with linkCrc16 and appended little endian
+uint16_t linkFrameHeader(uint8_t type, uint8_t seq, uint16_t length,
+                         uint8_t *out);
+
+// Detection list payload: a count byte followed by, per detection, the label
+// length, the label, the score scaled to 0..255 and x, y, width, height as
+// u16 LE in model input pixels. Returns the bytes written or 0 if the
+// detection does not fit in room.
+size_t linkPutDetection(uint8_t *out, size_t room, const char *label,
+                        float value, uint32_t x, uint32_t y, uint32_t width,
+                        uint32_t height);
+
+// Incremental frame parser, fed one byte at a time
+class LinkFrameDecoder
+{
+  public:
+    typedef enum {
+        LINK_NEED_MORE = 0, // Byte consumed, frame not complete
+        LINK_FRAME_OK,      // Frame complete and valid, see type()/payload()
+        LINK_ERR_CRC,       // Frame dropped, CRC mismatch
+        LINK_ERR_LENGTH,    // Frame dropped, payload too long
+    } status_t;
+
+    LinkFrameDecoder();
+
+    // Feeds one byte, must only be called with LINK_FRAME_START while idle()
+    status_t push(uint8_t byte);
+
+    // No frame in progress
+    bool idle() const { return state == STATE_START; }
+
+    uint8_t type() const { return frameType; }
+    uint8_t seq() const { return frameSeq; }
+    uint16_t length() const { return frameLength; }
+
+    // Payload of the last frame, with a spare byte for a terminator, valid
+    // until the next push
+    uint8_t *payload() { return buffer; }
+
+    // Frames received intact, frames skipped in the sender's sequence
+    // numbers and frames dropped
+    uint32_t validFrames() const { return valid; }
+    uint32_t lostFrames() const { return lost; }
+    uint32_t badFrames() const { return bad; }
+
+    // Forgets the sequence numbers, the next frame starts a new count
+    void reset();
+
+  private:
+    typedef enum {
+        STATE_START,
+        STATE_TYPE,
+        STATE_SEQ,
+        STATE_LENGTH_LO,
+        STATE_LENGTH_HI,
+        STATE_PAYLOAD,
+        STATE_CRC_LO,
+        STATE_CRC_HI,
+    } state_t;
+
+    state_t state;
+    uint8_t frameType;
+    uint8_t frameSeq;
+    uint16_t frameLength;
+    uint16_t received;
+    uint16_t crc;
+    uint16_t frameCrc;
+
+    bool synced;
+    uint8_t nextSeq;
+    uint32_t valid;
+    uint32_t lost;
+    uint32_t bad;
+
+    uint8_t buffer[LINK_MAX_PAYLOAD + 1];
+};
+
+// Tells when the controller stopped talking binary frames, see
+// LINK_IDLE_TIMEOUT_MS. Times are in ms and may wrap.
+class LinkWatchdog
+{
+  public:
+    LinkWatchdog();
+
+    // Starts watching a decoder, when the link turns binary
+    void start(const LinkFrameDecoder &decoder, uint32_t nowMs);
+
+    // Whether the link should fall back to text
+    bool expired(const LinkFrameDecoder &decoder, uint32_t nowMs);
+
+  private:
+    uint32_t valid;
+    uint32_t bad;
+    uint32_t lastFrameMs;
+};
+
+#endif
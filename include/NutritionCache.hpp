@@ -0,0 +1,119 @@
+#ifndef NUTRITION_CACHE_HPP
+#define NUTRITION_CACHE_HPP
+
+#include "StageRuntime.hpp"
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Labels cached at once, the model has a handful
+#define NUTRITION_CACHE_SIZE 8
+#define NUTRITION_LABEL_SIZE 24
+// How long a fetched value is served without asking the API again
+#define NUTRITION_CACHE_TTL_MS (60UL * 60UL * 1000UL)
+// Wait before a failed revalidation of a label is tried again
+#define NUTRITION_RETRY_MS (10UL * 1000UL)
+
+// Where values come from, the API on the device
+typedef struct {
+    // Calories of a label, false if the request failed. Never called
+    // concurrently.
+    bool (*fetch)(void *ctx, const char *label, float *calories);
+    void *ctx;
+} nutrition_source_t;
+
+typedef struct {
+    uint32_t hits;
+    // Served past their TTL while a revalidation was queued
+    uint32_t staleHits;
+    uint32_t misses;
+    uint32_t fetches;
+    uint32_t fetchFailures;
+    uint32_t revalidations;
+    uint32_t entries;
+} nutrition_cache_stats_t;
+
+// Label -> calories in front of the API. A hit costs no request. A value past
+// its TTL is still served, and refreshed by a background task. Only a label
+// never seen before waits for the API.
+class NutritionCache
+{
+  public:
+    NutritionCache();
+    ~NutritionCache();
+
+    // Starts the revalidation task, once
+    bool start(const nutrition_source_t &source,
+               uint32_t ttlMs = NUTRITION_CACHE_TTL_MS);
+
+    // Stops the revalidation task, queued revalidations are dropped
+    void stop();
+
+    // Calories of a label, fetched in the calling task on a miss. False if
+    // it is not cached and the fetch failed.
+    bool lookup(const char *label, float *calories);
+
+    // Fetches the labels that are not cached yet and queues a revalidation
+    // of the stale ones, returns how many labels have a value
+    size_t warm(const char *const *labels, size_t count);
+
+    // "<label> <calories>" lines, for persisting the cache. Returns the
+    // length, 0 if out is too small.
+    size_t save(char *out, size_t size);
+
+    // Entries from save(), stale until revalidated as nothing tells how old
+    // they are. Returns how many were loaded.
+    size_t load(const char *text, size_t length);
+
+    // Changes with every value added or changed, tells when to save again
+    uint32_t generation() const { return changes; }
+
+    void stats(nutrition_cache_stats_t &stats);
+
+  private:
+    struct Entry {
+        char label[NUTRITION_LABEL_SIZE];
+        float calories;
+        bool used;
+        // Fetched at least once since start() (loaded entries are stale)
+        bool fetched;
+        bool revalidating;
+        uint64_t fetchedUs;
+        uint64_t failedUs;
+        uint64_t lastUsedUs;
+    };
+
+    struct Revalidation {
+        char label[NUTRITION_LABEL_SIZE];
+    };
+
+    nutrition_source_t source;
+    uint64_t ttlUs;
+    std::atomic<bool> running;
+    std::atomic<uint32_t> changes;
+
+    StageLock entriesLock;
+    // Held through a whole request to the source, hundreds of ms on the
+    // device. A miss in lookup() and warm() wait on it, so the main loop only
+    // calls them where that wait is fine (INIT).
+    StageLock fetchLock;
+    Entry entries[NUTRITION_CACHE_SIZE];
+    nutrition_cache_stats_t counters;
+
+    StageQueue revalidations;
+    StageTask revalidateTask;
+
+    static void revalidateMain(void *arg);
+
+    Entry *find(const char *label);
+    Entry *insert(const char *label);
+    bool fetch(const char *label, float *calories);
+    void store(const char *label, float calories);
+    void queueRevalidation(Entry *entry, uint64_t now);
+
+    NutritionCache(const NutritionCache &) = delete;
+    NutritionCache &operator=(const NutritionCache &) = delete;
+};
+
+#endif
@@ -27,6 +27,8 @@ class SDReader
 
     String readFile(String path);
 
+    bool writeFile(String path, const String &content);
+
   private:
     String _defaultConfig = "SSID=\n"
                             "Password=\n"
@@ -0,0 +1,89 @@
+#ifndef STAGE_RUNTIME_HPP
+#define STAGE_RUNTIME_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Tasks and bounded queues the pipeline stages run on, FreeRTOS on the ESP32
+// (StageRuntimeFreeRTOS.cpp) and std::thread on the host
+// (StageRuntimeThread.cpp). Everything is allocated in init()/start(), never
+// while frames flow.
+
+#define STAGE_WAIT_FOREVER UINT32_MAX
+
+// Fixed-size items copied in and out, send blocks while the queue is full
+class StageQueue
+{
+  public:
+    StageQueue() : impl(nullptr) {}
+    ~StageQueue();
+
+    bool init(size_t itemSize, size_t capacity);
+
+    // Both return false if the timeout (ms) expires first
+    bool send(const void *item, uint32_t timeoutMs);
+    bool receive(void *item, uint32_t timeoutMs);
+
+    size_t waiting() const;
+
+  private:
+    void *impl;
+
+    StageQueue(const StageQueue &) = delete;
+    StageQueue &operator=(const StageQueue &) = delete;
+};
+
+// Mutual exclusion between stages. Most locks guard shared state and are
+// held briefly, but one may also serialize a blocking call, so the class
+// owning a lock says how long it is held.
+class StageLock
+{
+  public:
+    StageLock() : impl(nullptr) {}
+    ~StageLock();
+
+    bool init();
+
+    void lock();
+    void unlock();
+
+  private:
+    void *impl;
+
+    StageLock(const StageLock &) = delete;
+    StageLock &operator=(const StageLock &) = delete;
+};
+
+typedef void (*StageFunction)(void *arg);
+
+// One stage, runs fn(arg) until it returns
+class StageTask
+{
+  public:
+    StageTask() : impl(nullptr) {}
+    ~StageTask();
+
+    // core is a hint, -1 for any; stackSize and priority only apply on the
+    // ESP32
+    bool start(const char *name, StageFunction fn, void *arg,
+               uint32_t stackSize, int priority, int core);
+
+    // Waits for fn to return
+    void join();
+
+  private:
+    void *impl;
+
+    StageTask(const StageTask &) = delete;
+    StageTask &operator=(const StageTask &) = delete;
+};
+
+// Microseconds since boot, for stage timings
+uint64_t stageMicros();
+
+// Long-lived buffers handed between stages (frames), from PSRAM on the ESP32
+// when there is some
+void *stageAllocBuffer(size_t size);
+void stageFreeBuffer(void *buffer);
+
+#endif
@@ -78,6 +78,116 @@
     #define ESP_NN                                  1
 #endif
 
+// AVX2 / AVX-VNNI int8 conv and depthwise conv kernels on x86-64 hosts (picked at runtime, bit-exact with reference)
+#ifndef EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD
+    #if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+        #define EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD    1
+    #else
+        #define EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD    0
+    #endif
+#endif // EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD
+
+// NEON int8 requantization (and the add built on it) on AArch64 hosts (bit-exact with reference)
+#ifndef EI_CLASSIFIER_TFLITE_ENABLE_NEON
+    #if defined(__ARM_NEON) && defined(__aarch64__)
+        #define EI_CLASSIFIER_TFLITE_ENABLE_NEON    1
+    #else
+        #define EI_CLASSIFIER_TFLITE_ENABLE_NEON    0
+    #endif
+#endif // EI_CLASSIFIER_TFLITE_ENABLE_NEON
+
+// Repack int8 1x1 conv filters at prepare time and run those layers as a blocked GEMM
+// (costs about input depth * output depth bytes of persistent memory per layer).
+// Off on the ESP32-S3 and P4, where ESP-NN has SIMD 1x1 kernels.
+#ifndef EI_CLASSIFIER_TFLITE_PREPACK_POINTWISE_CONV
+    #if defined(EI_CLASSIFIER_TFLITE_ENABLE_ESP_NN_S3) || defined(EI_CLASSIFIER_TFLITE_ENABLE_ESP_NN_P4)
+        #define EI_CLASSIFIER_TFLITE_PREPACK_POINTWISE_CONV  0
+    #else
+        #define EI_CLASSIFIER_TFLITE_PREPACK_POINTWISE_CONV  1
+    #endif
+#endif // EI_CLASSIFIER_TFLITE_PREPACK_POINTWISE_CONV
+
+// Let a prepacked 1x1 conv run the residual ADD that consumes its output in its output
+// stage, so EON compiled models skip the ADD node (reference and ESP-NN kernels only)
+#ifndef EI_CLASSIFIER_TFLITE_FUSE_RESIDUAL_ADD
+    #if EI_CLASSIFIER_TFLITE_PREPACK_POINTWISE_CONV == 1 && EI_CLASSIFIER_TFLITE_ENABLE_CMSIS_NN == 0 && \
+        EI_CLASSIFIER_TFLITE_ENABLE_ARC == 0 && EI_CLASSIFIER_TFLITE_ENABLE_SILABS_MVP != 1
+        #define EI_CLASSIFIER_TFLITE_FUSE_RESIDUAL_ADD  1
+    #else
+        #define EI_CLASSIFIER_TFLITE_FUSE_RESIDUAL_ADD  0
+    #endif
+#endif // EI_CLASSIFIER_TFLITE_FUSE_RESIDUAL_ADD
+
+// Let EON compiled models run their first, highest resolution layers band by band of
+// rows, so the arena only holds a band of the tensors between them (reference and
+// ESP-NN kernels only)
+#ifndef EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST
+    #if EI_CLASSIFIER_TFLITE_ENABLE_CMSIS_NN == 0 && EI_CLASSIFIER_TFLITE_ENABLE_ARC == 0 && \
+        EI_CLASSIFIER_TFLITE_ENABLE_SILABS_MVP != 1
+        #define EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST  1
+    #else
+        #define EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST  0
+    #endif
+#endif // EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST
+
+// Let EON compiled models call the conv and depthwise conv kernels of their nodes directly,
+// with the 3x3 ones instantiated for the stride and depths of each layer (reference and
+// ESP-NN kernels only, off on the ESP32-S3 and P4 where ESP-NN has SIMD kernels)
+#ifndef EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS
+    #if EI_CLASSIFIER_TFLITE_ENABLE_CMSIS_NN == 0 && EI_CLASSIFIER_TFLITE_ENABLE_ARC == 0 && \
+        EI_CLASSIFIER_TFLITE_ENABLE_SILABS_MVP != 1 && !defined(EI_CLASSIFIER_TFLITE_ENABLE_ESP_NN_S3) && \
+        !defined(EI_CLASSIFIER_TFLITE_ENABLE_ESP_NN_P4)
+        #define EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS  1
+    #else
+        #define EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS  0
+    #endif
+#endif // EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS
+
+// Let EON compiled image models take uint8 pixels: the input tensor becomes uint8 with zero
+// point 0 and the first conv reads it unsigned (same output), so pixels are copied into the
+// input as they are instead of having 128 subtracted (needs EON_SPECIALIZED_KERNELS)
+#ifndef EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT
+    #define EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT  0
+#endif // EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT
+
+// Let FOMO models stop before their final SOFTMAX: the decoder only runs it for the cells
+// whose logits can reach the threshold (same boxes and confidences, see ei_fill_result_struct.h)
+#ifndef EI_CLASSIFIER_FOMO_LOGIT_DECODE
+    #define EI_CLASSIFIER_FOMO_LOGIT_DECODE  0
+#endif // EI_CLASSIFIER_FOMO_LOGIT_DECODE
+
+// Keep EON compiled models initialized between inferences (arena stays resident)
+#ifndef EI_CLASSIFIER_TFLITE_EON_PERSISTENT_SESSION
+    #define EI_CLASSIFIER_TFLITE_EON_PERSISTENT_SESSION  0
+#endif // EI_CLASSIFIER_TFLITE_EON_PERSISTENT_SESSION
+
+// Let EON compiled models report every layer to an ei::LayerProfiler (see ei_layer_profiler.h)
+#ifndef EI_CLASSIFIER_TFLITE_EON_PROFILE
+    #define EI_CLASSIFIER_TFLITE_EON_PROFILE  0
+#endif // EI_CLASSIFIER_TFLITE_EON_PROFILE
+
+// Let run_classifier_batch() spread frames over worker threads (needs std::thread)
+#ifndef EI_CLASSIFIER_BATCH_THREADS
+    #if defined(__linux__) || defined(__APPLE__) || defined(_WIN32)
+        #define EI_CLASSIFIER_BATCH_THREADS  1
+    #else
+        #define EI_CLASSIFIER_BATCH_THREADS  0
+    #endif
+#endif // EI_CLASSIFIER_BATCH_THREADS
+
+// Threads the conv, depthwise conv and add kernels split one layer over (calling thread
+// included, see ei_thread_pool.h). 0 is one per hardware thread. Dual core ESP32s use
+// the second core, other MCUs run every layer on the calling thread.
+#ifndef EI_CLASSIFIER_TFLITE_THREADS
+    #if defined(__linux__) || defined(__APPLE__) || defined(_WIN32)
+        #define EI_CLASSIFIER_TFLITE_THREADS  0
+    #elif defined(ESP32) && !defined(CONFIG_FREERTOS_UNICORE)
+        #define EI_CLASSIFIER_TFLITE_THREADS  2
+    #else
+        #define EI_CLASSIFIER_TFLITE_THREADS  1
+    #endif
+#endif // EI_CLASSIFIER_TFLITE_THREADS
+
 // no include checks in the compiler? then just include metadata and then ops_define (optional if on EON model)
 #ifndef __has_include
     #include "model-parameters/model_metadata.h"
@@ -199,6 +199,12 @@ typedef struct {
      * `EI_CLASSIFIER_HAS_ANOMALY == 1`.
      */
     int64_t anomaly_us;
+
+    /**
+     * Amount of time (in microseconds) it took to turn the model output into results
+     * (e.g. decoding bounding boxes) and to run the post-processing blocks
+     */
+    int64_t postprocessing_us;
 } ei_impulse_result_timing_t;
 
 /**
@@ -242,6 +248,30 @@ typedef struct {
      */
     uint32_t bounding_boxes_count;
 
+    /**
+     * Caller-owned storage the bounding boxes are written to, taken from the
+     * `ei_impulse_handle_t` when the classifier runs. If NULL, `bounding_boxes` points
+     * into storage of the SDK that is overwritten by the next inference.
+     */
+    ei_impulse_result_bounding_box_t *bounding_boxes_buffer;
+
+    /**
+     * Number of bounding boxes that fit in `bounding_boxes_buffer`.
+     */
+    uint32_t bounding_boxes_capacity;
+
+    /**
+     * More objects were detected than fit in `bounding_boxes_buffer`, the boxes
+     * past `bounding_boxes_capacity` were dropped.
+     */
+    bool bounding_boxes_truncated;
+
+    /**
+     * Caller-owned scratch space the decoders of the model output use while the result is
+     * filled. If NULL, they use state of the SDK that every such inference shares.
+     */
+    struct ei_impulse_scratch *scratch;
+
     /**
      * Array of classification results. If object detection is enabled, this will be
      * empty.
@@ -302,6 +332,36 @@ typedef struct {
 #endif
 } ei_impulse_result_t;
 
+/**
+ * @brief Options of `run_classifier_batch()`.
+ *
+ * A zero-initialised struct runs the batch on the calling thread.
+ */
+typedef struct {
+    /**
+     * Worker threads that invoke the model, each with a model instance of its own. 0 or 1
+     * runs the batch on the calling thread. Ignored without EI_CLASSIFIER_BATCH_THREADS.
+     */
+    uint32_t threads;
+
+    /**
+     * Quantize the next frames on the calling thread while the workers invoke the model,
+     * instead of every worker quantizing its own frames.
+     */
+    bool pipeline;
+
+    /**
+     * Storage for the bounding boxes of the results, `bounding_boxes_per_result` boxes for
+     * every result. Needed for object detection, the storage of the SDK only holds one result.
+     */
+    ei_impulse_result_bounding_box_t *bounding_boxes;
+
+    /**
+     * Number of bounding boxes per result in `bounding_boxes`.
+     */
+    uint32_t bounding_boxes_per_result;
+} ei_impulse_batch_config_t;
+
 /** @} */
 
 #endif // _EDGE_IMPULSE_RUN_CLASSIFIER_TYPES_H_
@@ -25,6 +25,7 @@ using namespace ei;
 #include "edge-impulse-sdk/classifier/ei_classifier_types.h"
 #include "edge-impulse-sdk/classifier/ei_nms.h"
 #include "edge-impulse-sdk/dsp/ei_vector.h"
+#include "edge-impulse-sdk/classifier/ei_classifier_config.h"
 
 #ifndef EI_HAS_OBJECT_DETECTION
     #if (EI_CLASSIFIER_OBJECT_DETECTION_LAST_LAYER == EI_CLASSIFIER_LAST_LAYER_SSD)
@@ -59,20 +60,65 @@ using namespace ei;
     #endif
 #endif
 
+#if defined(EI_HAS_FOMO) && EI_CLASSIFIER_FOMO_LOGIT_DECODE == 1
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/reference/softmax.h"
+#endif
+
 __attribute__((unused)) inline float sigmoid(float a) {
     return 1.0f / (1.0f + exp(-a));
 }
 
+/**
+ * Clear a result before inference, keeping the bounding box storage and scratch it was given
+ */
+__attribute__((unused)) static void ei_impulse_result_clear(ei_impulse_result_t *result) {
+    ei_impulse_result_bounding_box_t *boxes = result->bounding_boxes_buffer;
+    uint32_t box_capacity = result->bounding_boxes_capacity;
+    struct ei_impulse_scratch *scratch = result->scratch;
+
+    memset(result, 0, sizeof(ei_impulse_result_t));
+    result->bounding_boxes_buffer = boxes;
+    result->bounding_boxes_capacity = box_capacity;
+    result->scratch = scratch;
+}
+
 #ifdef EI_HAS_FOMO
+// Above-threshold cells of the heat map bound the number of cubes
+#ifndef EI_CLASSIFIER_FOMO_MAX_CUBES
+#define EI_CLASSIFIER_FOMO_MAX_CUBES    ((EI_CLASSIFIER_NN_OUTPUT_COUNT / (EI_CLASSIFIER_LABEL_COUNT + 1)) * EI_CLASSIFIER_LABEL_COUNT)
+#endif
+
+// Every cube can end up as a box, and at least object_detection_count are returned
+#ifndef EI_CLASSIFIER_FOMO_MAX_BOXES
+#if EI_CLASSIFIER_FOMO_MAX_CUBES > EI_CLASSIFIER_OBJECT_DETECTION_COUNT
+#define EI_CLASSIFIER_FOMO_MAX_BOXES    EI_CLASSIFIER_FOMO_MAX_CUBES
+#else
+#define EI_CLASSIFIER_FOMO_MAX_BOXES    EI_CLASSIFIER_OBJECT_DETECTION_COUNT
+#endif
+#endif
+
+#define EI_FOMO_CUBE_NONE               0xffff
+
 typedef struct cube {
-    size_t x;
-    size_t y;
-    size_t width;
-    size_t height;
+    uint8_t x;
+    uint8_t y;
+    uint8_t width;
+    uint8_t height;
+    uint16_t label_ix;
+    uint16_t next; // next cube of the same label, EI_FOMO_CUBE_NONE at the end
     float confidence;
-    const char *label;
 } ei_classifier_cube_t;
 
+/**
+ * Scratch space of the FOMO decoder, cubes are kept in the order they were created
+ */
+typedef struct {
+    ei_classifier_cube_t cubes[EI_CLASSIFIER_FOMO_MAX_CUBES];
+    uint16_t cube_count;
+    uint16_t head[EI_CLASSIFIER_LABEL_COUNT];
+    uint16_t tail[EI_CLASSIFIER_LABEL_COUNT];
+} ei_fomo_decoder_t;
+
 /**
  * Checks whether a new section overlaps with a cube,
  * and if so, will **update the cube**
@@ -110,56 +156,76 @@ __attribute__((unused)) static bool ei_cube_check_overlap(ei_classifier_cube_t *
     return true;
 }
 
-__attribute__((unused)) static void ei_handle_cube(std::vector<ei_classifier_cube_t*> *cubes, int x, int y, float vf, const char *label, float detection_threshold) {
-    if (vf < detection_threshold) return;
+/**
+ * Merge an above-threshold cell into the first overlapping cube of its label, or start a new cube
+ */
+__attribute__((unused)) static bool ei_handle_cube(ei_fomo_decoder_t *decoder, int x, int y, float vf, uint16_t label_ix) {
+    for (uint16_t ix = decoder->head[label_ix]; ix != EI_FOMO_CUBE_NONE; ix = decoder->cubes[ix].next) {
+        if (ei_cube_check_overlap(&decoder->cubes[ix], x, y, 1, 1, vf)) {
+            return true;
+        }
+    }
 
-    bool has_overlapping = false;
-    int width = 1;
-    int height = 1;
+    if (decoder->cube_count >= EI_CLASSIFIER_FOMO_MAX_CUBES) {
+        return false;
+    }
 
-    for (auto c : *cubes) {
-        // not cube for same class? continue
-        if (strcmp(c->label, label) != 0) continue;
+    uint16_t cube_ix = decoder->cube_count++;
+    ei_classifier_cube_t *cube = &decoder->cubes[cube_ix];
+    cube->x = x;
+    cube->y = y;
+    cube->width = 1;
+    cube->height = 1;
+    cube->label_ix = label_ix;
+    cube->next = EI_FOMO_CUBE_NONE;
+    cube->confidence = vf;
+
+    if (decoder->head[label_ix] == EI_FOMO_CUBE_NONE) {
+        decoder->head[label_ix] = cube_ix;
+    }
+    else {
+        decoder->cubes[decoder->tail[label_ix]].next = cube_ix;
+    }
+    decoder->tail[label_ix] = cube_ix;
+    return true;
+}
 
-        if (ei_cube_check_overlap(c, x, y, width, height, vf)) {
-            has_overlapping = true;
-            break;
-        }
+/**
+ * Reset the decoder, returns false if the impulse doesn't fit its scratch space
+ */
+__attribute__((unused)) static bool ei_fomo_decoder_init(ei_fomo_decoder_t *decoder, const ei_impulse_t *impulse, int out_width, int out_height) {
+    if (impulse->label_count > EI_CLASSIFIER_LABEL_COUNT || out_width > 255 || out_height > 255) {
+        return false;
     }
 
-    if (!has_overlapping) {
-        ei_classifier_cube_t *cube = new ei_classifier_cube_t();
-        cube->x = x;
-        cube->y = y;
-        cube->width = 1;
-        cube->height = 1;
-        cube->confidence = vf;
-        cube->label = label;
-        cubes->push_back(cube);
+    decoder->cube_count = 0;
+    for (size_t ix = 0; ix < impulse->label_count; ix++) {
+        decoder->head[ix] = EI_FOMO_CUBE_NONE;
     }
+    return true;
 }
 
-__attribute__((unused)) static void fill_result_struct_from_cubes(ei_impulse_result_t *result, std::vector<ei_classifier_cube_t*> *cubes, int out_width_factor, uint32_t object_detection_count) {
-    std::vector<ei_classifier_cube_t*> bbs;
-    static std::vector<ei_impulse_result_bounding_box_t> results;
-    int added_boxes_count = 0;
-    results.clear();
+/**
+ * Merges overlapping cubes of the same label (in creation order) and writes a box for every
+ * cube that's left. Writes up to box_capacity boxes, padded with empty boxes up to
+ * object_detection_count, and returns the number of detected boxes.
+ */
+__attribute__((unused)) static size_t fill_result_struct_from_cubes(ei_fomo_decoder_t *decoder, const ei_impulse_t *impulse,
+                                                                    ei_impulse_result_bounding_box_t *boxes, size_t box_capacity,
+                                                                    int out_width_factor) {
+    size_t added_boxes_count = 0;
+
+    // reuse the label chains for the cubes that were turned into boxes
+    for (size_t ix = 0; ix < impulse->label_count; ix++) {
+        decoder->head[ix] = EI_FOMO_CUBE_NONE;
+    }
 
-    for (auto sc : *cubes) {
+    for (uint16_t sc_ix = 0; sc_ix < decoder->cube_count; sc_ix++) {
+        ei_classifier_cube_t *sc = &decoder->cubes[sc_ix];
         bool has_overlapping = false;
 
-        int x = sc->x;
-        int y = sc->y;
-        int width = sc->width;
-        int height = sc->height;
-        const char *label = sc->label;
-        float vf = sc->confidence;
-
-        for (auto c : bbs) {
-            // not cube for same class? continue
-            if (strcmp(c->label, label) != 0) continue;
-
-            if (ei_cube_check_overlap(c, x, y, width, height, vf)) {
+        for (uint16_t ix = decoder->head[sc->label_ix]; ix != EI_FOMO_CUBE_NONE; ix = decoder->cubes[ix].next) {
+            if (ei_cube_check_overlap(&decoder->cubes[ix], sc->x, sc->y, sc->width, sc->height, sc->confidence)) {
                 has_overlapping = true;
                 break;
             }
@@ -169,38 +235,102 @@ __attribute__((unused)) static void fill_result_struct_from_cubes(ei_impulse_res
             continue;
         }
 
-        bbs.push_back(sc);
-
-        ei_impulse_result_bounding_box_t tmp = {
-            .label = sc->label,
-            .x = (uint32_t)(sc->x * out_width_factor),
-            .y = (uint32_t)(sc->y * out_width_factor),
-            .width = (uint32_t)(sc->width * out_width_factor),
-            .height = (uint32_t)(sc->height * out_width_factor),
-            .value = sc->confidence
-        };
-
-        results.push_back(tmp);
+        sc->next = EI_FOMO_CUBE_NONE;
+        if (decoder->head[sc->label_ix] == EI_FOMO_CUBE_NONE) {
+            decoder->head[sc->label_ix] = sc_ix;
+        }
+        else {
+            decoder->cubes[decoder->tail[sc->label_ix]].next = sc_ix;
+        }
+        decoder->tail[sc->label_ix] = sc_ix;
+
+        if (added_boxes_count < box_capacity) {
+            ei_impulse_result_bounding_box_t *bb = &boxes[added_boxes_count];
+            bb->label = impulse->categories[sc->label_ix];
+            bb->x = (uint32_t)(sc->x * out_width_factor);
+            bb->y = (uint32_t)(sc->y * out_width_factor);
+            bb->width = (uint32_t)(sc->width * out_width_factor);
+            bb->height = (uint32_t)(sc->height * out_width_factor);
+            bb->value = sc->confidence;
+        }
         added_boxes_count++;
     }
 
     // if we didn't detect min required objects, fill the rest with fixed value
-    if (added_boxes_count < object_detection_count) {
-        results.resize(object_detection_count);
-        for (size_t ix = added_boxes_count; ix < object_detection_count; ix++) {
-            results[ix].value = 0.0f;
-        }
+    for (size_t ix = added_boxes_count; ix < impulse->object_detection_count && ix < box_capacity; ix++) {
+        memset(&boxes[ix], 0, sizeof(ei_impulse_result_bounding_box_t));
     }
 
-    for (auto c : *cubes) {
-        delete c;
+    return added_boxes_count;
+}
+
+/**
+ * Boxes of the last FOMO result whose caller didn't provide storage, result->bounding_boxes points in here
+ */
+__attribute__((unused)) static ei_impulse_result_bounding_box_t *ei_fomo_result_boxes() {
+    static ei_impulse_result_bounding_box_t boxes[EI_CLASSIFIER_FOMO_MAX_BOXES];
+    return boxes;
+}
+
+/**
+ * Write the boxes of the decoded cubes into the caller's storage of the result, or into the
+ * storage of the SDK if the caller didn't set any. Only the caller's storage can be truncated.
+ */
+__attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_fomo_boxes(ei_fomo_decoder_t *decoder,
+                                                                              const ei_impulse_t *impulse,
+                                                                              ei_impulse_result_t *result,
+                                                                              int out_width_factor) {
+    ei_impulse_result_bounding_box_t *boxes = result->bounding_boxes_buffer;
+    size_t box_capacity = result->bounding_boxes_capacity;
+    if (!boxes) {
+        boxes = ei_fomo_result_boxes();
+        box_capacity = EI_CLASSIFIER_FOMO_MAX_BOXES;
     }
 
-    result->bounding_boxes = results.data();
-    result->bounding_boxes_count = added_boxes_count;
+    size_t boxes_count = fill_result_struct_from_cubes(decoder, impulse, boxes, box_capacity, out_width_factor);
+    if (boxes_count > box_capacity) {
+        if (!result->bounding_boxes_buffer) {
+            return EI_IMPULSE_OUT_OF_MEMORY;
+        }
+        result->bounding_boxes_truncated = true;
+        boxes_count = box_capacity;
+    }
+
+    result->bounding_boxes = boxes;
+    result->bounding_boxes_count = boxes_count;
+
+    return EI_IMPULSE_OK;
 }
 #endif
 
+/**
+ * Scratch space of the decoders of the model output, for one inference at a time. Inferences
+ * given scratch of their own don't share decoder state. Zero it before the first inference.
+ */
+typedef struct ei_impulse_scratch {
+#ifdef EI_HAS_FOMO
+    ei_fomo_decoder_t fomo;
+#if EI_CLASSIFIER_FOMO_LOGIT_DECODE == 1
+    // margin of the last threshold and softmax params, the scan costs a few hundred softmax rows
+    bool margin_valid;
+    tflite::SoftmaxParams margin_params;
+    int margin_threshold_i8;
+    int margin;
+    int8_t probs[EI_CLASSIFIER_LABEL_COUNT + 1];
+#endif // EI_CLASSIFIER_FOMO_LOGIT_DECODE == 1
+#else
+    uint8_t unused;
+#endif // EI_HAS_FOMO
+} ei_impulse_scratch_t;
+
+/**
+ * Scratch of the result, or the one of the SDK if the caller didn't give any
+ */
+__attribute__((unused)) static ei_impulse_scratch_t *ei_impulse_result_scratch(ei_impulse_result_t *result) {
+    static ei_impulse_scratch_t scratch;
+    return result->scratch ? result->scratch : &scratch;
+}
+
 __attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_f32_fomo(const ei_impulse_t *impulse,
                                                                             const ei_learning_block_config_tflite_graph_t *block_config,
                                                                             ei_impulse_result_t *result,
@@ -208,31 +338,50 @@ __attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_f32_fomo(cons
                                                                             int out_width,
                                                                             int out_height) {
 #ifdef EI_HAS_FOMO
-    std::vector<ei_classifier_cube_t*> cubes;
+    ei_fomo_decoder_t &decoder = ei_impulse_result_scratch(result)->fomo;
+
+    if (!ei_fomo_decoder_init(&decoder, impulse, out_width, out_height)) {
+        return EI_IMPULSE_OUT_OF_MEMORY;
+    }
 
     int out_width_factor = impulse->input_width / out_width;
 
     for (size_t y = 0; y < out_width; y++) {
-        // ei_printf("    [ ");
         for (size_t x = 0; x < out_height; x++) {
             size_t loc = ((y * out_height) + x) * (impulse->label_count + 1);
 
             for (size_t ix = 1; ix < impulse->label_count + 1; ix++) {
                 float vf = data[loc+ix];
+                if (vf < block_config->threshold) continue;
 
-                ei_handle_cube(&cubes, x, y, vf, impulse->categories[ix - 1], block_config->threshold);
+                if (!ei_handle_cube(&decoder, x, y, vf, ix - 1)) {
+                    return EI_IMPULSE_OUT_OF_MEMORY;
+                }
             }
         }
     }
 
-    fill_result_struct_from_cubes(result, &cubes, out_width_factor, impulse->object_detection_count);
-
-    return EI_IMPULSE_OK;
+    return fill_result_struct_fomo_boxes(&decoder, impulse, result, out_width_factor);
 #else
     return EI_IMPULSE_LAST_LAYER_NOT_AVAILABLE;
 #endif
 }
 
+#ifdef EI_HAS_FOMO
+/**
+ * Dequantized confidences are monotonic in the raw value (scale > 0), so the threshold
+ * becomes the lowest raw value whose confidence reaches it (128 if none does)
+ */
+__attribute__((unused)) static int ei_fomo_threshold_i8(float threshold, float zero_point, float scale) {
+    for (int v = -128; v <= 127; v++) {
+        if (static_cast<float>(v - zero_point) * scale >= threshold) {
+            return v;
+        }
+    }
+    return 128;
+}
+#endif
+
 __attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_i8_fomo(const ei_impulse_t *impulse,
                                                                            const ei_learning_block_config_tflite_graph_t *block_config,
                                                                            ei_impulse_result_t *result,
@@ -242,32 +391,156 @@ __attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_i8_fomo(const
                                                                            int out_width,
                                                                            int out_height) {
 #ifdef EI_HAS_FOMO
-    std::vector<ei_classifier_cube_t*> cubes;
+    ei_fomo_decoder_t &decoder = ei_impulse_result_scratch(result)->fomo;
+
+    if (!ei_fomo_decoder_init(&decoder, impulse, out_width, out_height)) {
+        return EI_IMPULSE_OUT_OF_MEMORY;
+    }
+
+    int threshold_i8 = ei_fomo_threshold_i8(block_config->threshold, zero_point, scale);
+    bool monotonic = scale > 0.0f;
 
     int out_width_factor = impulse->input_width / out_width;
 
     for (size_t y = 0; y < out_width; y++) {
-        // ei_printf("    [ ");
         for (size_t x = 0; x < out_height; x++) {
             size_t loc = ((y * out_height) + x) * (impulse->label_count + 1);
 
             for (size_t ix = 1; ix < impulse->label_count + 1; ix++) {
                 int8_t v = data[loc+ix];
+                if (monotonic && v < threshold_i8) continue;
+
                 float vf = static_cast<float>(v - zero_point) * scale;
+                if (!monotonic && vf < block_config->threshold) continue;
 
-                ei_handle_cube(&cubes, x, y, vf, impulse->categories[ix - 1], block_config->threshold);
+                if (!ei_handle_cube(&decoder, x, y, vf, ix - 1)) {
+                    return EI_IMPULSE_OUT_OF_MEMORY;
+                }
             }
         }
     }
 
-    fill_result_struct_from_cubes(result, &cubes, out_width_factor, impulse->object_detection_count);
-
-    return EI_IMPULSE_OK;
+    return fill_result_struct_fomo_boxes(&decoder, impulse, result, out_width_factor);
 #else
     return EI_IMPULSE_LAST_LAYER_NOT_AVAILABLE;
 #endif
 }
 
+#if defined(EI_HAS_FOMO) && EI_CLASSIFIER_FOMO_LOGIT_DECODE == 1
+/**
+ * Smallest lead of a class logit over every other logit of its cell that lets the softmax
+ * output of the class reach threshold_i8. With a given lead the output is highest when there
+ * is only one other class, so this scans two-class rows, with one output step of slack for
+ * the fixed-point rounding. 256 if no lead does.
+ */
+__attribute__((unused)) static int ei_fomo_logit_margin(const tflite::SoftmaxParams &params, int threshold_i8) {
+    const int32_t dims[2] = { 1, 2 };
+    const tflite::RuntimeShape shape(2, dims);
+
+    for (int margin = -255; margin <= 255; margin++) {
+        int8_t row[2] = {
+            static_cast<int8_t>(margin >= 0 ? 127 : 127 + margin),
+            static_cast<int8_t>(margin >= 0 ? 127 - margin : 127)
+        };
+        int8_t out[2];
+        tflite::reference_ops::Softmax(params, shape, row, shape, out);
+        if (out[0] >= threshold_i8 - 1) {
+            return margin;
+        }
+    }
+    return 256;
+}
+
+/**
+ * Like fill_result_struct_i8_fomo, but from the int8 logits the final SOFTMAX would have run
+ * on (params, zero_point and scale are those of the softmax). Cells where no class leads the
+ * others by the margin of ei_fomo_logit_margin are skipped, the softmax runs on the rest, so
+ * the boxes and confidences are the same as from the softmax output.
+ */
+__attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_i8_fomo_logits(const ei_impulse_t *impulse,
+                                                                                  const ei_learning_block_config_tflite_graph_t *block_config,
+                                                                                  ei_impulse_result_t *result,
+                                                                                  const int8_t *logits,
+                                                                                  const tflite::SoftmaxParams &params,
+                                                                                  float zero_point,
+                                                                                  float scale,
+                                                                                  int out_width,
+                                                                                  int out_height) {
+    ei_impulse_scratch_t *scratch = ei_impulse_result_scratch(result);
+    ei_fomo_decoder_t &decoder = scratch->fomo;
+    int8_t *probs = scratch->probs;
+
+    if (!ei_fomo_decoder_init(&decoder, impulse, out_width, out_height)) {
+        return EI_IMPULSE_OUT_OF_MEMORY;
+    }
+
+    const int depth = impulse->label_count + 1;
+    int threshold_i8 = ei_fomo_threshold_i8(block_config->threshold, zero_point, scale);
+    bool monotonic = scale > 0.0f;
+
+    if (!monotonic) {
+        scratch->margin = -256;
+        scratch->margin_valid = false;
+    }
+    else if (!scratch->margin_valid || threshold_i8 != scratch->margin_threshold_i8 ||
+             params.input_multiplier != scratch->margin_params.input_multiplier ||
+             params.input_left_shift != scratch->margin_params.input_left_shift ||
+             params.diff_min != scratch->margin_params.diff_min) {
+        scratch->margin = ei_fomo_logit_margin(params, threshold_i8);
+        scratch->margin_threshold_i8 = threshold_i8;
+        scratch->margin_params = params;
+        scratch->margin_valid = true;
+    }
+    const int margin = scratch->margin;
+
+    const int32_t dims[2] = { 1, depth };
+    const tflite::RuntimeShape shape(2, dims);
+    int out_width_factor = impulse->input_width / out_width;
+
+    for (size_t y = 0; y < out_width; y++) {
+        for (size_t x = 0; x < out_height; x++) {
+            size_t loc = ((y * out_height) + x) * depth;
+            const int8_t *cell = logits + loc;
+
+            // a class leads by its logit minus the largest other one
+            int first = -129;
+            int second = -129;
+            for (int ix = 0; ix < depth; ix++) {
+                if (cell[ix] > first) {
+                    second = first;
+                    first = cell[ix];
+                }
+                else if (cell[ix] > second) {
+                    second = cell[ix];
+                }
+            }
+            bool candidate = false;
+            for (int ix = 1; ix < depth && !candidate; ix++) {
+                int lead = cell[ix] - (cell[ix] == first ? second : first);
+                candidate = lead >= margin;
+            }
+            if (!candidate) continue;
+
+            tflite::reference_ops::Softmax(params, shape, cell, shape, probs);
+
+            for (size_t ix = 1; ix < impulse->label_count + 1; ix++) {
+                int8_t v = probs[ix];
+                if (monotonic && v < threshold_i8) continue;
+
+                float vf = static_cast<float>(v - zero_point) * scale;
+                if (!monotonic && vf < block_config->threshold) continue;
+
+                if (!ei_handle_cube(&decoder, x, y, vf, ix - 1)) {
+                    return EI_IMPULSE_OUT_OF_MEMORY;
+                }
+            }
+        }
+    }
+
+    return fill_result_struct_fomo_boxes(&decoder, impulse, result, out_width_factor);
+}
+#endif // EI_HAS_FOMO && EI_CLASSIFIER_FOMO_LOGIT_DECODE == 1
+
 /**
  * Fill the result structure from an unquantized output tensor
  * (we don't support quantized here a.t.m.)
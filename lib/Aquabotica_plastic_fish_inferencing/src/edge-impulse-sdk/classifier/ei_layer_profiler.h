@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2022 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS
+ * IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language
+ * governing permissions and limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _EI_LAYER_PROFILER_H_
+#define _EI_LAYER_PROFILER_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "edge-impulse-sdk/classifier/ei_classifier_config.h"
+#include "edge-impulse-sdk/porting/ei_classifier_porting.h"
+#include "edge-impulse-sdk/tensorflow/lite/micro/compatibility.h"
+#include "edge-impulse-sdk/tensorflow/lite/micro/micro_profiler_interface.h"
+
+// Number of events kept, older events are overwritten
+#ifndef EI_LAYER_PROFILER_MAX_EVENTS
+#define EI_LAYER_PROFILER_MAX_EVENTS    256
+#endif
+
+#define EI_LAYER_PROFILER_NO_NODE       0xffff
+
+/**
+ * Static description of a layer of the graph, filled in once when the model
+ * is initialised
+ */
+typedef struct {
+    /**
+     * Index of the node in the graph, EI_LAYER_PROFILER_NO_NODE for events
+     * started with BeginEvent()
+     */
+    uint16_t node;
+    /**
+     * Operator (e.g. "CONV_2D"), or the tag passed to BeginEvent()
+     */
+    const char *op_name;
+    /**
+     * Multiply-accumulates of the layer, 0 for data movement (e.g. PAD)
+     */
+    uint64_t macs;
+    /**
+     * Bytes of the activations read by the layer
+     */
+    uint32_t input_bytes;
+    /**
+     * Bytes of the constant inputs (weights, bias, paddings)
+     */
+    uint32_t weight_bytes;
+    /**
+     * Bytes written by the layer
+     */
+    uint32_t output_bytes;
+    /**
+     * Highest offset in the tensor arena used by the tensors of the layer
+     */
+    uint32_t arena_offset;
+} ei_layer_info_t;
+
+typedef struct {
+    ei_layer_info_t layer;
+    uint64_t start_us;
+    uint32_t duration_us;
+    /**
+     * Sequence number of the event, also its handle
+     */
+    uint32_t sequence;
+} ei_layer_profile_event_t;
+
+namespace ei {
+
+/**
+ * Records every layer of an EON compiled graph in a fixed ring buffer:
+ * wall time, operator, MACs, bytes moved and arena usage. Recording does no
+ * allocation and no printing, the events are exported afterwards with
+ * LogCsv(), LogChromeTrace() or LogLayerTotalsCsv().
+ *
+ * Attach it to a graph with <model>_set_profiler() or
+ * <model>_instance_set_profiler() (needs EI_CLASSIFIER_TFLITE_EON_PROFILE=1).
+ * As a tflite::MicroProfilerInterface it also takes other sections, e.g. via
+ * tflite::ScopedMicroProfiler. Not thread safe: use one per model instance.
+ */
+class LayerProfiler : public tflite::MicroProfilerInterface {
+public:
+    LayerProfiler() = default;
+    virtual ~LayerProfiler() = default;
+
+    uint32_t BeginEvent(const char *tag) override
+    {
+        ei_layer_info_t layer = { 0 };
+        layer.node = EI_LAYER_PROFILER_NO_NODE;
+        layer.op_name = tag;
+        return BeginLayer(&layer);
+    }
+
+    void EndEvent(uint32_t event_handle) override
+    {
+        uint64_t end_us = ei_read_timer_us();
+        ei_layer_profile_event_t *event = &events_[event_handle % EI_LAYER_PROFILER_MAX_EVENTS];
+
+        // overwritten in the meantime
+        if (event->sequence != event_handle) {
+            return;
+        }
+        event->duration_us = (uint32_t)(end_us - event->start_us);
+    }
+
+    /**
+     * Marks the start of a layer, returns the handle for EndEvent()
+     */
+    uint32_t BeginLayer(const ei_layer_info_t *layer)
+    {
+        uint32_t handle = next_sequence_++;
+        ei_layer_profile_event_t *event = &events_[handle % EI_LAYER_PROFILER_MAX_EVENTS];
+
+        event->layer = *layer;
+        event->sequence = handle;
+        event->duration_us = 0;
+        event->start_us = ei_read_timer_us();
+        return handle;
+    }
+
+    void ClearEvents()
+    {
+        first_sequence_ = next_sequence_;
+    }
+
+    /**
+     * Number of events available, at most EI_LAYER_PROFILER_MAX_EVENTS
+     */
+    size_t GetEventCount() const
+    {
+        uint32_t count = next_sequence_ - first_sequence_;
+        return count > EI_LAYER_PROFILER_MAX_EVENTS ? EI_LAYER_PROFILER_MAX_EVENTS : count;
+    }
+
+    /**
+     * Number of events overwritten since the last ClearEvents()
+     */
+    uint32_t GetDroppedEventCount() const
+    {
+        return (uint32_t)(next_sequence_ - first_sequence_ - GetEventCount());
+    }
+
+    /**
+     * Event ix, oldest first
+     */
+    const ei_layer_profile_event_t *GetEvent(size_t ix) const
+    {
+        uint32_t sequence = next_sequence_ - (uint32_t)GetEventCount() + (uint32_t)ix;
+        return &events_[sequence % EI_LAYER_PROFILER_MAX_EVENTS];
+    }
+
+    /**
+     * Prints one row per event
+     */
+    void LogCsv() const
+    {
+        ei_printf("\"Event\",\"Node\",\"Op\",\"Start (us)\",\"Duration (us)\",\"MACs\",\"Input bytes\",\"Weight bytes\",\"Output bytes\",\"Arena offset\"\n");
+        for (size_t ix = 0; ix < GetEventCount(); ix++) {
+            const ei_layer_profile_event_t *event = GetEvent(ix);
+            ei_printf("%lu,%d,%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+                (unsigned long)event->sequence, NodeForCsv(event), event->layer.op_name,
+                (unsigned long)(event->start_us - GetEvent(0)->start_us), (unsigned long)event->duration_us,
+                (unsigned long)event->layer.macs, (unsigned long)event->layer.input_bytes,
+                (unsigned long)event->layer.weight_bytes, (unsigned long)event->layer.output_bytes,
+                (unsigned long)event->layer.arena_offset);
+        }
+    }
+
+    /**
+     * Prints the events in the Chrome trace event format, to load in
+     * chrome://tracing or Perfetto
+     */
+    void LogChromeTrace() const
+    {
+        ei_printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        for (size_t ix = 0; ix < GetEventCount(); ix++) {
+            const ei_layer_profile_event_t *event = GetEvent(ix);
+            ei_printf("%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":%lu,\"dur\":%lu,"
+                "\"args\":{\"node\":%d,\"macs\":%lu,\"input_bytes\":%lu,\"weight_bytes\":%lu,\"output_bytes\":%lu,\"arena_offset\":%lu}}",
+                ix == 0 ? "" : ",", event->layer.op_name,
+                event->layer.node == EI_LAYER_PROFILER_NO_NODE ? "section" : "layer",
+                (unsigned long)(event->start_us - GetEvent(0)->start_us), (unsigned long)event->duration_us,
+                NodeForCsv(event), (unsigned long)event->layer.macs, (unsigned long)event->layer.input_bytes,
+                (unsigned long)event->layer.weight_bytes, (unsigned long)event->layer.output_bytes,
+                (unsigned long)event->layer.arena_offset);
+        }
+        ei_printf("\n]}\n");
+    }
+
+    /**
+     * Prints one row per node with the time summed over all its events, and
+     * its share of the time of all nodes
+     */
+    void LogLayerTotalsCsv() const
+    {
+        uint64_t total_us = 0;
+        uint16_t node_count = 0;
+
+        for (size_t ix = 0; ix < GetEventCount(); ix++) {
+            const ei_layer_profile_event_t *event = GetEvent(ix);
+            if (event->layer.node != EI_LAYER_PROFILER_NO_NODE) {
+                total_us += event->duration_us;
+                if (event->layer.node >= node_count) {
+                    node_count = event->layer.node + 1;
+                }
+            }
+        }
+
+        ei_printf("\"Node\",\"Op\",\"Count\",\"Total (us)\",\"Mean (us)\",\"Share (%%)\",\"MACs\",\"MACs/us\",\"Arena offset\"\n");
+        for (uint16_t node = 0; node < node_count; node++) {
+            const ei_layer_info_t *layer = nullptr;
+            uint64_t node_us = 0;
+            uint32_t count = 0;
+
+            for (size_t ix = 0; ix < GetEventCount(); ix++) {
+                const ei_layer_profile_event_t *event = GetEvent(ix);
+                if (event->layer.node == node) {
+                    layer = &event->layer;
+                    node_us += event->duration_us;
+                    count++;
+                }
+            }
+            if (!layer) {
+                continue;
+            }
+            ei_printf("%d,%s,%lu,%lu,%lu,", (int)node, layer->op_name, (unsigned long)count,
+                (unsigned long)node_us, (unsigned long)(node_us / count));
+            ei_printf_float(total_us ? 100.0f * node_us / total_us : 0.0f);
+            ei_printf(",%lu,", (unsigned long)layer->macs);
+            ei_printf_float(node_us ? (float)layer->macs * count / node_us : 0.0f);
+            ei_printf(",%lu\n", (unsigned long)layer->arena_offset);
+        }
+    }
+
+private:
+    static int NodeForCsv(const ei_layer_profile_event_t *event)
+    {
+        return event->layer.node == EI_LAYER_PROFILER_NO_NODE ? -1 : (int)event->layer.node;
+    }
+
+    ei_layer_profile_event_t events_[EI_LAYER_PROFILER_MAX_EVENTS] = {};
+    uint32_t next_sequence_ = 0;
+    uint32_t first_sequence_ = 0;
+
+    TF_LITE_REMOVE_VIRTUAL_DELETE;
+};
+
+} // namespace ei
+
+#endif // _EI_LAYER_PROFILER_H_
@@ -29,6 +29,10 @@
 #include "edge-impulse-sdk/tensorflow/lite/c/common.h"
 #endif // EI_CLASSIFIER_USE_FULL_TFLITE
 
+namespace tflite {
+struct SoftmaxParams;
+}
+
 #define EI_CLASSIFIER_NONE                       255
 #define EI_CLASSIFIER_UTENSOR                    1
 #define EI_CLASSIFIER_TFLITE                     2
@@ -200,6 +204,16 @@ typedef struct {
     TfLiteStatus (*model_reset)(void (*free)(void* ptr));
     TfLiteStatus (*model_input)(int, TfLiteTensor*);
     TfLiteStatus (*model_output)(int, TfLiteTensor*);
+    // implementation_version >= 2: independent model instances, may be NULL
+    TfLiteStatus (*model_instance_create)(void **instance, void*(*alloc_fnc)(size_t, size_t), void (*free)(void* ptr));
+    TfLiteStatus (*model_instance_invoke)(void *instance);
+    TfLiteStatus (*model_instance_destroy)(void *instance, void (*free)(void* ptr));
+    TfLiteStatus (*model_instance_input)(void *instance, int, TfLiteTensor*);
+    TfLiteStatus (*model_instance_output)(void *instance, int, TfLiteTensor*);
+    // implementation_version >= 3: stop before the final SOFTMAX and return its input, may be NULL
+    TfLiteStatus (*model_softmax_logits)(bool enable, TfLiteTensor *logits, tflite::SoftmaxParams *params);
+    TfLiteStatus (*model_instance_softmax_logits)(void *instance, bool enable, TfLiteTensor *logits,
+                                                  tflite::SoftmaxParams *params);
 } ei_config_tflite_eon_graph_t;
 
 typedef struct {
@@ -359,10 +373,15 @@ public:
 class ei_impulse_handle_t {
 public:
     ei_impulse_handle_t(const ei_impulse_t *impulse)
-        : state(impulse), impulse(impulse), post_processing_state(nullptr) {};
+        : state(impulse), impulse(impulse), post_processing_state(nullptr),
+          bounding_boxes(nullptr), bounding_boxes_capacity(0) {};
     ei_impulse_state_t state;
     const ei_impulse_t *impulse;
     void** post_processing_state;
+    // caller-owned storage for the bounding boxes of the next results, see
+    // ei_impulse_result_t::bounding_boxes_buffer
+    ei_impulse_result_bounding_box_t *bounding_boxes;
+    uint32_t bounding_boxes_capacity;
 };
 
 typedef struct {
@@ -28,8 +28,16 @@
 
 #include "edge-impulse-sdk/porting/ei_classifier_porting.h"
 #include "edge-impulse-sdk/porting/ei_logging.h"
+#include "edge-impulse-sdk/classifier/ei_classifier_config.h"
 #include <memory>
 
+#if EI_CLASSIFIER_BATCH_THREADS == 1
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif // EI_CLASSIFIER_BATCH_THREADS == 1
+
 #if EI_CLASSIFIER_HAS_ANOMALY
 #include "inferencing_engines/anomaly.h"
 #endif
@@ -94,6 +102,39 @@ static uint64_t classifier_continuous_features_written = 0;
 /* These functions (up to Public functions section) are not exposed to end-user,
 therefore changes are allowed. */
 
+/**
+ * @brief      Hand bounding box storage and decoder scratch to the result
+ *
+ * @param      result        The result
+ * @param      boxes         Storage for the bounding boxes, nullptr for storage of the SDK
+ * @param[in]  box_capacity  Number of bounding boxes that fit in boxes
+ * @param      scratch       Scratch of the decoders, nullptr for the one of the SDK
+ * @param[in]  clear         Wipe the rest of the result
+ */
+static void ei_impulse_result_init(ei_impulse_result_t *result, ei_impulse_result_bounding_box_t *boxes,
+                                   uint32_t box_capacity, ei_impulse_scratch_t *scratch, bool clear = true)
+{
+    if (clear) {
+        memset(result, 0, sizeof(ei_impulse_result_t));
+    }
+    result->bounding_boxes_buffer = boxes;
+    result->bounding_boxes_capacity = boxes ? box_capacity : 0;
+    result->bounding_boxes_truncated = false;
+    result->scratch = scratch;
+}
+
+/**
+ * @brief      Hand the bounding box storage of the handle to the result
+ *
+ * @param      handle  The impulse handle
+ * @param      result  The result
+ * @param[in]  clear   Wipe the rest of the result
+ */
+static void ei_impulse_result_init(ei_impulse_handle_t *handle, ei_impulse_result_t *result, bool clear = true)
+{
+    ei_impulse_result_init(result, handle->bounding_boxes, handle->bounding_boxes_capacity, nullptr, clear);
+}
+
 /**
  * @brief      Display the results of the inference
  *
@@ -219,20 +260,25 @@ extern "C" EI_IMPULSE_ERROR run_inference(
 }
 
 /**
- * @brief      Process a complete impulse
+ * @brief      Process a complete impulse into the given bounding box storage
  *
- * @param      impulse  struct with information about model and DSP
+ * @param      handle   Handle from open_impulse
  * @param      signal   Sample data
  * @param      result   Output classifier results
- * @param      handle   Handle from open_impulse. nullptr for backward compatibility
+ * @param      boxes    Storage for the bounding boxes, the handle's is not touched
+ * @param[in]  box_capacity  Number of bounding boxes that fit in boxes
+ * @param      scratch  Scratch of the decoders, nullptr for the one of the SDK
  * @param[in]  debug    Debug output enable
  *
  * @return     The ei impulse error.
  */
-extern "C" EI_IMPULSE_ERROR process_impulse(ei_impulse_handle_t *handle,
-                                            signal_t *signal,
-                                            ei_impulse_result_t *result,
-                                            bool debug = false)
+static EI_IMPULSE_ERROR process_impulse_boxes(ei_impulse_handle_t *handle,
+                                              signal_t *signal,
+                                              ei_impulse_result_t *result,
+                                              ei_impulse_result_bounding_box_t *boxes,
+                                              uint32_t box_capacity,
+                                              ei_impulse_scratch_t *scratch,
+                                              bool debug)
 {
     if ((handle == nullptr) || (handle->impulse  == nullptr) || (result  == nullptr) || (signal  == nullptr)) {
         return EI_IMPULSE_INFERENCE_ERROR;
@@ -242,7 +288,8 @@ extern "C" EI_IMPULSE_ERROR process_impulse(ei_impulse_handle_t *handle,
     // Shortcut for quantized image models
     ei_learning_block_t block = handle->impulse->learning_blocks[0];
     if (can_run_classifier_image_quantized(handle->impulse, block) == EI_IMPULSE_OK) {
-        EI_IMPULSE_ERROR res = run_classifier_image_quantized(handle->impulse, signal, result, debug);
+        ei_impulse_result_init(result, boxes, box_capacity, scratch);
+        EI_IMPULSE_ERROR res = run_nn_inference_image_quantized(handle->impulse, signal, result, block.config, debug);
         if (res != EI_IMPULSE_OK) {
             return res;
         }
@@ -252,8 +299,10 @@ extern "C" EI_IMPULSE_ERROR process_impulse(ei_impulse_handle_t *handle,
 #endif
 
 #ifndef EI_DSP_RESULT_OVERRIDE
+    ei_impulse_result_init(result, boxes, box_capacity, scratch);
+#else
     // Don't wipe in CI, as we store a pointer
-    memset(result, 0, sizeof(ei_impulse_result_t));
+    ei_impulse_result_init(result, boxes, box_capacity, scratch, false);
 #endif
     uint32_t block_num = handle->impulse->dsp_blocks_size + handle->impulse->learning_blocks_size;
 
@@ -399,6 +448,28 @@ extern "C" EI_IMPULSE_ERROR process_impulse(ei_impulse_handle_t *handle,
 #endif
 }
 
+/**
+ * @brief      Process a complete impulse
+ *
+ * @param      handle   Handle from open_impulse
+ * @param      signal   Sample data
+ * @param      result   Output classifier results
+ * @param[in]  debug    Debug output enable
+ *
+ * @return     The ei impulse error.
+ */
+extern "C" EI_IMPULSE_ERROR process_impulse(ei_impulse_handle_t *handle,
+                                            signal_t *signal,
+                                            ei_impulse_result_t *result,
+                                            bool debug = false)
+{
+    if (handle == nullptr) {
+        return EI_IMPULSE_INFERENCE_ERROR;
+    }
+    return process_impulse_boxes(handle, signal, result, handle->bounding_boxes,
+                                 handle->bounding_boxes_capacity, nullptr, debug);
+}
+
 /**
  * @brief      Opens an impulse
  *
@@ -439,7 +510,7 @@ extern "C" EI_IMPULSE_ERROR process_impulse_continuous(ei_impulse_handle_t *hand
         return EI_IMPULSE_ALLOC_FAILED;
     }
 
-    memset(result, 0, sizeof(ei_impulse_result_t));
+    ei_impulse_result_init(handle, result);
 
     EI_IMPULSE_ERROR ei_impulse_error = EI_IMPULSE_OK;
 
@@ -834,7 +905,8 @@ __attribute__((unused)) void run_classifier_init(ei_impulse_handle_t *handle)
  *
  * Deletes internal static variables used by `run_classifier_continuous()`, which
  * includes the moving average filter (MAF). This function should be called when you
- * are done running continuous classification.
+ * are done running continuous classification. Also releases the arena of a persistent
+ * EON session (`EI_CLASSIFIER_TFLITE_EON_PERSISTENT_SESSION`).
  *
  * **Blocking**: yes
  *
@@ -843,11 +915,17 @@ __attribute__((unused)) void run_classifier_init(ei_impulse_handle_t *handle)
 extern "C" void run_classifier_deinit(void)
 {
     deinit_postprocessing(&ei_default_impulse);
+#if (EI_CLASSIFIER_INFERENCING_ENGINE == EI_CLASSIFIER_TFLITE) && (EI_CLASSIFIER_COMPILED == 1)
+    ei_tflite_eon_session_release();
+#endif
 }
 
 __attribute__((unused)) void run_classifier_deinit(ei_impulse_handle_t *handle)
 {
     deinit_postprocessing(handle);
+#if (EI_CLASSIFIER_INFERENCING_ENGINE == EI_CLASSIFIER_TFLITE) && (EI_CLASSIFIER_COMPILED == 1)
+    ei_tflite_eon_session_release();
+#endif
 }
 
 /**
@@ -1029,6 +1107,585 @@ __attribute__((unused)) EI_IMPULSE_ERROR run_classifier(
     return process_impulse(impulse, signal, result, debug);
 }
 
+/**
+ * @brief Run the classifier over a raw features array, into caller-owned bounding box storage.
+ *
+ * Overloaded function [run_classifier()](#run_classifier) that writes the bounding boxes into
+ * `boxes` and decodes the FOMO output in `scratch`, instead of storage and state of the SDK.
+ * The result stays valid across inferences and shares nothing with other results, and the
+ * detection path doesn't allocate.
+ *
+ * The inference itself still runs the one model session of the impulse, so calls on the same
+ * impulse must not overlap, whatever storage they are given. To infer on several threads at
+ * once use [run_classifier_batch()](#run_classifier_batch), its workers have model instances
+ * of their own.
+ *
+ * @param[in] boxes Storage for at least `box_capacity` bounding boxes
+ * @param[in] box_capacity Number of bounding boxes that fit in `boxes`. If more objects are
+ *  detected, the first `box_capacity` are kept and `result->bounding_boxes_truncated` is set.
+ * @param[in] scratch Scratch of the decoders, zeroed before its first use and used by one
+ *  inference at a time, or NULL for the one of the SDK.
+ */
+__attribute__((unused)) EI_IMPULSE_ERROR run_classifier(
+    ei_impulse_handle_t *impulse,
+    signal_t *signal,
+    ei_impulse_result_t *result,
+    ei_impulse_result_bounding_box_t *boxes,
+    uint32_t box_capacity,
+    ei_impulse_scratch_t *scratch,
+    bool debug = false)
+{
+    return process_impulse_boxes(impulse, signal, result, boxes, box_capacity, scratch, debug);
+}
+
+#if (EI_CLASSIFIER_INFERENCING_ENGINE == EI_CLASSIFIER_TFLITE) && (EI_CLASSIFIER_COMPILED == 1) && (EI_CLASSIFIER_QUANTIZATION_ENABLED == 1)
+
+/**
+ * @brief Run the classifier over an image held in a byte buffer.
+ *
+ * Quantizes the pixels straight into the input tensor, instead of reading them as packed
+ * floats through a `signal_t` callback. Only available for quantized image impulses, and
+ * the image must already be the size of the model input.
+ *
+ * **Blocking**: yes
+ *
+ * @param[in] handle Pointer to an `ei_impulse_handle_t` struct that contains the model and
+ *  preprocessing information.
+ * @param[in] image Pointer to an `image_signal_t` struct describing the pixel buffer
+ *  (EI_CLASSIFIER_INPUT_WIDTH x EI_CLASSIFIER_INPUT_HEIGHT, RGB888, BGR888 or grayscale).
+ * @param[out] result  Pointer to an ei_impulse_result_t struct that will contain the various output
+ *  results from inference after `run_classifier_image_buffer()` returns.
+ * @param[in] debug Print internal preprocessing and inference debugging information via `ei_printf()`.
+ *
+ * @return Error code as defined by `EI_IMPULSE_ERROR` enum. `EI_IMPULSE_INVALID_SIZE` if the
+ *  image does not match the model input, `EI_IMPULSE_ONLY_SUPPORTED_FOR_IMAGES` if the impulse
+ *  can't be run on a quantized image.
+ */
+__attribute__((unused)) EI_IMPULSE_ERROR run_classifier_image_buffer(
+    ei_impulse_handle_t *handle,
+    const image_signal_t *image,
+    ei_impulse_result_t *result,
+    bool debug = false)
+{
+    if ((handle == nullptr) || (handle->impulse  == nullptr) || (result  == nullptr) || (image == nullptr)) {
+        return EI_IMPULSE_INFERENCE_ERROR;
+    }
+
+    if (image->width != handle->impulse->input_width || image->height != handle->impulse->input_height) {
+        return EI_IMPULSE_INVALID_SIZE;
+    }
+
+    ei_learning_block_t block = handle->impulse->learning_blocks[0];
+    EI_IMPULSE_ERROR res = can_run_classifier_image_quantized(handle->impulse, block);
+    if (res != EI_IMPULSE_OK) {
+        return res;
+    }
+
+    ei_impulse_result_init(handle, result);
+
+    res = run_nn_inference_image_buffer_quantized(handle->impulse, image, result, block.config, debug);
+    if (res != EI_IMPULSE_OK) {
+        return res;
+    }
+
+    return run_postprocessing(handle, result);
+}
+
+/**
+ * @brief Run the classifier over an image held in a byte buffer.
+ *
+ * Overloaded function [run_classifier_image_buffer()](#run_classifier_image_buffer) that defaults
+ * to the single impulse.
+ */
+__attribute__((unused)) EI_IMPULSE_ERROR run_classifier_image_buffer(
+    const image_signal_t *image,
+    ei_impulse_result_t *result,
+    bool debug = false)
+{
+    return run_classifier_image_buffer(&ei_default_impulse, image, result, debug);
+}
+
+/**
+ * @brief Run the classifier over an image that's produced row by row, into the given bounding
+ *  box storage and decoder scratch (the handle's storage is not touched)
+ */
+static EI_IMPULSE_ERROR run_classifier_image_stream_boxes(
+    ei_impulse_handle_t *handle,
+    const image_stream_t *image,
+    ei_impulse_result_t *result,
+    ei_impulse_result_bounding_box_t *boxes,
+    uint32_t box_capacity,
+    ei_impulse_scratch_t *scratch,
+    bool debug)
+{
+    if ((handle == nullptr) || (handle->impulse  == nullptr) || (result  == nullptr) || (image == nullptr)) {
+        return EI_IMPULSE_INFERENCE_ERROR;
+    }
+
+    if (image->width != handle->impulse->input_width || image->height != handle->impulse->input_height) {
+        return EI_IMPULSE_INVALID_SIZE;
+    }
+
+    ei_learning_block_t block = handle->impulse->learning_blocks[0];
+    EI_IMPULSE_ERROR res = can_run_classifier_image_quantized(handle->impulse, block);
+    if (res != EI_IMPULSE_OK) {
+        return res;
+    }
+
+    ei_impulse_result_init(result, boxes, box_capacity, scratch);
+
+    res = run_nn_inference_image_stream_quantized(handle->impulse, image, result, block.config, debug);
+    if (res != EI_IMPULSE_OK) {
+        return res;
+    }
+
+    return run_postprocessing(handle, result);
+}
+
+/**
+ * @brief Run the classifier over an image that's produced row by row.
+ *
+ * Each row is quantized into the input tensor as soon as the stream writes it, so
+ * a camera frame can be decoded, cropped and resized into the model input without
+ * ever holding the full frame (see `ei::image::processing::resize_stream_t`). Only
+ * available for quantized image impulses, the stream must produce the model input size.
+ *
+ * **Blocking**: yes
+ *
+ * @param[in] handle Pointer to an `ei_impulse_handle_t` struct that contains the model and
+ *  preprocessing information.
+ * @param[in] image Pointer to an `image_stream_t` struct
+ *  (EI_CLASSIFIER_INPUT_WIDTH x EI_CLASSIFIER_INPUT_HEIGHT, RGB888, BGR888 or grayscale).
+ * @param[out] result  Pointer to an ei_impulse_result_t struct that will contain the various output
+ *  results from inference after `run_classifier_image_stream()` returns.
+ * @param[in] debug Print internal preprocessing and inference debugging information via `ei_printf()`.
+ *
+ * @return Error code as defined by `EI_IMPULSE_ERROR` enum. `EI_IMPULSE_INVALID_SIZE` if the
+ *  image does not match the model input, `EI_IMPULSE_DSP_ERROR` if the stream failed.
+ */
+__attribute__((unused)) EI_IMPULSE_ERROR run_classifier_image_stream(
+    ei_impulse_handle_t *handle,
+    const image_stream_t *image,
+    ei_impulse_result_t *result,
+    bool debug = false)
+{
+    if (handle == nullptr) {
+        return EI_IMPULSE_INFERENCE_ERROR;
+    }
+    return run_classifier_image_stream_boxes(handle, image, result, handle->bounding_boxes,
+                                             handle->bounding_boxes_capacity, nullptr, debug);
+}
+
+/**
+ * @brief Run the classifier over an image that's produced row by row, into caller-owned
+ *  bounding box storage.
+ *
+ * Overloaded function [run_classifier_image_stream()](#run_classifier_image_stream) that writes
+ * the bounding boxes into `boxes` and decodes in `scratch`, see the matching
+ * [run_classifier()](#run_classifier) overload. Calls on the same impulse must not overlap.
+ */
+__attribute__((unused)) EI_IMPULSE_ERROR run_classifier_image_stream(
+    ei_impulse_handle_t *handle,
+    const image_stream_t *image,
+    ei_impulse_result_t *result,
+    ei_impulse_result_bounding_box_t *boxes,
+    uint32_t box_capacity,
+    ei_impulse_scratch_t *scratch,
+    bool debug = false)
+{
+    return run_classifier_image_stream_boxes(handle, image, result, boxes, box_capacity, scratch, debug);
+}
+
+/**
+ * @brief Run the classifier over an image that's produced row by row.
+ *
+ * Overloaded function [run_classifier_image_stream()](#run_classifier_image_stream) that defaults
+ * to the single impulse.
+ */
+__attribute__((unused)) EI_IMPULSE_ERROR run_classifier_image_stream(
+    const image_stream_t *image,
+    ei_impulse_result_t *result,
+    bool debug = false)
+{
+    return run_classifier_image_stream(&ei_default_impulse, image, result, debug);
+}
+
+#endif // (EI_CLASSIFIER_INFERENCING_ENGINE == EI_CLASSIFIER_TFLITE) && (EI_CLASSIFIER_COMPILED == 1) && (EI_CLASSIFIER_QUANTIZATION_ENABLED == 1)
+
+/**
+ * @brief State of a run_classifier_batch() call, shared by its workers
+ */
+struct ei_impulse_batch_t {
+    ei_impulse_handle_t *handle;
+    signal_t *signals;
+    ei_impulse_result_t *results;
+    size_t count;
+    const ei_impulse_batch_config_t *config;
+    void *block_config;
+    bool debug;
+    EI_IMPULSE_ERROR error;
+#if EI_CLASSIFIER_BATCH_THREADS == 1
+    std::mutex lock;
+    std::condition_variable changed;
+    // sharded: next frame to claim. pipelined: next frame to quantize
+    size_t next_frame;
+    // pipelined: instances waiting to be quantized into, and quantized frames waiting to be invoked
+    std::vector<void*> free_instances;
+    std::vector<std::pair<void*, size_t>> ready_frames;
+    bool producer_done;
+#endif // EI_CLASSIFIER_BATCH_THREADS == 1
+};
+
+/**
+ * @brief      Clear a result of the batch and hand it its bounding box storage, the scratch
+ *             comes from the worker that decodes it
+ */
+static void ei_impulse_batch_result_init(ei_impulse_batch_t *batch, size_t ix)
+{
+    ei_impulse_result_t *result = &batch->results[ix];
+
+    memset(result, 0, sizeof(ei_impulse_result_t));
+    if (batch->config->bounding_boxes) {
+        result->bounding_boxes_buffer = batch->config->bounding_boxes + ix * batch->config->bounding_boxes_per_result;
+        result->bounding_boxes_capacity = batch->config->bounding_boxes_per_result;
+    }
+}
+
+#if (EI_CLASSIFIER_INFERENCING_ENGINE == EI_CLASSIFIER_TFLITE) && (EI_CLASSIFIER_COMPILED == 1) && (EI_CLASSIFIER_QUANTIZATION_ENABLED == 1)
+
+/**
+ * @brief      Decode the output of an instance into a result of the batch, in the scratch of
+ *             the calling worker
+ */
+static EI_IMPULSE_ERROR ei_impulse_batch_fill_result(ei_impulse_batch_t *batch, void *instance, size_t ix,
+                                                     ei_impulse_scratch_t *scratch)
+{
+    ei_impulse_result_t *result = &batch->results[ix];
+
+    result->scratch = scratch;
+    EI_IMPULSE_ERROR res = run_nn_inference_instance_fill_result(batch->handle->impulse, instance, result,
+        batch->block_config, batch->debug);
+    // the scratch goes away with the worker
+    result->scratch = nullptr;
+    return res;
+}
+
+/**
+ * @brief      Run every frame of the batch on one model instance, on the calling thread
+ */
+static EI_IMPULSE_ERROR ei_impulse_batch_run_serial(ei_impulse_batch_t *batch)
+{
+    const ei_impulse_t *impulse = batch->handle->impulse;
+    std::unique_ptr<ei_impulse_scratch_t> scratch(new ei_impulse_scratch_t());
+    void *instance;
+
+    EI_IMPULSE_ERROR res = ei_tflite_eon_instance_create(batch->block_config, &instance);
+    if (res != EI_IMPULSE_OK) {
+        return res;
+    }
+
+    for (size_t ix = 0; ix < batch->count && res == EI_IMPULSE_OK; ix++) {
+        ei_impulse_result_t *result = &batch->results[ix];
+
+        ei_impulse_batch_result_init(batch, ix);
+        res = run_nn_inference_image_quantized_prepare(impulse, instance, &batch->signals[ix], result, batch->block_config, batch->debug);
+        if (res == EI_IMPULSE_OK) {
+            res = run_nn_inference_instance_invoke(instance, result, batch->block_config);
+        }
+        if (res == EI_IMPULSE_OK) {
+            res = ei_impulse_batch_fill_result(batch, instance, ix, scratch.get());
+        }
+    }
+
+    ei_tflite_eon_instance_destroy(batch->block_config, instance);
+    return res;
+}
+
+#if EI_CLASSIFIER_BATCH_THREADS == 1
+
+/**
+ * @brief      Record the first error of the batch, stops the other workers
+ */
+static void ei_impulse_batch_fail(ei_impulse_batch_t *batch, EI_IMPULSE_ERROR res)
+{
+    std::lock_guard<std::mutex> guard(batch->lock);
+    if (batch->error == EI_IMPULSE_OK) {
+        batch->error = res;
+    }
+    batch->changed.notify_all();
+}
+
+/**
+ * @brief      Worker of a sharded batch: claims frames and quantizes and invokes them on its
+ *             own instance
+ */
+static void ei_impulse_batch_shard_worker(ei_impulse_batch_t *batch)
+{
+    const ei_impulse_t *impulse = batch->handle->impulse;
+    std::unique_ptr<ei_impulse_scratch_t> scratch(new ei_impulse_scratch_t());
+    void *instance;
+
+    EI_IMPULSE_ERROR res = ei_tflite_eon_instance_create(batch->block_config, &instance);
+    if (res != EI_IMPULSE_OK) {
+        ei_impulse_batch_fail(batch, res);
+        return;
+    }
+
+    while (true) {
+        size_t ix;
+        {
+            std::lock_guard<std::mutex> guard(batch->lock);
+            if (batch->error != EI_IMPULSE_OK || batch->next_frame >= batch->count) {
+                break;
+            }
+            ix = batch->next_frame++;
+        }
+
+        ei_impulse_result_t *result = &batch->results[ix];
+
+        ei_impulse_batch_result_init(batch, ix);
+        res = run_nn_inference_image_quantized_prepare(impulse, instance, &batch->signals[ix], result, batch->block_config, batch->debug);
+        if (res == EI_IMPULSE_OK) {
+            res = run_nn_inference_instance_invoke(instance, result, batch->block_config);
+        }
+        if (res == EI_IMPULSE_OK) {
+            res = ei_impulse_batch_fill_result(batch, instance, ix, scratch.get());
+        }
+        if (res != EI_IMPULSE_OK) {
+            ei_impulse_batch_fail(batch, res);
+            break;
+        }
+    }
+
+    ei_tflite_eon_instance_destroy(batch->block_config, instance);
+}
+
+/**
+ * @brief      Worker of a pipelined batch: invokes the frames the calling thread quantized
+ */
+static void ei_impulse_batch_invoke_worker(ei_impulse_batch_t *batch)
+{
+    std::unique_ptr<ei_impulse_scratch_t> scratch(new ei_impulse_scratch_t());
+    std::unique_lock<std::mutex> guard(batch->lock);
+
+    while (true) {
+        batch->changed.wait(guard, [batch]() {
+            return batch->error != EI_IMPULSE_OK || !batch->ready_frames.empty() || batch->producer_done;
+        });
+        if (batch->error != EI_IMPULSE_OK || batch->ready_frames.empty()) {
+            break;
+        }
+
+        void *instance = batch->ready_frames.front().first;
+        size_t ix = batch->ready_frames.front().second;
+        batch->ready_frames.erase(batch->ready_frames.begin());
+
+        guard.unlock();
+        EI_IMPULSE_ERROR res = run_nn_inference_instance_invoke(instance, &batch->results[ix], batch->block_config);
+        if (res == EI_IMPULSE_OK) {
+            res = ei_impulse_batch_fill_result(batch, instance, ix, scratch.get());
+        }
+        guard.lock();
+
+        if (res != EI_IMPULSE_OK && batch->error == EI_IMPULSE_OK) {
+            batch->error = res;
+        }
+        batch->free_instances.push_back(instance);
+        batch->changed.notify_all();
+    }
+}
+
+/**
+ * @brief      Run the batch on worker threads. Pipelined, the calling thread quantizes frame
+ *             i+1 into a spare instance while the workers invoke frame i. Sharded, every
+ *             worker runs whole frames on its own instance.
+ */
+static EI_IMPULSE_ERROR ei_impulse_batch_run_threads(ei_impulse_batch_t *batch, uint32_t threads)
+{
+    std::vector<std::thread> workers;
+
+    batch->next_frame = 0;
+    batch->producer_done = false;
+
+    if (!batch->config->pipeline) {
+        for (uint32_t ix = 0; ix < threads; ix++) {
+            workers.emplace_back(ei_impulse_batch_shard_worker, batch);
+        }
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+        return batch->error;
+    }
+
+    // one instance per worker, plus the one being quantized into
+    std::vector<void*> instances;
+    EI_IMPULSE_ERROR res = EI_IMPULSE_OK;
+    for (uint32_t ix = 0; ix < threads + 1 && res == EI_IMPULSE_OK; ix++) {
+        void *instance;
+        res = ei_tflite_eon_instance_create(batch->block_config, &instance);
+        if (res == EI_IMPULSE_OK) {
+            instances.push_back(instance);
+        }
+    }
+
+    if (res == EI_IMPULSE_OK) {
+        batch->free_instances = instances;
+        for (uint32_t ix = 0; ix < threads; ix++) {
+            workers.emplace_back(ei_impulse_batch_invoke_worker, batch);
+        }
+
+        for (size_t ix = 0; ix < batch->count; ix++) {
+            void *instance;
+            {
+                std::unique_lock<std::mutex> guard(batch->lock);
+                batch->changed.wait(guard, [batch]() {
+                    return batch->error != EI_IMPULSE_OK || !batch->free_instances.empty();
+                });
+                if (batch->error != EI_IMPULSE_OK) {
+                    break;
+                }
+                instance = batch->free_instances.back();
+                batch->free_instances.pop_back();
+            }
+
+            ei_impulse_batch_result_init(batch, ix);
+            res = run_nn_inference_image_quantized_prepare(batch->handle->impulse, instance, &batch->signals[ix],
+                &batch->results[ix], batch->block_config, batch->debug);
+            if (res != EI_IMPULSE_OK) {
+                ei_impulse_batch_fail(batch, res);
+                break;
+            }
+
+            std::lock_guard<std::mutex> guard(batch->lock);
+            batch->ready_frames.push_back(std::make_pair(instance, ix));
+            batch->changed.notify_all();
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(batch->lock);
+            batch->producer_done = true;
+            batch->changed.notify_all();
+        }
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+        res = batch->error;
+    }
+
+    for (void *instance : instances) {
+        ei_tflite_eon_instance_destroy(batch->block_config, instance);
+    }
+    return res;
+}
+
+#endif // EI_CLASSIFIER_BATCH_THREADS == 1
+
+#endif // (EI_CLASSIFIER_INFERENCING_ENGINE == EI_CLASSIFIER_TFLITE) && (EI_CLASSIFIER_COMPILED == 1) && (EI_CLASSIFIER_QUANTIZATION_ENABLED == 1)
+
+/**
+ * @brief Run the classifier over a batch of raw features arrays.
+ *
+ * Runs `run_classifier()` over every signal, into the matching result. Quantized image impulses
+ * of compiled models that can be instantiated reuse prepared model instances for the whole
+ * batch, instead of setting the model up for every frame. With `config->threads` they spread
+ * the frames over worker threads, and with `config->pipeline` the calling thread quantizes the
+ * next frames while the workers invoke the model. Other impulses run frame by frame.
+ *
+ * With threads, the `get_data` callbacks of the signals are called from several threads at
+ * once (sharded) or from the calling thread (pipelined). Every worker decodes the model output
+ * in scratch of its own. Post-processing runs in frame order on the calling thread once all
+ * frames were inferred.
+ *
+ * **Blocking**: yes
+ *
+ * @param[in] handle Pointer to an `ei_impulse_handle_t` struct that contains the model and
+ *  preprocessing information.
+ * @param[in] signals Array of `count` signals, see `run_classifier()`.
+ * @param[out] results Array of `count` results.
+ * @param[in] count Number of frames in the batch.
+ * @param[in] config Threads, pipelining and bounding box storage, or NULL to run the batch
+ *  on the calling thread. Object detection impulses need `config->bounding_boxes`.
+ * @param[in] debug Print internal preprocessing and inference debugging information via `ei_printf()`.
+ *
+ * @return Error code as defined by `EI_IMPULSE_ERROR` enum, of the first frame that failed.
+ *  The results of the frames that weren't run are undefined.
+ */
+__attribute__((unused)) EI_IMPULSE_ERROR run_classifier_batch(
+    ei_impulse_handle_t *handle,
+    signal_t *signals,
+    ei_impulse_result_t *results,
+    size_t count,
+    const ei_impulse_batch_config_t *config = nullptr,
+    bool debug = false)
+{
+    if ((handle == nullptr) || (handle->impulse == nullptr) || (signals == nullptr) || (results == nullptr)) {
+        return EI_IMPULSE_INFERENCE_ERROR;
+    }
+
+    if (count == 0) {
+        return EI_IMPULSE_OK;
+    }
+
+    const ei_impulse_batch_config_t default_config = { 0 };
+    if (config == nullptr) {
+        config = &default_config;
+    }
+
+    if (handle->impulse->object_detection_count > 0 && count > 1 && config->bounding_boxes == nullptr) {
+        return EI_IMPULSE_OUT_OF_MEMORY;
+    }
+
+    ei_impulse_batch_t batch;
+    batch.handle = handle;
+    batch.signals = signals;
+    batch.results = results;
+    batch.count = count;
+    batch.config = config;
+    batch.block_config = handle->impulse->learning_blocks[0].config;
+    batch.debug = debug;
+    batch.error = EI_IMPULSE_OK;
+
+#if (EI_CLASSIFIER_INFERENCING_ENGINE == EI_CLASSIFIER_TFLITE) && (EI_CLASSIFIER_COMPILED == 1) && (EI_CLASSIFIER_QUANTIZATION_ENABLED == 1)
+    if (can_run_classifier_image_quantized(handle->impulse, handle->impulse->learning_blocks[0]) == EI_IMPULSE_OK &&
+        ei_tflite_eon_has_instances(batch.block_config)) {
+
+        EI_IMPULSE_ERROR res;
+#if EI_CLASSIFIER_BATCH_THREADS == 1
+        uint32_t threads = config->threads > count ? (uint32_t)count : config->threads;
+        if (threads > 1 || (threads == 1 && config->pipeline)) {
+            res = ei_impulse_batch_run_threads(&batch, threads);
+        }
+        else {
+            res = ei_impulse_batch_run_serial(&batch);
+        }
+#else
+        res = ei_impulse_batch_run_serial(&batch);
+#endif // EI_CLASSIFIER_BATCH_THREADS == 1
+        if (res != EI_IMPULSE_OK) {
+            return res;
+        }
+
+        for (size_t ix = 0; ix < count; ix++) {
+            res = run_postprocessing(handle, &results[ix]);
+            if (res != EI_IMPULSE_OK) {
+                return res;
+            }
+        }
+        return EI_IMPULSE_OK;
+    }
+#endif
+
+    for (size_t ix = 0; ix < count; ix++) {
+        ei_impulse_batch_result_init(&batch, ix);
+        EI_IMPULSE_ERROR res = run_classifier(handle, &signals[ix], &results[ix],
+            results[ix].bounding_boxes_buffer, results[ix].bounding_boxes_capacity, nullptr, debug);
+        if (res != EI_IMPULSE_OK) {
+            return res;
+        }
+    }
+    return EI_IMPULSE_OK;
+}
+
 /** @} */ // end of ei_functions Doxygen group
 
 /* Deprecated functions ------------------------------------------------------- */
@@ -23,6 +23,7 @@
 #include "edge-impulse-sdk/dsp/speechpy/speechpy.hpp"
 #include "edge-impulse-sdk/classifier/ei_signal_with_range.h"
 #include "edge-impulse-sdk/dsp/ei_flatten.h"
+#include "edge-impulse-sdk/dsp/image/quantize.hpp"
 #include "model-parameters/model_metadata.h"
 
 #if EI_CLASSIFIER_HR_ENABLED
@@ -1216,21 +1217,43 @@ __attribute__((unused)) int extract_drpai_features_quantized(signal_t *signal, m
 
 #if (EI_CLASSIFIER_QUANTIZATION_ENABLED == 1) && (EI_CLASSIFIER_INFERENCING_ENGINE != EI_CLASSIFIER_DRPAI)
 
+// pixels converted to RGB888 per kernel call when the input isn't RGB888 already
+#ifndef EI_DSP_IMAGE_QUANTIZE_CHUNK_PIXELS
+#define EI_DSP_IMAGE_QUANTIZE_CHUNK_PIXELS 64
+#endif
+
+static inline ei::image::quantize::scaling_t image_quantize_scaling(int image_scaling) {
+    switch (image_scaling) {
+        case EI_CLASSIFIER_IMAGE_SCALING_NONE: return ei::image::quantize::SCALING_DIV_255;
+        case EI_CLASSIFIER_IMAGE_SCALING_TORCH: return ei::image::quantize::SCALING_TORCH;
+        case EI_CLASSIFIER_IMAGE_SCALING_MIN128_127: return ei::image::quantize::SCALING_MIN128_127;
+        default: return ei::image::quantize::SCALING_RAW;
+    }
+}
+
+/**
+ * Quantize RGB888 pixels into the model input, returns the number of values written
+ */
+static inline size_t quantize_image_rgb888(const uint8_t *rgb, size_t pixels, int8_t *output, int16_t channel_count,
+                                           ei::image::quantize::scaling_t scaling, float scale, float zero_point) {
+    if (channel_count == 3) {
+        ei::image::quantize::rgb888_to_i8(rgb, output, pixels, scaling, scale, zero_point);
+        return pixels * 3;
+    }
+    ei::image::quantize::rgb888_to_gray_i8(rgb, output, pixels, scaling, scale, zero_point);
+    return pixels;
+}
+
 __attribute__((unused)) int extract_image_features_quantized(signal_t *signal, matrix_i8_t *output_matrix, void *config_ptr, float scale, float zero_point, const float frequency,
                                                              int image_scaling) {
     ei_dsp_config_image_t config = *((ei_dsp_config_image_t*)config_ptr);
 
     int16_t channel_count = strcmp(config.channels, "Grayscale") == 0 ? 1 : 3;
+    ei::image::quantize::scaling_t scaling = image_quantize_scaling(image_scaling);
+    uint8_t rgb[EI_DSP_IMAGE_QUANTIZE_CHUNK_PIXELS * 3];
 
     size_t output_ix = 0;
 
-    const int32_t iRedToGray = (int32_t)(0.299f * 65536.0f);
-    const int32_t iGreenToGray = (int32_t)(0.587f * 65536.0f);
-    const int32_t iBlueToGray = (int32_t)(0.114f * 65536.0f);
-
-    static const float torch_mean[] = { 0.485, 0.456, 0.406 };
-    static const float torch_std[] = { 0.229, 0.224, 0.225 };
-
 #if defined(EI_DSP_IMAGE_BUFFER_STATIC_SIZE)
     const size_t page_size = EI_DSP_IMAGE_BUFFER_STATIC_SIZE;
 #else
@@ -1252,103 +1275,157 @@ __attribute__((unused)) int extract_image_features_quantized(signal_t *signal, m
         }
         signal->get_data(ix, elements_to_read, input_matrix.buffer);
 
-        for (size_t jx = 0; jx < elements_to_read; jx++) {
-            uint32_t pixel = static_cast<uint32_t>(input_matrix.buffer[jx]);
+        for (size_t jx = 0; jx < elements_to_read; jx += EI_DSP_IMAGE_QUANTIZE_CHUNK_PIXELS) {
+            size_t pixels = elements_to_read - jx;
+            if (pixels > EI_DSP_IMAGE_QUANTIZE_CHUNK_PIXELS) {
+                pixels = EI_DSP_IMAGE_QUANTIZE_CHUNK_PIXELS;
+            }
 
-            if (channel_count == 3) {
-                // fast code path
-                if (scale == 0.003921568859368563f && zero_point == -128 && image_scaling == EI_CLASSIFIER_IMAGE_SCALING_NONE) {
-                    int32_t r = static_cast<int32_t>(pixel >> 16 & 0xff);
-                    int32_t g = static_cast<int32_t>(pixel >> 8 & 0xff);
-                    int32_t b = static_cast<int32_t>(pixel & 0xff);
-
-                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(r + zero_point);
-                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(g + zero_point);
-                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(b + zero_point);
-                }
-                // slow code path
-                else {
-                    float r = static_cast<float>(pixel >> 16 & 0xff);
-                    float g = static_cast<float>(pixel >> 8 & 0xff);
-                    float b = static_cast<float>(pixel & 0xff);
-
-                    if (image_scaling == EI_CLASSIFIER_IMAGE_SCALING_NONE) {
-                        r /= 255.0f;
-                        g /= 255.0f;
-                        b /= 255.0f;
-                    }
-                    else if (image_scaling == EI_CLASSIFIER_IMAGE_SCALING_TORCH) {
-                        r /= 255.0f;
-                        g /= 255.0f;
-                        b /= 255.0f;
-
-                        r = (r - torch_mean[0]) / torch_std[0];
-                        g = (g - torch_mean[1]) / torch_std[1];
-                        b = (b - torch_mean[2]) / torch_std[2];
-                    }
-                    else if (image_scaling == EI_CLASSIFIER_IMAGE_SCALING_MIN128_127) {
-                        r -= 128.0f;
-                        g -= 128.0f;
-                        b -= 128.0f;
-                    }
-
-                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(round(r / scale) + zero_point);
-                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(round(g / scale) + zero_point);
-                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(round(b / scale) + zero_point);
-                }
+            // unpack 0xRRGGBB into RGB888
+            for (size_t px = 0; px < pixels; px++) {
+                uint32_t pixel = static_cast<uint32_t>(input_matrix.buffer[jx + px]);
+                rgb[px * 3] = static_cast<uint8_t>(pixel >> 16 & 0xff);
+                rgb[px * 3 + 1] = static_cast<uint8_t>(pixel >> 8 & 0xff);
+                rgb[px * 3 + 2] = static_cast<uint8_t>(pixel & 0xff);
+            }
+
+            output_ix += quantize_image_rgb888(rgb, pixels, output_matrix->buffer + output_ix, channel_count,
+                scaling, scale, zero_point);
+        }
+
+        bytes_left -= elements_to_read;
+
+    }
+    return EIDSP_OK;
+}
+
+/**
+ * Quantize one row of an image in a byte buffer into the model input, returns the number of values written
+ */
+static inline size_t quantize_image_row(const uint8_t *row, size_t width, ei_image_signal_format_t format, int8_t *output,
+                                        int16_t channel_count, ei::image::quantize::scaling_t scaling, float scale,
+                                        float zero_point) {
+    if (format == EI_IMAGE_SIGNAL_RGB888) {
+        return quantize_image_rgb888(row, width, output, channel_count, scaling, scale, zero_point);
+    }
+    // layouts match, so quantizing is a plain byte transform
+    if (channel_count == 1 && format == EI_IMAGE_SIGNAL_GRAYSCALE && ei::image::quantize::is_sub128(scaling, scale, zero_point)) {
+        ei::image::quantize::bytes_sub128(row, output, width);
+        return width;
+    }
+    if (channel_count == 1 && format == EI_IMAGE_SIGNAL_GRAYSCALE && ei::image::quantize::is_copy(scaling, scale, zero_point)) {
+        memcpy(output, row, width);
+        return width;
+    }
+
+    uint8_t rgb[EI_DSP_IMAGE_QUANTIZE_CHUNK_PIXELS * 3];
+    size_t bytes_per_pixel = format == EI_IMAGE_SIGNAL_GRAYSCALE ? 1 : 3;
+    size_t output_ix = 0;
+
+    for (size_t x = 0; x < width; x += EI_DSP_IMAGE_QUANTIZE_CHUNK_PIXELS) {
+        size_t pixels = width - x;
+        if (pixels > EI_DSP_IMAGE_QUANTIZE_CHUNK_PIXELS) {
+            pixels = EI_DSP_IMAGE_QUANTIZE_CHUNK_PIXELS;
+        }
+
+        const uint8_t *src = row + x * bytes_per_pixel;
+        for (size_t px = 0; px < pixels; px++) {
+            if (format == EI_IMAGE_SIGNAL_BGR888) {
+                rgb[px * 3] = src[px * 3 + 2];
+                rgb[px * 3 + 1] = src[px * 3 + 1];
+                rgb[px * 3 + 2] = src[px * 3];
             }
             else {
-                // fast code path
-                if (scale == 0.003921568859368563f && zero_point == -128 && image_scaling == EI_CLASSIFIER_IMAGE_SCALING_NONE) {
-                    int32_t r = static_cast<int32_t>(pixel >> 16 & 0xff);
-                    int32_t g = static_cast<int32_t>(pixel >> 8 & 0xff);
-                    int32_t b = static_cast<int32_t>(pixel & 0xff);
-
-                    // ITU-R 601-2 luma transform
-                    // see: https://pillow.readthedocs.io/en/stable/reference/Image.html#PIL.Image.Image.convert
-                    int32_t gray = (iRedToGray * r) + (iGreenToGray * g) + (iBlueToGray * b);
-                    gray >>= 16; // scale down to int8_t
-                    gray += zero_point;
-                    if (gray < - 128) gray = -128;
-                    else if (gray > 127) gray = 127;
-                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(gray);
-                }
-                // slow code path
-                else {
-                    float r = static_cast<float>(pixel >> 16 & 0xff);
-                    float g = static_cast<float>(pixel >> 8 & 0xff);
-                    float b = static_cast<float>(pixel & 0xff);
-
-                    if (image_scaling == EI_CLASSIFIER_IMAGE_SCALING_NONE) {
-                        r /= 255.0f;
-                        g /= 255.0f;
-                        b /= 255.0f;
-                    }
-                    else if (image_scaling == EI_CLASSIFIER_IMAGE_SCALING_TORCH) {
-                        r /= 255.0f;
-                        g /= 255.0f;
-                        b /= 255.0f;
-
-                        r = (r - torch_mean[0]) / torch_std[0];
-                        g = (g - torch_mean[1]) / torch_std[1];
-                        b = (b - torch_mean[2]) / torch_std[2];
-                    }
-                    else if (image_scaling == EI_CLASSIFIER_IMAGE_SCALING_MIN128_127) {
-                        r -= 128.0f;
-                        g -= 128.0f;
-                        b -= 128.0f;
-                    }
-
-                    // ITU-R 601-2 luma transform
-                    // see: https://pillow.readthedocs.io/en/stable/reference/Image.html#PIL.Image.Image.convert
-                    float v = (0.299f * r) + (0.587f * g) + (0.114f * b);
-                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(round(v / scale) + zero_point);
-                }
+                rgb[px * 3] = rgb[px * 3 + 1] = rgb[px * 3 + 2] = src[px];
             }
         }
 
-        bytes_left -= elements_to_read;
+        output_ix += quantize_image_rgb888(rgb, pixels, output + output_ix, channel_count, scaling, scale, zero_point);
+    }
+    return output_ix;
+}
+
+/**
+ * Same as extract_image_features_quantized, but reads the pixels straight from a byte buffer.
+ * The image has to be the size of the model input.
+ */
+__attribute__((unused)) int extract_image_buffer_features_quantized(const image_signal_t *image, matrix_i8_t *output_matrix, void *config_ptr,
+                                                                    float scale, float zero_point, int image_scaling) {
+    ei_dsp_config_image_t config = *((ei_dsp_config_image_t*)config_ptr);
+
+    int16_t channel_count = strcmp(config.channels, "Grayscale") == 0 ? 1 : 3;
+    size_t bytes_per_pixel = image->format == EI_IMAGE_SIGNAL_GRAYSCALE ? 1 : 3;
+    size_t row_bytes = image->width * bytes_per_pixel;
+    size_t stride = image->stride ? image->stride : row_bytes;
+
+    if (image->width * image->height * channel_count != output_matrix->cols * output_matrix->rows || stride < row_bytes) {
+        EIDSP_ERR(EIDSP_MATRIX_SIZE_MISMATCH);
+    }
+
+    ei::image::quantize::scaling_t scaling = image_quantize_scaling(image_scaling);
+    int8_t *output = output_matrix->buffer;
+
+    for (size_t y = 0; y < image->height; y++) {
+        output += quantize_image_row(image->buffer + y * stride, image->width, image->format, output, channel_count,
+            scaling, scale, zero_point);
+    }
+    return EIDSP_OK;
+}
+
+typedef struct {
+    const image_stream_t *image;
+    int8_t *output;
+    int16_t channel_count;
+    ei::image::quantize::scaling_t scaling;
+    float scale;
+    float zero_point;
+    size_t next_row;
+} image_stream_quantize_sink_t;
 
+static int image_stream_quantize_row(void *sink_ptr, int y, const uint8_t *row) {
+    image_stream_quantize_sink_t *sink = (image_stream_quantize_sink_t*)sink_ptr;
+
+    if (y < 0 || (size_t)y != sink->next_row || sink->next_row >= sink->image->height) {
+        return EIDSP_OUT_OF_BOUNDS;
+    }
+
+    size_t row_values = sink->image->width * sink->channel_count;
+    quantize_image_row(row, sink->image->width, sink->image->format, sink->output + sink->next_row * row_values,
+        sink->channel_count, sink->scaling, sink->scale, sink->zero_point);
+    sink->next_row++;
+    return 0;
+}
+
+/**
+ * Same as extract_image_buffer_features_quantized, but the rows are quantized into the output
+ * as the stream produces them. The image has to be the size of the model input.
+ */
+__attribute__((unused)) int extract_image_stream_features_quantized(const image_stream_t *image, matrix_i8_t *output_matrix, void *config_ptr,
+                                                                    float scale, float zero_point, int image_scaling) {
+    ei_dsp_config_image_t config = *((ei_dsp_config_image_t*)config_ptr);
+
+    int16_t channel_count = strcmp(config.channels, "Grayscale") == 0 ? 1 : 3;
+
+    if (image->width * image->height * channel_count != output_matrix->cols * output_matrix->rows || !image->produce) {
+        EIDSP_ERR(EIDSP_MATRIX_SIZE_MISMATCH);
+    }
+
+    image_stream_quantize_sink_t sink;
+    sink.image = image;
+    sink.output = output_matrix->buffer;
+    sink.channel_count = channel_count;
+    sink.scaling = image_quantize_scaling(image_scaling);
+    sink.scale = scale;
+    sink.zero_point = zero_point;
+    sink.next_row = 0;
+
+    int ret = image->produce(image->ctx, &image_stream_quantize_row, &sink);
+    if (ret != 0) {
+        EIDSP_ERR(ret);
+    }
+    // every row has to be written
+    if (sink.next_row != image->height) {
+        EIDSP_ERR(EIDSP_BUFFER_SIZE_MISMATCH);
     }
     return EIDSP_OK;
 }
@@ -23,11 +23,70 @@
 #include "edge-impulse-sdk/tensorflow/lite/c/common.h"
 #include "edge-impulse-sdk/tensorflow/lite/kernels/internal/tensor_ctypes.h"
 #include "edge-impulse-sdk/classifier/ei_aligned_malloc.h"
+#include "edge-impulse-sdk/classifier/ei_classifier_config.h"
 #include "edge-impulse-sdk/classifier/ei_fill_result_struct.h"
 #include "edge-impulse-sdk/classifier/ei_model_types.h"
 #include "edge-impulse-sdk/classifier/inferencing_engines/tflite_helper.h"
 #include "edge-impulse-sdk/classifier/ei_run_dsp.h"
 
+#if EI_CLASSIFIER_TFLITE_EON_PERSISTENT_SESSION == 1
+/**
+ * Model that currently owns the resident arena. Keyed on the init function
+ * as the graph config for EON DSP blocks is created on the stack.
+ */
+static TfLiteStatus (*eon_session_model_init)(void*(*alloc_fnc)(size_t, size_t)) = nullptr;
+static TfLiteStatus (*eon_session_model_reset)(void (*free)(void* ptr)) = nullptr;
+#endif // EI_CLASSIFIER_TFLITE_EON_PERSISTENT_SESSION == 1
+
+/**
+ * @brief      Release the arena held by a persistent EON session.
+ *             The next inference will run init and prepare again.
+ *             No-op if EI_CLASSIFIER_TFLITE_EON_PERSISTENT_SESSION is disabled.
+ */
+__attribute__((unused)) void ei_tflite_eon_session_release(void) {
+#if EI_CLASSIFIER_TFLITE_EON_PERSISTENT_SESSION == 1
+    if (eon_session_model_reset) {
+        eon_session_model_reset(ei_aligned_free);
+    }
+    eon_session_model_init = nullptr;
+    eon_session_model_reset = nullptr;
+#endif // EI_CLASSIFIER_TFLITE_EON_PERSISTENT_SESSION == 1
+}
+
+/**
+ * Initialize the model, or reuse the resident one in session mode
+ */
+static TfLiteStatus inference_tflite_model_init(ei_config_tflite_eon_graph_t *graph_config) {
+#if EI_CLASSIFIER_TFLITE_EON_PERSISTENT_SESSION == 1
+    if (eon_session_model_init == graph_config->model_init) {
+        return kTfLiteOk;
+    }
+
+    // only one model can be resident at a time
+    ei_tflite_eon_session_release();
+
+    TfLiteStatus status = graph_config->model_init(ei_aligned_calloc);
+    if (status == kTfLiteOk) {
+        eon_session_model_init = graph_config->model_init;
+        eon_session_model_reset = graph_config->model_reset;
+    }
+    return status;
+#else
+    return graph_config->model_init(ei_aligned_calloc);
+#endif // EI_CLASSIFIER_TFLITE_EON_PERSISTENT_SESSION == 1
+}
+
+/**
+ * Free the model after inference, unless it's kept resident in session mode
+ */
+static TfLiteStatus inference_tflite_model_reset(ei_config_tflite_eon_graph_t *graph_config) {
+#if EI_CLASSIFIER_TFLITE_EON_PERSISTENT_SESSION == 1
+    return kTfLiteOk;
+#else
+    return graph_config->model_reset(ei_aligned_free);
+#endif // EI_CLASSIFIER_TFLITE_EON_PERSISTENT_SESSION == 1
+}
+
 /**
  * Setup the TFLite runtime
  *
@@ -51,7 +110,7 @@ static EI_IMPULSE_ERROR inference_tflite_setup(
 
     *ctx_start_us = ei_read_timer_us();
 
-    TfLiteStatus init_status = graph_config->model_init(ei_aligned_calloc);
+    TfLiteStatus init_status = inference_tflite_model_init(graph_config);
     if (init_status != kTfLiteOk) {
         ei_printf("Failed to initialize the model (error code %d)\n", init_status);
         return EI_IMPULSE_TFLITE_ARENA_ALLOC_FAILED;
@@ -82,6 +141,39 @@ static EI_IMPULSE_ERROR inference_tflite_setup(
     return EI_IMPULSE_OK;
 }
 
+#if defined(EI_HAS_FOMO) && EI_CLASSIFIER_FOMO_LOGIT_DECODE == 1
+/**
+ * Let the model (or an instance of it) stop before its final SOFTMAX so the FOMO result is
+ * decoded from the logits, or run the whole model again (enable = false, e.g. when the caller
+ * wants the output tensor). The setting sticks until the next call.
+ *
+ * @return  true if the next invokes stop before the softmax, logits and params are then set
+ */
+static bool inference_tflite_fomo_logits(
+    ei_learning_block_config_tflite_graph_t *block_config,
+    void *instance,
+    bool enable,
+    TfLiteTensor *logits,
+    tflite::SoftmaxParams *params) {
+
+    ei_config_tflite_eon_graph_t *graph_config = (ei_config_tflite_eon_graph_t*)block_config->graph_config;
+
+    if (graph_config->implementation_version < 3 ||
+        (instance ? !graph_config->model_instance_softmax_logits : !graph_config->model_softmax_logits)) {
+        return false;
+    }
+
+    enable = enable &&
+        block_config->classification_mode == EI_CLASSIFIER_CLASSIFICATION_MODE_OBJECT_DETECTION &&
+        block_config->object_detection_last_layer == EI_CLASSIFIER_LAST_LAYER_FOMO;
+
+    TfLiteStatus status = instance ?
+        graph_config->model_instance_softmax_logits(instance, enable, logits, params) :
+        graph_config->model_softmax_logits(enable, logits, params);
+    return enable && status == kTfLiteOk;
+}
+#endif // EI_HAS_FOMO && EI_CLASSIFIER_FOMO_LOGIT_DECODE == 1
+
 /**
  * Run TFLite model
  *
@@ -107,6 +199,14 @@ static EI_IMPULSE_ERROR inference_tflite_run(
 
     ei_config_tflite_eon_graph_t *graph_config = (ei_config_tflite_eon_graph_t*)block_config->graph_config;
 
+#if defined(EI_HAS_FOMO) && EI_CLASSIFIER_FOMO_LOGIT_DECODE == 1
+    // the output tensor is only complete if the softmax runs
+    TfLiteTensor logits;
+    tflite::SoftmaxParams softmax_params;
+    bool logit_decode = inference_tflite_fomo_logits(
+        block_config, nullptr, !result->copy_output, &logits, &softmax_params);
+#endif // EI_HAS_FOMO && EI_CLASSIFIER_FOMO_LOGIT_DECODE == 1
+
     if (graph_config->model_invoke() != kTfLiteOk) {
         return EI_IMPULSE_TFLITE_ERROR;
     }
@@ -121,8 +221,18 @@ static EI_IMPULSE_ERROR inference_tflite_run(
         ei_printf("Predictions (time: %d ms.):\n", result->timing.classification);
     }
 
-    EI_IMPULSE_ERROR fill_res = fill_result_struct_from_output_tensor_tflite(
+    uint64_t fill_start_us = ei_read_timer_us();
+    EI_IMPULSE_ERROR fill_res;
+#if defined(EI_HAS_FOMO) && EI_CLASSIFIER_FOMO_LOGIT_DECODE == 1
+    if (logit_decode) {
+        fill_res = fill_result_struct_i8_fomo_logits(impulse, block_config, result, logits.data.int8, softmax_params,
+            output->params.zero_point, output->params.scale, impulse->fomo_output_size, impulse->fomo_output_size);
+    }
+    else
+#endif // EI_HAS_FOMO && EI_CLASSIFIER_FOMO_LOGIT_DECODE == 1
+    fill_res = fill_result_struct_from_output_tensor_tflite(
         impulse, block_config, output, labels_tensor, scores_tensor, result, debug);
+    result->timing.postprocessing_us += ei_read_timer_us() - fill_start_us;
 
     if (fill_res != EI_IMPULSE_OK) {
         return fill_res;
@@ -185,7 +295,7 @@ EI_IMPULSE_ERROR run_nn_inference_from_dsp(
         return output_res;
     }
 
-    if (graph_config->model_reset(ei_aligned_free) != kTfLiteOk) {
+    if (inference_tflite_model_reset(graph_config) != kTfLiteOk) {
         return EI_IMPULSE_TFLITE_ERROR;
     }
 
@@ -259,7 +369,7 @@ EI_IMPULSE_ERROR run_nn_inference(
         }
     }
 
-    graph_config->model_reset(ei_aligned_free);
+    inference_tflite_model_reset(graph_config);
 
     if (run_res != EI_IMPULSE_OK) {
         return run_res;
@@ -270,21 +380,22 @@ EI_IMPULSE_ERROR run_nn_inference(
 
 #if EI_CLASSIFIER_QUANTIZATION_ENABLED == 1
 /**
- * Special function to run the classifier on images, only works on TFLite models (either interpreter or EON or for tensaiflow)
- * that allocates a lot less memory by quantizing in place. This only works if 'can_run_classifier_image_quantized'
- * returns EI_IMPULSE_OK.
+ * Quantizes either the signal or the image buffer into the input tensor and runs the model,
+ * see run_nn_inference_image_quantized
  */
-EI_IMPULSE_ERROR run_nn_inference_image_quantized(
+static EI_IMPULSE_ERROR run_nn_inference_image_quantized_impl(
     const ei_impulse_t *impulse,
     signal_t *signal,
+    const image_signal_t *image,
+    const image_stream_t *image_stream,
     ei_impulse_result_t *result,
     void *config_ptr,
-    bool debug = false) {
+    bool debug) {
 
     ei_learning_block_config_tflite_graph_t *block_config = (ei_learning_block_config_tflite_graph_t*)config_ptr;
     ei_config_tflite_eon_graph_t *graph_config = (ei_config_tflite_eon_graph_t*)block_config->graph_config;
 
-    memset(result, 0, sizeof(ei_impulse_result_t));
+    ei_impulse_result_clear(result);
 
     uint64_t ctx_start_us;
     TfLiteTensor input;
@@ -316,8 +427,19 @@ EI_IMPULSE_ERROR run_nn_inference_image_quantized(
     ei::matrix_i8_t features_matrix(1, impulse->nn_input_frame_size, input.data.int8);
 
     // run DSP process and quantize automatically
-    int ret = extract_image_features_quantized(signal, &features_matrix, impulse->dsp_blocks[0].config, input.params.scale, input.params.zero_point,
-        impulse->frequency, impulse->learning_blocks[0].image_scaling);
+    int ret;
+    if (image_stream) {
+        ret = extract_image_stream_features_quantized(image_stream, &features_matrix, impulse->dsp_blocks[0].config, input.params.scale,
+            input.params.zero_point, impulse->learning_blocks[0].image_scaling);
+    }
+    else if (image) {
+        ret = extract_image_buffer_features_quantized(image, &features_matrix, impulse->dsp_blocks[0].config, input.params.scale,
+            input.params.zero_point, impulse->learning_blocks[0].image_scaling);
+    }
+    else {
+        ret = extract_image_features_quantized(signal, &features_matrix, impulse->dsp_blocks[0].config, input.params.scale, input.params.zero_point,
+            impulse->frequency, impulse->learning_blocks[0].image_scaling);
+    }
 
     if (ret != EIDSP_OK) {
         ei_printf("ERR: Failed to run DSP process (%d)\n", ret);
@@ -334,7 +456,8 @@ EI_IMPULSE_ERROR run_nn_inference_image_quantized(
     if (debug) {
         ei_printf("Features (%d ms.): ", result->timing.dsp);
         for (size_t ix = 0; ix < features_matrix.cols; ix++) {
-            ei_printf_float((features_matrix.buffer[ix] - input.params.zero_point) * input.params.scale);
+            int32_t value = input.type == kTfLiteUInt8 ? (uint8_t)features_matrix.buffer[ix] : features_matrix.buffer[ix];
+            ei_printf_float((value - input.params.zero_point) * input.params.scale);
             ei_printf(" ");
         }
         ei_printf("\n");
@@ -353,7 +476,7 @@ EI_IMPULSE_ERROR run_nn_inference_image_quantized(
         result,
         debug);
 
-    graph_config->model_reset(ei_aligned_free);
+    inference_tflite_model_reset(graph_config);
 
     if (run_res != EI_IMPULSE_OK) {
         return run_res;
@@ -361,6 +484,230 @@ EI_IMPULSE_ERROR run_nn_inference_image_quantized(
 
     return EI_IMPULSE_OK;
 }
+
+/**
+ * Special function to run the classifier on images, only works on TFLite models (either interpreter or EON or for tensaiflow)
+ * that allocates a lot less memory by quantizing in place. This only works if 'can_run_classifier_image_quantized'
+ * returns EI_IMPULSE_OK.
+ */
+EI_IMPULSE_ERROR run_nn_inference_image_quantized(
+    const ei_impulse_t *impulse,
+    signal_t *signal,
+    ei_impulse_result_t *result,
+    void *config_ptr,
+    bool debug = false) {
+
+    return run_nn_inference_image_quantized_impl(impulse, signal, nullptr, nullptr, result, config_ptr, debug);
+}
+
+/**
+ * Like run_nn_inference_image_quantized, but quantizes the pixels of a byte buffer directly into
+ * the input tensor. Same requirements as run_nn_inference_image_quantized.
+ */
+EI_IMPULSE_ERROR run_nn_inference_image_buffer_quantized(
+    const ei_impulse_t *impulse,
+    const image_signal_t *image,
+    ei_impulse_result_t *result,
+    void *config_ptr,
+    bool debug = false) {
+
+    return run_nn_inference_image_quantized_impl(impulse, nullptr, image, nullptr, result, config_ptr, debug);
+}
+
+/**
+ * Like run_nn_inference_image_buffer_quantized, but the rows are quantized into the input tensor
+ * as the stream produces them (e.g. while a JPEG is decoded and resized).
+ */
+EI_IMPULSE_ERROR run_nn_inference_image_stream_quantized(
+    const ei_impulse_t *impulse,
+    const image_stream_t *image_stream,
+    ei_impulse_result_t *result,
+    void *config_ptr,
+    bool debug = false) {
+
+    return run_nn_inference_image_quantized_impl(impulse, nullptr, nullptr, image_stream, result, config_ptr, debug);
+}
+
+/**
+ * Whether the compiled model can be instantiated, so several frames can be in flight at once
+ * (see run_classifier_batch)
+ */
+__attribute__((unused)) static bool ei_tflite_eon_has_instances(void *config_ptr) {
+    ei_learning_block_config_tflite_graph_t *block_config = (ei_learning_block_config_tflite_graph_t*)config_ptr;
+    ei_config_tflite_eon_graph_t *graph_config = (ei_config_tflite_eon_graph_t*)block_config->graph_config;
+
+    return graph_config->implementation_version >= 2 &&
+        graph_config->model_instance_create && graph_config->model_instance_invoke &&
+        graph_config->model_instance_destroy && graph_config->model_instance_input &&
+        graph_config->model_instance_output;
+}
+
+/**
+ * Create a model instance (init and prepare), independent of the resident model
+ */
+__attribute__((unused)) static EI_IMPULSE_ERROR ei_tflite_eon_instance_create(void *config_ptr, void **instance) {
+    ei_learning_block_config_tflite_graph_t *block_config = (ei_learning_block_config_tflite_graph_t*)config_ptr;
+    ei_config_tflite_eon_graph_t *graph_config = (ei_config_tflite_eon_graph_t*)block_config->graph_config;
+
+    TfLiteStatus status = graph_config->model_instance_create(instance, ei_aligned_calloc, ei_aligned_free);
+    if (status != kTfLiteOk) {
+        ei_printf("Failed to initialize the model (error code %d)\n", status);
+        return EI_IMPULSE_TFLITE_ARENA_ALLOC_FAILED;
+    }
+    return EI_IMPULSE_OK;
+}
+
+/**
+ * Free a model instance
+ */
+__attribute__((unused)) static void ei_tflite_eon_instance_destroy(void *config_ptr, void *instance) {
+    ei_learning_block_config_tflite_graph_t *block_config = (ei_learning_block_config_tflite_graph_t*)config_ptr;
+    ei_config_tflite_eon_graph_t *graph_config = (ei_config_tflite_eon_graph_t*)block_config->graph_config;
+
+    graph_config->model_instance_destroy(instance, ei_aligned_free);
+}
+
+/**
+ * First half of run_nn_inference_image_quantized on a model instance: quantizes the signal into
+ * the input tensor of the instance. Can run while other instances are invoked.
+ */
+__attribute__((unused)) static EI_IMPULSE_ERROR run_nn_inference_image_quantized_prepare(
+    const ei_impulse_t *impulse,
+    void *instance,
+    signal_t *signal,
+    ei_impulse_result_t *result,
+    void *config_ptr,
+    bool debug = false) {
+
+    ei_learning_block_config_tflite_graph_t *block_config = (ei_learning_block_config_tflite_graph_t*)config_ptr;
+    ei_config_tflite_eon_graph_t *graph_config = (ei_config_tflite_eon_graph_t*)block_config->graph_config;
+
+    TfLiteTensor input;
+    if (graph_config->model_instance_input(instance, 0, &input) != kTfLiteOk) {
+        return EI_IMPULSE_TFLITE_ERROR;
+    }
+
+    if (input.type != TfLiteType::kTfLiteInt8 && input.type != TfLiteType::kTfLiteUInt8) {
+        return EI_IMPULSE_ONLY_SUPPORTED_FOR_IMAGES;
+    }
+
+    uint64_t dsp_start_us = ei_read_timer_us();
+
+    ei::matrix_i8_t features_matrix(1, impulse->nn_input_frame_size, input.data.int8);
+
+    int ret = extract_image_features_quantized(signal, &features_matrix, impulse->dsp_blocks[0].config, input.params.scale,
+        input.params.zero_point, impulse->frequency, impulse->learning_blocks[0].image_scaling);
+    if (ret != EIDSP_OK) {
+        ei_printf("ERR: Failed to run DSP process (%d)\n", ret);
+        return EI_IMPULSE_DSP_ERROR;
+    }
+
+    if (ei_run_impulse_check_canceled() == EI_IMPULSE_CANCELED) {
+        return EI_IMPULSE_CANCELED;
+    }
+
+    result->timing.dsp_us = ei_read_timer_us() - dsp_start_us;
+    result->timing.dsp = (int)(result->timing.dsp_us / 1000);
+
+    if (debug) {
+        ei_printf("Features (%d ms.): ", result->timing.dsp);
+        for (size_t ix = 0; ix < features_matrix.cols; ix++) {
+            int32_t value = input.type == kTfLiteUInt8 ? (uint8_t)features_matrix.buffer[ix] : features_matrix.buffer[ix];
+            ei_printf_float((value - input.params.zero_point) * input.params.scale);
+            ei_printf(" ");
+        }
+        ei_printf("\n");
+    }
+
+    return EI_IMPULSE_OK;
+}
+
+/**
+ * Second half of run_nn_inference_image_quantized on a model instance: invokes the instance
+ * whose input was prepared. The result is filled by run_nn_inference_instance_fill_result.
+ */
+__attribute__((unused)) static EI_IMPULSE_ERROR run_nn_inference_instance_invoke(
+    void *instance,
+    ei_impulse_result_t *result,
+    void *config_ptr) {
+
+    ei_learning_block_config_tflite_graph_t *block_config = (ei_learning_block_config_tflite_graph_t*)config_ptr;
+    ei_config_tflite_eon_graph_t *graph_config = (ei_config_tflite_eon_graph_t*)block_config->graph_config;
+
+#if defined(EI_HAS_FOMO) && EI_CLASSIFIER_FOMO_LOGIT_DECODE == 1
+    // run_nn_inference_instance_fill_result decodes the logits when the softmax is skipped
+    inference_tflite_fomo_logits(block_config, instance, !result->copy_output, nullptr, nullptr);
+#endif // EI_HAS_FOMO && EI_CLASSIFIER_FOMO_LOGIT_DECODE == 1
+
+    uint64_t ctx_start_us = ei_read_timer_us();
+
+    if (graph_config->model_instance_invoke(instance) != kTfLiteOk) {
+        return EI_IMPULSE_TFLITE_ERROR;
+    }
+
+    result->timing.classification_us = ei_read_timer_us() - ctx_start_us;
+    result->timing.classification = (int)(result->timing.classification_us / 1000);
+
+    if (ei_run_impulse_check_canceled() == EI_IMPULSE_CANCELED) {
+        return EI_IMPULSE_CANCELED;
+    }
+
+    return EI_IMPULSE_OK;
+}
+
+/**
+ * Fill the result from the output tensors of an invoked instance. The last layer decoders keep
+ * their scratch space in statics, so only one result can be filled at a time.
+ */
+__attribute__((unused)) static EI_IMPULSE_ERROR run_nn_inference_instance_fill_result(
+    const ei_impulse_t *impulse,
+    void *instance,
+    ei_impulse_result_t *result,
+    void *config_ptr,
+    bool debug = false) {
+
+    ei_learning_block_config_tflite_graph_t *block_config = (ei_learning_block_config_tflite_graph_t*)config_ptr;
+    ei_config_tflite_eon_graph_t *graph_config = (ei_config_tflite_eon_graph_t*)block_config->graph_config;
+
+    TfLiteTensor output;
+    TfLiteTensor output_scores;
+    TfLiteTensor output_labels;
+
+    if (graph_config->model_instance_output(instance, block_config->output_data_tensor, &output) != kTfLiteOk) {
+        return EI_IMPULSE_TFLITE_ERROR;
+    }
+
+    if (block_config->object_detection_last_layer == EI_CLASSIFIER_LAST_LAYER_SSD) {
+        if (graph_config->model_instance_output(instance, block_config->output_score_tensor, &output_scores) != kTfLiteOk) {
+            return EI_IMPULSE_TFLITE_ERROR;
+        }
+        if (graph_config->model_instance_output(instance, block_config->output_labels_tensor, &output_labels) != kTfLiteOk) {
+            return EI_IMPULSE_TFLITE_ERROR;
+        }
+    }
+
+    if (debug) {
+        ei_printf("Predictions (time: %d ms.):\n", result->timing.classification);
+    }
+
+    uint64_t fill_start_us = ei_read_timer_us();
+    EI_IMPULSE_ERROR fill_res;
+#if defined(EI_HAS_FOMO) && EI_CLASSIFIER_FOMO_LOGIT_DECODE == 1
+    // same decision as run_nn_inference_instance_invoke, which already set it
+    TfLiteTensor logits;
+    tflite::SoftmaxParams softmax_params;
+    if (inference_tflite_fomo_logits(block_config, instance, !result->copy_output, &logits, &softmax_params)) {
+        fill_res = fill_result_struct_i8_fomo_logits(impulse, block_config, result, logits.data.int8, softmax_params,
+            output.params.zero_point, output.params.scale, impulse->fomo_output_size, impulse->fomo_output_size);
+    }
+    else
+#endif // EI_HAS_FOMO && EI_CLASSIFIER_FOMO_LOGIT_DECODE == 1
+    fill_res = fill_result_struct_from_output_tensor_tflite(
+        impulse, block_config, &output, &output_labels, &output_scores, result, debug);
+    result->timing.postprocessing_us += ei_read_timer_us() - fill_start_us;
+
+    return fill_res;
+}
 #endif // EI_CLASSIFIER_QUANTIZATION_ENABLED == 1
 
 __attribute__((unused)) int extract_tflite_eon_features(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float frequency) {
@@ -192,8 +192,10 @@ static EI_IMPULSE_ERROR inference_tflite_run(
         ei_printf("Predictions (time: %d ms.):\n", result->timing.classification);
     }
 
+    uint64_t fill_start_us = ei_read_timer_us();
     EI_IMPULSE_ERROR fill_res = fill_result_struct_from_output_tensor_tflite(
         impulse, block_config, output, labels_tensor, scores_tensor, result, debug);
+    result->timing.postprocessing_us += ei_read_timer_us() - fill_start_us;
 
     delete interpreter;
 
@@ -353,7 +355,7 @@ EI_IMPULSE_ERROR run_nn_inference_image_quantized(
 {
     ei_learning_block_config_tflite_graph_t *block_config = (ei_learning_block_config_tflite_graph_t*)config_ptr;
 
-    memset(result, 0, sizeof(ei_impulse_result_t));
+    ei_impulse_result_clear(result);
 
     uint64_t ctx_start_us;
     TfLiteTensor* input;
@@ -19,6 +19,7 @@
 #define EI_POSTPROCESSING_H
 
 #include "edge-impulse-sdk/classifier/ei_model_types.h"
+#include "edge-impulse-sdk/porting/ei_classifier_porting.h"
 
 #if EI_CLASSIFIER_CALIBRATION_ENABLED
 #include "edge-impulse-sdk/classifier/postprocessing/ei_performance_calibration.h"
@@ -80,6 +81,7 @@ extern "C" EI_IMPULSE_ERROR run_postprocessing(ei_impulse_handle_t *handle,
         return EI_IMPULSE_OUT_OF_MEMORY;
     }
     auto impulse = handle->impulse;
+    uint64_t postprocessing_start_us = ei_read_timer_us();
 
     for (size_t i = 0; i < impulse->postprocessing_blocks_size; i++) {
         void* state = NULL;
@@ -96,6 +98,8 @@ extern "C" EI_IMPULSE_ERROR run_postprocessing(ei_impulse_handle_t *handle,
         }
     }
 
+    result->timing.postprocessing_us += ei_read_timer_us() - postprocessing_start_us;
+
     return EI_IMPULSE_OK;
 }
 
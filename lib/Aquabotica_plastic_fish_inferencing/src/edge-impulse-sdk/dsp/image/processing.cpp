@@ -544,6 +544,340 @@ int resize_image_using_mode(
     // shouldn't get here
     return -2;
 }
+
+// fixed point of resize_image
+constexpr int RESIZE_FRAC_BITS = 14;
+constexpr int RESIZE_FRAC_VAL = (1 << RESIZE_FRAC_BITS);
+constexpr int RESIZE_FRAC_MASK = (RESIZE_FRAC_VAL - 1);
+
+// Crop, resize and padding of a stream, without its row buffers
+static int resize_stream_layout(
+    resize_stream_t *stream,
+    int srcWidth,
+    int srcHeight,
+    int dstWidth,
+    int dstHeight,
+    int pixel_size_B,
+    int mode,
+    int band_rows)
+{
+    memset(stream, 0, sizeof(resize_stream_t));
+
+    stream->srcWidth = srcWidth;
+    stream->srcHeight = srcHeight;
+    stream->dstWidth = dstWidth;
+    stream->pixel_size_B = pixel_size_B;
+    stream->cropWidth = srcWidth;
+    stream->cropHeight = srcHeight;
+    stream->resizeWidth = dstWidth;
+    stream->resizeHeight = dstHeight;
+    stream->prev_row_ix = -1;
+    stream->band_rows = band_rows;
+
+    if (mode == EI_CLASSIFIER_RESIZE_FIT_SHORTEST) {
+        calculate_crop_dims(srcWidth, srcHeight, dstWidth, dstHeight, stream->cropWidth, stream->cropHeight);
+        stream->cropX = (srcWidth - stream->cropWidth) / 2;
+        stream->cropY = (srcHeight - stream->cropHeight) / 2;
+    }
+    else if (mode == EI_CLASSIFIER_RESIZE_FIT_LONGEST) {
+        // same dimensions as resize_image_using_mode
+        float srcAspect = static_cast<float>(srcWidth) / srcHeight;
+        float dstAspect = static_cast<float>(dstWidth) / dstHeight;
+        if (srcAspect > dstAspect) {
+            stream->resizeWidth = dstWidth;
+            stream->resizeHeight = static_cast<int>(dstWidth / srcAspect);
+        }
+        else {
+            stream->resizeHeight = dstHeight;
+            stream->resizeWidth = static_cast<int>(dstHeight * srcAspect);
+        }
+        stream->padX = (dstWidth - stream->resizeWidth) / 2;
+        stream->padY = (dstHeight - stream->resizeHeight) / 2;
+    }
+    else if (mode != EI_CLASSIFIER_RESIZE_SQUASH) {
+        return EIDSP_PARAMETER_INVALID;
+    }
+    stream->padBottom = dstHeight - stream->padY - stream->resizeHeight;
+
+    if (stream->cropHeight < 2 || stream->resizeWidth <= 0 || stream->resizeHeight <= 0 || band_rows < 0) {
+        return EIDSP_PARAMETER_INVALID;
+    }
+    return EIDSP_OK;
+}
+
+// each row buffer starts 16-byte aligned in a caller's buffer
+static inline size_t resize_stream_align(size_t size)
+{
+    return (size + 15) & ~(size_t)15;
+}
+
+static size_t resize_stream_buffers_size(const resize_stream_t *stream)
+{
+    size_t crop_row_B = stream->cropWidth * stream->pixel_size_B;
+    return resize_stream_align(crop_row_B) + resize_stream_align(stream->dstWidth * stream->pixel_size_B) +
+        resize_stream_align(stream->resizeWidth * sizeof(uint32_t)) + crop_row_B * stream->band_rows;
+}
+
+size_t resize_stream_buffer_size(
+    int srcWidth,
+    int srcHeight,
+    int dstWidth,
+    int dstHeight,
+    int pixel_size_B,
+    int mode,
+    int band_rows)
+{
+    resize_stream_t stream;
+
+    if (resize_stream_layout(&stream, srcWidth, srcHeight, dstWidth, dstHeight, pixel_size_B, mode, band_rows) !=
+        EIDSP_OK) {
+        return 0;
+    }
+    return resize_stream_buffers_size(&stream);
+}
+
+int resize_stream_init(
+    resize_stream_t *stream,
+    int srcWidth,
+    int srcHeight,
+    int dstWidth,
+    int dstHeight,
+    int pixel_size_B,
+    int mode,
+    int band_rows,
+    resize_stream_row_fn write_row,
+    void *ctx,
+    uint8_t *buffer,
+    size_t buffer_size)
+{
+    int res = resize_stream_layout(stream, srcWidth, srcHeight, dstWidth, dstHeight, pixel_size_B, mode, band_rows);
+    if (res != EIDSP_OK) {
+        return res;
+    }
+    stream->write_row = write_row;
+    stream->ctx = ctx;
+
+    stream->src_y_frac = (stream->cropHeight * RESIZE_FRAC_VAL) / stream->resizeHeight;
+
+    size_t crop_row_B = stream->cropWidth * pixel_size_B;
+    if (buffer) {
+        if (buffer_size < resize_stream_buffers_size(stream)) {
+            return EIDSP_OUT_OF_MEM;
+        }
+        stream->prev_row = buffer;
+        buffer += resize_stream_align(crop_row_B);
+        stream->dst_row = buffer;
+        memset(stream->dst_row, 0, dstWidth * pixel_size_B);
+        buffer += resize_stream_align(dstWidth * pixel_size_B);
+        stream->x_table = (uint32_t *)buffer;
+        buffer += resize_stream_align(stream->resizeWidth * sizeof(uint32_t));
+        if (band_rows > 0) {
+            stream->band = buffer;
+        }
+    }
+    else {
+        stream->owns_buffers = true;
+        stream->prev_row = (uint8_t *)ei_malloc(crop_row_B);
+        stream->dst_row = (uint8_t *)ei_calloc(dstWidth * pixel_size_B, 1);
+        stream->x_table = (uint32_t *)ei_malloc(stream->resizeWidth * sizeof(uint32_t));
+        if (band_rows > 0) {
+            stream->band = (uint8_t *)ei_malloc(crop_row_B * band_rows);
+        }
+        if (!stream->prev_row || !stream->dst_row || !stream->x_table || (band_rows > 0 && !stream->band)) {
+            resize_stream_free(stream);
+            return EIDSP_OUT_OF_MEM;
+        }
+    }
+
+    // column and fraction of every output pixel, as resize_image steps them
+    const uint32_t src_x_frac = (stream->cropWidth * RESIZE_FRAC_VAL) / stream->resizeWidth;
+    uint32_t src_x_accum = 0;
+    for (int x = 0; x < stream->resizeWidth; x++) {
+        stream->x_table[x] = ((src_x_accum >> RESIZE_FRAC_BITS) << 16) | (src_x_accum & RESIZE_FRAC_MASK);
+        src_x_accum += src_x_frac;
+    }
+
+    return EIDSP_OK;
+}
+
+static int resize_stream_write_padding(resize_stream_t *stream, int first_y, int rows)
+{
+    if (rows <= 0) {
+        return EIDSP_OK;
+    }
+
+    // dst_row only ever has the resized region written, so clearing it is enough
+    memset(stream->dst_row, 0, stream->dstWidth * stream->pixel_size_B);
+    for (int y = first_y; y < first_y + rows; y++) {
+        int res = stream->write_row(stream->ctx, y, stream->dst_row);
+        if (res != 0) {
+            return res;
+        }
+    }
+    return EIDSP_OK;
+}
+
+/**
+ * @brief Interpolate one output row from crop rows top and bottom (bilinear, as resize_image)
+ */
+static void resize_stream_interpolate(resize_stream_t *stream, const uint8_t *top, const uint8_t *bottom, uint32_t y_frac)
+{
+    const int B = stream->pixel_size_B;
+    const uint32_t ny_frac = RESIZE_FRAC_VAL - y_frac;
+    const uint32_t last_tx = stream->cropWidth - 1;
+    uint8_t *d = stream->dst_row + stream->padX * B;
+
+    for (int x = 0; x < stream->resizeWidth; x++) {
+        uint32_t tx = stream->x_table[x] >> 16;
+        uint32_t x_frac = stream->x_table[x] & 0xffff;
+        uint32_t nx_frac = RESIZE_FRAC_VAL - x_frac;
+        uint32_t tx1 = tx < last_tx ? tx + 1 : last_tx;
+        const uint8_t *s0 = top + tx * B;
+        const uint8_t *s1 = top + tx1 * B;
+        const uint8_t *s2 = bottom + tx * B;
+        const uint8_t *s3 = bottom + tx1 * B;
+
+        for (int color = 0; color < B; color++) {
+            uint32_t p00 = ((s0[color] * nx_frac) + (s1[color] * x_frac) + RESIZE_FRAC_VAL / 2) >> RESIZE_FRAC_BITS; // top line
+            uint32_t p01 = ((s2[color] * nx_frac) + (s3[color] * x_frac) + RESIZE_FRAC_VAL / 2) >> RESIZE_FRAC_BITS; // bottom line
+            *d++ = (uint8_t)(((p00 * ny_frac) + (p01 * y_frac) + RESIZE_FRAC_VAL / 2) >> RESIZE_FRAC_BITS);
+        }
+    }
+}
+
+/**
+ * @brief Write all output rows that can be made with the rows pushed so far
+ *
+ * @param rows First of row_count consecutive source rows (starting at next_src_row),
+ *  x_offset_B is added to get to the first cropped pixel
+ */
+static int resize_stream_process(resize_stream_t *stream, const uint8_t *rows, int row_count, size_t stride,
+                                 size_t x_offset_B)
+{
+    const int first = stream->next_src_row - stream->cropY; // crop row of rows[0]
+    const int avail_end = first + row_count < stream->cropHeight ? first + row_count : stream->cropHeight;
+
+    if (row_count <= 0 || stream->next_src_row + row_count > stream->srcHeight) {
+        return row_count == 0 ? EIDSP_OK : EIDSP_OUT_OF_BOUNDS;
+    }
+    stream->next_src_row += row_count;
+
+    while (stream->next_resized_row < stream->resizeHeight) {
+        int ty = stream->src_y_accum >> RESIZE_FRAC_BITS;
+        int ty1 = ty + 1 < stream->cropHeight ? ty + 1 : stream->cropHeight - 1;
+        if (ty1 >= avail_end) {
+            break; // wait for more rows
+        }
+
+        const uint8_t *top;
+        if (ty >= first) {
+            top = rows + (ty - first) * stride + x_offset_B;
+        }
+        else if (ty == stream->prev_row_ix) {
+            top = stream->prev_row;
+        }
+        else {
+            return EIDSP_OUT_OF_BOUNDS;
+        }
+        const uint8_t *bottom = ty1 >= first ? rows + (ty1 - first) * stride + x_offset_B : stream->prev_row;
+
+        if (stream->next_resized_row == 0) {
+            int res = resize_stream_write_padding(stream, 0, stream->padY);
+            if (res != EIDSP_OK) {
+                return res;
+            }
+        }
+
+        resize_stream_interpolate(stream, top, bottom, stream->src_y_accum & RESIZE_FRAC_MASK);
+        int res = stream->write_row(stream->ctx, stream->padY + stream->next_resized_row, stream->dst_row);
+        if (res != 0) {
+            return res;
+        }
+        stream->src_y_accum += stream->src_y_frac;
+        stream->next_resized_row++;
+
+        if (stream->next_resized_row == stream->resizeHeight) {
+            res = resize_stream_write_padding(stream, stream->padY + stream->resizeHeight, stream->padBottom);
+            if (res != EIDSP_OK) {
+                return res;
+            }
+        }
+    }
+
+    // keep the last row, the next output row may interpolate between it and the next push
+    if (avail_end - 1 >= first && avail_end - 1 >= 0) {
+        memcpy(stream->prev_row, rows + (avail_end - 1 - first) * stride + x_offset_B,
+               stream->cropWidth * stream->pixel_size_B);
+        stream->prev_row_ix = avail_end - 1;
+    }
+    return EIDSP_OK;
+}
+
+int resize_stream_push_rows(
+    resize_stream_t *stream,
+    const uint8_t *rows,
+    int row_count,
+    size_t stride)
+{
+    return resize_stream_process(stream, rows, row_count, stride, stream->cropX * stream->pixel_size_B);
+}
+
+int resize_stream_push_block(
+    resize_stream_t *stream,
+    int x,
+    int y,
+    int w,
+    int h,
+    const uint8_t *data)
+{
+    const int B = stream->pixel_size_B;
+
+    if (h > stream->band_rows || y != stream->next_src_row || x + w > stream->srcWidth) {
+        return EIDSP_OUT_OF_BOUNDS;
+    }
+
+    // only the cropped columns of rows in the crop are kept
+    int crop_start = x > stream->cropX ? x : stream->cropX;
+    int crop_end = x + w < stream->cropX + stream->cropWidth ? x + w : stream->cropX + stream->cropWidth;
+    bool rows_in_crop = y + h > stream->cropY && y < stream->cropY + stream->cropHeight;
+
+    if (rows_in_crop && crop_start < crop_end) {
+        for (int row = 0; row < h; row++) {
+            memcpy(stream->band + (row * stream->cropWidth + crop_start - stream->cropX) * B,
+                   data + (row * w + crop_start - x) * B,
+                   (crop_end - crop_start) * B);
+        }
+    }
+
+    // rightmost block of the band
+    if (x + w == stream->srcWidth) {
+        return resize_stream_process(stream, stream->band, h, stream->cropWidth * B, 0);
+    }
+    return EIDSP_OK;
+}
+
+int resize_stream_finish(resize_stream_t *stream)
+{
+    if (stream->next_resized_row != stream->resizeHeight) {
+        return EIDSP_BUFFER_SIZE_MISMATCH;
+    }
+    return EIDSP_OK;
+}
+
+void resize_stream_free(resize_stream_t *stream)
+{
+    if (stream->owns_buffers) {
+        ei_free(stream->prev_row);
+        ei_free(stream->dst_row);
+        ei_free(stream->x_table);
+        ei_free(stream->band);
+    }
+    stream->owns_buffers = false;
+    stream->prev_row = nullptr;
+    stream->dst_row = nullptr;
+    stream->x_table = nullptr;
+    stream->band = nullptr;
+}
 } //namespaces
 }
 }
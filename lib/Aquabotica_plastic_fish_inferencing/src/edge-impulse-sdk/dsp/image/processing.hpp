@@ -216,5 +216,149 @@ int resize_image_using_mode(
     int dstHeight,
     int pixel_size_B,
     int mode);
+/**
+ * @brief Called for every output row of a resize stream, top to bottom
+ *
+ * @param ctx Context passed to resize_stream_init
+ * @param y Output row
+ * @param row dstWidth * pixel_size_B bytes, only valid during the call
+ * @return 0 to continue, anything else aborts the stream and is returned by the push function
+ */
+typedef int (*resize_stream_row_fn)(void *ctx, int y, const uint8_t *row);
+
+/**
+ * Streaming version of resize_image_using_mode: source rows are pushed in order (e.g. as a
+ * JPEG is decoded, one MCU row at a time) and output rows are written as soon as the
+ * source rows they interpolate from are in. Only keeps one source row between pushes,
+ * plus a band of cropped rows when fed with push_block.
+ * Output is identical to resize_image_using_mode, except at the right / bottom edge when
+ * upscaling, where the edge pixel is repeated.
+ */
+typedef struct {
+    int srcWidth;
+    int srcHeight;
+    int dstWidth;
+    int pixel_size_B;
+    // region of the source that's resized (the crop for FIT_SHORTEST)
+    int cropX;
+    int cropY;
+    int cropWidth;
+    int cropHeight;
+    // size and position of the resized region in the output (padded for FIT_LONGEST)
+    int resizeWidth;
+    int resizeHeight;
+    int padX;
+    int padY;
+    int padBottom;
+    uint32_t src_y_frac;
+    uint32_t src_y_accum;
+    int next_src_row; // next source row expected
+    int next_resized_row; // next row of the resized region to write
+    int prev_row_ix; // crop row held in prev_row, -1 if none
+    uint8_t *prev_row;
+    uint8_t *dst_row;
+    uint32_t *x_table; // per output column: source column << 16 | fraction
+    // band of cropped rows assembled by resize_stream_push_block
+    uint8_t *band;
+    int band_rows;
+    resize_stream_row_fn write_row;
+    void *ctx;
+    bool owns_buffers; // row buffers come from ei_malloc, not from the caller
+} resize_stream_t;
+
+/**
+ * @brief Bytes of row buffers a resize stream with these parameters needs, for the
+ * buffer argument of resize_stream_init
+ *
+ * @return size_t Size in bytes, 0 if the parameters are invalid
+ */
+size_t resize_stream_buffer_size(
+    int srcWidth,
+    int srcHeight,
+    int dstWidth,
+    int dstHeight,
+    int pixel_size_B,
+    int mode,
+    int band_rows);
+
+/**
+ * @brief Set up a resize stream, allocates the row buffers unless a buffer is passed
+ *
+ * @param stream Stream to initialize
+ * @param srcWidth Input width in pixels
+ * @param srcHeight Input height in pixels
+ * @param dstWidth Desired new width in pixels
+ * @param dstHeight Desired new height in pixels
+ * @param pixel_size_B Size of pixels in Bytes. 3 for RGB, 1 for mono
+ * @param mode Resizing mode (FIT_SHORTEST=1, FIT_LONGEST=2, SQUASH=3)
+ * @param band_rows Most rows of a block pushed through resize_stream_push_block
+ *  (MCU height of the JPEG, 16 covers all), 0 if only resize_stream_push_rows is used
+ * @param write_row Called with every output row
+ * @param ctx Passed to write_row
+ * @param buffer Memory for the row buffers, kept by the caller and reused from frame to
+ *  frame, nullptr to allocate them with ei_malloc
+ * @param buffer_size Size of buffer, at least resize_stream_buffer_size
+ * @return int Status code (0 for success, non-zero for failure)
+ */
+int resize_stream_init(
+    resize_stream_t *stream,
+    int srcWidth,
+    int srcHeight,
+    int dstWidth,
+    int dstHeight,
+    int pixel_size_B,
+    int mode,
+    int band_rows,
+    resize_stream_row_fn write_row,
+    void *ctx,
+    uint8_t *buffer = nullptr,
+    size_t buffer_size = 0);
+
+/**
+ * @brief Push the next source rows
+ *
+ * @param stream Stream
+ * @param rows First row, srcWidth pixels
+ * @param row_count Number of rows
+ * @param stride Bytes from the start of a row to the start of the next one
+ * @return int Status code (0 for success, non-zero for failure)
+ */
+int resize_stream_push_rows(
+    resize_stream_t *stream,
+    const uint8_t *rows,
+    int row_count,
+    size_t stride);
+
+/**
+ * @brief Push a block of source pixels, in the order a JPEG decoder writes MCUs
+ * (left to right, then top to bottom). Rows are resized once the rightmost block is in.
+ *
+ * @param stream Stream, band_rows set to at least h
+ * @param x X coord of the block
+ * @param y Y coord of the block
+ * @param w Width of the block in pixels
+ * @param h Height of the block in pixels
+ * @param data w * h pixels, packed
+ * @return int Status code (0 for success, non-zero for failure)
+ */
+int resize_stream_push_block(
+    resize_stream_t *stream,
+    int x,
+    int y,
+    int w,
+    int h,
+    const uint8_t *data);
+
+/**
+ * @brief Check that all output rows were written
+ *
+ * @return int EIDSP_OK, or EIDSP_BUFFER_SIZE_MISMATCH if source rows are missing
+ */
+int resize_stream_finish(resize_stream_t *stream);
+
+/**
+ * @brief Free the row buffers of a stream, unless they came from the caller
+ */
+void resize_stream_free(resize_stream_t *stream);
 }}} //namespaces
 #endif //!__EI_IMAGE_PROCESSING__H__
\ No newline at end of file
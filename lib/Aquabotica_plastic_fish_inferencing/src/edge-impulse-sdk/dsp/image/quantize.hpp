@@ -0,0 +1,686 @@
+/*
+ * Copyright (c) 2024 EdgeImpulse Inc.
+ *
+ * Generated by Edge Impulse and licensed under the applicable Edge Impulse
+ * Terms of Service. Community and Professional Terms of Service
+ * (https://docs.edgeimpulse.com/page/terms-of-service) or Enterprise Terms of
+ * Service (https://docs.edgeimpulse.com/page/enterprise-terms-of-service),
+ * according to your product plan subscription (the “License”).
+ *
+ * This software, documentation and other associated files (collectively referred
+ * to as the “Software”) is a single SDK variation generated by the Edge Impulse
+ * platform and requires an active paid Edge Impulse subscription to use this
+ * Software for any purpose.
+ *
+ * You may NOT use this Software unless you have an active Edge Impulse subscription
+ * that meets the eligibility requirements for the applicable License, subject to
+ * your full and continued compliance with the terms and conditions of the License,
+ * including without limitation any usage restrictions under the applicable License.
+ *
+ * If you do not have an active Edge Impulse product plan subscription, or if use
+ * of this Software exceeds the usage limitations of your Edge Impulse product plan
+ * subscription, you are not permitted to use this Software and must immediately
+ * delete and erase all copies of this Software within your control or possession.
+ * Edge Impulse reserves all rights and remedies available to enforce its rights.
+ *
+ * Unless required by applicable law or agreed to in writing, the Software is
+ * distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific language governing
+ * permissions, disclaimers and limitations under the License.
+ */
+#ifndef __EIDSP_IMAGE_QUANTIZE__H__
+#define __EIDSP_IMAGE_QUANTIZE__H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+// Vectorised kernels on SSE2/SSSE3/AVX2 and AArch64 NEON hosts, scalar elsewhere (e.g. ESP32).
+// SSE2 is the x86-64 baseline, the SSSE3 and AVX2 kernels are picked at runtime (see below).
+#ifndef EIDSP_IMAGE_QUANTIZE_SIMD
+#if defined(__SSE2__) || (defined(__ARM_NEON) && defined(__aarch64__))
+#define EIDSP_IMAGE_QUANTIZE_SIMD 1
+#else
+#define EIDSP_IMAGE_QUANTIZE_SIMD 0
+#endif
+#endif // EIDSP_IMAGE_QUANTIZE_SIMD
+
+#if EIDSP_IMAGE_QUANTIZE_SIMD == 1
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+#endif // EIDSP_IMAGE_QUANTIZE_SIMD == 1
+
+// With EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD the SSSE3 and AVX2 kernels are compiled with target
+// attributes and used when the CPU has AVX2 (GetX86Simd() of the TFLite kernels), so a build
+// without -mssse3 / -mavx2 still gets them. Otherwise they follow the build target.
+#if EIDSP_IMAGE_QUANTIZE_SIMD == 1 && defined(__SSE2__)
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/x86_check.h"
+
+#if EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+#define EIDSP_IMAGE_QUANTIZE_AVX2 1
+#define EIDSP_TARGET_AVX2 EI_X86_TARGET_AVX2
+#elif defined(__AVX2__)
+#define EIDSP_IMAGE_QUANTIZE_AVX2 1
+#define EIDSP_TARGET_AVX2
+#else
+#define EIDSP_IMAGE_QUANTIZE_AVX2 0
+#endif
+
+#if defined(__SSSE3__)
+#define EIDSP_IMAGE_QUANTIZE_SSSE3 1
+#define EIDSP_TARGET_SSSE3
+#elif EIDSP_IMAGE_QUANTIZE_AVX2 == 1
+// only picked on AVX2 CPUs, which all have SSSE3
+#define EIDSP_IMAGE_QUANTIZE_SSSE3 1
+#define EIDSP_TARGET_SSSE3 EIDSP_TARGET_AVX2
+#else
+#define EIDSP_IMAGE_QUANTIZE_SSSE3 0
+#endif
+#endif // EIDSP_IMAGE_QUANTIZE_SIMD == 1 && defined(__SSE2__)
+
+namespace ei { namespace image { namespace quantize {
+
+/**
+ * How a 0..255 channel value is scaled before it's quantized
+ */
+typedef enum {
+    SCALING_DIV_255 = 0, // v / 255
+    SCALING_TORCH = 1, // (v / 255 - mean) / std, with the ImageNet mean and std
+    SCALING_MIN128_127 = 2, // v - 128
+    SCALING_RAW = 3 // v
+} scaling_t;
+
+// ITU-R 601-2 luma transform in 16.16 fixed point
+// see: https://pillow.readthedocs.io/en/stable/reference/Image.html#PIL.Image.Image.convert
+static const int32_t luma_r = (int32_t)(0.299f * 65536.0f);
+static const int32_t luma_g = (int32_t)(0.587f * 65536.0f);
+static const int32_t luma_b = (int32_t)(0.114f * 65536.0f);
+
+static const float torch_mean[] = { 0.485, 0.456, 0.406 };
+static const float torch_std[] = { 0.229, 0.224, 0.225 };
+
+/**
+ * @brief Whether the input quantization is the one the sub128 kernels implement
+ * (scale 1/255, zero point -128, values scaled to 0..1)
+ */
+inline bool is_sub128(scaling_t scaling, float scale, float zero_point)
+{
+    return scale == 0.003921568859368563f && zero_point == -128 && scaling == SCALING_DIV_255;
+}
+
+/**
+ * @brief Whether the input quantization keeps the bytes as they are (scale 1/255, zero point 0,
+ * values scaled to 0..1), the uint8 input of EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT
+ */
+inline bool is_copy(scaling_t scaling, float scale, float zero_point)
+{
+    return scale == 0.003921568859368563f && zero_point == 0 && scaling == SCALING_DIV_255;
+}
+
+/**
+ * Reference implementations, also used for the tails of the vectorised kernels
+ */
+namespace scalar {
+
+template <scaling_t S>
+inline float scale_channel(float v, int channel)
+{
+    switch (S) {
+        case SCALING_DIV_255:
+            return v / 255.0f;
+        case SCALING_TORCH:
+            v /= 255.0f;
+            return (v - torch_mean[channel]) / torch_std[channel];
+        case SCALING_MIN128_127:
+            return v - 128.0f;
+        default:
+            return v;
+    }
+}
+
+/**
+ * @brief Quantize bytes with scale 1/255 and zero point -128, i.e. out = in - 128,
+ * a word at a time (v - 128 as int8 is v ^ 0x80)
+ */
+inline void bytes_sub128(const uint8_t *in, int8_t *out, size_t length)
+{
+    const size_t word_mask = (size_t)0x8080808080808080ULL;
+    size_t ix = 0;
+
+    for (; ix + sizeof(size_t) <= length; ix += sizeof(size_t)) {
+        size_t word;
+        memcpy(&word, in + ix, sizeof(size_t));
+        word ^= word_mask;
+        memcpy(out + ix, &word, sizeof(size_t));
+    }
+    for (; ix < length; ix++) {
+        out[ix] = static_cast<int8_t>(in[ix] ^ 0x80);
+    }
+}
+
+/**
+ * @brief RGB888 to a grayscale int8 input with scale 1/255 and zero point -128
+ */
+inline void rgb888_to_gray_sub128(const uint8_t *in, int8_t *out, size_t pixels)
+{
+    for (size_t ix = 0; ix < pixels; ix++, in += 3) {
+        int32_t gray = (luma_r * in[0]) + (luma_g * in[1]) + (luma_b * in[2]);
+        gray >>= 16; // scale down to int8_t
+        gray += -128;
+        if (gray < - 128) gray = -128;
+        else if (gray > 127) gray = 127;
+        out[ix] = static_cast<int8_t>(gray);
+    }
+}
+
+/**
+ * @brief RGB888 to an RGB int8 input with any quantization
+ */
+template <scaling_t S>
+inline void rgb888_to_i8(const uint8_t *in, int8_t *out, size_t pixels, float scale, float zero_point)
+{
+    for (size_t ix = 0; ix < pixels; ix++, in += 3, out += 3) {
+        for (int c = 0; c < 3; c++) {
+            float v = scale_channel<S>(static_cast<float>(in[c]), c);
+            out[c] = static_cast<int8_t>(round(v / scale) + zero_point);
+        }
+    }
+}
+
+/**
+ * @brief RGB888 to a grayscale int8 input with any quantization
+ */
+template <scaling_t S>
+inline void rgb888_to_gray_i8(const uint8_t *in, int8_t *out, size_t pixels, float scale, float zero_point)
+{
+    for (size_t ix = 0; ix < pixels; ix++, in += 3) {
+        float r = scale_channel<S>(static_cast<float>(in[0]), 0);
+        float g = scale_channel<S>(static_cast<float>(in[1]), 1);
+        float b = scale_channel<S>(static_cast<float>(in[2]), 2);
+
+        float v = (0.299f * r) + (0.587f * g) + (0.114f * b);
+        out[ix] = static_cast<int8_t>(round(v / scale) + zero_point);
+    }
+}
+
+} // namespace scalar
+
+#if EIDSP_IMAGE_QUANTIZE_SIMD == 1 && defined(__SSE2__)
+
+/**
+ * round() (half away from zero) for |v| < 2^31, returned as int32
+ */
+inline __m128i sse2_round_away(__m128 v)
+{
+    __m128i t = _mm_cvttps_epi32(v);
+    __m128 frac = _mm_sub_ps(v, _mm_cvtepi32_ps(t));
+    __m128 abs_frac = _mm_andnot_ps(_mm_set1_ps(-0.0f), frac);
+    __m128i round_up = _mm_castps_si128(_mm_cmpge_ps(abs_frac, _mm_set1_ps(0.5f)));
+    // +1 for positive, -1 for negative values
+    __m128i step = _mm_or_si128(_mm_srai_epi32(_mm_castps_si128(v), 31), _mm_set1_epi32(1));
+    return _mm_add_epi32(t, _mm_and_si128(round_up, step));
+}
+
+template <scaling_t S>
+inline __m128i sse2_quantize(__m128i values, int pattern, float scale, __m128i zero_point,
+                             const __m128 *mean, const __m128 *std)
+{
+    __m128 v = _mm_cvtepi32_ps(values);
+
+    switch (S) {
+        case SCALING_DIV_255:
+            v = _mm_div_ps(v, _mm_set1_ps(255.0f));
+            break;
+        case SCALING_TORCH:
+            v = _mm_div_ps(v, _mm_set1_ps(255.0f));
+            v = _mm_div_ps(_mm_sub_ps(v, mean[pattern]), std[pattern]);
+            break;
+        case SCALING_MIN128_127:
+            v = _mm_sub_ps(v, _mm_set1_ps(128.0f));
+            break;
+        default:
+            break;
+    }
+    v = _mm_div_ps(v, _mm_set1_ps(scale));
+    // low byte of the int32, like the scalar float -> int8_t conversion
+    return _mm_and_si128(_mm_add_epi32(sse2_round_away(v), zero_point), _mm_set1_epi32(0xff));
+}
+
+/**
+ * Whether the AVX2 kernels run on this CPU
+ */
+inline bool x86_avx2()
+{
+#if defined(__AVX2__)
+    return true;
+#elif EIDSP_IMAGE_QUANTIZE_AVX2 == 1
+    return tflite::optimized_ops::GetX86Simd() != tflite::optimized_ops::X86Simd::kNone;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Whether the SSSE3 kernels run on this CPU
+ */
+inline bool x86_ssse3()
+{
+#if defined(__SSSE3__)
+    return true;
+#else
+    return x86_avx2();
+#endif
+}
+
+#if EIDSP_IMAGE_QUANTIZE_AVX2 == 1
+
+/**
+ * v ^ 0x80 over 32 byte blocks, returns how many bytes were done
+ */
+EIDSP_TARGET_AVX2 inline size_t bytes_sub128_avx2(const uint8_t *in, int8_t *out, size_t length)
+{
+    const __m256i mask = _mm256_set1_epi8((char)0x80);
+    size_t ix = 0;
+
+    for (; ix + 32 <= length; ix += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + ix));
+        _mm256_storeu_si256((__m256i *)(out + ix), _mm256_xor_si256(v, mask));
+    }
+    return ix;
+}
+
+/**
+ * RGB888 to int8 over 48 value blocks, returns how many values were done
+ */
+template <scaling_t S>
+EIDSP_TARGET_AVX2 inline size_t rgb888_to_i8_avx2(const uint8_t *in, int8_t *out, size_t length, float scale, float zero_point)
+{
+    // channel of lane j in vector q of a 48 value block is (8q + j) % 3, repeats every 3 vectors
+    __m256 mean[3], std[3];
+    for (int q = 0; q < 3; q++) {
+        float m[8], s[8];
+        for (int j = 0; j < 8; j++) {
+            m[j] = torch_mean[(8 * q + j) % 3];
+            s[j] = torch_std[(8 * q + j) % 3];
+        }
+        mean[q] = _mm256_loadu_ps(m);
+        std[q] = _mm256_loadu_ps(s);
+    }
+    const __m256 v255 = _mm256_set1_ps(255.0f);
+    const __m256 v128 = _mm256_set1_ps(128.0f);
+    const __m256 vscale = _mm256_set1_ps(scale);
+    const __m256i vzero_point = _mm256_set1_epi32((int32_t)zero_point);
+    const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i low_byte = _mm256_set1_epi32(0xff);
+    size_t ix = 0;
+
+    for (; ix + 48 <= length; ix += 48) {
+        for (int q = 0; q < 6; q++) {
+            __m256 v = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(in + ix + q * 8))));
+
+            switch (S) {
+                case SCALING_DIV_255:
+                    v = _mm256_div_ps(v, v255);
+                    break;
+                case SCALING_TORCH:
+                    v = _mm256_div_ps(v, v255);
+                    v = _mm256_div_ps(_mm256_sub_ps(v, mean[q % 3]), std[q % 3]);
+                    break;
+                case SCALING_MIN128_127:
+                    v = _mm256_sub_ps(v, v128);
+                    break;
+                default:
+                    break;
+            }
+            v = _mm256_div_ps(v, vscale);
+
+            // round half away from zero
+            __m256i t = _mm256_cvttps_epi32(v);
+            __m256 frac = _mm256_andnot_ps(sign_mask, _mm256_sub_ps(v, _mm256_cvtepi32_ps(t)));
+            __m256i round_up = _mm256_castps_si256(_mm256_cmp_ps(frac, half, _CMP_GE_OQ));
+            __m256i step = _mm256_or_si256(_mm256_srai_epi32(_mm256_castps_si256(v), 31), one);
+            t = _mm256_add_epi32(_mm256_add_epi32(t, _mm256_and_si256(round_up, step)), vzero_point);
+            t = _mm256_and_si256(t, low_byte);
+
+            __m128i w = _mm_packs_epi32(_mm256_castsi256_si128(t), _mm256_extracti128_si256(t, 1));
+            _mm_storel_epi64((__m128i *)(out + ix + q * 8), _mm_packus_epi16(w, w));
+        }
+    }
+    return ix;
+}
+
+#endif // EIDSP_IMAGE_QUANTIZE_AVX2 == 1
+
+#if EIDSP_IMAGE_QUANTIZE_SSSE3 == 1
+
+/**
+ * RGB888 to gray - 128 over 16 pixel blocks, returns how many pixels were done
+ */
+EIDSP_TARGET_SSSE3 inline size_t rgb888_to_gray_sub128_ssse3(const uint8_t *in, int8_t *out, size_t pixels)
+{
+    // gathers the R, G and B bytes of 16 pixels spread over three 16 byte loads
+    const __m128i r0 = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i r1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+    const __m128i r2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+    const __m128i g0 = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i g1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+    const __m128i g2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+    const __m128i b0 = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i b1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+    const __m128i b2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+    // madd pairs: luma_r * r + (luma_g - 65536) * g, the 65536 * g is added separately
+    const __m128i coef_rg = _mm_set1_epi32((luma_r & 0xffff) | ((luma_g - 65536) << 16));
+    const __m128i coef_b = _mm_set1_epi32(luma_b);
+    const __m128i zero = _mm_setzero_si128();
+    size_t ix = 0;
+
+    for (; ix + 16 <= pixels; ix += 16) {
+        const uint8_t *p = in + ix * 3;
+        __m128i a = _mm_loadu_si128((const __m128i *)p);
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(p + 32));
+
+        __m128i r8 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, r0), _mm_shuffle_epi8(b, r1)), _mm_shuffle_epi8(c, r2));
+        __m128i g8 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, g0), _mm_shuffle_epi8(b, g1)), _mm_shuffle_epi8(c, g2));
+        __m128i b8 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, b0), _mm_shuffle_epi8(b, b1)), _mm_shuffle_epi8(c, b2));
+
+        __m128i gray16[2];
+        for (int half = 0; half < 2; half++) {
+            __m128i r16 = half ? _mm_unpackhi_epi8(r8, zero) : _mm_unpacklo_epi8(r8, zero);
+            __m128i g16 = half ? _mm_unpackhi_epi8(g8, zero) : _mm_unpacklo_epi8(g8, zero);
+            __m128i b16 = half ? _mm_unpackhi_epi8(b8, zero) : _mm_unpacklo_epi8(b8, zero);
+
+            __m128i lo = _mm_add_epi32(
+                _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(r16, g16), coef_rg),
+                              _mm_madd_epi16(_mm_unpacklo_epi16(b16, zero), coef_b)),
+                _mm_slli_epi32(_mm_unpacklo_epi16(g16, zero), 16));
+            __m128i hi = _mm_add_epi32(
+                _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(r16, g16), coef_rg),
+                              _mm_madd_epi16(_mm_unpackhi_epi16(b16, zero), coef_b)),
+                _mm_slli_epi32(_mm_unpackhi_epi16(g16, zero), 16));
+
+            gray16[half] = _mm_packs_epi32(_mm_srli_epi32(lo, 16), _mm_srli_epi32(hi, 16));
+        }
+
+        // gray is at most 254, so gray - 128 as int8 is gray ^ 0x80
+        __m128i gray8 = _mm_packus_epi16(gray16[0], gray16[1]);
+        _mm_storeu_si128((__m128i *)(out + ix), _mm_xor_si128(gray8, _mm_set1_epi8((char)0x80)));
+    }
+    return ix;
+}
+
+#endif // EIDSP_IMAGE_QUANTIZE_SSSE3 == 1
+
+#endif // EIDSP_IMAGE_QUANTIZE_SIMD == 1 && defined(__SSE2__)
+
+/**
+ * @brief Name of the instruction set the kernels run with on this CPU
+ */
+inline const char *simd_name()
+{
+#if EIDSP_IMAGE_QUANTIZE_SIMD == 1 && defined(__SSE2__)
+    if (x86_avx2()) {
+        return "avx2";
+    }
+    return x86_ssse3() ? "ssse3" : "sse2";
+#elif EIDSP_IMAGE_QUANTIZE_SIMD == 1 && defined(__ARM_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+/**
+ * @brief Quantize bytes with scale 1/255 and zero point -128 (out = in - 128)
+ */
+inline void bytes_sub128(const uint8_t *in, int8_t *out, size_t length)
+{
+    size_t ix = 0;
+
+#if EIDSP_IMAGE_QUANTIZE_SIMD == 1
+#if defined(__SSE2__)
+#if EIDSP_IMAGE_QUANTIZE_AVX2 == 1
+    if (x86_avx2()) {
+        ix = bytes_sub128_avx2(in, out, length);
+    }
+#endif
+
+    const __m128i mask = _mm_set1_epi8((char)0x80);
+    for (; ix + 16 <= length; ix += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + ix));
+        _mm_storeu_si128((__m128i *)(out + ix), _mm_xor_si128(v, mask));
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t mask = vdupq_n_u8(0x80);
+    for (; ix + 16 <= length; ix += 16) {
+        vst1q_s8(out + ix, vreinterpretq_s8_u8(veorq_u8(vld1q_u8(in + ix), mask)));
+    }
+#endif
+#endif // EIDSP_IMAGE_QUANTIZE_SIMD == 1
+
+    scalar::bytes_sub128(in + ix, out + ix, length - ix);
+}
+
+/**
+ * @brief RGB888 to a grayscale int8 input with scale 1/255 and zero point -128
+ */
+inline void rgb888_to_gray_sub128(const uint8_t *in, int8_t *out, size_t pixels)
+{
+    size_t ix = 0;
+
+#if EIDSP_IMAGE_QUANTIZE_SIMD == 1
+#if defined(__SSE2__)
+#if EIDSP_IMAGE_QUANTIZE_SSSE3 == 1
+    if (x86_ssse3()) {
+        ix = rgb888_to_gray_sub128_ssse3(in, out, pixels);
+    }
+#endif
+#elif defined(__ARM_NEON)
+    for (; ix + 16 <= pixels; ix += 16) {
+        uint8x16x3_t rgb = vld3q_u8(in + ix * 3);
+        uint16x8_t gray16[2];
+
+        for (int half = 0; half < 2; half++) {
+            uint16x8_t r16 = vmovl_u8(half ? vget_high_u8(rgb.val[0]) : vget_low_u8(rgb.val[0]));
+            uint16x8_t g16 = vmovl_u8(half ? vget_high_u8(rgb.val[1]) : vget_low_u8(rgb.val[1]));
+            uint16x8_t b16 = vmovl_u8(half ? vget_high_u8(rgb.val[2]) : vget_low_u8(rgb.val[2]));
+
+            uint32x4_t lo = vmull_n_u16(vget_low_u16(r16), (uint16_t)luma_r);
+            lo = vmlal_n_u16(lo, vget_low_u16(g16), (uint16_t)luma_g);
+            lo = vmlal_n_u16(lo, vget_low_u16(b16), (uint16_t)luma_b);
+            uint32x4_t hi = vmull_n_u16(vget_high_u16(r16), (uint16_t)luma_r);
+            hi = vmlal_n_u16(hi, vget_high_u16(g16), (uint16_t)luma_g);
+            hi = vmlal_n_u16(hi, vget_high_u16(b16), (uint16_t)luma_b);
+
+            gray16[half] = vcombine_u16(vshrn_n_u32(lo, 16), vshrn_n_u32(hi, 16));
+        }
+
+        // gray is at most 254, so gray - 128 as int8 is gray ^ 0x80
+        uint8x16_t gray8 = vcombine_u8(vmovn_u16(gray16[0]), vmovn_u16(gray16[1]));
+        vst1q_s8(out + ix, vreinterpretq_s8_u8(veorq_u8(gray8, vdupq_n_u8(0x80))));
+    }
+#endif
+#endif // EIDSP_IMAGE_QUANTIZE_SIMD == 1
+
+    scalar::rgb888_to_gray_sub128(in + ix * 3, out + ix, pixels - ix);
+}
+
+/**
+ * @brief RGB888 to an RGB int8 input with any quantization, the scaling is a template
+ * parameter so the per-value work is branch free
+ */
+template <scaling_t S>
+inline void rgb888_to_i8(const uint8_t *in, int8_t *out, size_t pixels, float scale, float zero_point)
+{
+    size_t ix = 0;
+    const size_t length = pixels * 3;
+
+#if EIDSP_IMAGE_QUANTIZE_SIMD == 1
+#if defined(__SSE2__)
+#if EIDSP_IMAGE_QUANTIZE_AVX2 == 1
+    if (x86_avx2()) {
+        ix = rgb888_to_i8_avx2<S>(in, out, length, scale, zero_point);
+    }
+#endif
+    {
+        // channel of lane j in vector q of a 48 value block is (4q + j) % 3, repeats every 3 vectors
+        __m128 mean[3], std[3];
+        for (int q = 0; q < 3; q++) {
+            mean[q] = _mm_setr_ps(torch_mean[(4 * q) % 3], torch_mean[(4 * q + 1) % 3],
+                                  torch_mean[(4 * q + 2) % 3], torch_mean[(4 * q + 3) % 3]);
+            std[q] = _mm_setr_ps(torch_std[(4 * q) % 3], torch_std[(4 * q + 1) % 3],
+                                 torch_std[(4 * q + 2) % 3], torch_std[(4 * q + 3) % 3]);
+        }
+        const __m128i vzero_point = _mm_set1_epi32((int32_t)zero_point);
+        const __m128i zero = _mm_setzero_si128();
+
+        for (; ix + 48 <= length; ix += 48) {
+            for (int k = 0; k < 3; k++) {
+                __m128i bytes = _mm_loadu_si128((const __m128i *)(in + ix + k * 16));
+                __m128i lo16 = _mm_unpacklo_epi8(bytes, zero);
+                __m128i hi16 = _mm_unpackhi_epi8(bytes, zero);
+
+                __m128i q0 = sse2_quantize<S>(_mm_unpacklo_epi16(lo16, zero), (4 * k + 0) % 3, scale, vzero_point, mean, std);
+                __m128i q1 = sse2_quantize<S>(_mm_unpackhi_epi16(lo16, zero), (4 * k + 1) % 3, scale, vzero_point, mean, std);
+                __m128i q2 = sse2_quantize<S>(_mm_unpacklo_epi16(hi16, zero), (4 * k + 2) % 3, scale, vzero_point, mean, std);
+                __m128i q3 = sse2_quantize<S>(_mm_unpackhi_epi16(hi16, zero), (4 * k + 3) % 3, scale, vzero_point, mean, std);
+
+                __m128i packed = _mm_packus_epi16(_mm_packs_epi32(q0, q1), _mm_packs_epi32(q2, q3));
+                _mm_storeu_si128((__m128i *)(out + ix + k * 16), packed);
+            }
+        }
+    }
+#elif defined(__ARM_NEON)
+    {
+        float32x4_t mean[3], std[3];
+        for (int q = 0; q < 3; q++) {
+            float m[4], s[4];
+            for (int j = 0; j < 4; j++) {
+                m[j] = torch_mean[(4 * q + j) % 3];
+                s[j] = torch_std[(4 * q + j) % 3];
+            }
+            mean[q] = vld1q_f32(m);
+            std[q] = vld1q_f32(s);
+        }
+        const float32x4_t v255 = vdupq_n_f32(255.0f);
+        const float32x4_t v128 = vdupq_n_f32(128.0f);
+        const float32x4_t vscale = vdupq_n_f32(scale);
+        const int32x4_t vzero_point = vdupq_n_s32((int32_t)zero_point);
+
+        for (; ix + 48 <= length; ix += 48) {
+            for (int k = 0; k < 3; k++) {
+                uint8x16_t bytes = vld1q_u8(in + ix + k * 16);
+                uint16x8_t lo16 = vmovl_u8(vget_low_u8(bytes));
+                uint16x8_t hi16 = vmovl_u8(vget_high_u8(bytes));
+                uint32x4_t values[4] = { vmovl_u16(vget_low_u16(lo16)), vmovl_u16(vget_high_u16(lo16)),
+                                         vmovl_u16(vget_low_u16(hi16)), vmovl_u16(vget_high_u16(hi16)) };
+                int16x4_t narrowed[4];
+
+                for (int j = 0; j < 4; j++) {
+                    int pattern = (4 * k + j) % 3;
+                    float32x4_t v = vcvtq_f32_u32(values[j]);
+
+                    switch (S) {
+                        case SCALING_DIV_255:
+                            v = vdivq_f32(v, v255);
+                            break;
+                        case SCALING_TORCH:
+                            v = vdivq_f32(v, v255);
+                            v = vdivq_f32(vsubq_f32(v, mean[pattern]), std[pattern]);
+                            break;
+                        case SCALING_MIN128_127:
+                            v = vsubq_f32(v, v128);
+                            break;
+                        default:
+                            break;
+                    }
+                    v = vdivq_f32(v, vscale);
+
+                    // vcvtaq rounds half away from zero, like round()
+                    narrowed[j] = vmovn_s32(vaddq_s32(vcvtaq_s32_f32(v), vzero_point));
+                }
+
+                int8x16_t packed = vcombine_s8(vmovn_s16(vcombine_s16(narrowed[0], narrowed[1])),
+                                               vmovn_s16(vcombine_s16(narrowed[2], narrowed[3])));
+                vst1q_s8(out + ix + k * 16, packed);
+            }
+        }
+    }
+#endif
+#endif // EIDSP_IMAGE_QUANTIZE_SIMD == 1
+
+    scalar::rgb888_to_i8<S>(in + ix, out + ix, (length - ix) / 3, scale, zero_point);
+}
+
+/**
+ * @brief Quantize RGB888 pixels into an RGB int8 input, picks the kernel once per call
+ */
+inline void rgb888_to_i8(const uint8_t *in, int8_t *out, size_t pixels, scaling_t scaling, float scale, float zero_point)
+{
+    if (is_sub128(scaling, scale, zero_point)) {
+        bytes_sub128(in, out, pixels * 3);
+        return;
+    }
+    if (is_copy(scaling, scale, zero_point)) {
+        memcpy(out, in, pixels * 3);
+        return;
+    }
+
+    switch (scaling) {
+        case SCALING_DIV_255:
+            rgb888_to_i8<SCALING_DIV_255>(in, out, pixels, scale, zero_point);
+            break;
+        case SCALING_TORCH:
+            rgb888_to_i8<SCALING_TORCH>(in, out, pixels, scale, zero_point);
+            break;
+        case SCALING_MIN128_127:
+            rgb888_to_i8<SCALING_MIN128_127>(in, out, pixels, scale, zero_point);
+            break;
+        default:
+            rgb888_to_i8<SCALING_RAW>(in, out, pixels, scale, zero_point);
+            break;
+    }
+}
+
+/**
+ * @brief Quantize RGB888 pixels into a grayscale int8 input, picks the kernel once per call
+ */
+inline void rgb888_to_gray_i8(const uint8_t *in, int8_t *out, size_t pixels, scaling_t scaling, float scale, float zero_point)
+{
+    if (is_sub128(scaling, scale, zero_point)) {
+        rgb888_to_gray_sub128(in, out, pixels);
+        return;
+    }
+
+    switch (scaling) {
+        case SCALING_DIV_255:
+            scalar::rgb888_to_gray_i8<SCALING_DIV_255>(in, out, pixels, scale, zero_point);
+            break;
+        case SCALING_TORCH:
+            scalar::rgb888_to_gray_i8<SCALING_TORCH>(in, out, pixels, scale, zero_point);
+            break;
+        case SCALING_MIN128_127:
+            scalar::rgb888_to_gray_i8<SCALING_MIN128_127>(in, out, pixels, scale, zero_point);
+            break;
+        default:
+            scalar::rgb888_to_gray_i8<SCALING_RAW>(in, out, pixels, scale, zero_point);
+            break;
+    }
+}
+
+}}} // namespaces
+
+#endif // __EIDSP_IMAGE_QUANTIZE__H__
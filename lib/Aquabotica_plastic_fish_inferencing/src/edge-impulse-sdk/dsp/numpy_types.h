@@ -625,6 +625,56 @@ typedef struct ei_signal_t {
     size_t total_length;
 } signal_t;
 
+/**
+ * Pixel layout of an image_signal_t buffer
+ */
+typedef enum {
+    EI_IMAGE_SIGNAL_RGB888 = 0,
+    EI_IMAGE_SIGNAL_BGR888 = 1,
+    EI_IMAGE_SIGNAL_GRAYSCALE = 2
+} ei_image_signal_format_t;
+
+/**
+ * Image in a byte buffer (e.g. a camera frame). Quantized image models read it
+ * directly into the input tensor, without packing pixels into floats through
+ * signal_t::get_data.
+ */
+typedef struct ei_image_signal_t {
+    /**
+     * First pixel of the top row
+     */
+    const uint8_t *buffer;
+    size_t width;
+    size_t height;
+    /**
+     * Bytes from the start of a row to the start of the next one, 0 if rows are packed
+     */
+    size_t stride;
+    ei_image_signal_format_t format;
+} image_signal_t;
+
+/**
+ * Receives one row of an image_stream_t (width pixels), returns 0 to continue
+ */
+typedef int (*ei_image_row_writer_t)(void *sink, int y, const uint8_t *row);
+
+/**
+ * Image produced row by row, e.g. resized while a JPEG is decoded. Quantized image
+ * models quantize every row straight into the input tensor as it's written, so the
+ * image is never held in memory as a whole.
+ */
+typedef struct ei_image_stream_t {
+    /**
+     * Writes every row of the image, top to bottom, through write_row(sink, y, row).
+     * Returns 0 on success.
+     */
+    int (*produce)(void *ctx, ei_image_row_writer_t write_row, void *sink);
+    void *ctx;
+    size_t width;
+    size_t height;
+    ei_image_signal_format_t format;
+} image_stream_t;
+
 /** @} */
 
 #ifdef __cplusplus
@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2022 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS
+ * IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language
+ * governing permissions and limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _EI_THREAD_POOL_H_
+#define _EI_THREAD_POOL_H_
+
+#include <stdint.h>
+#include "edge-impulse-sdk/classifier/ei_classifier_config.h"
+
+// Most threads a layer is split over, EI_CLASSIFIER_TFLITE_THREADS=0 included
+#ifndef EI_THREAD_POOL_MAX_THREADS
+#define EI_THREAD_POOL_MAX_THREADS      8
+#endif
+
+// Least work (MACs or elements) worth handing to another thread: waking a thread
+// takes tens of microseconds on a host OS, a few on FreeRTOS
+#ifndef EI_THREAD_POOL_MIN_TASK_WORK
+    #if defined(__linux__) || defined(__APPLE__) || defined(_WIN32)
+        #define EI_THREAD_POOL_MIN_TASK_WORK    200000
+    #else
+        #define EI_THREAD_POOL_MIN_TASK_WORK    20000
+    #endif
+#endif
+
+// Stack of the FreeRTOS worker tasks (bytes)
+#ifndef EI_THREAD_POOL_STACK_SIZE
+#define EI_THREAD_POOL_STACK_SIZE       4096
+#endif
+
+#if EI_CLASSIFIER_TFLITE_THREADS != 1 && (defined(__linux__) || defined(__APPLE__) || defined(_WIN32))
+#define EI_THREAD_POOL_STD              1
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#elif EI_CLASSIFIER_TFLITE_THREADS > 1 && defined(ESP32)
+#define EI_THREAD_POOL_FREERTOS         1
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#endif
+
+namespace ei {
+
+/**
+ * Task of a parallel_for(), run once for every index in [0, count)
+ */
+typedef void (*parallel_task_fn)(void *ctx, int task);
+
+#if defined(EI_THREAD_POOL_STD) || defined(EI_THREAD_POOL_FREERTOS)
+
+/**
+ * Runs the tasks of one parallel_for() at a time over a fixed set of worker
+ * threads, created on first use and kept for the lifetime of the program.
+ * The calling thread works too, and every thread claims the next task from a
+ * shared counter until none are left, so a thread that is slowed down (e.g.
+ * the other ESP32 core servicing WiFi) takes fewer tasks. Results never
+ * depend on which thread ran a task, as long as tasks write disjoint outputs.
+ *
+ * A parallel_for() that finds the pool busy (another model instance, a batch
+ * worker, or a task itself calling parallel_for()) runs its tasks on the
+ * calling thread instead of waiting.
+ */
+class ThreadPool {
+public:
+    static ThreadPool &get()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    /**
+     * Threads a parallel_for() can use, the calling thread included
+     */
+    int threads() const
+    {
+        return threads_;
+    }
+
+    /**
+     * Runs fn(ctx, task) for every task in [0, count), returns false without
+     * running anything if the pool is busy
+     */
+    bool run(int count, parallel_task_fn fn, void *ctx)
+    {
+        bool idle = false;
+        if (!busy_.compare_exchange_strong(idle, true, std::memory_order_acquire)) {
+            return false;
+        }
+
+        fn_ = fn;
+        ctx_ = ctx;
+        count_ = count;
+        next_.store(0, std::memory_order_relaxed);
+        start_workers();
+        work();
+        wait_workers();
+
+        busy_.store(false, std::memory_order_release);
+        return true;
+    }
+
+private:
+    ThreadPool();
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void start_workers();
+    void wait_workers();
+
+    void work()
+    {
+        int task;
+        while ((task = next_.fetch_add(1, std::memory_order_relaxed)) < count_) {
+            fn_(ctx_, task);
+        }
+    }
+
+    int threads_ = 1;
+    std::atomic<bool> busy_ { false };
+    std::atomic<int> next_ { 0 };
+    parallel_task_fn fn_ = nullptr;
+    void *ctx_ = nullptr;
+    int count_ = 0;
+
+#if defined(EI_THREAD_POOL_STD)
+    void worker()
+    {
+        uint32_t seen = 0;
+        std::unique_lock<std::mutex> guard(lock_);
+        while (true) {
+            wake_.wait(guard, [&]() { return stop_ || generation_ != seen; });
+            if (stop_) {
+                return;
+            }
+            seen = generation_;
+            guard.unlock();
+            work();
+            guard.lock();
+            // run() waits for every worker, so none can miss a generation
+            if (--running_ == 0) {
+                done_.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex lock_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    uint32_t generation_ = 0;
+    int running_ = 0;
+    bool stop_ = false;
+#else
+    static void worker(void *arg)
+    {
+        ThreadPool *pool = static_cast<ThreadPool *>(arg);
+        while (true) {
+            xSemaphoreTake(pool->wake_, portMAX_DELAY);
+            pool->work();
+            xSemaphoreGive(pool->done_);
+        }
+    }
+
+    int workers_ = 0;
+    SemaphoreHandle_t wake_ = nullptr;
+    SemaphoreHandle_t done_ = nullptr;
+#endif
+};
+
+#if defined(EI_THREAD_POOL_STD)
+
+inline ThreadPool::ThreadPool()
+{
+    int threads = EI_CLASSIFIER_TFLITE_THREADS;
+    if (threads <= 0) {
+        threads = (int)std::thread::hardware_concurrency();
+    }
+    threads_ = threads < 1 ? 1 : (threads > EI_THREAD_POOL_MAX_THREADS ? EI_THREAD_POOL_MAX_THREADS : threads);
+    for (int ix = 1; ix < threads_; ix++) {
+        workers_.emplace_back(&ThreadPool::worker, this);
+    }
+}
+
+inline ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread &worker : workers_) {
+        worker.join();
+    }
+}
+
+inline void ThreadPool::start_workers()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        generation_++;
+        running_ = (int)workers_.size();
+    }
+    wake_.notify_all();
+}
+
+inline void ThreadPool::wait_workers()
+{
+    std::unique_lock<std::mutex> guard(lock_);
+    done_.wait(guard, [&]() { return running_ == 0; });
+}
+
+#else
+
+// One worker pinned to every other core, at the priority of the first caller
+inline ThreadPool::ThreadPool()
+{
+    int threads = EI_CLASSIFIER_TFLITE_THREADS > portNUM_PROCESSORS ? portNUM_PROCESSORS : EI_CLASSIFIER_TFLITE_THREADS;
+    wake_ = xSemaphoreCreateCounting(threads, 0);
+    done_ = xSemaphoreCreateCounting(threads, 0);
+    if (wake_ == nullptr || done_ == nullptr) {
+        return;
+    }
+
+    const BaseType_t core = xPortGetCoreID();
+    for (int ix = 1; ix < threads; ix++) {
+        if (xTaskCreatePinnedToCore(&ThreadPool::worker, "ei_pool", EI_THREAD_POOL_STACK_SIZE, this,
+                uxTaskPriorityGet(nullptr), nullptr, (core + ix) % portNUM_PROCESSORS) != pdPASS) {
+            break;
+        }
+        workers_++;
+    }
+    threads_ = workers_ + 1;
+}
+
+// Never destroyed while a program runs on an MCU
+inline ThreadPool::~ThreadPool()
+{
+}
+
+inline void ThreadPool::start_workers()
+{
+    for (int ix = 0; ix < workers_; ix++) {
+        xSemaphoreGive(wake_);
+    }
+}
+
+inline void ThreadPool::wait_workers()
+{
+    for (int ix = 0; ix < workers_; ix++) {
+        xSemaphoreTake(done_, portMAX_DELAY);
+    }
+}
+
+#endif
+
+/**
+ * Threads a parallel_for() can use, the calling thread included
+ */
+inline int parallel_threads()
+{
+    return ThreadPool::get().threads();
+}
+
+/**
+ * Runs fn(ctx, task) for every task in [0, count), spread over the thread
+ * pool. Returns once every task ran.
+ */
+inline void parallel_for(int count, parallel_task_fn fn, void *ctx)
+{
+    if (count > 1 && ThreadPool::get().run(count, fn, ctx)) {
+        return;
+    }
+    for (int task = 0; task < count; task++) {
+        fn(ctx, task);
+    }
+}
+
+#else
+
+inline int parallel_threads()
+{
+    return 1;
+}
+
+inline void parallel_for(int count, parallel_task_fn fn, void *ctx)
+{
+    for (int task = 0; task < count; task++) {
+        fn(ctx, task);
+    }
+}
+
+#endif // EI_THREAD_POOL_STD || EI_THREAD_POOL_FREERTOS
+
+/**
+ * parallel_for() with a callable, e.g. a lambda taking the task index
+ */
+template <typename Fn>
+inline void parallel_for(int count, const Fn &fn)
+{
+    parallel_for(count, [](void *ctx, int task) { (*static_cast<const Fn *>(ctx))(task); },
+        const_cast<Fn *>(&fn));
+}
+
+/**
+ * Number of tasks to split `items` rows (or blocks) holding `work` MACs or
+ * elements into: 1 when the work does not pay for waking another thread,
+ * otherwise two per thread, so the threads can balance out
+ */
+inline int parallel_tasks(int items, uint64_t work)
+{
+    int threads = parallel_threads();
+    if (threads <= 1 || items <= 1 || work < 2 * (uint64_t)EI_THREAD_POOL_MIN_TASK_WORK) {
+        return 1;
+    }
+    uint64_t tasks = work / EI_THREAD_POOL_MIN_TASK_WORK;
+    if (tasks > (uint64_t)(2 * threads)) {
+        tasks = 2 * threads;
+    }
+    return tasks > (uint64_t)items ? items : (int)tasks;
+}
+
+/**
+ * First of the `items` rows (or blocks) task `task` of `tasks` covers, the
+ * task ends where task + 1 starts
+ */
+inline int parallel_task_first(int items, int tasks, int task)
+{
+    return (int)((int64_t)items * task / tasks);
+}
+
+} // namespace ei
+
+#endif // _EI_THREAD_POOL_H_
@@ -0,0 +1,75 @@
+/* Copyright 2019 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_INTEGER_OPS_ADD_H_
+#define TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_INTEGER_OPS_ADD_H_
+
+// Edge Impulse: int8 element-wise add with its three requantizations (both
+// inputs to the common scale, the sum to the output) run as rows through
+// requantize.h, bit-exact with reference_integer_ops::AddElementwise.
+
+#include <algorithm>
+
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/integer_ops/requantize.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/reference/integer_ops/add.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/types.h"
+
+namespace tflite {
+namespace optimized_integer_ops {
+
+// Elements per block, the int32 intermediates live on the stack
+constexpr int kAddBlock = 64;
+
+// Drop-in for reference_integer_ops::AddElementwise (the input shifts of an
+// add are never positive, so MultiplyByQuantizedMultiplier rounds them the
+// same as MultiplyByQuantizedMultiplierSmallerThanOneExp)
+inline void AddElementwise(int size, const ArithmeticParams& params,
+                           const int8_t* input1_data, const int8_t* input2_data,
+                           int8_t* output_data) {
+  reference_integer_ops::CheckArithmeticParams(params);
+  TFLITE_DCHECK_LE(params.input1_shift, 0);
+  TFLITE_DCHECK_LE(params.input2_shift, 0);
+  TFLITE_DCHECK_LE(params.output_shift, 0);
+
+  int32_t input1[kAddBlock];
+  int32_t input2[kAddBlock];
+  for (int first = 0; first < size; first += kAddBlock) {
+    const int count = std::min(kAddBlock, size - first);
+    for (int i = 0; i < count; ++i) {
+      input1[i] = (params.input1_offset + input1_data[first + i]) *
+                  (1 << params.left_shift);
+      input2[i] = (params.input2_offset + input2_data[first + i]) *
+                  (1 << params.left_shift);
+    }
+    MultiplyByQuantizedMultiplierRow(input1, input1, count,
+                                     params.input1_multiplier,
+                                     params.input1_shift);
+    MultiplyByQuantizedMultiplierRow(input2, input2, count,
+                                     params.input2_multiplier,
+                                     params.input2_shift);
+    for (int i = 0; i < count; ++i) {
+      input1[i] += input2[i];
+    }
+    RequantizeRowPerTensor(input1, params.output_multiplier,
+                           params.output_shift, count, params.output_offset,
+                           params.quantized_activation_min,
+                           params.quantized_activation_max,
+                           output_data + first);
+  }
+}
+
+}  // namespace optimized_integer_ops
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_INTEGER_OPS_ADD_H_
@@ -0,0 +1,347 @@
+/* Copyright 2019 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_INTEGER_OPS_CONV_H_
+#define TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_INTEGER_OPS_CONV_H_
+
+// Edge Impulse: x86-64 AVX2 / AVX-VNNI version of
+// reference_integer_ops::ConvPerChannel. The accumulation is exact in int32
+// and the requantization is the reference one (run a pixel at a time by
+// RequantizeRow), so the output is bit-exact
+// with the reference kernel, which is still used for anything not covered
+// here (grouped convolutions, very deep filters, CPUs without AVX2).
+
+#include <string.h>
+
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/integer_ops/requantize.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/x86_check.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/reference/integer_ops/conv.h"
+
+#if EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+
+namespace tflite {
+namespace optimized_integer_ops {
+
+// Output pixels computed together, they share every filter load
+constexpr int kX86ConvPixels = 4;
+// Longest filter (height * width * input depth) and most output channels
+// the kernel keeps on the stack
+constexpr int kX86ConvMaxDepth = 4608;
+constexpr int kX86ConvMaxOutputDepth = 1024;
+
+struct X86ConvGeometry {
+  int input_height;
+  int input_width;
+  int input_depth;
+  int filter_height;
+  int filter_width;
+  int stride_height;
+  int stride_width;
+  int dilation_height;
+  int dilation_width;
+  int pad_height;
+  int pad_width;
+  // filter_height * filter_width * input_depth, and rounded up to a vector
+  int depth;
+  int padded_depth;
+};
+
+// Receptive field of an output pixel in filter order as (input + input_offset)
+// in int16, 0 outside the image and past the filter depth
+EI_X86_TARGET_AVX2 inline void X86ConvPatchInt16(const X86ConvGeometry& g,
+                                                 const int8_t* input_batch,
+                                                 int32_t input_offset,
+                                                 int in_y_origin,
+                                                 int in_x_origin,
+                                                 int16_t* patch) {
+  const __m256i offset = _mm256_set1_epi16(static_cast<int16_t>(input_offset));
+  int16_t* dst = patch;
+  for (int filter_y = 0; filter_y < g.filter_height; ++filter_y) {
+    const int in_y = in_y_origin + g.dilation_height * filter_y;
+    for (int filter_x = 0; filter_x < g.filter_width; ++filter_x) {
+      const int in_x = in_x_origin + g.dilation_width * filter_x;
+      if (in_x < 0 || in_x >= g.input_width || in_y < 0 ||
+          in_y >= g.input_height) {
+        memset(dst, 0, g.input_depth * sizeof(int16_t));
+        dst += g.input_depth;
+        continue;
+      }
+      const int8_t* src =
+          input_batch + (in_y * g.input_width + in_x) * g.input_depth;
+      int c = 0;
+      for (; c + 16 <= g.input_depth; c += 16) {
+        __m256i v = _mm256_cvtepi8_epi16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + c)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + c),
+                            _mm256_add_epi16(v, offset));
+      }
+      for (; c < g.input_depth; ++c) {
+        dst[c] = static_cast<int16_t>(src[c] + input_offset);
+      }
+      dst += g.input_depth;
+    }
+  }
+  memset(dst, 0, (g.padded_depth - g.depth) * sizeof(int16_t));
+}
+
+// Receptive field of an output pixel in filter order as (input + 128) in
+// uint8, for the unsigned x signed VNNI dot products. Outside the image it is
+// (128 - input_offset), so that (input + input_offset) is 0 there as in the
+// reference, past the filter depth it is 0.
+EI_X86_TARGET_AVX2 inline void X86ConvPatchUint8(const X86ConvGeometry& g,
+                                                 const int8_t* input_batch,
+                                                 int32_t input_offset,
+                                                 int in_y_origin,
+                                                 int in_x_origin,
+                                                 uint8_t* patch) {
+  const __m256i sign = _mm256_set1_epi8(static_cast<char>(0x80));
+  uint8_t* dst = patch;
+  for (int filter_y = 0; filter_y < g.filter_height; ++filter_y) {
+    const int in_y = in_y_origin + g.dilation_height * filter_y;
+    for (int filter_x = 0; filter_x < g.filter_width; ++filter_x) {
+      const int in_x = in_x_origin + g.dilation_width * filter_x;
+      if (in_x < 0 || in_x >= g.input_width || in_y < 0 ||
+          in_y >= g.input_height) {
+        memset(dst, 128 - input_offset, g.input_depth);
+        dst += g.input_depth;
+        continue;
+      }
+      const int8_t* src =
+          input_batch + (in_y * g.input_width + in_x) * g.input_depth;
+      int c = 0;
+      for (; c + 32 <= g.input_depth; c += 32) {
+        __m256i v =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + c));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + c),
+                            _mm256_xor_si256(v, sign));
+      }
+      for (; c < g.input_depth; ++c) {
+        dst[c] = static_cast<uint8_t>(src[c] ^ 0x80);
+      }
+      dst += g.input_depth;
+    }
+  }
+  memset(dst, 0, g.padded_depth - g.depth);
+}
+
+// Filter row of an output channel, read a whole vector at a time. Rows whose
+// last vector would run past the end of the filter are copied first, the
+// bytes after the row only ever meet the zero padding of the patches.
+inline const int8_t* X86ConvFilterRow(const X86ConvGeometry& g,
+                                      const int8_t* filter_data,
+                                      int output_depth, int out_channel,
+                                      int8_t* tail_row) {
+  const int8_t* row = filter_data + out_channel * g.depth;
+  if (out_channel * g.depth + g.padded_depth <= output_depth * g.depth) {
+    return row;
+  }
+  memcpy(tail_row, row, g.depth);
+  memset(tail_row + g.depth, 0, g.padded_depth - g.depth);
+  return tail_row;
+}
+
+// acc[p * output_depth + oc] = sum over the filter of patch_p * filter_oc
+template <int kPixels>
+EI_X86_TARGET_AVX2 inline void X86ConvDotAvx2(const X86ConvGeometry& g,
+                                              const int16_t* patches,
+                                              const int8_t* filter_data,
+                                              int output_depth,
+                                              int32_t* acc) {
+  alignas(32) int8_t tail_row[kX86ConvMaxDepth];
+  for (int out_channel = 0; out_channel < output_depth; ++out_channel) {
+    const int8_t* row =
+        X86ConvFilterRow(g, filter_data, output_depth, out_channel, tail_row);
+    __m256i sums[kPixels];
+    for (int p = 0; p < kPixels; ++p) {
+      sums[p] = _mm256_setzero_si256();
+    }
+    for (int k = 0; k < g.padded_depth; k += 16) {
+      const __m256i weights = _mm256_cvtepi8_epi16(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + k)));
+      for (int p = 0; p < kPixels; ++p) {
+        const __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+            patches + p * kX86ConvMaxDepth + k));
+        // (input + offset) fits int16 and the pairwise sums of the products
+        // are exact in int32
+        sums[p] = _mm256_add_epi32(sums[p], _mm256_madd_epi16(values, weights));
+      }
+    }
+    for (int p = 0; p < kPixels; ++p) {
+      acc[p * output_depth + out_channel] = optimized_ops::X86HorizontalSum(sums[p]);
+    }
+  }
+}
+
+// As X86ConvDotAvx2 on (input + 128) patches, corrected with the filter sums
+template <int kPixels>
+EI_X86_TARGET_AVX_VNNI inline void X86ConvDotAvxVnni(
+    const X86ConvGeometry& g, const uint8_t* patches,
+    const int8_t* filter_data, int output_depth, const int32_t* corrections,
+    int32_t* acc) {
+  alignas(32) int8_t tail_row[kX86ConvMaxDepth];
+  for (int out_channel = 0; out_channel < output_depth; ++out_channel) {
+    const int8_t* row =
+        X86ConvFilterRow(g, filter_data, output_depth, out_channel, tail_row);
+    __m256i sums[kPixels];
+    for (int p = 0; p < kPixels; ++p) {
+      sums[p] = _mm256_setzero_si256();
+    }
+    for (int k = 0; k < g.padded_depth; k += 32) {
+      const __m256i weights =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + k));
+      for (int p = 0; p < kPixels; ++p) {
+        const __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+            patches + p * kX86ConvMaxDepth + k));
+        // sums of 4 products of uint8 and int8, no saturation
+        sums[p] = _mm256_dpbusd_avx_epi32(sums[p], values, weights);
+      }
+    }
+    for (int p = 0; p < kPixels; ++p) {
+      acc[p * output_depth + out_channel] =
+          optimized_ops::X86HorizontalSum(sums[p]) + corrections[out_channel];
+    }
+  }
+}
+
+inline bool X86ConvSupported(const RuntimeShape& input_shape,
+                             const RuntimeShape& filter_shape,
+                             const RuntimeShape& output_shape) {
+  return input_shape.Dims(3) == filter_shape.Dims(3) &&
+         filter_shape.Dims(1) * filter_shape.Dims(2) * filter_shape.Dims(3) <=
+             kX86ConvMaxDepth - 32 &&
+         output_shape.Dims(3) <= kX86ConvMaxOutputDepth;
+}
+
+// Drop-in for reference_integer_ops::ConvPerChannel (int8 input and filter)
+inline void ConvPerChannel(
+    const ConvParams& params, const int32_t* output_multiplier,
+    const int32_t* output_shift, const RuntimeShape& input_shape,
+    const int8_t* input_data, const RuntimeShape& filter_shape,
+    const int8_t* filter_data, const RuntimeShape& bias_shape,
+    const int32_t* bias_data, const RuntimeShape& output_shape,
+    int8_t* output_data,
+    optimized_ops::X86Simd simd = optimized_ops::GetX86Simd()) {
+  if (simd == optimized_ops::X86Simd::kNone ||
+      !X86ConvSupported(input_shape, filter_shape, output_shape)) {
+    reference_integer_ops::ConvPerChannel(
+        params, output_multiplier, output_shift, input_shape, input_data,
+        filter_shape, filter_data, bias_shape, bias_data, output_shape,
+        output_data);
+    return;
+  }
+  const bool vnni = simd == optimized_ops::X86Simd::kAvxVnni;
+
+  const int32_t input_offset = params.input_offset;
+  const int32_t output_offset = params.output_offset;
+  const int32_t output_activation_min = params.quantized_activation_min;
+  const int32_t output_activation_max = params.quantized_activation_max;
+  TFLITE_DCHECK_LE(output_activation_min, output_activation_max);
+  TFLITE_DCHECK_EQ(input_shape.DimensionsCount(), 4);
+  TFLITE_DCHECK_EQ(filter_shape.DimensionsCount(), 4);
+  TFLITE_DCHECK_EQ(output_shape.DimensionsCount(), 4);
+  const int batches = MatchingDim(input_shape, 0, output_shape, 0);
+  const int output_depth = MatchingDim(filter_shape, 0, output_shape, 3);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  if (bias_data) {
+    TFLITE_DCHECK_EQ(bias_shape.FlatSize(), output_depth);
+  }
+
+  X86ConvGeometry g;
+  g.input_height = input_shape.Dims(1);
+  g.input_width = input_shape.Dims(2);
+  g.input_depth = input_shape.Dims(3);
+  g.filter_height = filter_shape.Dims(1);
+  g.filter_width = filter_shape.Dims(2);
+  g.stride_height = params.stride_height;
+  g.stride_width = params.stride_width;
+  g.dilation_height = params.dilation_height_factor;
+  g.dilation_width = params.dilation_width_factor;
+  g.pad_height = params.padding_values.height;
+  g.pad_width = params.padding_values.width;
+  g.depth = g.filter_height * g.filter_width * g.input_depth;
+  const int vector_bytes = vnni ? 32 : 16;
+  g.padded_depth = (g.depth + vector_bytes - 1) / vector_bytes * vector_bytes;
+
+  alignas(32) int16_t patches[kX86ConvPixels * kX86ConvMaxDepth];
+  int32_t acc[kX86ConvPixels * kX86ConvMaxOutputDepth];
+  // sum((input + 128) * filter) + (input_offset - 128) * sum(filter)
+  //   = sum((input + input_offset) * filter)
+  int32_t corrections[kX86ConvMaxOutputDepth];
+  if (vnni) {
+    for (int out_channel = 0; out_channel < output_depth; ++out_channel) {
+      const int8_t* row = filter_data + out_channel * g.depth;
+      int32_t sum = 0;
+      for (int k = 0; k < g.depth; ++k) {
+        sum += row[k];
+      }
+      corrections[out_channel] = (input_offset - 128) * sum;
+    }
+  }
+  uint8_t* patches_u8 = reinterpret_cast<uint8_t*>(patches);
+
+  for (int batch = 0; batch < batches; ++batch) {
+    const int8_t* input_batch =
+        input_data + batch * g.input_height * g.input_width * g.input_depth;
+    for (int out_y = 0; out_y < output_height; ++out_y) {
+      const int in_y_origin = (out_y * g.stride_height) - g.pad_height;
+      for (int out_x0 = 0; out_x0 < output_width; out_x0 += kX86ConvPixels) {
+        const int pixels = std::min(kX86ConvPixels, output_width - out_x0);
+        for (int p = 0; p < pixels; ++p) {
+          const int in_x_origin =
+              ((out_x0 + p) * g.stride_width) - g.pad_width;
+          if (vnni) {
+            X86ConvPatchUint8(g, input_batch, input_offset, in_y_origin,
+                              in_x_origin, patches_u8 + p * kX86ConvMaxDepth);
+          } else {
+            X86ConvPatchInt16(g, input_batch, input_offset, in_y_origin,
+                              in_x_origin, patches + p * kX86ConvMaxDepth);
+          }
+        }
+
+        if (vnni) {
+          switch (pixels) {
+            case 4: X86ConvDotAvxVnni<4>(g, patches_u8, filter_data, output_depth, corrections, acc); break;
+            case 3: X86ConvDotAvxVnni<3>(g, patches_u8, filter_data, output_depth, corrections, acc); break;
+            case 2: X86ConvDotAvxVnni<2>(g, patches_u8, filter_data, output_depth, corrections, acc); break;
+            default: X86ConvDotAvxVnni<1>(g, patches_u8, filter_data, output_depth, corrections, acc); break;
+          }
+        } else {
+          switch (pixels) {
+            case 4: X86ConvDotAvx2<4>(g, patches, filter_data, output_depth, acc); break;
+            case 3: X86ConvDotAvx2<3>(g, patches, filter_data, output_depth, acc); break;
+            case 2: X86ConvDotAvx2<2>(g, patches, filter_data, output_depth, acc); break;
+            default: X86ConvDotAvx2<1>(g, patches, filter_data, output_depth, acc); break;
+          }
+        }
+
+        for (int p = 0; p < pixels; ++p) {
+          RequantizeRow(acc + p * output_depth, bias_data, output_multiplier,
+                        output_shift, output_depth, output_offset,
+                        output_activation_min, output_activation_max,
+                        output_data +
+                            Offset(output_shape, batch, out_y, out_x0 + p, 0),
+                        PointwiseRequantize());
+        }
+      }
+    }
+  }
+}
+
+}  // namespace optimized_integer_ops
+}  // namespace tflite
+
+#endif  // EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+
+#endif  // TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_INTEGER_OPS_CONV_H_
@@ -0,0 +1,372 @@
+/* Copyright 2019 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_INTEGER_OPS_CONV_3X3_H_
+#define TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_INTEGER_OPS_CONV_3X3_H_
+
+// Edge Impulse: int8 3x3 conv and depthwise conv (depth multiplier 1, no
+// dilation, single batch) with the stride and channel counts as template
+// arguments, so EON compiled models can instantiate one kernel per layer.
+// The tap and channel loops have constant trip counts the compiler unrolls,
+// and output pixels whose window lies inside the input skip the padding
+// checks. The channels of every output pixel are requantized as one row
+// (RequantizeRow). Accumulation is exact in int32, so the output is bit-exact with
+// reference_integer_ops::ConvPerChannel / DepthwiseConvPerChannel when the
+// requantization passed in is PointwiseRequantize (and with the ESP-NN
+// kernels for EspNnRequantize).
+//
+// The conv also reads uint8 inputs: a uint8 pixel u with input_offset 0 is
+// the int8 value u - 128 with input_offset 128 (zero point -128), so a model
+// can take image bytes as they are (EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT).
+// Padding taps contribute 0 either way.
+
+#include <algorithm>
+
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/common.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/integer_ops/requantize.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/x86_check.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/types.h"
+
+namespace tflite {
+namespace optimized_integer_ops {
+
+// Taps [first, end) of a 3 wide window starting at in (may be negative) that
+// fall inside an input of size rows or columns
+inline void Conv3x3Taps(int in, int size, int* first, int* end) {
+  *first = std::max(0, -in);
+  *end = std::min(3, size - in);
+}
+
+template <int kStride, int kDepth, typename Requantize>
+inline void DepthwiseConv3x3PerChannelPortable(
+    const DepthwiseParams& params, const int32_t* output_multiplier,
+    const int32_t* output_shift, const RuntimeShape& input_shape,
+    const int8_t* input_data, const int8_t* filter_data,
+    const int32_t* bias_data, const RuntimeShape& output_shape,
+    int8_t* output_data, const Requantize& requantize) {
+  const int input_height = input_shape.Dims(1);
+  const int input_width = input_shape.Dims(2);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  const int32_t input_offset = params.input_offset;
+  TFLITE_DCHECK_EQ(input_shape.Dims(3), kDepth);
+  TFLITE_DCHECK_EQ(output_shape.Dims(3), kDepth);
+
+  int32_t acc[kDepth];
+  for (int out_y = 0; out_y < output_height; ++out_y) {
+    const int in_y = out_y * kStride - params.padding_values.height;
+    int y_first, y_end;
+    Conv3x3Taps(in_y, input_height, &y_first, &y_end);
+    for (int out_x = 0; out_x < output_width; ++out_x) {
+      const int in_x = out_x * kStride - params.padding_values.width;
+      int x_first, x_end;
+      Conv3x3Taps(in_x, input_width, &x_first, &x_end);
+
+      for (int c = 0; c < kDepth; ++c) {
+        acc[c] = bias_data ? bias_data[c] : 0;
+      }
+      if (y_first == 0 && y_end == 3 && x_first == 0 && x_end == 3) {
+        for (int ky = 0; ky < 3; ++ky) {
+          for (int kx = 0; kx < 3; ++kx) {
+            const int8_t* in =
+                input_data + ((in_y + ky) * input_width + in_x + kx) * kDepth;
+            const int8_t* filter = filter_data + (ky * 3 + kx) * kDepth;
+            for (int c = 0; c < kDepth; ++c) {
+              acc[c] += filter[c] * (in[c] + input_offset);
+            }
+          }
+        }
+      } else {
+        for (int ky = y_first; ky < y_end; ++ky) {
+          for (int kx = x_first; kx < x_end; ++kx) {
+            const int8_t* in =
+                input_data + ((in_y + ky) * input_width + in_x + kx) * kDepth;
+            const int8_t* filter = filter_data + (ky * 3 + kx) * kDepth;
+            for (int c = 0; c < kDepth; ++c) {
+              acc[c] += filter[c] * (in[c] + input_offset);
+            }
+          }
+        }
+      }
+
+      RequantizeRow(acc, nullptr, output_multiplier, output_shift, kDepth,
+                    params.output_offset, params.quantized_activation_min,
+                    params.quantized_activation_max,
+                    output_data + (out_y * output_width + out_x) * kDepth,
+                    requantize);
+    }
+  }
+}
+
+// The 3x3 window of one output pixel as input + input_offset, zero where it
+// is padding, in filter (OHWI) order
+template <int kInputDepth, typename InputT>
+inline void Conv3x3Patch(const InputT* input_data, int input_height,
+                         int input_width, int in_y, int in_x,
+                         int32_t input_offset, int32_t* patch) {
+  int y_first, y_end, x_first, x_end;
+  Conv3x3Taps(in_y, input_height, &y_first, &y_end);
+  Conv3x3Taps(in_x, input_width, &x_first, &x_end);
+  for (int ky = 0; ky < 3; ++ky) {
+    for (int kx = 0; kx < 3; ++kx) {
+      int32_t* tap = patch + (ky * 3 + kx) * kInputDepth;
+      if (ky < y_first || ky >= y_end || kx < x_first || kx >= x_end) {
+        for (int c = 0; c < kInputDepth; ++c) {
+          tap[c] = 0;
+        }
+        continue;
+      }
+      const InputT* in =
+          input_data + ((in_y + ky) * input_width + in_x + kx) * kInputDepth;
+      for (int c = 0; c < kInputDepth; ++c) {
+        tap[c] = in[c] + input_offset;
+      }
+    }
+  }
+}
+
+template <int kStride, int kInputDepth, int kOutputDepth, typename InputT,
+          typename Requantize>
+inline void Conv3x3PerChannelPortable(
+    const ConvParams& params, const int32_t* output_multiplier,
+    const int32_t* output_shift, const RuntimeShape& input_shape,
+    const InputT* input_data, const int8_t* filter_data,
+    const int32_t* bias_data, const RuntimeShape& output_shape,
+    int8_t* output_data, const Requantize& requantize) {
+  constexpr int kPatch = 9 * kInputDepth;
+  const int input_height = input_shape.Dims(1);
+  const int input_width = input_shape.Dims(2);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  TFLITE_DCHECK_EQ(input_shape.Dims(3), kInputDepth);
+  TFLITE_DCHECK_EQ(output_shape.Dims(3), kOutputDepth);
+
+  int32_t patch[kPatch];
+  int32_t acc[kOutputDepth];
+  for (int out_y = 0; out_y < output_height; ++out_y) {
+    const int in_y = out_y * kStride - params.padding_values.height;
+    for (int out_x = 0; out_x < output_width; ++out_x) {
+      const int in_x = out_x * kStride - params.padding_values.width;
+      Conv3x3Patch<kInputDepth>(input_data, input_height, input_width, in_y,
+                                in_x, params.input_offset, patch);
+
+      for (int o = 0; o < kOutputDepth; ++o) {
+        const int8_t* filter = filter_data + o * kPatch;
+        int32_t sum = 0;
+        for (int k = 0; k < kPatch; ++k) {
+          sum += patch[k] * filter[k];
+        }
+        acc[o] = sum;
+      }
+      RequantizeRow(acc, bias_data, output_multiplier, output_shift,
+                    kOutputDepth, params.output_offset,
+                    params.quantized_activation_min,
+                    params.quantized_activation_max,
+                    output_data + (out_y * output_width + out_x) * kOutputDepth,
+                    requantize);
+    }
+  }
+}
+
+#if EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+
+// 8 channels per vector, any channels past the last multiple of 8 in scalar
+template <int kStride, int kDepth, typename Requantize>
+EI_X86_TARGET_AVX2 inline void DepthwiseConv3x3PerChannelAvx2(
+    const DepthwiseParams& params, const int32_t* output_multiplier,
+    const int32_t* output_shift, const RuntimeShape& input_shape,
+    const int8_t* input_data, const int8_t* filter_data,
+    const int32_t* bias_data, const RuntimeShape& output_shape,
+    int8_t* output_data, const Requantize& requantize) {
+  constexpr int kBlocks = kDepth / 8;
+  const int input_height = input_shape.Dims(1);
+  const int input_width = input_shape.Dims(2);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  const int32_t input_offset = params.input_offset;
+  TFLITE_DCHECK_EQ(input_shape.Dims(3), kDepth);
+  TFLITE_DCHECK_EQ(output_shape.Dims(3), kDepth);
+
+  const __m256i offset = _mm256_set1_epi32(input_offset);
+  alignas(32) int32_t acc[kDepth];
+
+  for (int out_y = 0; out_y < output_height; ++out_y) {
+    const int in_y = out_y * kStride - params.padding_values.height;
+    int y_first, y_end;
+    Conv3x3Taps(in_y, input_height, &y_first, &y_end);
+    for (int out_x = 0; out_x < output_width; ++out_x) {
+      const int in_x = out_x * kStride - params.padding_values.width;
+      int x_first, x_end;
+      Conv3x3Taps(in_x, input_width, &x_first, &x_end);
+
+      __m256i sum[kBlocks > 0 ? kBlocks : 1];
+      for (int b = 0; b < kBlocks; ++b) {
+        sum[b] = bias_data ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+                                 bias_data + b * 8))
+                           : _mm256_setzero_si256();
+      }
+      for (int c = kBlocks * 8; c < kDepth; ++c) {
+        acc[c] = bias_data ? bias_data[c] : 0;
+      }
+      for (int ky = y_first; ky < y_end; ++ky) {
+        for (int kx = x_first; kx < x_end; ++kx) {
+          const int8_t* in =
+              input_data + ((in_y + ky) * input_width + in_x + kx) * kDepth;
+          const int8_t* filter = filter_data + (ky * 3 + kx) * kDepth;
+          for (int b = 0; b < kBlocks; ++b) {
+            const __m256i values = _mm256_add_epi32(
+                _mm256_cvtepi8_epi32(_mm_loadl_epi64(
+                    reinterpret_cast<const __m128i*>(in + b * 8))),
+                offset);
+            const __m256i weights = _mm256_cvtepi8_epi32(_mm_loadl_epi64(
+                reinterpret_cast<const __m128i*>(filter + b * 8)));
+            sum[b] = _mm256_add_epi32(sum[b], _mm256_mullo_epi32(values, weights));
+          }
+          for (int c = kBlocks * 8; c < kDepth; ++c) {
+            acc[c] += filter[c] * (in[c] + input_offset);
+          }
+        }
+      }
+      for (int b = 0; b < kBlocks; ++b) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(acc + b * 8), sum[b]);
+      }
+
+      RequantizeRow(acc, nullptr, output_multiplier, output_shift, kDepth,
+                    params.output_offset, params.quantized_activation_min,
+                    params.quantized_activation_max,
+                    output_data + (out_y * output_width + out_x) * kDepth,
+                    requantize);
+    }
+  }
+}
+
+// Every patch value is broadcast against one row of a filter transposed to
+// [patch position][output channel] int32, 8 output channels per vector
+template <int kStride, int kInputDepth, int kOutputDepth, typename InputT,
+          typename Requantize>
+EI_X86_TARGET_AVX2 inline void Conv3x3PerChannelAvx2(
+    const ConvParams& params, const int32_t* output_multiplier,
+    const int32_t* output_shift, const RuntimeShape& input_shape,
+    const InputT* input_data, const int8_t* filter_data,
+    const int32_t* bias_data, const RuntimeShape& output_shape,
+    int8_t* output_data, const Requantize& requantize) {
+  static_assert(kOutputDepth % 8 == 0, "whole vectors of output channels");
+  constexpr int kPatch = 9 * kInputDepth;
+  constexpr int kBlocks = kOutputDepth / 8;
+  const int input_height = input_shape.Dims(1);
+  const int input_width = input_shape.Dims(2);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  TFLITE_DCHECK_EQ(input_shape.Dims(3), kInputDepth);
+  TFLITE_DCHECK_EQ(output_shape.Dims(3), kOutputDepth);
+
+  alignas(32) int32_t filter[kPatch * kOutputDepth];
+  for (int o = 0; o < kOutputDepth; ++o) {
+    for (int k = 0; k < kPatch; ++k) {
+      filter[k * kOutputDepth + o] = filter_data[o * kPatch + k];
+    }
+  }
+  int32_t patch[kPatch];
+  alignas(32) int32_t acc[kOutputDepth];
+
+  for (int out_y = 0; out_y < output_height; ++out_y) {
+    const int in_y = out_y * kStride - params.padding_values.height;
+    for (int out_x = 0; out_x < output_width; ++out_x) {
+      const int in_x = out_x * kStride - params.padding_values.width;
+      Conv3x3Patch<kInputDepth>(input_data, input_height, input_width, in_y,
+                                in_x, params.input_offset, patch);
+
+      __m256i sum[kBlocks];
+      for (int b = 0; b < kBlocks; ++b) {
+        sum[b] = bias_data ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+                                 bias_data + b * 8))
+                           : _mm256_setzero_si256();
+      }
+      for (int k = 0; k < kPatch; ++k) {
+        const __m256i value = _mm256_set1_epi32(patch[k]);
+        const int32_t* row = filter + k * kOutputDepth;
+        for (int b = 0; b < kBlocks; ++b) {
+          sum[b] = _mm256_add_epi32(
+              sum[b], _mm256_mullo_epi32(
+                          value, _mm256_load_si256(reinterpret_cast<const __m256i*>(
+                                     row + b * 8))));
+        }
+      }
+      for (int b = 0; b < kBlocks; ++b) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(acc + b * 8), sum[b]);
+      }
+
+      RequantizeRow(acc, nullptr, output_multiplier, output_shift,
+                    kOutputDepth, params.output_offset,
+                    params.quantized_activation_min,
+                    params.quantized_activation_max,
+                    output_data + (out_y * output_width + out_x) * kOutputDepth,
+                    requantize);
+    }
+  }
+}
+
+#endif  // EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+
+// Depthwise 3x3 conv of an NHWC input with kDepth channels, HWC filter
+template <int kStride, int kDepth, typename Requantize>
+inline void DepthwiseConv3x3PerChannel(
+    const DepthwiseParams& params, const int32_t* output_multiplier,
+    const int32_t* output_shift, const RuntimeShape& input_shape,
+    const int8_t* input_data, const int8_t* filter_data,
+    const int32_t* bias_data, const RuntimeShape& output_shape,
+    int8_t* output_data, const Requantize& requantize) {
+#if EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+  if (kDepth >= 8 &&
+      optimized_ops::GetX86Simd() != optimized_ops::X86Simd::kNone) {
+    DepthwiseConv3x3PerChannelAvx2<kStride, kDepth>(
+        params, output_multiplier, output_shift, input_shape, input_data,
+        filter_data, bias_data, output_shape, output_data, requantize);
+    return;
+  }
+#endif
+  DepthwiseConv3x3PerChannelPortable<kStride, kDepth>(
+      params, output_multiplier, output_shift, input_shape, input_data,
+      filter_data, bias_data, output_shape, output_data, requantize);
+}
+
+// 3x3 conv of an NHWC int8 or uint8 input with kInputDepth channels, OHWI
+// filter
+template <int kStride, int kInputDepth, int kOutputDepth, typename InputT,
+          typename Requantize>
+inline void Conv3x3PerChannel(
+    const ConvParams& params, const int32_t* output_multiplier,
+    const int32_t* output_shift, const RuntimeShape& input_shape,
+    const InputT* input_data, const int8_t* filter_data,
+    const int32_t* bias_data, const RuntimeShape& output_shape,
+    int8_t* output_data, const Requantize& requantize) {
+#if EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+  if (kOutputDepth % 8 == 0 && 9 * kInputDepth * kOutputDepth <= 4096 &&
+      optimized_ops::GetX86Simd() != optimized_ops::X86Simd::kNone) {
+    Conv3x3PerChannelAvx2<kStride, kInputDepth,
+                          kOutputDepth % 8 == 0 ? kOutputDepth : 8>(
+        params, output_multiplier, output_shift, input_shape, input_data,
+        filter_data, bias_data, output_shape, output_data, requantize);
+    return;
+  }
+#endif
+  Conv3x3PerChannelPortable<kStride, kInputDepth, kOutputDepth>(
+      params, output_multiplier, output_shift, input_shape, input_data,
+      filter_data, bias_data, output_shape, output_data, requantize);
+}
+
+}  // namespace optimized_integer_ops
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_INTEGER_OPS_CONV_3X3_H_
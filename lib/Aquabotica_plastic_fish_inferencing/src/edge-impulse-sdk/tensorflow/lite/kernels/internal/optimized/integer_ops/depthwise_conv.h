@@ -0,0 +1,165 @@
+/* Copyright 2019 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_INTEGER_OPS_DEPTHWISE_CONV_H_
+#define TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_INTEGER_OPS_DEPTHWISE_CONV_H_
+
+// Edge Impulse: x86-64 AVX2 version of
+// reference_integer_ops::DepthwiseConvPerChannel, 8 channels per vector.
+// Depthwise has no reduction over channels for VNNI to speed up, so AVX-VNNI
+// CPUs run the AVX2 kernel. Bit-exact with the reference kernel, which is
+// still used for depth multipliers other than 1 and CPUs without AVX2.
+
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/integer_ops/requantize.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/x86_check.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/reference/integer_ops/depthwise_conv.h"
+
+#if EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+
+namespace tflite {
+namespace optimized_integer_ops {
+
+EI_X86_TARGET_AVX2 inline void DepthwiseConvPerChannelAvx2(
+    const DepthwiseParams& params, const int32_t* output_multiplier,
+    const int32_t* output_shift, const RuntimeShape& input_shape,
+    const int8_t* input_data, const RuntimeShape& filter_shape,
+    const int8_t* filter_data, const RuntimeShape& bias_shape,
+    const int32_t* bias_data, const RuntimeShape& output_shape,
+    int8_t* output_data) {
+  const int stride_width = params.stride_width;
+  const int stride_height = params.stride_height;
+  const int dilation_width_factor = params.dilation_width_factor;
+  const int dilation_height_factor = params.dilation_height_factor;
+  const int pad_width = params.padding_values.width;
+  const int pad_height = params.padding_values.height;
+  const int32_t input_offset = params.input_offset;
+  const int32_t output_offset = params.output_offset;
+  const int32_t output_activation_min = params.quantized_activation_min;
+  const int32_t output_activation_max = params.quantized_activation_max;
+
+  TFLITE_DCHECK_EQ(input_shape.DimensionsCount(), 4);
+  TFLITE_DCHECK_EQ(filter_shape.DimensionsCount(), 4);
+  TFLITE_DCHECK_EQ(output_shape.DimensionsCount(), 4);
+  TFLITE_DCHECK_LE(output_activation_min, output_activation_max);
+  const int batches = MatchingDim(input_shape, 0, output_shape, 0);
+  const int depth = MatchingDim(filter_shape, 3, output_shape, 3);
+  const int input_height = input_shape.Dims(1);
+  const int input_width = input_shape.Dims(2);
+  const int filter_height = filter_shape.Dims(1);
+  const int filter_width = filter_shape.Dims(2);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  TFLITE_DCHECK_EQ(input_shape.Dims(3), depth);
+  TFLITE_DCHECK_EQ(bias_shape.FlatSize(), depth);
+
+  const __m256i offset = _mm256_set1_epi32(input_offset);
+  alignas(32) int32_t acc[8];
+
+  for (int batch = 0; batch < batches; ++batch) {
+    for (int out_y = 0; out_y < output_height; ++out_y) {
+      const int in_y_origin = (out_y * stride_height) - pad_height;
+      for (int out_x = 0; out_x < output_width; ++out_x) {
+        const int in_x_origin = (out_x * stride_width) - pad_width;
+        int8_t* out = output_data + Offset(output_shape, batch, out_y, out_x, 0);
+
+        int channel = 0;
+        for (; channel + 8 <= depth; channel += 8) {
+          __m256i sum = _mm256_setzero_si256();
+          for (int filter_y = 0; filter_y < filter_height; ++filter_y) {
+            const int in_y = in_y_origin + dilation_height_factor * filter_y;
+            if (in_y < 0 || in_y >= input_height) {
+              continue;
+            }
+            for (int filter_x = 0; filter_x < filter_width; ++filter_x) {
+              const int in_x = in_x_origin + dilation_width_factor * filter_x;
+              // Zero padding by omitting the areas outside the image.
+              if (in_x < 0 || in_x >= input_width) {
+                continue;
+              }
+              const __m256i values = _mm256_add_epi32(
+                  _mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(
+                      input_data + Offset(input_shape, batch, in_y, in_x, channel)))),
+                  offset);
+              const __m256i weights =
+                  _mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(
+                      filter_data + Offset(filter_shape, 0, filter_y, filter_x, channel))));
+              sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(values, weights));
+            }
+          }
+          _mm256_store_si256(reinterpret_cast<__m256i*>(acc), sum);
+
+          RequantizeRow(acc, bias_data ? bias_data + channel : nullptr,
+                        output_multiplier + channel, output_shift + channel, 8,
+                        output_offset, output_activation_min,
+                        output_activation_max, out + channel,
+                        PointwiseRequantize());
+        }
+
+        for (; channel < depth; ++channel) {
+          int32_t value = 0;
+          for (int filter_y = 0; filter_y < filter_height; ++filter_y) {
+            const int in_y = in_y_origin + dilation_height_factor * filter_y;
+            for (int filter_x = 0; filter_x < filter_width; ++filter_x) {
+              const int in_x = in_x_origin + dilation_width_factor * filter_x;
+              if (in_x < 0 || in_x >= input_width || in_y < 0 ||
+                  in_y >= input_height) {
+                continue;
+              }
+              int32_t input_val =
+                  input_data[Offset(input_shape, batch, in_y, in_x, channel)];
+              int32_t filter_val =
+                  filter_data[Offset(filter_shape, 0, filter_y, filter_x, channel)];
+              value += filter_val * (input_val + input_offset);
+            }
+          }
+          RequantizeRow(&value, bias_data ? bias_data + channel : nullptr,
+                        output_multiplier + channel, output_shift + channel, 1,
+                        output_offset, output_activation_min,
+                        output_activation_max, out + channel,
+                        PointwiseRequantize());
+        }
+      }
+    }
+  }
+}
+
+// Drop-in for reference_integer_ops::DepthwiseConvPerChannel (int8 input and
+// filter)
+inline void DepthwiseConvPerChannel(
+    const DepthwiseParams& params, const int32_t* output_multiplier,
+    const int32_t* output_shift, const RuntimeShape& input_shape,
+    const int8_t* input_data, const RuntimeShape& filter_shape,
+    const int8_t* filter_data, const RuntimeShape& bias_shape,
+    const int32_t* bias_data, const RuntimeShape& output_shape,
+    int8_t* output_data,
+    optimized_ops::X86Simd simd = optimized_ops::GetX86Simd()) {
+  if (simd == optimized_ops::X86Simd::kNone || params.depth_multiplier != 1) {
+    reference_integer_ops::DepthwiseConvPerChannel(
+        params, output_multiplier, output_shift, input_shape, input_data,
+        filter_shape, filter_data, bias_shape, bias_data, output_shape,
+        output_data);
+    return;
+  }
+  DepthwiseConvPerChannelAvx2(params, output_multiplier, output_shift,
+                              input_shape, input_data, filter_shape,
+                              filter_data, bias_shape, bias_data, output_shape,
+                              output_data);
+}
+
+}  // namespace optimized_integer_ops
+}  // namespace tflite
+
+#endif  // EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+
+#endif  // TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_INTEGER_OPS_DEPTHWISE_CONV_H_
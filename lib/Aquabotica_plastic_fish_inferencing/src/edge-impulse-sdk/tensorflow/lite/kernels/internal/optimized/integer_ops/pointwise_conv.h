@@ -0,0 +1,478 @@
+/* Copyright 2019 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_INTEGER_OPS_POINTWISE_CONV_H_
+#define TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_INTEGER_OPS_POINTWISE_CONV_H_
+
+// Edge Impulse: int8 1x1 convolution as a GEMM over a filter that was
+// repacked once at prepare time (PackPointwiseConv). The filter is stored in
+// panels of 8 output channels, each panel holding groups of 4 input channels:
+//
+//   packed[((panel * depth_groups + group) * 8 + channel) * 4 + k]
+//
+// so a group of 4 input values is multiplied against 8 output channels with
+// one contiguous 32 byte load (one _mm256_dpbusd_avx_epi32 on AVX-VNNI).
+// The input offset is folded into the bias while packing, and every tile is
+// requantized as soon as it is accumulated. Accumulation is exact in int32,
+// so the output is bit-exact with reference_integer_ops::ConvPerChannel when
+// the requantization passed in is MultiplyByQuantizedMultiplier.
+//
+// The kernels can also run a residual ADD in the output stage: every int8
+// result y is replaced by reference_integer_ops::AddFunc(residual, y) (run as
+// AddElementwise) before it is stored, so the conv output itself never goes
+// through memory.
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/common.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/integer_ops/add.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/integer_ops/requantize.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/x86_check.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/types.h"
+
+namespace tflite {
+namespace optimized_integer_ops {
+
+// Output channels per panel and input channels per group of the packed filter
+constexpr int kPointwisePanelWidth = 8;
+constexpr int kPointwiseDepthGroup = 4;
+
+struct PointwiseConvPacked {
+  int input_depth;
+  int output_depth;
+  // Per output channel (padded to a whole panel):
+  // bias + input_offset * sum(filter)
+  int32_t* bias;
+#if EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+  // bias - 128 * sum(filter), for kernels that flip the input to uint8
+  int32_t* bias_uint8;
+#endif
+  // Panels, see the layout above. nullptr when the layer is not packed.
+  int8_t* filter;
+};
+
+inline int PointwiseConvPanels(int output_depth) {
+  return (output_depth + kPointwisePanelWidth - 1) / kPointwisePanelWidth;
+}
+
+inline int PointwiseConvDepthGroups(int input_depth) {
+  return (input_depth + kPointwiseDepthGroup - 1) / kPointwiseDepthGroup;
+}
+
+// Size of the buffer PackPointwiseConv needs
+inline size_t PointwiseConvPackedBytes(int input_depth, int output_depth) {
+  const size_t channels =
+      PointwiseConvPanels(output_depth) * kPointwisePanelWidth;
+  size_t bias_arrays = 1;
+#if EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+  bias_arrays = 2;
+#endif
+  return channels * bias_arrays * sizeof(int32_t) +
+         channels * PointwiseConvDepthGroups(input_depth) *
+             kPointwiseDepthGroup;
+}
+
+// Repacks an OHWI 1x1 filter (and folds input_offset into the bias) into
+// buffer, which must hold PointwiseConvPackedBytes() bytes. bias_data may be
+// nullptr.
+inline void PackPointwiseConv(const int8_t* filter_data,
+                              const int32_t* bias_data, int32_t input_offset,
+                              int input_depth, int output_depth, void* buffer,
+                              PointwiseConvPacked* packed) {
+  const int channels = PointwiseConvPanels(output_depth) * kPointwisePanelWidth;
+  const int groups = PointwiseConvDepthGroups(input_depth);
+  int32_t* bias = static_cast<int32_t*>(buffer);
+  int32_t* next = bias + channels;
+#if EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+  packed->bias_uint8 = next;
+  next += channels;
+#endif
+  int8_t* filter = reinterpret_cast<int8_t*>(next);
+  memset(filter, 0,
+         static_cast<size_t>(channels) * groups * kPointwiseDepthGroup);
+
+  for (int out_channel = 0; out_channel < channels; ++out_channel) {
+    int32_t sum = 0;
+    if (out_channel < output_depth) {
+      const int panel = out_channel / kPointwisePanelWidth;
+      const int lane = out_channel % kPointwisePanelWidth;
+      for (int in_channel = 0; in_channel < input_depth; ++in_channel) {
+        const int8_t value =
+            filter_data[out_channel * input_depth + in_channel];
+        const int group = in_channel / kPointwiseDepthGroup;
+        filter[((panel * groups + group) * kPointwisePanelWidth + lane) *
+                   kPointwiseDepthGroup +
+               in_channel % kPointwiseDepthGroup] = value;
+        sum += value;
+      }
+    }
+    const int32_t b =
+        (bias_data && out_channel < output_depth) ? bias_data[out_channel] : 0;
+    bias[out_channel] = b + input_offset * sum;
+#if EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+    packed->bias_uint8[out_channel] = bias[out_channel] - 128 * sum;
+#endif
+  }
+
+  packed->input_depth = input_depth;
+  packed->output_depth = output_depth;
+  packed->bias = bias;
+  packed->filter = filter;
+}
+
+// Requantizes the int32 accumulators of one pixel against one panel. With
+// add_params set, residual holds the ADD's other input at the same positions
+// as out (without, it is not read and the kernels point it at the output).
+template <typename Requantize>
+inline void PointwiseConvStore(const int32_t* acc, const int32_t* bias,
+                               const int32_t* output_multiplier,
+                               const int32_t* output_shift,
+                               const ConvParams& params, int channels,
+                               int8_t* out, const Requantize& requantize,
+                               const ArithmeticParams* add_params,
+                               const int8_t* residual) {
+  if (!add_params) {
+    RequantizeRow(acc, bias, output_multiplier, output_shift, channels,
+                  params.output_offset, params.quantized_activation_min,
+                  params.quantized_activation_max, out, requantize);
+    return;
+  }
+  int8_t value[kPointwisePanelWidth];
+  RequantizeRow(acc, bias, output_multiplier, output_shift, channels,
+                params.output_offset, params.quantized_activation_min,
+                params.quantized_activation_max, value, requantize);
+  AddElementwise(channels, *add_params, residual, value, out);
+}
+
+// Plain C++ kernel (ESP32 and anything without x86 SIMD), one pixel against
+// one panel at a time so the 8 accumulators stay in registers
+template <typename Requantize>
+inline void PointwiseConvPerChannelPortable(
+    const PointwiseConvPacked& packed, const ConvParams& params,
+    const int32_t* output_multiplier, const int32_t* output_shift,
+    const RuntimeShape& input_shape, const int8_t* input_data,
+    const RuntimeShape& output_shape, int8_t* output_data,
+    const Requantize& requantize, const ArithmeticParams* add_params = nullptr,
+    const int8_t* residual_data = nullptr) {
+  const int batches = MatchingDim(input_shape, 0, output_shape, 0);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  const int input_depth = packed.input_depth;
+  const int output_depth = packed.output_depth;
+  const int panels = PointwiseConvPanels(output_depth);
+  const int groups = PointwiseConvDepthGroups(input_depth);
+  const int pixel_stride = params.stride_width * input_depth;
+  TFLITE_DCHECK_EQ(input_shape.Dims(3), input_depth);
+  TFLITE_DCHECK_EQ(output_shape.Dims(3), output_depth);
+
+  for (int batch = 0; batch < batches; ++batch) {
+    for (int out_y = 0; out_y < output_height; ++out_y) {
+      const int8_t* in =
+          input_data +
+          Offset(input_shape, batch, out_y * params.stride_height, 0, 0);
+      int8_t* out = output_data + Offset(output_shape, batch, out_y, 0, 0);
+      const int8_t* residual =
+          (add_params ? residual_data : output_data) +
+          Offset(output_shape, batch, out_y, 0, 0);
+      for (int out_x = 0; out_x < output_width; ++out_x) {
+        for (int panel = 0; panel < panels; ++panel) {
+          const int8_t* w =
+              packed.filter + panel * groups * kPointwisePanelWidth *
+                                  kPointwiseDepthGroup;
+          int32_t acc[kPointwisePanelWidth] = {};
+          for (int group = 0; group < groups; ++group) {
+            const int first = group * kPointwiseDepthGroup;
+            // the filter is zero past input_depth, so is the input here
+            int32_t x[kPointwiseDepthGroup] = {};
+            for (int k = 0; k < kPointwiseDepthGroup && first + k < input_depth;
+                 ++k) {
+              x[k] = in[first + k];
+            }
+            for (int i = 0; i < kPointwisePanelWidth; ++i) {
+              acc[i] += x[0] * w[0] + x[1] * w[1] + x[2] * w[2] + x[3] * w[3];
+              w += kPointwiseDepthGroup;
+            }
+          }
+
+          const int first = panel * kPointwisePanelWidth;
+          PointwiseConvStore(
+              acc, packed.bias + first, output_multiplier + first,
+              output_shift + first, params,
+              std::min(kPointwisePanelWidth, output_depth - first), out + first,
+              requantize, add_params, residual + first);
+        }
+        in += pixel_stride;
+        out += output_depth;
+        residual += output_depth;
+      }
+    }
+  }
+}
+
+#if EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+
+// Output pixels computed together, they share every filter load
+constexpr int kPointwiseX86Pixels = 4;
+
+// Input values group..group+3 of a pixel, the depth tail zero filled
+inline int32_t PointwiseConvLoadGroup(const int8_t* in, int group,
+                                      int input_depth) {
+  int32_t value = 0;
+  const int first = group * kPointwiseDepthGroup;
+  if (first + kPointwiseDepthGroup <= input_depth) {
+    memcpy(&value, in + first, kPointwiseDepthGroup);
+  } else {
+    memcpy(&value, in + first, input_depth - first);
+  }
+  return value;
+}
+
+// AVX2: the filter group is widened to int16 as (channels 0-3, channels 4-7)
+// and multiplied with _mm256_madd_epi16, which leaves pairs of partial sums
+// that are reduced once per tile
+template <int kPixels, int kPanels>
+EI_X86_TARGET_AVX2 inline void PointwiseConvTileAvx2(
+    const int8_t* const* in, const int8_t* w, int panel_bytes, int input_depth,
+    int32_t acc[][kPixels][kPointwisePanelWidth]) {
+  const int groups = PointwiseConvDepthGroups(input_depth);
+  __m256i low[kPanels][kPixels];
+  __m256i high[kPanels][kPixels];
+  for (int n = 0; n < kPanels; ++n) {
+    for (int p = 0; p < kPixels; ++p) {
+      low[n][p] = _mm256_setzero_si256();
+      high[n][p] = _mm256_setzero_si256();
+    }
+  }
+  for (int group = 0; group < groups; ++group) {
+    __m256i values[kPixels];
+    for (int p = 0; p < kPixels; ++p) {
+      const int32_t group_values =
+          PointwiseConvLoadGroup(in[p], group, input_depth);
+      values[p] = _mm256_broadcastq_epi64(
+          _mm_cvtepi8_epi16(_mm_cvtsi32_si128(group_values)));
+    }
+    for (int n = 0; n < kPanels; ++n) {
+      const __m256i weights = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(w + n * panel_bytes));
+      const __m256i weights_low =
+          _mm256_cvtepi8_epi16(_mm256_castsi256_si128(weights));
+      const __m256i weights_high =
+          _mm256_cvtepi8_epi16(_mm256_extracti128_si256(weights, 1));
+      for (int p = 0; p < kPixels; ++p) {
+        low[n][p] = _mm256_add_epi32(low[n][p],
+                                     _mm256_madd_epi16(weights_low, values[p]));
+        high[n][p] = _mm256_add_epi32(
+            high[n][p], _mm256_madd_epi16(weights_high, values[p]));
+      }
+    }
+    w += kPointwisePanelWidth * kPointwiseDepthGroup;
+  }
+  // hadd leaves channels as 0 1 4 5 | 2 3 6 7
+  const __m256i order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+  for (int n = 0; n < kPanels; ++n) {
+    for (int p = 0; p < kPixels; ++p) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc[n][p]),
+                          _mm256_permutevar8x32_epi32(
+                              _mm256_hadd_epi32(low[n][p], high[n][p]), order));
+    }
+  }
+}
+
+// AVX-VNNI: one _mm256_dpbusd_avx_epi32 per group, with the input flipped to
+// uint8 (x + 128, corrected for by PointwiseConvPacked::bias_uint8)
+template <int kPixels, int kPanels>
+EI_X86_TARGET_AVX_VNNI inline void PointwiseConvTileAvxVnni(
+    const int8_t* const* in, const int8_t* w, int panel_bytes, int input_depth,
+    int32_t acc[][kPixels][kPointwisePanelWidth]) {
+  const int groups = PointwiseConvDepthGroups(input_depth);
+  const __m256i flip = _mm256_set1_epi8(static_cast<char>(0x80));
+  __m256i sum[kPanels][kPixels];
+  for (int n = 0; n < kPanels; ++n) {
+    for (int p = 0; p < kPixels; ++p) {
+      sum[n][p] = _mm256_setzero_si256();
+    }
+  }
+  for (int group = 0; group < groups; ++group) {
+    __m256i values[kPixels];
+    for (int p = 0; p < kPixels; ++p) {
+      values[p] = _mm256_xor_si256(
+          _mm256_set1_epi32(PointwiseConvLoadGroup(in[p], group, input_depth)),
+          flip);
+    }
+    for (int n = 0; n < kPanels; ++n) {
+      const __m256i weights = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(w + n * panel_bytes));
+      for (int p = 0; p < kPixels; ++p) {
+        sum[n][p] = _mm256_dpbusd_avx_epi32(sum[n][p], values[p], weights);
+      }
+    }
+    w += kPointwisePanelWidth * kPointwiseDepthGroup;
+  }
+  for (int n = 0; n < kPanels; ++n) {
+    for (int p = 0; p < kPixels; ++p) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc[n][p]), sum[n][p]);
+    }
+  }
+}
+
+// kPixels output pixels against kPanels panels starting at first_panel,
+// requantized right away
+template <int kPixels, int kPanels, bool kVnni>
+inline void PointwiseConvTile(const PointwiseConvPacked& packed,
+                              const ConvParams& params,
+                              const int32_t* output_multiplier,
+                              const int32_t* output_shift,
+                              const int8_t* const* in, int first_panel,
+                              int8_t* out, const ArithmeticParams* add_params,
+                              const int8_t* residual) {
+  const int output_depth = packed.output_depth;
+  const int panel_bytes = PointwiseConvDepthGroups(packed.input_depth) *
+                          kPointwisePanelWidth * kPointwiseDepthGroup;
+  const int8_t* w = packed.filter + first_panel * panel_bytes;
+  const int32_t* bias = kVnni ? packed.bias_uint8 : packed.bias;
+  int32_t acc[kPanels][kPixels][kPointwisePanelWidth];
+
+  if (kVnni) {
+    PointwiseConvTileAvxVnni<kPixels, kPanels>(in, w, panel_bytes,
+                                               packed.input_depth, acc);
+  } else {
+    PointwiseConvTileAvx2<kPixels, kPanels>(in, w, panel_bytes,
+                                            packed.input_depth, acc);
+  }
+  for (int n = 0; n < kPanels; ++n) {
+    const int first = (first_panel + n) * kPointwisePanelWidth;
+    const int channels = std::min(kPointwisePanelWidth, output_depth - first);
+    for (int p = 0; p < kPixels; ++p) {
+      const int offset = p * output_depth + first;
+      PointwiseConvStore(acc[n][p], bias + first, output_multiplier + first,
+                         output_shift + first, params, channels, out + offset,
+                         PointwiseRequantize(), add_params, residual + offset);
+    }
+  }
+}
+
+// Every panel for kPixels output pixels. VNNI has the registers to run two
+// panels at once, which doubles the independent dot product chains.
+template <int kPixels, bool kVnni>
+inline void PointwiseConvPixels(const PointwiseConvPacked& packed,
+                                const ConvParams& params,
+                                const int32_t* output_multiplier,
+                                const int32_t* output_shift,
+                                const int8_t* const* in, int8_t* out,
+                                const ArithmeticParams* add_params,
+                                const int8_t* residual) {
+  constexpr int kPanels = kVnni ? 2 : 1;
+  const int panels = PointwiseConvPanels(packed.output_depth);
+  int panel = 0;
+  for (; panel + kPanels <= panels; panel += kPanels) {
+    PointwiseConvTile<kPixels, kPanels, kVnni>(packed, params,
+                                               output_multiplier, output_shift,
+                                               in, panel, out, add_params,
+                                               residual);
+  }
+  for (; panel < panels; ++panel) {
+    PointwiseConvTile<kPixels, 1, kVnni>(packed, params, output_multiplier,
+                                         output_shift, in, panel, out,
+                                         add_params, residual);
+  }
+}
+
+template <bool kVnni>
+inline void PointwiseConvPerChannelX86(
+    const PointwiseConvPacked& packed, const ConvParams& params,
+    const int32_t* output_multiplier, const int32_t* output_shift,
+    const RuntimeShape& input_shape, const int8_t* input_data,
+    const RuntimeShape& output_shape, int8_t* output_data,
+    const ArithmeticParams* add_params, const int8_t* residual_data) {
+  const int batches = MatchingDim(input_shape, 0, output_shape, 0);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  const int pixel_stride = params.stride_width * packed.input_depth;
+  TFLITE_DCHECK_EQ(input_shape.Dims(3), packed.input_depth);
+  TFLITE_DCHECK_EQ(output_shape.Dims(3), packed.output_depth);
+
+  for (int batch = 0; batch < batches; ++batch) {
+    for (int out_y = 0; out_y < output_height; ++out_y) {
+      const int8_t* row =
+          input_data +
+          Offset(input_shape, batch, out_y * params.stride_height, 0, 0);
+      int8_t* out = output_data + Offset(output_shape, batch, out_y, 0, 0);
+      const int8_t* residual =
+          (add_params ? residual_data : output_data) +
+          Offset(output_shape, batch, out_y, 0, 0);
+      const int8_t* in[kPointwiseX86Pixels];
+      int out_x = 0;
+      for (; out_x + kPointwiseX86Pixels <= output_width;
+           out_x += kPointwiseX86Pixels) {
+        for (int p = 0; p < kPointwiseX86Pixels; ++p) {
+          in[p] = row + (out_x + p) * pixel_stride;
+        }
+        PointwiseConvPixels<kPointwiseX86Pixels, kVnni>(
+            packed, params, output_multiplier, output_shift, in,
+            out + out_x * packed.output_depth, add_params,
+            residual + out_x * packed.output_depth);
+      }
+      for (; out_x < output_width; ++out_x) {
+        in[0] = row + out_x * pixel_stride;
+        PointwiseConvPixels<1, kVnni>(
+            packed, params, output_multiplier, output_shift, in,
+            out + out_x * packed.output_depth, add_params,
+            residual + out_x * packed.output_depth);
+      }
+    }
+  }
+}
+
+#endif  // EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+
+// Drop-in for reference_integer_ops::ConvPerChannel on a packed 1x1 filter
+// (no padding, any stride). With add_params set it is the conv followed by
+// reference_integer_ops::Add(add_params, residual_data, conv output), where
+// residual_data has the output shape.
+inline void PointwiseConvPerChannel(
+    const PointwiseConvPacked& packed, const ConvParams& params,
+    const int32_t* output_multiplier, const int32_t* output_shift,
+    const RuntimeShape& input_shape, const int8_t* input_data,
+    const RuntimeShape& output_shape, int8_t* output_data,
+    const ArithmeticParams* add_params = nullptr,
+    const int8_t* residual_data = nullptr) {
+#if EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+  switch (optimized_ops::GetX86Simd()) {
+    case optimized_ops::X86Simd::kAvxVnni:
+      PointwiseConvPerChannelX86<true>(
+          packed, params, output_multiplier, output_shift, input_shape,
+          input_data, output_shape, output_data, add_params, residual_data);
+      return;
+    case optimized_ops::X86Simd::kAvx2:
+      PointwiseConvPerChannelX86<false>(
+          packed, params, output_multiplier, output_shift, input_shape,
+          input_data, output_shape, output_data, add_params, residual_data);
+      return;
+    default:
+      break;
+  }
+#endif  // EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+  PointwiseConvPerChannelPortable(packed, params, output_multiplier,
+                                  output_shift, input_shape, input_data,
+                                  output_shape, output_data,
+                                  PointwiseRequantize(), add_params,
+                                  residual_data);
+}
+
+}  // namespace optimized_integer_ops
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_INTEGER_OPS_POINTWISE_CONV_H_
@@ -0,0 +1,345 @@
+/* Copyright 2019 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_INTEGER_OPS_REQUANTIZE_H_
+#define TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_INTEGER_OPS_REQUANTIZE_H_
+
+// Edge Impulse: requantization of int32 accumulators to int8, shared by the
+// optimized int8 conv, depthwise conv and add kernels. A call handles a row
+// of outputs (e.g. every channel of one pixel): bias, per channel or per
+// tensor multiplier and shift, output offset and the activation clamp (which
+// is how a fused ReLU / ReLU6 arrives) in one pass.
+//
+// With PointwiseRequantize (TFLite rounding) the rows run 8 values at a time
+// on AVX2 and NEON, bit-exact with MultiplyByQuantizedMultiplier: a rounding
+// doubling high mul, then a rounding divide by a power of two. Any other
+// requantization (EspNnRequantize), and TFLITE_SINGLE_ROUNDING builds, run
+// the same rows value by value.
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <limits>
+
+#include "edge-impulse-sdk/classifier/ei_classifier_config.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/common.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/x86_check.h"
+
+#if TFLITE_SINGLE_ROUNDING
+#define EI_REQUANTIZE_X86 0
+#define EI_REQUANTIZE_NEON 0
+#else
+#define EI_REQUANTIZE_X86 EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD
+#define EI_REQUANTIZE_NEON EI_CLASSIFIER_TFLITE_ENABLE_NEON
+#endif  // TFLITE_SINGLE_ROUNDING
+
+#if EI_REQUANTIZE_NEON == 1
+#include <arm_neon.h>
+#endif
+
+namespace tflite {
+namespace optimized_integer_ops {
+
+// TFLite rounding, for the requantize argument of the kernels
+struct PointwiseRequantize {
+  int32_t operator()(int32_t value, int32_t multiplier, int32_t shift) const {
+    return MultiplyByQuantizedMultiplier(value, multiplier, shift);
+  }
+};
+
+// Same rounding as esp_nn_multiply_by_quantized_mult_fast, so the kernels give
+// the same output as the ESP-NN conv and depthwise conv kernels
+struct EspNnRequantize {
+  int32_t operator()(int32_t value, int32_t multiplier, int32_t shift) const {
+    const int32_t left_shift = shift > 0 ? shift : 0;
+    const int32_t right_shift = left_shift - shift;
+    const int64_t product =
+        static_cast<int64_t>(value << left_shift) * multiplier + (1 << 30);
+    int32_t result = static_cast<int32_t>(product >> 31);
+    if (right_shift) {
+      const int32_t to_add = (1 << (right_shift - 1)) - (result < 0);
+      result = (result + to_add) >> right_shift;
+    }
+    return result;
+  }
+};
+
+// One output of a row, value by value
+template <typename Requantize>
+inline int8_t RequantizeValue(int32_t acc, int32_t multiplier, int32_t shift,
+                              int32_t output_offset, int32_t activation_min,
+                              int32_t activation_max,
+                              const Requantize& requantize) {
+  int32_t value = requantize(acc, multiplier, shift) + output_offset;
+  value = std::max(value, activation_min);
+  value = std::min(value, activation_max);
+  return static_cast<int8_t>(value);
+}
+
+#if EI_REQUANTIZE_X86 == 1
+
+// MultiplyByQuantizedMultiplier of 8 lanes. The high mul keeps bits 31..62 of
+// the 64-bit products (even lanes shifted down, odd lanes up, so they land in
+// the right half), which is what the scalar division by 2^31 gives once the
+// nudge of 2^30 is added; only INT32_MIN * INT32_MIN needs saturating.
+EI_X86_TARGET_AVX2 inline __m256i MultiplyByQuantizedMultiplierAvx2(
+    __m256i x, __m256i multiplier, __m256i shift) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i left_shift = _mm256_max_epi32(shift, zero);
+  const __m256i right_shift = _mm256_sub_epi32(left_shift, shift);
+  x = _mm256_sllv_epi32(x, left_shift);
+
+  const __m256i nudge = _mm256_set1_epi64x(1ll << 30);
+  const __m256i even = _mm256_srli_epi64(
+      _mm256_add_epi64(_mm256_mul_epi32(x, multiplier), nudge), 31);
+  const __m256i odd = _mm256_slli_epi64(
+      _mm256_add_epi64(_mm256_mul_epi32(_mm256_srli_epi64(x, 32),
+                                        _mm256_srli_epi64(multiplier, 32)),
+                       nudge),
+      1);
+  __m256i high = _mm256_blend_epi32(even, odd, 0xAA);
+  const __m256i min = _mm256_set1_epi32(std::numeric_limits<int32_t>::min());
+  const __m256i overflow = _mm256_and_si256(_mm256_cmpeq_epi32(x, min),
+                                            _mm256_cmpeq_epi32(multiplier, min));
+  high = _mm256_blendv_epi8(
+      high, _mm256_set1_epi32(std::numeric_limits<int32_t>::max()), overflow);
+
+  // RoundingDivideByPOT: round half away from zero
+  const __m256i mask =
+      _mm256_sub_epi32(_mm256_sllv_epi32(one, right_shift), one);
+  const __m256i remainder = _mm256_and_si256(high, mask);
+  const __m256i threshold =
+      _mm256_sub_epi32(_mm256_srli_epi32(mask, 1), _mm256_srai_epi32(high, 31));
+  return _mm256_sub_epi32(_mm256_srav_epi32(high, right_shift),
+                          _mm256_cmpgt_epi32(remainder, threshold));
+}
+
+// kPerChannel: multiplier and shift hold count values, otherwise one
+template <bool kPerChannel>
+EI_X86_TARGET_AVX2 inline void RequantizeRowAvx2(
+    const int32_t* acc, const int32_t* bias, const int32_t* multiplier,
+    const int32_t* shift, int count, int32_t output_offset,
+    int32_t activation_min, int32_t activation_max, int8_t* out) {
+  const __m256i offset = _mm256_set1_epi32(output_offset);
+  const __m256i low = _mm256_set1_epi32(activation_min);
+  const __m256i high = _mm256_set1_epi32(activation_max);
+  __m256i m = _mm256_set1_epi32(multiplier[0]);
+  __m256i s = _mm256_set1_epi32(shift[0]);
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i value =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i));
+    if (bias) {
+      value = _mm256_add_epi32(
+          value, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bias + i)));
+    }
+    if (kPerChannel) {
+      m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(multiplier + i));
+      s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(shift + i));
+    }
+    value = _mm256_add_epi32(MultiplyByQuantizedMultiplierAvx2(value, m, s),
+                             offset);
+    value = _mm256_min_epi32(_mm256_max_epi32(value, low), high);
+    const __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(value),
+                                          _mm256_extracti128_si256(value, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i),
+                     _mm_packs_epi16(words, words));
+  }
+  for (; i < count; ++i) {
+    const int c = kPerChannel ? i : 0;
+    out[i] = RequantizeValue(bias ? acc[i] + bias[i] : acc[i], multiplier[c],
+                             shift[c], output_offset, activation_min,
+                             activation_max, PointwiseRequantize());
+  }
+}
+
+EI_X86_TARGET_AVX2 inline void MultiplyByQuantizedMultiplierRowAvx2(
+    const int32_t* in, int32_t* out, int count, int32_t multiplier,
+    int32_t shift) {
+  const __m256i m = _mm256_set1_epi32(multiplier);
+  const __m256i s = _mm256_set1_epi32(shift);
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(out + i),
+        MultiplyByQuantizedMultiplierAvx2(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)), m, s));
+  }
+  for (; i < count; ++i) {
+    out[i] = MultiplyByQuantizedMultiplier(in[i], multiplier, shift);
+  }
+}
+
+#endif  // EI_REQUANTIZE_X86 == 1
+
+#if EI_REQUANTIZE_NEON == 1
+
+// MultiplyByQuantizedMultiplier of 4 lanes: vqrdmulhq_s32 is the saturating
+// rounding doubling high mul, and vrshlq_s32 rounds half up, so negative
+// values are moved down by one first to round half away from zero
+inline int32x4_t MultiplyByQuantizedMultiplierNeon(int32x4_t x,
+                                                   int32x4_t multiplier,
+                                                   int32x4_t shift) {
+  const int32x4_t zero = vdupq_n_s32(0);
+  const int32x4_t left_shift = vmaxq_s32(shift, zero);
+  const int32x4_t right_shift = vminq_s32(shift, zero);
+  const int32x4_t high =
+      vqrdmulhq_s32(vshlq_s32(x, left_shift), multiplier);
+  const int32x4_t fixup = vshrq_n_s32(vandq_s32(high, right_shift), 31);
+  return vrshlq_s32(vqaddq_s32(high, fixup), right_shift);
+}
+
+template <bool kPerChannel>
+inline void RequantizeRowNeon(const int32_t* acc, const int32_t* bias,
+                              const int32_t* multiplier, const int32_t* shift,
+                              int count, int32_t output_offset,
+                              int32_t activation_min, int32_t activation_max,
+                              int8_t* out) {
+  const int32x4_t offset = vdupq_n_s32(output_offset);
+  const int32x4_t low = vdupq_n_s32(activation_min);
+  const int32x4_t high = vdupq_n_s32(activation_max);
+  int32x4_t m[2] = {vdupq_n_s32(multiplier[0]), vdupq_n_s32(multiplier[0])};
+  int32x4_t s[2] = {vdupq_n_s32(shift[0]), vdupq_n_s32(shift[0])};
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    int32x4_t value[2];
+    for (int h = 0; h < 2; ++h) {
+      value[h] = vld1q_s32(acc + i + h * 4);
+      if (bias) {
+        value[h] = vaddq_s32(value[h], vld1q_s32(bias + i + h * 4));
+      }
+      if (kPerChannel) {
+        m[h] = vld1q_s32(multiplier + i + h * 4);
+        s[h] = vld1q_s32(shift + i + h * 4);
+      }
+      value[h] = vaddq_s32(
+          MultiplyByQuantizedMultiplierNeon(value[h], m[h], s[h]), offset);
+      value[h] = vminq_s32(vmaxq_s32(value[h], low), high);
+    }
+    vst1_s8(out + i, vqmovn_s16(vcombine_s16(vqmovn_s32(value[0]),
+                                             vqmovn_s32(value[1]))));
+  }
+  for (; i < count; ++i) {
+    const int c = kPerChannel ? i : 0;
+    out[i] = RequantizeValue(bias ? acc[i] + bias[i] : acc[i], multiplier[c],
+                             shift[c], output_offset, activation_min,
+                             activation_max, PointwiseRequantize());
+  }
+}
+
+inline void MultiplyByQuantizedMultiplierRowNeon(const int32_t* in,
+                                                 int32_t* out, int count,
+                                                 int32_t multiplier,
+                                                 int32_t shift) {
+  const int32x4_t m = vdupq_n_s32(multiplier);
+  const int32x4_t s = vdupq_n_s32(shift);
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    vst1q_s32(out + i,
+              MultiplyByQuantizedMultiplierNeon(vld1q_s32(in + i), m, s));
+  }
+  for (; i < count; ++i) {
+    out[i] = MultiplyByQuantizedMultiplier(in[i], multiplier, shift);
+  }
+}
+
+#endif  // EI_REQUANTIZE_NEON == 1
+
+// out[i] = clamp(requantize(acc[i] + bias[i], multiplier[i], shift[i]) +
+// output_offset), bias may be null
+template <typename Requantize>
+inline void RequantizeRow(const int32_t* acc, const int32_t* bias,
+                          const int32_t* multiplier, const int32_t* shift,
+                          int count, int32_t output_offset,
+                          int32_t activation_min, int32_t activation_max,
+                          int8_t* out, const Requantize& requantize) {
+  for (int i = 0; i < count; ++i) {
+    out[i] = RequantizeValue(bias ? acc[i] + bias[i] : acc[i], multiplier[i],
+                             shift[i], output_offset, activation_min,
+                             activation_max, requantize);
+  }
+}
+
+// TFLite rounding takes the vector paths
+inline void RequantizeRow(const int32_t* acc, const int32_t* bias,
+                          const int32_t* multiplier, const int32_t* shift,
+                          int count, int32_t output_offset,
+                          int32_t activation_min, int32_t activation_max,
+                          int8_t* out, const PointwiseRequantize& requantize) {
+#if EI_REQUANTIZE_X86 == 1
+  if (optimized_ops::GetX86Simd() != optimized_ops::X86Simd::kNone) {
+    RequantizeRowAvx2<true>(acc, bias, multiplier, shift, count, output_offset,
+                            activation_min, activation_max, out);
+    return;
+  }
+#elif EI_REQUANTIZE_NEON == 1
+  RequantizeRowNeon<true>(acc, bias, multiplier, shift, count, output_offset,
+                          activation_min, activation_max, out);
+  return;
+#endif
+  RequantizeRow<PointwiseRequantize>(acc, bias, multiplier, shift, count,
+                                     output_offset, activation_min,
+                                     activation_max, out, requantize);
+}
+
+// RequantizeRow with one multiplier and shift for the whole row (TFLite
+// rounding), e.g. the output of an add
+inline void RequantizeRowPerTensor(const int32_t* acc, int32_t multiplier,
+                                   int32_t shift, int count,
+                                   int32_t output_offset,
+                                   int32_t activation_min,
+                                   int32_t activation_max, int8_t* out) {
+#if EI_REQUANTIZE_X86 == 1
+  if (optimized_ops::GetX86Simd() != optimized_ops::X86Simd::kNone) {
+    RequantizeRowAvx2<false>(acc, nullptr, &multiplier, &shift, count,
+                             output_offset, activation_min, activation_max,
+                             out);
+    return;
+  }
+#elif EI_REQUANTIZE_NEON == 1
+  RequantizeRowNeon<false>(acc, nullptr, &multiplier, &shift, count,
+                           output_offset, activation_min, activation_max, out);
+  return;
+#endif
+  for (int i = 0; i < count; ++i) {
+    out[i] = RequantizeValue(acc[i], multiplier, shift, output_offset,
+                             activation_min, activation_max,
+                             PointwiseRequantize());
+  }
+}
+
+// out[i] = MultiplyByQuantizedMultiplier(in[i], multiplier, shift), without
+// offset or clamp (in and out may be the same row)
+inline void MultiplyByQuantizedMultiplierRow(const int32_t* in, int32_t* out,
+                                             int count, int32_t multiplier,
+                                             int32_t shift) {
+#if EI_REQUANTIZE_X86 == 1
+  if (optimized_ops::GetX86Simd() != optimized_ops::X86Simd::kNone) {
+    MultiplyByQuantizedMultiplierRowAvx2(in, out, count, multiplier, shift);
+    return;
+  }
+#elif EI_REQUANTIZE_NEON == 1
+  MultiplyByQuantizedMultiplierRowNeon(in, out, count, multiplier, shift);
+  return;
+#endif
+  for (int i = 0; i < count; ++i) {
+    out[i] = MultiplyByQuantizedMultiplier(in[i], multiplier, shift);
+  }
+}
+
+}  // namespace optimized_integer_ops
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_INTEGER_OPS_REQUANTIZE_H_
@@ -0,0 +1,73 @@
+/* Copyright 2019 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_X86_CHECK_H_
+#define TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_X86_CHECK_H_
+
+// Edge Impulse: x86-64 SIMD support of the kernels in optimized/, enabled with
+// EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD. The kernels are compiled per
+// instruction set with target attributes and picked at runtime, so the
+// library itself does not need to be built with -mavx2.
+
+#include "edge-impulse-sdk/classifier/ei_classifier_config.h"
+
+#if EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+
+#include <immintrin.h>
+
+#define EI_X86_TARGET_AVX2 __attribute__((target("avx2")))
+#define EI_X86_TARGET_AVX_VNNI __attribute__((target("avx2,avxvnni")))
+
+namespace tflite {
+namespace optimized_ops {
+
+enum class X86Simd {
+  kNone,
+  kAvx2,
+  // AVX2 plus the 256-bit VNNI dot products (_mm256_dpbusd_avx_epi32)
+  kAvxVnni,
+};
+
+inline X86Simd DetectX86Simd() {
+  __builtin_cpu_init();
+  if (!__builtin_cpu_supports("avx2")) {
+    return X86Simd::kNone;
+  }
+  if (__builtin_cpu_supports("avxvnni")) {
+    return X86Simd::kAvxVnni;
+  }
+  return X86Simd::kAvx2;
+}
+
+// Instruction set the kernels use on this CPU, detected once
+inline X86Simd GetX86Simd() {
+  static const X86Simd simd = DetectX86Simd();
+  return simd;
+}
+
+// Sum of the 8 lanes
+EI_X86_TARGET_AVX2 inline int32_t X86HorizontalSum(__m256i v) {
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v),
+                            _mm256_extracti128_si256(v, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(s);
+}
+
+}  // namespace optimized_ops
+}  // namespace tflite
+
+#endif  // EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+
+#endif  // TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_X86_CHECK_H_
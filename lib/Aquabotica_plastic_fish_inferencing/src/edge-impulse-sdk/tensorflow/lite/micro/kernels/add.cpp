@@ -1066,6 +1066,7 @@ limitations under the License.
 
 #include "edge-impulse-sdk/tensorflow/lite/c/builtin_op_data.h"
 #include "edge-impulse-sdk/tensorflow/lite/c/common.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/integer_ops/add.h"
 #include "edge-impulse-sdk/tensorflow/lite/kernels/internal/quantization_util.h"
 #include "edge-impulse-sdk/tensorflow/lite/kernels/internal/reference/integer_ops/add.h"
 #include "edge-impulse-sdk/tensorflow/lite/kernels/internal/reference/process_broadcast_shapes.h"
@@ -1149,33 +1150,41 @@ TfLiteStatus EvalAddQuantized(TfLiteContext* context, TfLiteNode* node,
         const int8_t *input2_data = tflite::micro::GetTensorData<int8_t>(input2);
         int8_t *out_data = tflite::micro::GetTensorData<int8_t>(output);
 
-        esp_nn_add_elementwise_s8(input1_data,
-                                  input2_data,
-                                  data->input1_offset,
-                                  data->input2_offset,
-                                  data->input1_multiplier,
-                                  data->input2_multiplier,
-                                  data->input1_shift,
-                                  data->input2_shift,
-                                  data->left_shift,
-                                  out_data,
-                                  data->output_offset,
-                                  data->output_multiplier,
-                                  data->output_shift,
-                                  data->output_activation_min,
-                                  data->output_activation_max,
-                                  MatchingElementsSize(tflite::micro::GetTensorShape(input1),
-                                                       tflite::micro::GetTensorShape(input2),
-                                                       tflite::micro::GetTensorShape(output))
-                                  );
+        AddRunChunks(
+            MatchingElementsSize(tflite::micro::GetTensorShape(input1),
+                                 tflite::micro::GetTensorShape(input2),
+                                 tflite::micro::GetTensorShape(output)),
+            [&](int first, int size) {
+          esp_nn_add_elementwise_s8(input1_data + first,
+                                    input2_data + first,
+                                    data->input1_offset,
+                                    data->input2_offset,
+                                    data->input1_multiplier,
+                                    data->input2_multiplier,
+                                    data->input1_shift,
+                                    data->input2_shift,
+                                    data->left_shift,
+                                    out_data + first,
+                                    data->output_offset,
+                                    data->output_multiplier,
+                                    data->output_shift,
+                                    data->output_activation_min,
+                                    data->output_activation_max,
+                                    size);
+        });
 #else
-        reference_integer_ops::Add(
-            op_params, tflite::micro::GetTensorShape(input1),
-            tflite::micro::GetTensorData<int8_t>(input1),
-            tflite::micro::GetTensorShape(input2),
-            tflite::micro::GetTensorData<int8_t>(input2),
-            tflite::micro::GetTensorShape(output),
-            tflite::micro::GetTensorData<int8_t>(output));
+        const int8_t* input1_data = tflite::micro::GetTensorData<int8_t>(input1);
+        const int8_t* input2_data = tflite::micro::GetTensorData<int8_t>(input2);
+        int8_t* out_data = tflite::micro::GetTensorData<int8_t>(output);
+        AddRunChunks(
+            MatchingElementsSize(tflite::micro::GetTensorShape(input1),
+                                 tflite::micro::GetTensorShape(input2),
+                                 tflite::micro::GetTensorShape(output)),
+            [&](int first, int size) {
+              optimized_integer_ops::AddElementwise(
+                  size, op_params, input1_data + first, input2_data + first,
+                  out_data + first);
+            });
 #endif
       }
       break;
@@ -1270,6 +1279,7 @@ limitations under the License.
 
 #include "edge-impulse-sdk/tensorflow/lite/c/builtin_op_data.h"
 #include "edge-impulse-sdk/tensorflow/lite/c/common.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/integer_ops/add.h"
 #include "edge-impulse-sdk/tensorflow/lite/kernels/internal/quantization_util.h"
 #include "edge-impulse-sdk/tensorflow/lite/kernels/internal/reference/integer_ops/add.h"
 #include "edge-impulse-sdk/tensorflow/lite/kernels/internal/reference/process_broadcast_shapes.h"
@@ -1340,13 +1350,18 @@ TfLiteStatus EvalAddQuantized(TfLiteContext* context, TfLiteNode* node,
             tflite::micro::GetTensorShape(output),
             tflite::micro::GetTensorData<int8_t>(output));
       } else {
-        reference_integer_ops::Add(
-            op_params, tflite::micro::GetTensorShape(input1),
-            tflite::micro::GetTensorData<int8_t>(input1),
-            tflite::micro::GetTensorShape(input2),
-            tflite::micro::GetTensorData<int8_t>(input2),
-            tflite::micro::GetTensorShape(output),
-            tflite::micro::GetTensorData<int8_t>(output));
+        const int8_t* input1_data = tflite::micro::GetTensorData<int8_t>(input1);
+        const int8_t* input2_data = tflite::micro::GetTensorData<int8_t>(input2);
+        int8_t* out_data = tflite::micro::GetTensorData<int8_t>(output);
+        AddRunChunks(
+            MatchingElementsSize(tflite::micro::GetTensorShape(input1),
+                                 tflite::micro::GetTensorShape(input2),
+                                 tflite::micro::GetTensorShape(output)),
+            [&](int first, int size) {
+              optimized_integer_ops::AddElementwise(
+                  size, op_params, input1_data + first, input2_data + first,
+                  out_data + first);
+            });
       }
       break;
     }
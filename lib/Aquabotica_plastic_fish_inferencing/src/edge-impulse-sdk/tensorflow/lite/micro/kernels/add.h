@@ -16,8 +16,10 @@ limitations under the License.
 #ifndef TENSORFLOW_LITE_MICRO_KERNELS_ADD_H_
 #define TENSORFLOW_LITE_MICRO_KERNELS_ADD_H_
 
+#include <algorithm>
 #include <cstdint>
 
+#include "edge-impulse-sdk/porting/ei_thread_pool.h"
 #include "edge-impulse-sdk/tensorflow/lite/c/builtin_op_data.h"
 #include "edge-impulse-sdk/tensorflow/lite/c/common.h"
 
@@ -59,6 +61,26 @@ TfLiteStatus CalculateOpDataAdd(TfLiteContext* context, TfLiteAddParams* params,
 
 TfLiteStatus AddPrepare(TfLiteContext* context, TfLiteNode* node);
 
+// Edge Impulse: runs kernel(first, size) of an elementwise ADD over `size`
+// elements on chunks spread over the ei thread pool (one call on all of them
+// when too small to split). Chunks start on a multiple of 16 elements.
+template <typename Kernel>
+inline void AddRunChunks(int size, const Kernel& kernel) {
+  const int blocks = (size + 15) / 16;
+  const int tasks = ei::parallel_tasks(blocks, static_cast<uint64_t>(size));
+  if (tasks <= 1) {
+    kernel(0, size);
+    return;
+  }
+  ei::parallel_for(tasks, [&](int task) {
+    const int first =
+        std::min(size, 16 * ei::parallel_task_first(blocks, tasks, task));
+    const int end =
+        std::min(size, 16 * ei::parallel_task_first(blocks, tasks, task + 1));
+    kernel(first, end - first);
+  });
+}
+
 // Generic must define registration function.
 TfLiteRegistration Register_ADD();
 
@@ -1705,6 +1705,13 @@ limitations under the License.
 #include "edge-impulse-sdk/porting/espressif/ESP-NN/include/esp_nn.h"
 #endif
 
+// ESP-NN's 1x1 path on the ESP32 is plain C, the packed filter kernel beats it
+#if ESP_NN && EI_CLASSIFIER_TFLITE_PREPACK_POINTWISE_CONV == 1
+#define EI_CONV_PACKED_POINTWISE 1
+#else
+#define EI_CONV_PACKED_POINTWISE 0
+#endif
+
 
 long long conv_total_time = 0;
 
@@ -1716,6 +1723,10 @@ struct NodeData {
 #if ESP_NN
   int buffer_idx;
 #endif
+  optimized_integer_ops::PointwiseConvPacked pointwise;
+  // Residual ADD run in the output stage, see ConvPrepareResidualAdd
+  bool residual_add;
+  ArithmeticParams add_params;
 };
 
 void* Init(TfLiteContext* context, const char* buffer, size_t length) {
@@ -1814,6 +1825,13 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   }
 #endif
 
+  data->pointwise.filter = nullptr;
+  data->residual_add = false;
+#if EI_CONV_PACKED_POINTWISE
+  TF_LITE_ENSURE_STATUS(ConvPreparePointwise(context, node, data->op_data,
+                                             &data->pointwise));
+#endif
+
   micro_context->DeallocateTempTfLiteTensor(output);
   micro_context->DeallocateTempTfLiteTensor(input);
   micro_context->DeallocateTempTfLiteTensor(filter);
@@ -1831,28 +1849,58 @@ inline void EvalQuantizedPerChannel(
   const int dilation_width_factor = params.dilation_width_factor;
   const int dilation_height_factor = params.dilation_height_factor;
 
+  RuntimeShape filter_shape = tflite::micro::GetTensorShape(filter);
+  RuntimeShape input_shape = tflite::micro::GetTensorShape(input);
+  RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
+  int8_t *output_data = tflite::micro::GetTensorData<int8_t>(output);
+  const uint64_t macs = static_cast<uint64_t>(output_shape.FlatSize()) *
+                        filter_shape.FlatSize() / filter_shape.Dims(0);
+
+#if EI_CONV_PACKED_POINTWISE
+  if (data.pointwise.filter != nullptr) {
+    // esp_nn_add_elementwise_s8 rounds like reference_integer_ops::AddFunc
+    const TfLiteEvalTensor* residual =
+        data.residual_add
+            ? tflite::micro::GetEvalInput(context, node, kConvResidualTensor)
+            : nullptr;
+    const int8_t* residual_data =
+        residual ? tflite::micro::GetTensorData<int8_t>(residual) : nullptr;
+    ConvRunRowBands(
+        ConvParamsQuantized(params, data.op_data), 1, input_shape,
+        tflite::micro::GetTensorData<int8_t>(input), output_shape, output_data,
+        macs,
+        [&](const ConvParams& band_params, const RuntimeShape& band_input_shape,
+            const int8_t* band_input, const RuntimeShape& band_output_shape,
+            int8_t* band_output) {
+          optimized_integer_ops::PointwiseConvPerChannelPortable(
+              data.pointwise, band_params,
+              data.op_data.per_channel_output_multiplier,
+              data.op_data.per_channel_output_shift, band_input_shape,
+              band_input, band_output_shape, band_output,
+              optimized_integer_ops::EspNnRequantize(),
+              residual ? &data.add_params : nullptr,
+              residual ? residual_data + (band_output - output_data)
+                       : nullptr);
+        });
+    return;
+  }
+#endif
+
   if (dilation_width_factor == 1 && dilation_height_factor == 1) {
     // Get parameters.
-    RuntimeShape filter_shape = tflite::micro::GetTensorShape(filter);
-    RuntimeShape input_shape = tflite::micro::GetTensorShape(input);
-    RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
     RuntimeShape bias_shape = tflite::micro::GetTensorShape(bias);
 
     const int8_t *input_data = tflite::micro::GetTensorData<int8_t>(input);
-    int8_t *output_data = tflite::micro::GetTensorData<int8_t>(output);
 
     const int32_t input_offset = -data.op_data.input_zero_point;
     const int32_t output_offset = data.op_data.output_zero_point;
     const int stride_width = params.stride_width;
     const int stride_height = params.stride_height;
     const int pad_width = data.op_data.padding.width;
-    const int pad_height = data.op_data.padding.height;
 
-    const int input_height = input_shape.Dims(1);
     const int input_width = input_shape.Dims(2);
     const int filter_height = filter_shape.Dims(1);
     const int filter_width = filter_shape.Dims(2);
-    const int output_height = output_shape.Dims(1);
     const int output_width = output_shape.Dims(2);
 
     // Set min and max value of the output.
@@ -1878,39 +1926,51 @@ inline void EvalQuantizedPerChannel(
     }
     esp_nn_set_conv_scratch_buf(scratch_buf);
 
-    const int input_size = input_width * input_height * input_depth;
-    const int output_size = output_width * output_height * output_depth;
-
-    data_dims_t input_dims =  {
-                                .width = input_width, .height = input_height,
-                                .channels = input_depth, .extra = 1
-                              };
-    data_dims_t output_dims = {
-                                .width = output_width, .height = output_height,
-                                .channels = output_depth, .extra = 1
-                              };
     data_dims_t filter_dims = { .width = filter_width, .height = filter_height,
                                 .channels = 0, .extra = 0
                               };
-    conv_params_t conv_params = {
-                                  .in_offset = input_offset, .out_offset = output_offset,
-                                  .stride = {stride_width, stride_height},
-                                  .padding = {pad_width, pad_height},
-                                  .dilation = {0, 0},
-                                  .activation = {activation_min, activation_max}
-                                };
     quant_data_t quant_data = {
                                 .shift = data.op_data.per_channel_output_shift,
                                 .mult = data.op_data.per_channel_output_multiplier
                               };
 
-    for (int i_batch = 0; i_batch < batch_size; i_batch++) {
-      esp_nn_conv_s8(&input_dims, input_data + i_batch * input_size,
-                     &filter_dims, tflite::micro::GetTensorData<int8_t>(filter),
-                     tflite::micro::GetTensorData<int32_t>(bias),
-                     &output_dims, output_data + i_batch * output_size,
-                     &conv_params, &quant_data);
-    }
+    // ESP-NN has one scratch buffer for every call, bands only run without it
+    ConvRunRowBands(
+        ConvParamsQuantized(params, data.op_data), filter_height, input_shape,
+        input_data, output_shape, output_data,
+        data.buffer_idx == -1 ? macs : 0,
+        [&](const ConvParams& band_params, const RuntimeShape& band_input_shape,
+            const int8_t* band_input, const RuntimeShape& band_output_shape,
+            int8_t* band_output) {
+      const int input_height = band_input_shape.Dims(1);
+      const int output_height = band_output_shape.Dims(1);
+      const int input_size = input_width * input_height * input_depth;
+      const int output_size = output_width * output_height * output_depth;
+
+      data_dims_t input_dims =  {
+                                  .width = input_width, .height = input_height,
+                                  .channels = input_depth, .extra = 1
+                                };
+      data_dims_t output_dims = {
+                                  .width = output_width, .height = output_height,
+                                  .channels = output_depth, .extra = 1
+                                };
+      conv_params_t conv_params = {
+                                    .in_offset = input_offset, .out_offset = output_offset,
+                                    .stride = {stride_width, stride_height},
+                                    .padding = {pad_width, band_params.padding_values.height},
+                                    .dilation = {0, 0},
+                                    .activation = {activation_min, activation_max}
+                                  };
+
+      for (int i_batch = 0; i_batch < batch_size; i_batch++) {
+        esp_nn_conv_s8(&input_dims, band_input + i_batch * input_size,
+                       &filter_dims, tflite::micro::GetTensorData<int8_t>(filter),
+                       tflite::micro::GetTensorData<int32_t>(bias),
+                       &output_dims, band_output + i_batch * output_size,
+                       &conv_params, &quant_data);
+      }
+    });
   } else {
     reference_integer_ops::ConvPerChannel(
         ConvParamsQuantized(params, data.op_data),
@@ -1934,7 +1994,7 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
   const TfLiteEvalTensor* filter =
       tflite::micro::GetEvalInput(context, node, kConvWeightsTensor);
   const TfLiteEvalTensor* bias =
-      (NumInputs(node) == 3)
+      (NumInputs(node) > kConvBiasTensor)
           ? tflite::micro::GetEvalInput(context, node, kConvBiasTensor)
           : nullptr;
   TfLiteEvalTensor* output =
@@ -2029,6 +2089,33 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
 
 }  // namespace
 
+#if EI_CLASSIFIER_TFLITE_FUSE_RESIDUAL_ADD == 1
+TfLiteStatus ConvPrepareResidualAdd(TfLiteContext* context,
+                                    TfLiteNode* conv_node,
+                                    const TfLiteNode* add_node,
+                                    int conv_input) {
+  NodeData* data = static_cast<NodeData*>(conv_node->user_data);
+  TF_LITE_ENSURE_STATUS(ConvResidualAddParams(context, conv_node, add_node,
+                                              conv_input, data->pointwise,
+                                              &data->add_params));
+  data->residual_add = true;
+  return kTfLiteOk;
+}
+#endif  // EI_CLASSIFIER_TFLITE_FUSE_RESIDUAL_ADD == 1
+
+#if EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+void ConvSetPaddingHeight(TfLiteNode* node, int padding_height) {
+  static_cast<NodeData*>(node->user_data)->op_data.padding.height =
+      padding_height;
+}
+#endif  // EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+
+#if EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS == 1
+TfLiteStatus ConvEval(TfLiteContext* context, TfLiteNode* node) {
+  return Eval(context, node);
+}
+#endif  // EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS == 1
+
 TfLiteRegistration Register_CONV_2D() {
   return tflite::micro::RegisterOp(Init, Prepare, Eval);
 }
@@ -2056,6 +2143,7 @@ limitations under the License.
 #include "edge-impulse-sdk/tensorflow/lite/c/builtin_op_data.h"
 #include "edge-impulse-sdk/tensorflow/lite/c/common.h"
 #include "edge-impulse-sdk/tensorflow/lite/kernels/internal/portable_tensor_utils.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/integer_ops/conv.h"
 #include "edge-impulse-sdk/tensorflow/lite/kernels/internal/reference/conv.h"
 #include "edge-impulse-sdk/tensorflow/lite/kernels/internal/reference/integer_ops/conv.h"
 #include "edge-impulse-sdk/tensorflow/lite/kernels/kernel_util.h"
@@ -2065,9 +2153,31 @@ limitations under the License.
 namespace tflite {
 namespace {
 
+struct NodeData {
+  // First member, ConvPrepare sees the user data as an OpDataConv
+  OpDataConv op_data;
+  optimized_integer_ops::PointwiseConvPacked pointwise;
+  // Residual ADD run in the output stage, see ConvPrepareResidualAdd
+  bool residual_add;
+  ArithmeticParams add_params;
+};
+
 void* Init(TfLiteContext* context, const char* buffer, size_t length) {
   TFLITE_DCHECK(context->AllocatePersistentBuffer != nullptr);
-  return context->AllocatePersistentBuffer(context, sizeof(OpDataConv));
+  return context->AllocatePersistentBuffer(context, sizeof(NodeData));
+}
+
+TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
+  TF_LITE_ENSURE_STATUS(ConvPrepare(context, node));
+
+  NodeData* data = static_cast<NodeData*>(node->user_data);
+  data->pointwise.filter = nullptr;
+  data->residual_add = false;
+#if EI_CLASSIFIER_TFLITE_PREPACK_POINTWISE_CONV == 1
+  TF_LITE_ENSURE_STATUS(ConvPreparePointwise(context, node, data->op_data,
+                                             &data->pointwise));
+#endif
+  return kTfLiteOk;
 }
 
 TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
@@ -2076,7 +2186,7 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
   const TfLiteEvalTensor* filter =
       tflite::micro::GetEvalInput(context, node, kConvWeightsTensor);
   const TfLiteEvalTensor* bias =
-      (NumInputs(node) == 3)
+      (NumInputs(node) > kConvBiasTensor)
           ? tflite::micro::GetEvalInput(context, node, kConvBiasTensor)
           : nullptr;
   TfLiteEvalTensor* output =
@@ -2086,7 +2196,8 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
   const auto& params =
       *(reinterpret_cast<TfLiteConvParams*>(node->builtin_data));
   TFLITE_DCHECK(node->user_data != nullptr);
-  const auto& data = *(static_cast<const OpDataConv*>(node->user_data));
+  const auto& node_data = *(static_cast<const NodeData*>(node->user_data));
+  const OpDataConv& data = node_data.op_data;
 
   TF_LITE_ENSURE_EQ(context, input->type, output->type);
   TF_LITE_ENSURE_MSG(
@@ -2179,17 +2290,63 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
           break;
         }
         case kTfLiteInt8: {
-          reference_integer_ops::ConvPerChannel(
-              ConvParamsQuantized(params, data),
-              data.per_channel_output_multiplier, data.per_channel_output_shift,
-              tflite::micro::GetTensorShape(input),
-              tflite::micro::GetTensorData<int8_t>(input),
-              tflite::micro::GetTensorShape(filter),
-              tflite::micro::GetTensorData<int8_t>(filter),
-              tflite::micro::GetTensorShape(bias),
-              tflite::micro::GetOptionalTensorData<int32_t>(bias),
-              tflite::micro::GetTensorShape(output),
-              tflite::micro::GetTensorData<int8_t>(output));
+          const RuntimeShape input_shape = tflite::micro::GetTensorShape(input);
+          const RuntimeShape filter_shape =
+              tflite::micro::GetTensorShape(filter);
+          const RuntimeShape output_shape =
+              tflite::micro::GetTensorShape(output);
+          int8_t* output_data = tflite::micro::GetTensorData<int8_t>(output);
+          const uint64_t macs = static_cast<uint64_t>(output_shape.FlatSize()) *
+                                filter_shape.FlatSize() / filter_shape.Dims(0);
+
+          if (node_data.pointwise.filter != nullptr) {
+            const TfLiteEvalTensor* residual =
+                node_data.residual_add ? tflite::micro::GetEvalInput(
+                                             context, node, kConvResidualTensor)
+                                       : nullptr;
+            const int8_t* residual_data =
+                residual ? tflite::micro::GetTensorData<int8_t>(residual)
+                         : nullptr;
+            ConvRunRowBands(
+                ConvParamsQuantized(params, data), 1, input_shape,
+                tflite::micro::GetTensorData<int8_t>(input), output_shape,
+                output_data, macs,
+                [&](const ConvParams& band_params,
+                    const RuntimeShape& band_input_shape,
+                    const int8_t* band_input, const RuntimeShape& band_output_shape,
+                    int8_t* band_output) {
+                  optimized_integer_ops::PointwiseConvPerChannel(
+                      node_data.pointwise, band_params,
+                      data.per_channel_output_multiplier,
+                      data.per_channel_output_shift, band_input_shape,
+                      band_input, band_output_shape, band_output,
+                      residual ? &node_data.add_params : nullptr,
+                      residual ? residual_data + (band_output - output_data)
+                               : nullptr);
+                });
+            break;
+          }
+          const RuntimeShape bias_shape = tflite::micro::GetTensorShape(bias);
+          ConvRunRowBands(
+              ConvParamsQuantized(params, data), filter_shape.Dims(1),
+              input_shape, tflite::micro::GetTensorData<int8_t>(input),
+              output_shape, output_data, macs,
+              [&](const ConvParams& band_params,
+                  const RuntimeShape& band_input_shape,
+                  const int8_t* band_input, const RuntimeShape& band_output_shape,
+                  int8_t* band_output) {
+#if EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+                optimized_integer_ops::ConvPerChannel(
+#else
+                reference_integer_ops::ConvPerChannel(
+#endif
+                    band_params, data.per_channel_output_multiplier,
+                    data.per_channel_output_shift, band_input_shape,
+                    band_input, filter_shape,
+                    tflite::micro::GetTensorData<int8_t>(filter), bias_shape,
+                    tflite::micro::GetOptionalTensorData<int32_t>(bias),
+                    band_output_shape, band_output);
+              });
           break;
         }
         default:
@@ -2209,8 +2366,35 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
 
 }  // namespace
 
+#if EI_CLASSIFIER_TFLITE_FUSE_RESIDUAL_ADD == 1
+TfLiteStatus ConvPrepareResidualAdd(TfLiteContext* context,
+                                    TfLiteNode* conv_node,
+                                    const TfLiteNode* add_node,
+                                    int conv_input) {
+  NodeData* data = static_cast<NodeData*>(conv_node->user_data);
+  TF_LITE_ENSURE_STATUS(ConvResidualAddParams(context, conv_node, add_node,
+                                              conv_input, data->pointwise,
+                                              &data->add_params));
+  data->residual_add = true;
+  return kTfLiteOk;
+}
+#endif  // EI_CLASSIFIER_TFLITE_FUSE_RESIDUAL_ADD == 1
+
+#if EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+void ConvSetPaddingHeight(TfLiteNode* node, int padding_height) {
+  static_cast<NodeData*>(node->user_data)->op_data.padding.height =
+      padding_height;
+}
+#endif  // EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+
+#if EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS == 1
+TfLiteStatus ConvEval(TfLiteContext* context, TfLiteNode* node) {
+  return Eval(context, node);
+}
+#endif  // EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS == 1
+
 TfLiteRegistration Register_CONV_2D() {
-  return tflite::micro::RegisterOp(Init, ConvPrepare, Eval);
+  return tflite::micro::RegisterOp(Init, Prepare, Eval);
 }
 
 }  // namespace tflite
@@ -16,11 +16,16 @@ limitations under the License.
 #ifndef TENSORFLOW_LITE_MICRO_KERNELS_CONV_H_
 #define TENSORFLOW_LITE_MICRO_KERNELS_CONV_H_
 
+#include <algorithm>
 #include <cstdint>
 
+#include "edge-impulse-sdk/porting/ei_thread_pool.h"
 #include "edge-impulse-sdk/tensorflow/lite/c/builtin_op_data.h"
 #include "edge-impulse-sdk/tensorflow/lite/c/common.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/integer_ops/conv_3x3.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/integer_ops/pointwise_conv.h"
 #include "edge-impulse-sdk/tensorflow/lite/kernels/internal/types.h"
+#include "edge-impulse-sdk/tensorflow/lite/micro/kernels/kernel_util.h"
 
 namespace tflite {
 
@@ -56,6 +61,9 @@ extern const int kConvWeightsTensor;
 extern const int kConvBiasTensor;
 extern const int kConvOutputTensor;
 extern const int kConvQuantizedDimension;
+// Edge Impulse: the skip connection input of a conv that runs a residual ADD
+// (see ConvPrepareResidualAdd)
+extern const int kConvResidualTensor;
 
 // Returns a ConvParams struct with all the parameters needed for a
 // float computation.
@@ -76,6 +84,198 @@ TfLiteStatus CalculateOpDataConv(TfLiteContext* context, TfLiteNode* node,
 
 TfLiteStatus ConvPrepare(TfLiteContext* context, TfLiteNode* node);
 
+// Edge Impulse: repacks the constant filter of an int8 1x1 convolution without
+// padding for optimized_integer_ops::PointwiseConvPerChannel. Call after the
+// OpDataConv is prepared. packed->filter stays nullptr for any other
+// convolution, or if the packed filter does not fit in memory.
+TfLiteStatus ConvPreparePointwise(
+    TfLiteContext* context, TfLiteNode* node, const OpDataConv& data,
+    optimized_integer_ops::PointwiseConvPacked* packed);
+
+#if EI_CLASSIFIER_TFLITE_FUSE_RESIDUAL_ADD == 1
+// Edge Impulse: lets a prepared conv run the prepared int8 ADD node that adds
+// its output (ADD input conv_input) to a tensor of the same shape, bit-exact
+// with reference_integer_ops::Add. Returns kTfLiteError if the conv kernel
+// cannot (only packed 1x1 convs can). On success the caller passes the ADD's
+// other input as conv input kConvResidualTensor (bias becomes -1 when absent),
+// makes the ADD's output the conv's output and stops running the ADD.
+TfLiteStatus ConvPrepareResidualAdd(TfLiteContext* context,
+                                    TfLiteNode* conv_node,
+                                    const TfLiteNode* add_node, int conv_input);
+
+// The part of ConvPrepareResidualAdd shared by the conv kernels: checks the
+// pair and fills the AddFunc parameters, with the residual as input1
+TfLiteStatus ConvResidualAddParams(
+    TfLiteContext* context, const TfLiteNode* conv_node,
+    const TfLiteNode* add_node, int conv_input,
+    const optimized_integer_ops::PointwiseConvPacked& packed,
+    ArithmeticParams* params);
+#endif  // EI_CLASSIFIER_TFLITE_FUSE_RESIDUAL_ADD == 1
+
+#if EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT == 1
+// Edge Impulse: lets a prepared conv whose int8 input has zero point -128 read
+// that input as uint8 with zero point 0 instead: u = x + 128, so the output
+// does not change. Only Conv3x3Eval reads uint8 inputs, EON compiled models
+// call this for a node they run with it and then hand out a uint8 input.
+TfLiteStatus ConvPrepareUint8Input(TfLiteContext* context, TfLiteNode* node);
+#endif  // EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT == 1
+
+#if EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+// Edge Impulse: sets the top padding a prepared conv applies to its input, so
+// it can run on a band of rows that starts inside the input (EON compiled
+// models run their first layers band by band)
+void ConvSetPaddingHeight(TfLiteNode* node, int padding_height);
+#endif  // EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+
+// Edge Impulse: runs kernel(params, input_shape, input_data, output_shape,
+// output_data) of a single batch conv or depthwise conv (ConvParams or
+// DepthwiseParams) on bands of output rows spread over the ei thread pool.
+// Every band gets the input rows it reads and its own top padding, so the
+// output is the same as one call on the whole tensors, which is what runs
+// when the layer is too small to split (macs) or batched.
+template <typename Params, typename InputT, typename Kernel>
+inline void ConvRunRowBands(const Params& params, int filter_height,
+                            const RuntimeShape& input_shape,
+                            const InputT* input_data,
+                            const RuntimeShape& output_shape,
+                            int8_t* output_data, uint64_t macs,
+                            const Kernel& kernel) {
+  const int output_height = output_shape.Dims(1);
+  const int tasks = input_shape.Dims(0) == 1
+                        ? ei::parallel_tasks(output_height, macs)
+                        : 1;
+  if (tasks <= 1) {
+    kernel(params, input_shape, input_data, output_shape, output_data);
+    return;
+  }
+
+  const int input_height = input_shape.Dims(1);
+  const int input_row = input_shape.Dims(2) * input_shape.Dims(3);
+  const int output_row = output_shape.Dims(2) * output_shape.Dims(3);
+  const int filter_extent =
+      params.dilation_height_factor * (filter_height - 1) + 1;
+
+  ei::parallel_for(tasks, [&](int task) {
+    const int output_first =
+        ei::parallel_task_first(output_height, tasks, task);
+    const int output_end =
+        ei::parallel_task_first(output_height, tasks, task + 1);
+    const int first_y =
+        output_first * params.stride_height - params.padding_values.height;
+    const int input_first = std::max(0, first_y);
+    const int input_end =
+        std::min(input_height, (output_end - 1) * params.stride_height -
+                                   params.padding_values.height +
+                                   filter_extent);
+
+    Params band_params = params;
+    band_params.padding_values.height = input_first - first_y;
+    const int32_t band_input_dims[4] = {1, input_end - input_first,
+                                        input_shape.Dims(2),
+                                        input_shape.Dims(3)};
+    const int32_t band_output_dims[4] = {1, output_end - output_first,
+                                         output_shape.Dims(2),
+                                         output_shape.Dims(3)};
+    const RuntimeShape band_input_shape(4, band_input_dims);
+    const RuntimeShape band_output_shape(4, band_output_dims);
+    kernel(band_params, band_input_shape,
+           input_data + input_first * input_row, band_output_shape,
+           output_data + output_first * output_row);
+  });
+}
+
+#if EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS == 1
+// Edge Impulse: requantization of the specialized kernels, the rounding of the
+// kernels they replace
+#if ESP_NN
+typedef optimized_integer_ops::EspNnRequantize ConvRequantize;
+#else
+typedef optimized_integer_ops::PointwiseRequantize ConvRequantize;
+#endif
+
+// Edge Impulse: the Eval of Register_CONV_2D(), for EON compiled models that
+// call the kernel of a node directly
+TfLiteStatus ConvEval(TfLiteContext* context, TfLiteNode* node);
+
+// The part of Conv3x3Eval that depends on the input type
+template <int kStride, int kInputDepth, int kOutputDepth, typename InputT>
+void Conv3x3EvalInput(const TfLiteConvParams& params, const OpDataConv& data,
+                      const RuntimeShape& input_shape, const InputT* input_data,
+                      const TfLiteEvalTensor* filter,
+                      const TfLiteEvalTensor* bias,
+                      const RuntimeShape& output_shape,
+                      TfLiteEvalTensor* output) {
+  const int8_t* filter_data = tflite::micro::GetTensorData<int8_t>(filter);
+  const int32_t* bias_data =
+      tflite::micro::GetOptionalTensorData<int32_t>(bias);
+  const uint64_t macs =
+      static_cast<uint64_t>(output_shape.FlatSize()) * 9 * kInputDepth;
+  ConvRunRowBands(
+      ConvParamsQuantized(params, data), 3, input_shape, input_data,
+      output_shape, tflite::micro::GetTensorData<int8_t>(output), macs,
+      [&](const ConvParams& band_params, const RuntimeShape& band_input_shape,
+          const InputT* band_input, const RuntimeShape& band_output_shape,
+          int8_t* band_output) {
+        optimized_integer_ops::Conv3x3PerChannel<kStride, kInputDepth,
+                                                 kOutputDepth>(
+            band_params, data.per_channel_output_multiplier,
+            data.per_channel_output_shift, band_input_shape, band_input,
+            filter_data, bias_data, band_output_shape, band_output,
+            ConvRequantize());
+      });
+}
+
+// Edge Impulse: Eval of a CONV_2D node that EON compiled models instantiate
+// for each int8 3x3 conv, from the stride and depths of the layer. Runs
+// optimized_integer_ops::Conv3x3PerChannel, or ConvEval if the node turns out
+// not to match. Also takes a uint8 input with zero point 0 (the generic conv
+// kernels do not), see EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT.
+template <int kStride, int kInputDepth, int kOutputDepth>
+TfLiteStatus Conv3x3Eval(TfLiteContext* context, TfLiteNode* node) {
+  const TfLiteEvalTensor* input =
+      tflite::micro::GetEvalInput(context, node, kConvInputTensor);
+  const TfLiteEvalTensor* filter =
+      tflite::micro::GetEvalInput(context, node, kConvWeightsTensor);
+  const TfLiteEvalTensor* bias =
+      (node->inputs->size > kConvBiasTensor)
+          ? tflite::micro::GetEvalInput(context, node, kConvBiasTensor)
+          : nullptr;
+  TfLiteEvalTensor* output =
+      tflite::micro::GetEvalOutput(context, node, kConvOutputTensor);
+
+  TFLITE_DCHECK(node->builtin_data != nullptr);
+  const auto& params =
+      *(reinterpret_cast<TfLiteConvParams*>(node->builtin_data));
+  // Every conv kernel keeps its OpDataConv first in user_data
+  TFLITE_DCHECK(node->user_data != nullptr);
+  const OpDataConv& data = *(static_cast<const OpDataConv*>(node->user_data));
+
+  const RuntimeShape input_shape = tflite::micro::GetTensorShape(input);
+  const RuntimeShape filter_shape = tflite::micro::GetTensorShape(filter);
+  const RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
+  if ((input->type != kTfLiteInt8 && input->type != kTfLiteUInt8) ||
+      filter->type != kTfLiteInt8 || params.stride_height != kStride ||
+      params.stride_width != kStride || params.dilation_height_factor != 1 ||
+      params.dilation_width_factor != 1 || input_shape.Dims(0) != 1 ||
+      input_shape.Dims(3) != kInputDepth ||
+      filter_shape.Dims(0) != kOutputDepth || filter_shape.Dims(1) != 3 ||
+      filter_shape.Dims(2) != 3 || filter_shape.Dims(3) != kInputDepth) {
+    return ConvEval(context, node);
+  }
+
+  if (input->type == kTfLiteUInt8) {
+    Conv3x3EvalInput<kStride, kInputDepth, kOutputDepth>(
+        params, data, input_shape, tflite::micro::GetTensorData<uint8_t>(input),
+        filter, bias, output_shape, output);
+  } else {
+    Conv3x3EvalInput<kStride, kInputDepth, kOutputDepth>(
+        params, data, input_shape, tflite::micro::GetTensorData<int8_t>(input),
+        filter, bias, output_shape, output);
+  }
+  return kTfLiteOk;
+}
+#endif  // EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS == 1
+
 // This is the most generic TfLiteRegistration. The actual supported types may
 // still be target dependent. The only requirement is that every implementation
 // (reference or optimized) must define this function.
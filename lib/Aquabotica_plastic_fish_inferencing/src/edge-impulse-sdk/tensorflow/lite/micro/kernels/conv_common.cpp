@@ -16,8 +16,10 @@ limitations under the License.
 #include "edge-impulse-sdk/tensorflow/lite/c/builtin_op_data.h"
 #include "edge-impulse-sdk/tensorflow/lite/c/c_api_types.h"
 #include "edge-impulse-sdk/tensorflow/lite/c/common.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/tensor_ctypes.h"
 #include "edge-impulse-sdk/tensorflow/lite/kernels/kernel_util.h"
 #include "edge-impulse-sdk/tensorflow/lite/kernels/padding.h"
+#include "edge-impulse-sdk/tensorflow/lite/micro/kernels/add.h"
 #include "edge-impulse-sdk/tensorflow/lite/micro/kernels/conv.h"
 #include "edge-impulse-sdk/tensorflow/lite/micro/kernels/kernel_util.h"
 
@@ -27,6 +29,7 @@ const int kConvInputTensor = 0;
 const int kConvWeightsTensor = 1;
 const int kConvBiasTensor = 2;
 const int kConvOutputTensor = 0;
+const int kConvResidualTensor = 3;
 
 // Conv is quantized along dimension 0:
 // https://www.tensorflow.org/lite/performance/quantization_spec
@@ -201,4 +204,110 @@ TfLiteStatus ConvPrepare(TfLiteContext* context, TfLiteNode* node) {
 
   return kTfLiteOk;
 }
+
+TfLiteStatus ConvPreparePointwise(
+    TfLiteContext* context, TfLiteNode* node, const OpDataConv& data,
+    optimized_integer_ops::PointwiseConvPacked* packed) {
+  packed->filter = nullptr;
+
+  MicroContext* micro_context = GetMicroContext(context);
+  TfLiteTensor* input =
+      micro_context->AllocateTempInputTensor(node, kConvInputTensor);
+  TF_LITE_ENSURE(context, input != nullptr);
+  TfLiteTensor* filter =
+      micro_context->AllocateTempInputTensor(node, kConvWeightsTensor);
+  TF_LITE_ENSURE(context, filter != nullptr);
+  TfLiteTensor* bias =
+      micro_context->AllocateTempInputTensor(node, kConvBiasTensor);
+
+  const bool pointwise =
+      input->type == kTfLiteInt8 && filter->type == kTfLiteInt8 &&
+      filter->dims->size == 4 && filter->dims->data[1] == 1 &&
+      filter->dims->data[2] == 1 && data.padding.width == 0 &&
+      data.padding.height == 0 && IsConstantTensor(filter) &&
+      (bias == nullptr ||
+       (bias->type == kTfLiteInt32 && IsConstantTensor(bias)));
+
+  if (pointwise) {
+    const int output_depth = filter->dims->data[0];
+    const int input_depth = filter->dims->data[3];
+    void* buffer = context->AllocatePersistentBuffer(
+        context, optimized_integer_ops::PointwiseConvPackedBytes(input_depth,
+                                                                 output_depth));
+    if (buffer != nullptr) {
+      optimized_integer_ops::PackPointwiseConv(
+          GetTensorData<int8_t>(filter),
+          bias ? GetTensorData<int32_t>(bias) : nullptr,
+          -data.input_zero_point, input_depth, output_depth, buffer, packed);
+    }
+  }
+
+  if (bias != nullptr) {
+    micro_context->DeallocateTempTfLiteTensor(bias);
+  }
+  micro_context->DeallocateTempTfLiteTensor(filter);
+  micro_context->DeallocateTempTfLiteTensor(input);
+
+  return kTfLiteOk;
+}
+
+#if EI_CLASSIFIER_TFLITE_FUSE_RESIDUAL_ADD == 1
+TfLiteStatus ConvResidualAddParams(
+    TfLiteContext* context, const TfLiteNode* conv_node,
+    const TfLiteNode* add_node, int conv_input,
+    const optimized_integer_ops::PointwiseConvPacked& packed,
+    ArithmeticParams* params) {
+  TF_LITE_ENSURE(context, add_node->user_data != nullptr);
+  TF_LITE_ENSURE(context, conv_input == kAddInputTensor1 ||
+                              conv_input == kAddInputTensor2);
+  const OpDataAdd* add = static_cast<const OpDataAdd*>(add_node->user_data);
+  if (packed.filter == nullptr || add->requires_broadcast) {
+    return kTfLiteError;
+  }
+
+  MicroContext* micro_context = GetMicroContext(context);
+  TfLiteTensor* conv_output =
+      micro_context->AllocateTempOutputTensor(conv_node, kConvOutputTensor);
+  TF_LITE_ENSURE(context, conv_output != nullptr);
+  TfLiteTensor* add_output =
+      micro_context->AllocateTempOutputTensor(add_node, kAddOutputTensor);
+  TF_LITE_ENSURE(context, add_output != nullptr);
+  const bool fusable = conv_output->type == kTfLiteInt8 &&
+                       add_output->type == kTfLiteInt8 &&
+                       HaveSameShapes(conv_output, add_output);
+  micro_context->DeallocateTempTfLiteTensor(add_output);
+  micro_context->DeallocateTempTfLiteTensor(conv_output);
+  if (!fusable) {
+    return kTfLiteError;
+  }
+
+  // AddFunc is symmetric, so the residual always goes in as input1
+  const bool conv_is_input1 = conv_input == kAddInputTensor1;
+  params->input1_offset = conv_is_input1 ? add->input2_offset : add->input1_offset;
+  params->input1_multiplier =
+      conv_is_input1 ? add->input2_multiplier : add->input1_multiplier;
+  params->input1_shift = conv_is_input1 ? add->input2_shift : add->input1_shift;
+  params->input2_offset = conv_is_input1 ? add->input1_offset : add->input2_offset;
+  params->input2_multiplier =
+      conv_is_input1 ? add->input1_multiplier : add->input2_multiplier;
+  params->input2_shift = conv_is_input1 ? add->input1_shift : add->input2_shift;
+  params->left_shift = add->left_shift;
+  params->output_offset = add->output_offset;
+  params->output_multiplier = add->output_multiplier;
+  params->output_shift = add->output_shift;
+  SetActivationParams(add->output_activation_min, add->output_activation_max,
+                      params);
+  return kTfLiteOk;
+}
+#endif  // EI_CLASSIFIER_TFLITE_FUSE_RESIDUAL_ADD == 1
+
+#if EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT == 1
+TfLiteStatus ConvPrepareUint8Input(TfLiteContext* context, TfLiteNode* node) {
+  OpDataConv* data = static_cast<OpDataConv*>(node->user_data);
+  TF_LITE_ENSURE_EQ(context, data->input_zero_point, -128);
+  data->input_zero_point = 0;
+  return kTfLiteOk;
+}
+#endif  // EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT == 1
+
 }  // namespace tflite
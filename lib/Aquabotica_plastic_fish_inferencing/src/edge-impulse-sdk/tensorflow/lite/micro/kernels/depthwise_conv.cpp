@@ -1689,14 +1689,11 @@ inline void EvalQuantizedPerChannel(TfLiteContext* context, TfLiteNode* node,
     const int stride_width = params.stride_width;
     const int stride_height = params.stride_height;
     const int pad_width = data.op_data.padding.width;
-    const int pad_height = data.op_data.padding.height;
 
-    const int input_height = input_shape.Dims(1);
     const int input_width = input_shape.Dims(2);
     const int input_depth = input_shape.Dims(3);
     const int filter_height = filter_shape.Dims(1);
     const int filter_width = filter_shape.Dims(2);
-    const int output_height = output_shape.Dims(1);
     const int output_width = output_shape.Dims(2);
 
     // Set min and max value of the output.
@@ -1713,8 +1710,6 @@ inline void EvalQuantizedPerChannel(TfLiteContext* context, TfLiteNode* node,
       TFLITE_DCHECK_EQ(bias_shape.FlatSize(), output_depth);
     }
 
-    const int input_size = input_width * input_height * input_depth;
-    const int output_size = output_width * output_height * output_depth;
     void *scratch_buf = NULL;
     if (data.buffer_idx > -1) {
       scratch_buf = context->GetScratchBuffer(context, data.buffer_idx);
@@ -1722,36 +1717,54 @@ inline void EvalQuantizedPerChannel(TfLiteContext* context, TfLiteNode* node,
 
     esp_nn_set_depthwise_conv_scratch_buf(scratch_buf);
 
-    data_dims_t input_dims =  {
-                                .width = input_width, .height = input_height,
-                                .channels = input_depth, .extra = 1
-                              };
-    data_dims_t output_dims = {
-                                .width = output_width, .height = output_height,
-                                .channels = output_depth, .extra = 1
-                              };
     data_dims_t filter_dims = { .width = filter_width, .height = filter_height,
                                 .channels = 0, .extra = 0
                               };
-    dw_conv_params_t conv_params =  {
-                                      .in_offset = input_offset, .out_offset = output_offset,
-                                      .ch_mult = depth_multiplier,
-                                      .stride = {stride_width, stride_height},
-                                      .padding = {pad_width, pad_height}, .dilation = {0, 0},
-                                      .activation = {activation_min, activation_max}
-                                    };
     quant_data_t quant_data = {
                                 .shift = data.op_data.per_channel_output_shift,
                                 .mult = data.op_data.per_channel_output_multiplier
                               };
-
-    for (int i_batch = 0; i_batch < batch_size; i_batch++) {
-      esp_nn_depthwise_conv_s8(&input_dims, input_data + i_batch * input_size,
-                               &filter_dims, tflite::micro::GetTensorData<int8_t>(filter),
-                               tflite::micro::GetTensorData<int32_t>(bias),
-                               &output_dims, output_data + i_batch * output_size,
-                               &conv_params, &quant_data);
-    }
+    const uint64_t macs = static_cast<uint64_t>(output_shape.FlatSize()) *
+                          filter_height * filter_width;
+
+    // ESP-NN has one scratch buffer for every call, bands only run without it
+    ConvRunRowBands(
+        DepthwiseConvParamsQuantized(params, data.op_data), filter_height,
+        input_shape, input_data, output_shape, output_data,
+        data.buffer_idx == -1 ? macs : 0,
+        [&](const DepthwiseParams& band_params,
+            const RuntimeShape& band_input_shape, const int8_t* band_input,
+            const RuntimeShape& band_output_shape, int8_t* band_output) {
+      const int input_height = band_input_shape.Dims(1);
+      const int output_height = band_output_shape.Dims(1);
+      const int input_size = input_width * input_height * input_depth;
+      const int output_size = output_width * output_height * output_depth;
+
+      data_dims_t input_dims =  {
+                                  .width = input_width, .height = input_height,
+                                  .channels = input_depth, .extra = 1
+                                };
+      data_dims_t output_dims = {
+                                  .width = output_width, .height = output_height,
+                                  .channels = output_depth, .extra = 1
+                                };
+      dw_conv_params_t conv_params =  {
+                                        .in_offset = input_offset, .out_offset = output_offset,
+                                        .ch_mult = depth_multiplier,
+                                        .stride = {stride_width, stride_height},
+                                        .padding = {pad_width, band_params.padding_values.height},
+                                        .dilation = {0, 0},
+                                        .activation = {activation_min, activation_max}
+                                      };
+
+      for (int i_batch = 0; i_batch < batch_size; i_batch++) {
+        esp_nn_depthwise_conv_s8(&input_dims, band_input + i_batch * input_size,
+                                 &filter_dims, tflite::micro::GetTensorData<int8_t>(filter),
+                                 tflite::micro::GetTensorData<int32_t>(bias),
+                                 &output_dims, band_output + i_batch * output_size,
+                                 &conv_params, &quant_data);
+      }
+    });
   } else {
     reference_integer_ops::DepthwiseConvPerChannel(
         DepthwiseConvParamsQuantized(params, data.op_data),
@@ -1965,6 +1978,19 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
 
 }  // namespace
 
+#if EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+void DepthwiseConvSetPaddingHeight(TfLiteNode* node, int padding_height) {
+  static_cast<NodeData*>(node->user_data)->op_data.padding.height =
+      padding_height;
+}
+#endif  // EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+
+#if EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS == 1
+TfLiteStatus DepthwiseConvEval(TfLiteContext* context, TfLiteNode* node) {
+  return Eval(context, node);
+}
+#endif  // EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS == 1
+
 TfLiteRegistration Register_DEPTHWISE_CONV_2D() {
   return tflite::micro::RegisterOp(Init, Prepare, Eval);
 }
@@ -1992,6 +2018,7 @@ limitations under the License.
 #include "edge-impulse-sdk/tensorflow/lite/c/builtin_op_data.h"
 #include "edge-impulse-sdk/tensorflow/lite/c/common.h"
 #include "edge-impulse-sdk/tensorflow/lite/kernels/internal/portable_tensor_utils.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/internal/optimized/integer_ops/depthwise_conv.h"
 #include "edge-impulse-sdk/tensorflow/lite/kernels/internal/reference/depthwiseconv_float.h"
 #include "edge-impulse-sdk/tensorflow/lite/kernels/internal/reference/integer_ops/depthwise_conv.h"
 #include "edge-impulse-sdk/tensorflow/lite/kernels/kernel_util.h"
@@ -2071,17 +2098,34 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
           break;
         }
         case kTfLiteInt8: {
-          reference_integer_ops::DepthwiseConvPerChannel(
-              DepthwiseConvParamsQuantized(params, data),
-              data.per_channel_output_multiplier, data.per_channel_output_shift,
+          const RuntimeShape filter_shape =
+              tflite::micro::GetTensorShape(filter);
+          const RuntimeShape bias_shape = tflite::micro::GetTensorShape(bias);
+          const RuntimeShape output_shape =
+              tflite::micro::GetTensorShape(output);
+          const uint64_t macs = static_cast<uint64_t>(output_shape.FlatSize()) *
+                                filter_shape.Dims(1) * filter_shape.Dims(2);
+          ConvRunRowBands(
+              DepthwiseConvParamsQuantized(params, data), filter_shape.Dims(1),
               tflite::micro::GetTensorShape(input),
-              tflite::micro::GetTensorData<int8_t>(input),
-              tflite::micro::GetTensorShape(filter),
-              tflite::micro::GetTensorData<int8_t>(filter),
-              tflite::micro::GetTensorShape(bias),
-              tflite::micro::GetOptionalTensorData<int32_t>(bias),
-              tflite::micro::GetTensorShape(output),
-              tflite::micro::GetTensorData<int8_t>(output));
+              tflite::micro::GetTensorData<int8_t>(input), output_shape,
+              tflite::micro::GetTensorData<int8_t>(output), macs,
+              [&](const DepthwiseParams& band_params,
+                  const RuntimeShape& band_input_shape,
+                  const int8_t* band_input, const RuntimeShape& band_output_shape,
+                  int8_t* band_output) {
+#if EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+                optimized_integer_ops::DepthwiseConvPerChannel(
+#else
+                reference_integer_ops::DepthwiseConvPerChannel(
+#endif
+                    band_params, data.per_channel_output_multiplier,
+                    data.per_channel_output_shift, band_input_shape,
+                    band_input, filter_shape,
+                    tflite::micro::GetTensorData<int8_t>(filter), bias_shape,
+                    tflite::micro::GetOptionalTensorData<int32_t>(bias),
+                    band_output_shape, band_output);
+              });
           break;
         }
         default:
@@ -2101,6 +2145,18 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
 
 }  // namespace
 
+#if EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+void DepthwiseConvSetPaddingHeight(TfLiteNode* node, int padding_height) {
+  static_cast<OpDataConv*>(node->user_data)->padding.height = padding_height;
+}
+#endif  // EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+
+#if EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS == 1
+TfLiteStatus DepthwiseConvEval(TfLiteContext* context, TfLiteNode* node) {
+  return Eval(context, node);
+}
+#endif  // EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS == 1
+
 TfLiteRegistration Register_DEPTHWISE_CONV_2D() {
   return tflite::micro::RegisterOp(Init, DepthwiseConvPrepare, Eval);
 }
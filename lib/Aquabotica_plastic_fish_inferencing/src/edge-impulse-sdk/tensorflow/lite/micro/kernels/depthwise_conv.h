@@ -49,6 +49,69 @@ TfLiteStatus CalculateOpDataDepthwiseConv(
 
 TfLiteStatus DepthwiseConvPrepare(TfLiteContext* context, TfLiteNode* node);
 
+#if EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+// Edge Impulse: depthwise version of ConvSetPaddingHeight
+void DepthwiseConvSetPaddingHeight(TfLiteNode* node, int padding_height);
+#endif  // EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+
+#if EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS == 1
+// Edge Impulse: the Eval of Register_DEPTHWISE_CONV_2D(), see ConvEval
+TfLiteStatus DepthwiseConvEval(TfLiteContext* context, TfLiteNode* node);
+
+// Edge Impulse: depthwise version of Conv3x3Eval, for int8 3x3 depthwise
+// convs with a depth multiplier of 1
+template <int kStride, int kDepth>
+TfLiteStatus DepthwiseConv3x3Eval(TfLiteContext* context, TfLiteNode* node) {
+  const TfLiteEvalTensor* input =
+      tflite::micro::GetEvalInput(context, node, kDepthwiseConvInputTensor);
+  const TfLiteEvalTensor* filter =
+      tflite::micro::GetEvalInput(context, node, kDepthwiseConvWeightsTensor);
+  const TfLiteEvalTensor* bias =
+      (node->inputs->size == 3)
+          ? tflite::micro::GetEvalInput(context, node, kDepthwiseConvBiasTensor)
+          : nullptr;
+  TfLiteEvalTensor* output =
+      tflite::micro::GetEvalOutput(context, node, kDepthwiseConvOutputTensor);
+
+  TFLITE_DCHECK(node->builtin_data != nullptr);
+  const auto& params =
+      *(reinterpret_cast<TfLiteDepthwiseConvParams*>(node->builtin_data));
+  TFLITE_DCHECK(node->user_data != nullptr);
+  const OpDataConv& data = *(static_cast<const OpDataConv*>(node->user_data));
+
+  const RuntimeShape input_shape = tflite::micro::GetTensorShape(input);
+  const RuntimeShape filter_shape = tflite::micro::GetTensorShape(filter);
+  const RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
+  if (input->type != kTfLiteInt8 || filter->type != kTfLiteInt8 ||
+      params.stride_height != kStride || params.stride_width != kStride ||
+      params.dilation_height_factor != 1 || params.dilation_width_factor != 1 ||
+      params.depth_multiplier != 1 || input_shape.Dims(0) != 1 ||
+      input_shape.Dims(3) != kDepth || filter_shape.Dims(1) != 3 ||
+      filter_shape.Dims(2) != 3 || filter_shape.Dims(3) != kDepth) {
+    return DepthwiseConvEval(context, node);
+  }
+
+  const int8_t* filter_data = tflite::micro::GetTensorData<int8_t>(filter);
+  const int32_t* bias_data =
+      tflite::micro::GetOptionalTensorData<int32_t>(bias);
+  const uint64_t macs = static_cast<uint64_t>(output_shape.FlatSize()) * 9;
+  ConvRunRowBands(
+      DepthwiseConvParamsQuantized(params, data), 3, input_shape,
+      tflite::micro::GetTensorData<int8_t>(input), output_shape,
+      tflite::micro::GetTensorData<int8_t>(output), macs,
+      [&](const DepthwiseParams& band_params,
+          const RuntimeShape& band_input_shape, const int8_t* band_input,
+          const RuntimeShape& band_output_shape, int8_t* band_output) {
+        optimized_integer_ops::DepthwiseConv3x3PerChannel<kStride, kDepth>(
+            band_params, data.per_channel_output_multiplier,
+            data.per_channel_output_shift, band_input_shape, band_input,
+            filter_data, bias_data, band_output_shape, band_output,
+            ConvRequantize());
+      });
+  return kTfLiteOk;
+}
+#endif  // EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS == 1
+
 // This is the most generic TfLiteRegistration. The actual supported types may
 // still be target dependent. The only requirement is that every implementation
 // (reference or optimized) must define this function.
@@ -77,12 +77,19 @@ ei_model_dsp_t ei_dsp_blocks[ei_dsp_blocks_size] = {
     }
 };
 const ei_config_tflite_eon_graph_t ei_config_tflite_graph_4 = {
-    .implementation_version = 1,
+    .implementation_version = 3,
     .model_init = &tflite_learn_4_init,
     .model_invoke = &tflite_learn_4_invoke,
     .model_reset = &tflite_learn_4_reset,
     .model_input = &tflite_learn_4_input,
     .model_output = &tflite_learn_4_output,
+    .model_instance_create = &tflite_learn_4_instance_create,
+    .model_instance_invoke = &tflite_learn_4_instance_invoke,
+    .model_instance_destroy = &tflite_learn_4_instance_destroy,
+    .model_instance_input = &tflite_learn_4_instance_input,
+    .model_instance_output = &tflite_learn_4_instance_output,
+    .model_softmax_logits = &tflite_learn_4_softmax_logits,
+    .model_instance_softmax_logits = &tflite_learn_4_instance_softmax_logits,
 };
 
 const ei_learning_block_config_tflite_graph_t ei_learning_block_config_4 = {
@@ -32,10 +32,18 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <new>
 #include "edge-impulse-sdk/tensorflow/lite/c/builtin_op_data.h"
 #include "edge-impulse-sdk/tensorflow/lite/c/common.h"
+#include "edge-impulse-sdk/tensorflow/lite/kernels/padding.h"
+#include "edge-impulse-sdk/tensorflow/lite/micro/kernels/conv.h"
+#include "edge-impulse-sdk/tensorflow/lite/micro/kernels/depthwise_conv.h"
+#include "edge-impulse-sdk/tensorflow/lite/micro/kernels/softmax.h"
 #include "edge-impulse-sdk/tensorflow/lite/micro/micro_mutable_op_resolver.h"
 #include "edge-impulse-sdk/porting/ei_classifier_porting.h"
+#include "edge-impulse-sdk/classifier/ei_layer_profiler.h"
+#include "tflite-model/tflite_learn_4_compiled.h"
 
 #if EI_CLASSIFIER_PRINT_STATE
 #if defined(__cplusplus) && EI_C_LINKAGE == 1
@@ -93,10 +101,39 @@ using namespace tflite::ops::micro;
 
 namespace {
 
+// 1x1 conv filters repacked at prepare time, 14 layers (PointwiseConvPackedBytes)
+#if EI_CLASSIFIER_TFLITE_PREPACK_POINTWISE_CONV == 1
+#if EI_CLASSIFIER_TFLITE_ENABLE_X86_SIMD == 1
+constexpr int kPackedFilterArenaSize = 18176;
+#else
+constexpr int kPackedFilterArenaSize = 16000;
+#endif
+#else
+constexpr int kPackedFilterArenaSize = 0;
+#endif // EI_CLASSIFIER_TFLITE_PREPACK_POINTWISE_CONV
+
+// Nodes 0 to 5 (the 48x48 layers and the stride 2 depthwise conv after them)
+// run band by band of 4 output rows, see invoke_depth_first. The plan then
+// only holds one band of the tensors between them: 84480 bytes of tensors
+// instead of 138240.
+#if EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+constexpr size_t kDepthFirstLastNode = 5;
+constexpr int kDepthFirstBandRows = 4;
+constexpr int kPlannedTensorArenaSize = 100272;
+#else
+constexpr int kPlannedTensorArenaSize = 154032;
+#endif // EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST
+
+#if EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT == 1 && EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS != 1
+#error "EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT needs EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS"
+#endif
+
+// The plan does not allocate the outputs of the two PAD nodes, they are folded
+// into the depthwise convs that read them (see fuse_pad_nodes)
 #if defined(EI_CLASSIFIER_ALLOCATION_STATIC_HIMAX) || defined(EI_CLASSIFIER_ALLOCATION_STATIC_HIMAX_GNU)
-constexpr int kTensorArenaSize = 242656;
+constexpr int kTensorArenaSize = kPlannedTensorArenaSize + 1024 + kPackedFilterArenaSize;
 #else
-constexpr int kTensorArenaSize = 241632;
+constexpr int kTensorArenaSize = kPlannedTensorArenaSize + kPackedFilterArenaSize;
 #endif
 
 #if defined(EI_CLASSIFIER_ALLOCATION_STATIC)
@@ -116,9 +153,6 @@ uint8_t tensor_arena[kTensorArenaSize] ALIGN(16) __attribute__((section(".tensor
 uint8_t* tensor_arena = NULL;
 #endif
 
-static uint8_t* tensor_boundary;
-static uint8_t* current_location;
-
 template <int SZ, class T> struct TfArray {
   int sz; T elem[SZ];
 };
@@ -146,18 +180,20 @@ typedef struct {
   int16_t index;
 } TfLiteEvalTensorWithIndex;
 
-TfLiteContext ctx{};
 static const int MAX_TFL_TENSOR_COUNT = 4;
-static TfLiteTensorWithIndex tflTensors[MAX_TFL_TENSOR_COUNT];
-static const int MAX_TFL_EVAL_COUNT = 4;
-static TfLiteEvalTensorWithIndex tflEvalTensors[MAX_TFL_EVAL_COUNT];
-TfLiteRegistration registrations[OP_LAST];
+// 5: a conv that runs a residual ADD also reads the skip connection
+static const int MAX_TFL_EVAL_COUNT = 5;
 
 namespace g0 {
 const TfArray<4, int> tensor_dimension0 = { 4, { 1,96,96,3 } };
 const TfArray<1, float> quant0_scale = { 1, { 0.0039215688593685627, } };
 const TfArray<1, int> quant0_zero = { 1, { -128 } };
 const TfLiteAffineQuantization quant0 = { (TfLiteFloatArray*)&quant0_scale, (TfLiteIntArray*)&quant0_zero, 0 };
+#if EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT == 1
+// The input as uint8 pixels, see fold_input_zero_point
+const TfArray<1, int> quant0_uint8_zero = { 1, { 0 } };
+const TfLiteAffineQuantization quant0_uint8 = { (TfLiteFloatArray*)&quant0_scale, (TfLiteIntArray*)&quant0_uint8_zero, 0 };
+#endif // EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT
 const MODEL_SECTION(EI_MODEL_SECTION) ALIGN(16) int32_t tensor_data1[4*2] = { 
   0, 0, 
   0, 1, 
@@ -1236,20 +1272,29 @@ TensorInfo_t tensorData[] = {
 { kTfLiteMmapRo, kTfLiteInt8, (int32_t*)g0::tensor_data41, (TfLiteIntArray*)&g0::tensor_dimension41, 144, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant41))}, },
 { kTfLiteMmapRo, kTfLiteInt32, (int32_t*)g0::tensor_data42, (TfLiteIntArray*)&g0::tensor_dimension42, 64, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant42))}, },
 { kTfLiteMmapRo, kTfLiteInt8, (int32_t*)g0::tensor_data43, (TfLiteIntArray*)&g0::tensor_dimension43, 432, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant43))}, },
+#if EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 55296), (TfLiteIntArray*)&g0::tensor_dimension44, 8448, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant44))}, },
+{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 63744), (TfLiteIntArray*)&g0::tensor_dimension45, 6912, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant45))}, },
+{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 55296), (TfLiteIntArray*)&g0::tensor_dimension46, 3456, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant46))}, },
+{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 63744), (TfLiteIntArray*)&g0::tensor_dimension47, 20736, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant47))}, },
+{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 0), (TfLiteIntArray*)&g0::tensor_dimension48, 0, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant48))}, },
+{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 27648), (TfLiteIntArray*)&g0::tensor_dimension49, 27648, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant49))}, },
+#else
 { kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 36864), (TfLiteIntArray*)&g0::tensor_dimension44, 36864, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant44))}, },
 { kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 0), (TfLiteIntArray*)&g0::tensor_dimension45, 36864, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant45))}, },
-{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 36864), (TfLiteIntArray*)&g0::tensor_dimension46, 18432, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant46))}, },
-{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 115248), (TfLiteIntArray*)&g0::tensor_dimension47, 110592, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant47))}, },
-{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 0), (TfLiteIntArray*)&g0::tensor_dimension48, 115248, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant48))}, },
-{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 115248), (TfLiteIntArray*)&g0::tensor_dimension49, 27648, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant49))}, },
+{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 110592), (TfLiteIntArray*)&g0::tensor_dimension46, 18432, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant46))}, },
+{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 0), (TfLiteIntArray*)&g0::tensor_dimension47, 110592, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant47))}, },
+{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 0), (TfLiteIntArray*)&g0::tensor_dimension48, 0, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant48))}, },
+{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 110592), (TfLiteIntArray*)&g0::tensor_dimension49, 27648, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant49))}, },
+#endif // EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST
 { kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 55296), (TfLiteIntArray*)&g0::tensor_dimension50, 4608, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant50))}, },
 { kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 27648), (TfLiteIntArray*)&g0::tensor_dimension51, 27648, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant51))}, },
 { kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 0), (TfLiteIntArray*)&g0::tensor_dimension52, 27648, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant52))}, },
 { kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 27648), (TfLiteIntArray*)&g0::tensor_dimension53, 4608, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant53))}, },
-{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 0), (TfLiteIntArray*)&g0::tensor_dimension54, 4608, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant54))}, },
+{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 59904), (TfLiteIntArray*)&g0::tensor_dimension54, 4608, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant54))}, },
 { kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 30000), (TfLiteIntArray*)&g0::tensor_dimension55, 27648, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant55))}, },
-{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 0), (TfLiteIntArray*)&g0::tensor_dimension56, 30000, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant56))}, },
-{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 30000), (TfLiteIntArray*)&g0::tensor_dimension57, 6912, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant57))}, },
+{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 0), (TfLiteIntArray*)&g0::tensor_dimension56, 0, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant56))}, },
+{ kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 0), (TfLiteIntArray*)&g0::tensor_dimension57, 6912, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant57))}, },
 { kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 36912), (TfLiteIntArray*)&g0::tensor_dimension58, 2304, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant58))}, },
 { kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 13824), (TfLiteIntArray*)&g0::tensor_dimension59, 13824, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant59))}, },
 { kTfLiteArenaRw, kTfLiteInt8, (int32_t*)(tensor_arena + 0), (TfLiteIntArray*)&g0::tensor_dimension60, 13824, {kTfLiteAffineQuantization, const_cast<void*>(static_cast<const void*>(&g0::quant60))}, },
@@ -1266,7 +1311,7 @@ TensorInfo_t tensorData[] = {
 };
 
 #ifndef TF_LITE_STATIC_MEMORY
-TfLiteNode tflNodes[27] = {
+const TfLiteNode tflNodes[27] = {
 { (TfLiteIntArray*)&g0::inputs0, (TfLiteIntArray*)&g0::outputs0, (TfLiteIntArray*)&g0::inputs0, nullptr, nullptr, const_cast<void*>(static_cast<const void*>(&g0::opdata0)), nullptr, 0, },
 { (TfLiteIntArray*)&g0::inputs1, (TfLiteIntArray*)&g0::outputs1, (TfLiteIntArray*)&g0::inputs1, nullptr, nullptr, const_cast<void*>(static_cast<const void*>(&g0::opdata1)), nullptr, 0, },
 { (TfLiteIntArray*)&g0::inputs2, (TfLiteIntArray*)&g0::outputs2, (TfLiteIntArray*)&g0::inputs2, nullptr, nullptr, const_cast<void*>(static_cast<const void*>(&g0::opdata2)), nullptr, 0, },
@@ -1296,7 +1341,7 @@ TfLiteNode tflNodes[27] = {
 { (TfLiteIntArray*)&g0::inputs26, (TfLiteIntArray*)&g0::outputs26, (TfLiteIntArray*)&g0::inputs26, nullptr, nullptr, const_cast<void*>(static_cast<const void*>(&g0::opdata26)), nullptr, 0, },
 };
 #else
-TfLiteNode tflNodes[27] = {
+const TfLiteNode tflNodes[27] = {
 { (TfLiteIntArray*)&g0::inputs0, (TfLiteIntArray*)&g0::outputs0, (TfLiteIntArray*)&g0::inputs0, nullptr, const_cast<void*>(static_cast<const void*>(&g0::opdata0)), nullptr, 0, },
 { (TfLiteIntArray*)&g0::inputs1, (TfLiteIntArray*)&g0::outputs1, (TfLiteIntArray*)&g0::inputs1, nullptr, const_cast<void*>(static_cast<const void*>(&g0::opdata1)), nullptr, 0, },
 { (TfLiteIntArray*)&g0::inputs2, (TfLiteIntArray*)&g0::outputs2, (TfLiteIntArray*)&g0::inputs2, nullptr, const_cast<void*>(static_cast<const void*>(&g0::opdata2)), nullptr, 0, },
@@ -1345,32 +1390,150 @@ static const int out_tensor_indices[] = {
 };
 
 
-size_t current_subgraph_index = 0;
+static const uint16_t TENSOR_IX_UNUSED = 0x7FFF;
 
-static void init_tflite_tensor(size_t i, TfLiteTensor *tensor) {
-  tensor->type = tensorData[i].type;
-  tensor->is_variable = false;
+typedef struct {
+  size_t bytes;
+  void *ptr;
+} scratch_buffer_t;
 
-#if defined(EI_CLASSIFIER_ALLOCATION_HEAP)
-  tensor->allocation_type = tensorData[i].allocation_type;
-#else
-  tensor->allocation_type = (tensor_arena <= tensorData[i].data && tensorData[i].data < tensor_arena + kTensorArenaSize) ? kTfLiteArenaRw : kTfLiteMmapRo;
-#endif
-  tensor->bytes = tensorData[i].bytes;
-  tensor->dims = tensorData[i].dims;
+#if EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+// A node of the depth-first stage, with the rows of its input an output row reads
+typedef struct {
+  size_t node;
+  int stride;
+  int filter_height; // dilated
+  int padding; // top padding of the whole input
+  int input_rows;
+} depth_first_node_t;
+
+// The rows of a tensor that a node sees while it runs on a band
+typedef struct {
+  int tensor;
+  void *data;
+  TfArray<4, int> dims;
+} tensor_window_t;
+#endif // EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST
 
-#if defined(EI_CLASSIFIER_ALLOCATION_HEAP)
-  if(tensor->allocation_type == kTfLiteArenaRw){
-    uint8_t* start = (uint8_t*) ((uintptr_t)tensorData[i].data + (uintptr_t) tensor_arena);
+struct EonInstance;
+
+class EonMicroContext : public MicroContext {
+ public:
+
+  EonMicroContext(EonInstance *instance): MicroContext(nullptr, nullptr, nullptr), instance_(instance) { }
+
+  void* AllocatePersistentBuffer(size_t bytes);
+
+  TfLiteStatus RequestScratchBufferInArena(size_t bytes,
+                                           int* buffer_index);
+
+  void* GetScratchBuffer(int buffer_index);
+
+  TfLiteTensor* AllocateTempTfLiteTensor(int tensor_index);
 
-    tensor->data.data =  start;
+  void DeallocateTempTfLiteTensor(TfLiteTensor* tensor) {
+    return;
   }
-  else {
-      tensor->data.data = tensorData[i].data;
+
+  bool IsAllTempTfLiteTensorDeallocated() {
+    return true;
   }
+
+  TfLiteEvalTensor* GetEvalTensor(int tensor_index);
+
+  EonInstance* instance() const {
+    return instance_;
+  }
+
+ private:
+  EonInstance *instance_;
+};
+
+// Everything that changes while the model runs. One per model instance, so
+// separate instances can be invoked concurrently.
+struct EonInstance {
+  EonInstance(): micro_context(this) { }
+
+  uint8_t* tensor_arena = nullptr;
+  bool owns_arena = false;
+  uint8_t* tensor_boundary = nullptr;
+  uint8_t* current_location = nullptr;
+  TfLiteContext ctx{};
+  EonMicroContext micro_context;
+  TfLiteRegistration registrations[OP_LAST];
+  TfLiteNode nodes[27];
+  TfLiteTensorWithIndex tflTensors[MAX_TFL_TENSOR_COUNT];
+  TfLiteEvalTensorWithIndex tflEvalTensors[MAX_TFL_EVAL_COUNT];
+  void* overflow_buffers[EI_MAX_OVERFLOW_BUFFER_COUNT];
+  size_t overflow_buffers_ix = 0;
+  scratch_buffer_t scratch_buffers[EI_MAX_SCRATCH_BUFFER_COUNT];
+  size_t scratch_buffers_ix = 0;
+  size_t current_subgraph_index = 0;
+  // Nodes that run as part of a neighbour: PAD nodes in the depthwise conv
+  // after them, ADD nodes in the conv before them
+  bool fused_node[27];
+  // Rewritten inputs and params of those convs (one per PAD or ADD node)
+  TfArray<3, int> pad_conv_inputs[2];
+  TfLiteDepthwiseConvParams pad_conv_params[2];
+  TfArray<4, int> add_conv_inputs[3];
+  TfArray<1, int> add_conv_outputs[3];
+  // Params of the final SOFTMAX when the FOMO decoder can run it on the logits,
+  // and whether invokes stop before it (see softmax_logits)
+  bool has_softmax_logits = false;
+  SoftmaxParams softmax_params;
+  bool skip_softmax = false;
+#if EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT == 1
+  // The input takes uint8 pixels, see fold_input_zero_point
+  bool uint8_input = false;
+#endif // EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT
+#if EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+  // Nodes that run band by band, and the input and output rows of the one
+  // running (see invoke_depth_first)
+  depth_first_node_t depth_first_nodes[kDepthFirstLastNode + 1];
+  size_t depth_first_count = 0;
+  tensor_window_t windows[2];
+  size_t window_count = 0;
+#endif // EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST
+#if EI_CLASSIFIER_TFLITE_EON_PROFILE
+  ei::LayerProfiler* profiler = nullptr;
+  ei_layer_info_t layers[27];
+  // what a node did on the last band
+  ei_layer_info_t band_layer;
+#endif // EI_CLASSIFIER_TFLITE_EON_PROFILE
+};
+
+// Instance behind the single-instance API (tflite_learn_4_init etc.)
+EonInstance default_instance;
+
+static EonInstance* GetInstance(const struct TfLiteContext* context) {
+  return static_cast<EonMicroContext*>(context->impl_)->instance();
+}
+
+// Returns where tensor i lives for this instance, arena tensors are relocated into its arena
+static void* tensor_data_ptr(EonInstance* inst, size_t i, TfLiteAllocationType* allocation_type) {
+#if defined(EI_CLASSIFIER_ALLOCATION_HEAP)
+  *allocation_type = tensorData[i].allocation_type;
+  if (*allocation_type == kTfLiteArenaRw) {
+    return (uint8_t*) ((uintptr_t)tensorData[i].data + (uintptr_t) inst->tensor_arena);
+  }
+  return tensorData[i].data;
 #else
-  tensor->data.data = tensorData[i].data;
+  uint8_t* data = (uint8_t*) tensorData[i].data;
+  if (tensor_arena <= data && data < tensor_arena + kTensorArenaSize) {
+    *allocation_type = kTfLiteArenaRw;
+    return inst->tensor_arena + (data - tensor_arena);
+  }
+  *allocation_type = kTfLiteMmapRo;
+  return data;
 #endif // EI_CLASSIFIER_ALLOCATION_HEAP
+}
+
+static void init_tflite_tensor(EonInstance* inst, size_t i, TfLiteTensor *tensor) {
+  tensor->type = tensorData[i].type;
+  tensor->is_variable = false;
+  tensor->data.data = tensor_data_ptr(inst, i, &tensor->allocation_type);
+  tensor->bytes = tensorData[i].bytes;
+  tensor->dims = tensorData[i].dims;
   tensor->quantization = tensorData[i].quantization;
   if (tensor->quantization.type == kTfLiteAffineQuantization) {
     TfLiteAffineQuantization const* quant = ((TfLiteAffineQuantization const*)(tensorData[i].quantization.params));
@@ -1378,38 +1541,47 @@ static void init_tflite_tensor(size_t i, TfLiteTensor *tensor) {
     tensor->params.zero_point = quant->zero_point->data[0];
   }
 
+#if EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT == 1
+  if (inst->uint8_input && (int)i == in_tensor_indices[0]) {
+    tensor->type = kTfLiteUInt8;
+    tensor->quantization.params = const_cast<void*>(static_cast<const void*>(&g0::quant0_uint8));
+    tensor->params.zero_point = 0;
+  }
+#endif // EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT
 }
 
-static void init_tflite_eval_tensor(int i, TfLiteEvalTensor *tensor) {
+static void init_tflite_eval_tensor(EonInstance* inst, int i, TfLiteEvalTensor *tensor) {
+  TfLiteAllocationType allocation_type;
 
   tensor->type = tensorData[i].type;
+#if EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT == 1
+  if (inst->uint8_input && i == in_tensor_indices[0]) {
+    tensor->type = kTfLiteUInt8;
+  }
+#endif // EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT
 
   tensor->dims = tensorData[i].dims;
 
-#if defined(EI_CLASSIFIER_ALLOCATION_HEAP)
-  auto allocation_type = tensorData[i].allocation_type;
-  if(allocation_type == kTfLiteArenaRw) {
-    uint8_t* start = (uint8_t*) ((uintptr_t)tensorData[i].data + (uintptr_t) tensor_arena);
+  tensor->data.data = tensor_data_ptr(inst, i, &allocation_type);
 
-    tensor->data.data =  start;
-  }
-  else {
-    tensor->data.data = tensorData[i].data;
+#if EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+  for (size_t ix = 0; ix < inst->window_count; ix++) {
+    if (inst->windows[ix].tensor == i) {
+      tensor->dims = (TfLiteIntArray*)&inst->windows[ix].dims;
+      tensor->data.data = inst->windows[ix].data;
+    }
   }
-#else
-  tensor->data.data = tensorData[i].data;
-#endif // EI_CLASSIFIER_ALLOCATION_HEAP
+#endif // EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST
 }
 
-static void* overflow_buffers[EI_MAX_OVERFLOW_BUFFER_COUNT];
-static size_t overflow_buffers_ix = 0;
 static void * AllocatePersistentBufferImpl(struct TfLiteContext* ctx,
                                        size_t bytes) {
+  EonInstance* inst = GetInstance(ctx);
   void *ptr;
   uint32_t align_bytes = (bytes % 16) ? 16 - (bytes % 16) : 0;
 
-  if (current_location - (bytes + align_bytes) < tensor_boundary) {
-    if (overflow_buffers_ix > EI_MAX_OVERFLOW_BUFFER_COUNT - 1) {
+  if (inst->current_location - (bytes + align_bytes) < inst->tensor_boundary) {
+    if (inst->overflow_buffers_ix > EI_MAX_OVERFLOW_BUFFER_COUNT - 1) {
       ei_printf("ERR: Failed to allocate persistent buffer of size %d, does not fit in tensor arena and reached EI_MAX_OVERFLOW_BUFFER_COUNT\n",
         (int)bytes);
       return NULL;
@@ -1422,33 +1594,27 @@ static void * AllocatePersistentBufferImpl(struct TfLiteContext* ctx,
       ei_printf("ERR: Failed to allocate persistent buffer of size %d\n", (int)bytes);
       return NULL;
     }
-    overflow_buffers[overflow_buffers_ix++] = ptr;
+    inst->overflow_buffers[inst->overflow_buffers_ix++] = ptr;
     return ptr;
   }
 
-  current_location -= bytes;
+  inst->current_location -= bytes;
 
   // align to the left aligned boundary of 16 bytes
-  current_location -= 15; // for alignment
-  current_location += 16 - ((uintptr_t)(current_location) & 15);
+  inst->current_location -= 15; // for alignment
+  inst->current_location += 16 - ((uintptr_t)(inst->current_location) & 15);
 
-  ptr = current_location;
+  ptr = inst->current_location;
   memset(ptr, 0, bytes);
 
   return ptr;
 }
 
-typedef struct {
-  size_t bytes;
-  void *ptr;
-} scratch_buffer_t;
-
-static scratch_buffer_t scratch_buffers[EI_MAX_SCRATCH_BUFFER_COUNT];
-static size_t scratch_buffers_ix = 0;
-
 static TfLiteStatus RequestScratchBufferInArenaImpl(struct TfLiteContext* ctx, size_t bytes,
                                                 int* buffer_idx) {
-  if (scratch_buffers_ix > EI_MAX_SCRATCH_BUFFER_COUNT - 1) {
+  EonInstance* inst = GetInstance(ctx);
+
+  if (inst->scratch_buffers_ix > EI_MAX_SCRATCH_BUFFER_COUNT - 1) {
     ei_printf("ERR: Failed to allocate scratch buffer of size %d, reached EI_MAX_SCRATCH_BUFFER_COUNT\n",
       (int)bytes);
     return kTfLiteError;
@@ -1464,48 +1630,49 @@ static TfLiteStatus RequestScratchBufferInArenaImpl(struct TfLiteContext* ctx, s
     return kTfLiteError;
   }
 
-  scratch_buffers[scratch_buffers_ix] = b;
-  *buffer_idx = scratch_buffers_ix;
+  inst->scratch_buffers[inst->scratch_buffers_ix] = b;
+  *buffer_idx = inst->scratch_buffers_ix;
 
-  scratch_buffers_ix++;
+  inst->scratch_buffers_ix++;
 
   return kTfLiteOk;
 }
 
 static void* GetScratchBufferImpl(struct TfLiteContext* ctx, int buffer_idx) {
-  if (buffer_idx > (int)scratch_buffers_ix) {
+  EonInstance* inst = GetInstance(ctx);
+
+  if (buffer_idx > (int)inst->scratch_buffers_ix) {
     return NULL;
   }
-  return scratch_buffers[buffer_idx].ptr;
+  return inst->scratch_buffers[buffer_idx].ptr;
 }
 
-static const uint16_t TENSOR_IX_UNUSED = 0x7FFF;
-
-static void ResetTensors() {
+static void ResetTensors(EonInstance* inst) {
   for (size_t ix = 0; ix < MAX_TFL_TENSOR_COUNT; ix++) {
-    tflTensors[ix].index = TENSOR_IX_UNUSED;
+    inst->tflTensors[ix].index = TENSOR_IX_UNUSED;
   }
   for (size_t ix = 0; ix < MAX_TFL_EVAL_COUNT; ix++) {
-    tflEvalTensors[ix].index = TENSOR_IX_UNUSED;
+    inst->tflEvalTensors[ix].index = TENSOR_IX_UNUSED;
   }
 }
 
 static TfLiteTensor* GetTensorImpl(const struct TfLiteContext* context,
                                int tensor_idx) {
+  EonInstance* inst = GetInstance(context);
 
-  tensor_idx = tflTensors_subgraph_index[current_subgraph_index] + tensor_idx;
+  tensor_idx = tflTensors_subgraph_index[inst->current_subgraph_index] + tensor_idx;
 
   for (size_t ix = 0; ix < MAX_TFL_TENSOR_COUNT; ix++) {
     // already used? OK!
-    if (tflTensors[ix].index == tensor_idx) {
-      return &tflTensors[ix].tensor;
+    if (inst->tflTensors[ix].index == tensor_idx) {
+      return &inst->tflTensors[ix].tensor;
     }
     // passed all the ones we've used, so end of the list?
-    if (tflTensors[ix].index == TENSOR_IX_UNUSED) {
+    if (inst->tflTensors[ix].index == TENSOR_IX_UNUSED) {
       // init the tensor
-      init_tflite_tensor(tensor_idx, &tflTensors[ix].tensor);
-      tflTensors[ix].index = tensor_idx;
-      return &tflTensors[ix].tensor;
+      init_tflite_tensor(inst, tensor_idx, &inst->tflTensors[ix].tensor);
+      inst->tflTensors[ix].index = tensor_idx;
+      return &inst->tflTensors[ix].tensor;
     }
   }
 
@@ -1515,20 +1682,21 @@ static TfLiteTensor* GetTensorImpl(const struct TfLiteContext* context,
 
 static TfLiteEvalTensor* GetEvalTensorImpl(const struct TfLiteContext* context,
                                        int tensor_idx) {
+  EonInstance* inst = GetInstance(context);
 
-  tensor_idx = tflTensors_subgraph_index[current_subgraph_index] + tensor_idx;
+  tensor_idx = tflTensors_subgraph_index[inst->current_subgraph_index] + tensor_idx;
 
   for (size_t ix = 0; ix < MAX_TFL_EVAL_COUNT; ix++) {
     // already used? OK!
-    if (tflEvalTensors[ix].index == tensor_idx) {
-      return &tflEvalTensors[ix].tensor;
+    if (inst->tflEvalTensors[ix].index == tensor_idx) {
+      return &inst->tflEvalTensors[ix].tensor;
     }
     // passed all the ones we've used, so end of the list?
-    if (tflEvalTensors[ix].index == TENSOR_IX_UNUSED) {
+    if (inst->tflEvalTensors[ix].index == TENSOR_IX_UNUSED) {
       // init the tensor
-      init_tflite_eval_tensor(tensor_idx, &tflEvalTensors[ix].tensor);
-      tflEvalTensors[ix].index = tensor_idx;
-      return &tflEvalTensors[ix].tensor;
+      init_tflite_eval_tensor(inst, tensor_idx, &inst->tflEvalTensors[ix].tensor);
+      inst->tflEvalTensors[ix].index = tensor_idx;
+      return &inst->tflEvalTensors[ix].tensor;
     }
   }
 
@@ -1536,195 +1704,741 @@ static TfLiteEvalTensor* GetEvalTensorImpl(const struct TfLiteContext* context,
   return nullptr;
 }
 
-class EonMicroContext : public MicroContext {
- public:
- 
-  EonMicroContext(): MicroContext(nullptr, nullptr, nullptr) { }
+void* EonMicroContext::AllocatePersistentBuffer(size_t bytes) {
+  return AllocatePersistentBufferImpl(&instance_->ctx, bytes);
+}
+
+TfLiteStatus EonMicroContext::RequestScratchBufferInArena(size_t bytes,
+                                                          int* buffer_index) {
+  return RequestScratchBufferInArenaImpl(&instance_->ctx, bytes, buffer_index);
+}
+
+void* EonMicroContext::GetScratchBuffer(int buffer_index) {
+  return GetScratchBufferImpl(&instance_->ctx, buffer_index);
+}
+
+TfLiteTensor* EonMicroContext::AllocateTempTfLiteTensor(int tensor_index) {
+  return GetTensorImpl(&instance_->ctx, tensor_index);
+}
+
+TfLiteEvalTensor* EonMicroContext::GetEvalTensor(int tensor_index) {
+  return GetEvalTensorImpl(&instance_->ctx, tensor_index);
+}
 
-  void* AllocatePersistentBuffer(size_t bytes) {
-    return AllocatePersistentBufferImpl(nullptr, bytes);
+// True if nothing but node reads tensor (and it is not a model output)
+static bool only_read_by(int tensor, size_t node) {
+  for (size_t i = 0; i < 27; ++i) {
+    for (int ix = 0; i != node && ix < tflNodes[i].inputs->size; ix++) {
+      if (tflNodes[i].inputs->data[ix] == tensor) {
+        return false;
+      }
+    }
+  }
+  for (size_t ix = 0; ix < sizeof(out_tensor_indices) / sizeof(out_tensor_indices[0]); ix++) {
+    if (out_tensor_indices[ix] == tensor) {
+      return false;
+    }
   }
+  return true;
+}
 
-  TfLiteStatus RequestScratchBufferInArena(size_t bytes,
-                                           int* buffer_index) {
-  return RequestScratchBufferInArenaImpl(nullptr, bytes, buffer_index);
+// True if PAD node i only feeds a VALID depthwise conv at i + 1 whose output
+// size and border match SAME padding on the unpadded input. Padding with the
+// zero point adds nothing to the sums, so the conv can skip the border taps
+// instead (which every depthwise kernel does for SAME padding).
+static bool can_fuse_pad(size_t i) {
+  if (used_ops[i] != OP_PAD || i + 1 >= 27 || used_ops[i + 1] != OP_DEPTHWISE_CONV_2D) {
+    return false;
+  }
+  const TfLiteNode& pad = tflNodes[i];
+  const TfLiteNode& conv = tflNodes[i + 1];
+  const int input = pad.inputs->data[0];
+  const int output = pad.outputs->data[0];
+  // without a constant_values input the pad value is the output zero point
+  if (pad.inputs->size != 2 || conv.inputs->data[0] != output || conv.inputs->size > 3) {
+    return false;
+  }
+  if (!only_read_by(output, i + 1)) {
+    return false;
   }
 
-  void* GetScratchBuffer(int buffer_index) {
-    return GetScratchBufferImpl(nullptr, buffer_index);
+  const TensorInfo_t& in = tensorData[input];
+  const TensorInfo_t& out = tensorData[output];
+  if (in.type != kTfLiteInt8 || out.type != kTfLiteInt8 || in.dims->size != 4 ||
+      in.quantization.type != kTfLiteAffineQuantization ||
+      out.quantization.type != kTfLiteAffineQuantization) {
+    return false;
   }
- 
-  TfLiteTensor* AllocateTempTfLiteTensor(int tensor_index) {
-    return GetTensorImpl(nullptr, tensor_index);
+  const TfLiteAffineQuantization* in_quant = (const TfLiteAffineQuantization*)in.quantization.params;
+  const TfLiteAffineQuantization* out_quant = (const TfLiteAffineQuantization*)out.quantization.params;
+  if (in_quant->scale->data[0] != out_quant->scale->data[0] ||
+      in_quant->zero_point->data[0] != out_quant->zero_point->data[0]) {
+    return false;
   }
 
-  void DeallocateTempTfLiteTensor(TfLiteTensor* tensor) {
-    return;
+  // paddings are [batch, height, width, channels] x [before, after]
+  const TensorInfo_t& paddings = tensorData[pad.inputs->data[1]];
+  if (paddings.allocation_type != kTfLiteMmapRo || paddings.type != kTfLiteInt32 ||
+      paddings.bytes != 4 * 2 * sizeof(int32_t)) {
+    return false;
+  }
+  const int32_t* p = (const int32_t*)paddings.data;
+  if (p[0] != 0 || p[1] != 0 || p[6] != 0 || p[7] != 0) {
+    return false;
   }
 
-  bool IsAllTempTfLiteTensorDeallocated() {
-    return true;
+  const TfLiteDepthwiseConvParams* params = (const TfLiteDepthwiseConvParams*)conv.builtin_data;
+  const TfLiteIntArray* filter_dims = tensorData[conv.inputs->data[1]].dims;
+  const TfLiteIntArray* conv_out_dims = tensorData[conv.outputs->data[0]].dims;
+  if (params->padding != kTfLitePaddingValid) {
+    return false;
+  }
+  int out_height, out_width;
+  TfLitePaddingValues same = ComputePaddingHeightWidth(
+      params->stride_height, params->stride_width, params->dilation_height_factor,
+      params->dilation_width_factor, in.dims->data[1], in.dims->data[2],
+      filter_dims->data[1], filter_dims->data[2], kTfLitePaddingSame, &out_height, &out_width);
+  return out_height == conv_out_dims->data[1] && out_width == conv_out_dims->data[2] &&
+         p[2] == same.height && p[3] == same.height + same.height_offset &&
+         p[4] == same.width && p[5] == same.width + same.width_offset;
+}
+
+// Runs PAD -> depthwise conv pairs as one SAME padded depthwise conv on the
+// unpadded tensor, so the padded copy is never written
+static TfLiteStatus fuse_pad_nodes(EonInstance* inst) {
+  const size_t max_fused = sizeof(inst->pad_conv_inputs) / sizeof(inst->pad_conv_inputs[0]);
+  size_t fused = 0;
+
+  for (size_t i = 0; i < 27 && fused < max_fused; ++i) {
+    if (!can_fuse_pad(i)) {
+      continue;
+    }
+    TfLiteNode* conv = &inst->nodes[i + 1];
+    TfArray<3, int>* inputs = &inst->pad_conv_inputs[fused];
+    TfLiteDepthwiseConvParams* params = &inst->pad_conv_params[fused];
+
+    inputs->sz = conv->inputs->size;
+    for (int ix = 0; ix < conv->inputs->size; ix++) {
+      inputs->elem[ix] = conv->inputs->data[ix];
+    }
+    inputs->elem[0] = inst->nodes[i].inputs->data[0];
+    *params = *(const TfLiteDepthwiseConvParams*)conv->builtin_data;
+    params->padding = kTfLitePaddingSame;
+
+    conv->inputs = (TfLiteIntArray*)inputs;
+    conv->builtin_data = params;
+    inst->fused_node[i] = true;
+    fused++;
   }
 
-  TfLiteEvalTensor* GetEvalTensor(int tensor_index) {
-    return GetEvalTensorImpl(nullptr, tensor_index);
+  // arena tensors of 0 bytes were planned away, so whatever writes them must have been fused
+  for (size_t i = 0; i < 27; ++i) {
+    for (int ix = 0; !inst->fused_node[i] && ix < inst->nodes[i].outputs->size; ix++) {
+      const TensorInfo_t& out = tensorData[inst->nodes[i].outputs->data[ix]];
+      if (out.allocation_type == kTfLiteArenaRw && out.bytes == 0) {
+        ei_printf("ERR: node %d writes a tensor that is not in the arena plan\n", (int)i);
+        return kTfLiteError;
+      }
+    }
   }
+  return kTfLiteOk;
+}
 
+#if EI_CLASSIFIER_TFLITE_FUSE_RESIDUAL_ADD == 1
+// Node that writes tensor, -1 for the model input and constants
+static int producer_of(int tensor) {
+  for (size_t i = 0; i < 27; ++i) {
+    for (int ix = 0; ix < tflNodes[i].outputs->size; ix++) {
+      if (tflNodes[i].outputs->data[ix] == tensor) {
+        return (int)i;
+      }
+    }
+  }
+  return -1;
+}
+
+// Runs every ADD of a conv output (read by nothing else) and an earlier tensor
+// in the output stage of that conv, if its kernel can (ConvPrepareResidualAdd).
+// The arena plan keeps the ADD output clear of what the conv reads, so it
+// holds whether or not a pair gets fused.
+static void fuse_add_nodes(EonInstance* inst) {
+  const size_t max_fused = sizeof(inst->add_conv_inputs) / sizeof(inst->add_conv_inputs[0]);
+  size_t fused = 0;
+
+  for (size_t i = 0; i < 27 && fused < max_fused; ++i) {
+    const TfLiteNode& add = inst->nodes[i];
+    if (used_ops[i] != OP_ADD || add.inputs->size != 2) {
+      continue;
+    }
+    for (int conv_input = 0; conv_input < 2; conv_input++) {
+      const int conv_output = add.inputs->data[conv_input];
+      const int residual = add.inputs->data[1 - conv_input];
+      const int conv_ix = producer_of(conv_output);
+      if (conv_ix < 0 || used_ops[conv_ix] != OP_CONV_2D || producer_of(residual) >= conv_ix ||
+          !only_read_by(conv_output, i)) {
+        continue;
+      }
+      TfLiteNode* conv = &inst->nodes[conv_ix];
+      if (conv->inputs->size > 3 || conv->outputs->size != 1) {
+        continue;
+      }
+      ResetTensors(inst);
+      if (ConvPrepareResidualAdd(&inst->ctx, conv, &add, conv_input) != kTfLiteOk) {
+        continue;
+      }
+
+      TfArray<4, int>* inputs = &inst->add_conv_inputs[fused];
+      TfArray<1, int>* outputs = &inst->add_conv_outputs[fused];
+      inputs->sz = 4;
+      for (int ix = 0; ix < 3; ix++) {
+        inputs->elem[ix] = ix < conv->inputs->size ? conv->inputs->data[ix] : -1;
+      }
+      inputs->elem[3] = residual;
+      outputs->sz = 1;
+      outputs->elem[0] = add.outputs->data[0];
+      conv->inputs = (TfLiteIntArray*)inputs;
+      conv->outputs = (TfLiteIntArray*)outputs;
+      inst->fused_node[i] = true;
+      fused++;
+      break;
+    }
+  }
+}
+#endif // EI_CLASSIFIER_TFLITE_FUSE_RESIDUAL_ADD
+
+#if EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT == 1
+// Folds the -128 zero point of the input into node 0, its only reader, which
+// then reads the input as uint8 pixels (node 0 runs Conv3x3Eval, see
+// invoke_kernel). The input is handed out as uint8 with zero point 0 from
+// then on, so images are copied in as they are.
+static TfLiteStatus fold_input_zero_point(EonInstance* inst) {
+  const int input = in_tensor_indices[0];
+  if (used_ops[0] != OP_CONV_2D || inst->nodes[0].inputs->data[0] != input || !only_read_by(input, 0)) {
+    ei_printf("ERR: the model input cannot take uint8 pixels\n");
+    return kTfLiteError;
+  }
+  ResetTensors(inst);
+  TfLiteStatus status = ConvPrepareUint8Input(&inst->ctx, &inst->nodes[0]);
+  if (status != kTfLiteOk) {
+    ei_printf("ERR: the model input cannot take uint8 pixels\n");
+    return status;
+  }
+  inst->uint8_input = true;
+  return kTfLiteOk;
+}
+#endif // EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT
+
+#if EI_CLASSIFIER_TFLITE_EON_PROFILE
+static const char* const op_names[OP_LAST] = {
+  "CONV_2D", "DEPTHWISE_CONV_2D", "PAD", "ADD", "SOFTMAX",
 };
 
+static size_t tensor_elements(size_t i) {
+  size_t elements = 1;
+  for (int d = 0; d < tensorData[i].dims->size; d++) {
+    elements *= tensorData[i].dims->data[d];
+  }
+  return elements;
+}
 
-} // namespace
+// Describes every node for the profiler: operator, MACs, bytes moved and arena usage
+static void init_layer_info(EonInstance* inst) {
+  for (size_t i = 0; i < 27; ++i) {
+    ei_layer_info_t* layer = &inst->layers[i];
+    const TfLiteIntArray* inputs = inst->nodes[i].inputs;
+    const TfLiteIntArray* outputs = inst->nodes[i].outputs;
+
+    memset(layer, 0, sizeof(ei_layer_info_t));
+    layer->node = (uint16_t)i;
+    layer->op_name = op_names[used_ops[i]];
+
+    for (int ix = 0; ix < inputs->size + outputs->size; ix++) {
+      bool is_output = ix >= inputs->size;
+      int t = is_output ? outputs->data[ix - inputs->size] : inputs->data[ix];
+      if (t < 0) {
+        continue;
+      }
+      TfLiteAllocationType allocation_type;
+      uint8_t* data = (uint8_t*)tensor_data_ptr(inst, t, &allocation_type);
+      uint32_t bytes = (uint32_t)tensorData[t].bytes;
+      if (allocation_type != kTfLiteArenaRw) {
+        layer->weight_bytes += bytes;
+        continue;
+      }
+      if (is_output) {
+        layer->output_bytes += bytes;
+      }
+      else {
+        layer->input_bytes += bytes;
+      }
+      uint32_t end = (uint32_t)(data + bytes - inst->tensor_arena);
+      if (end > layer->arena_offset) {
+        layer->arena_offset = end;
+      }
+    }
 
-TfLiteStatus tflite_learn_4_init( void*(*alloc_fnc)(size_t,size_t) ) {
+    size_t output_elements = tensor_elements(outputs->data[0]);
+    const TfLiteIntArray* filter_dims = inputs->size > 1 ? tensorData[inputs->data[1]].dims : nullptr;
+    switch (used_ops[i]) {
+      case OP_CONV_2D:
+        // filter is [out channels, height, width, in channels]
+        layer->macs = (uint64_t)output_elements * filter_dims->data[1] * filter_dims->data[2] * filter_dims->data[3];
+        break;
+      case OP_DEPTHWISE_CONV_2D:
+        // filter is [1, height, width, channels]
+        layer->macs = (uint64_t)output_elements * filter_dims->data[1] * filter_dims->data[2];
+        break;
+      case OP_ADD:
+      case OP_SOFTMAX:
+        layer->macs = output_elements;
+        break;
+      default:
+        break;
+    }
+  }
+}
+#endif // EI_CLASSIFIER_TFLITE_EON_PROFILE
+
+// The final SOFTMAX can be left to the FOMO decoder when it maps int8 logits to
+// the int8 model output
+static void init_softmax_logits(EonInstance* inst) {
+  const size_t last = tflNodes_subgraph_index[1] - 1;
+  const TfLiteNode& node = inst->nodes[last];
+  inst->has_softmax_logits = false;
+  inst->skip_softmax = false;
+  if (used_ops[last] != OP_SOFTMAX || node.outputs->data[0] != out_tensor_indices[0]) {
+    return;
+  }
+  TfLiteTensor input;
+  TfLiteTensor output;
+  init_tflite_tensor(inst, node.inputs->data[0], &input);
+  init_tflite_tensor(inst, node.outputs->data[0], &output);
+  if (input.type != kTfLiteInt8 || output.type != kTfLiteInt8) {
+    return;
+  }
+  inst->has_softmax_logits = CalculateSoftmaxParams(&inst->ctx, &input, &output,
+      static_cast<const TfLiteSoftmaxParams*>(node.builtin_data), &inst->softmax_params) == kTfLiteOk;
+}
+
+#if EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+// Input of depth-first node c, or the output of the last one for c == depth_first_count
+static int depth_first_tensor(const EonInstance* inst, size_t c) {
+  if (c == inst->depth_first_count) {
+    return inst->nodes[inst->depth_first_nodes[c - 1].node].outputs->data[0];
+  }
+  return inst->nodes[inst->depth_first_nodes[c].node].inputs->data[0];
+}
+
+static size_t row_bytes(int tensor) {
+  const TfLiteIntArray* dims = tensorData[tensor].dims;
+  return (size_t)dims->data[2] * dims->data[3];
+}
+
+// Rows [first[c], end[c]) of depth_first_tensor(c) needed for the band of the
+// last output that starts at row
+static void band_rows(const EonInstance* inst, int row, int* first, int* end) {
+  const size_t count = inst->depth_first_count;
+  first[count] = row;
+  end[count] = std::min(row + kDepthFirstBandRows, tensorData[depth_first_tensor(inst, count)].dims->data[1]);
+  for (size_t c = count; c-- > 0;) {
+    const depth_first_node_t& n = inst->depth_first_nodes[c];
+    first[c] = std::max(0, first[c + 1] * n.stride - n.padding);
+    end[c] = std::min(n.input_rows, (end[c + 1] - 1) * n.stride - n.padding + n.filter_height);
+  }
+}
+
+// Points window at rows [first, end) of depth_first_tensor(c). The input and
+// output of the stage are planned whole, the tensors in between only hold a band.
+static void set_window(EonInstance* inst, tensor_window_t* window, size_t c, int first, int end) {
+  const int tensor = depth_first_tensor(inst, c);
+  TfLiteAllocationType allocation_type;
+  uint8_t* data = (uint8_t*)tensor_data_ptr(inst, tensor, &allocation_type);
+  const bool whole = c == 0 || c == inst->depth_first_count;
+
+  window->tensor = tensor;
+  window->data = whole ? data + first * row_bytes(tensor) : data;
+  window->dims.sz = 4;
+  for (int d = 0; d < 4; d++) {
+    window->dims.elem[d] = tensorData[tensor].dims->data[d];
+  }
+  window->dims.elem[1] = end - first;
+}
+
+// True if no node that still runs, except node, reads tensor (and it is not a model output)
+static bool only_run_by(const EonInstance* inst, int tensor, size_t node) {
+  for (size_t i = 0; i < 27; ++i) {
+    for (int ix = 0; i != node && !inst->fused_node[i] && ix < inst->nodes[i].inputs->size; ix++) {
+      if (inst->nodes[i].inputs->data[ix] == tensor) {
+        return false;
+      }
+    }
+  }
+  for (size_t ix = 0; ix < sizeof(out_tensor_indices) / sizeof(out_tensor_indices[0]); ix++) {
+    if (out_tensor_indices[ix] == tensor) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Nodes up to kDepthFirstLastNode must be a chain of int8 convs and depthwise
+// convs, each read only by the next, with every band fitting the arena plan
+static TfLiteStatus init_depth_first(EonInstance* inst) {
+  inst->depth_first_count = 0;
+  inst->window_count = 0;
+
+  for (size_t i = 0; i <= kDepthFirstLastNode; ++i) {
+    if (inst->fused_node[i]) {
+      continue;
+    }
+    const TfLiteNode& node = inst->nodes[i];
+    int stride_height, stride_width, dilation_height, dilation_width;
+    TfLitePadding padding;
+    if (used_ops[i] == OP_CONV_2D) {
+      const TfLiteConvParams* params = (const TfLiteConvParams*)node.builtin_data;
+      stride_height = params->stride_height;
+      stride_width = params->stride_width;
+      dilation_height = params->dilation_height_factor;
+      dilation_width = params->dilation_width_factor;
+      padding = params->padding;
+    }
+    else if (used_ops[i] == OP_DEPTHWISE_CONV_2D) {
+      const TfLiteDepthwiseConvParams* params = (const TfLiteDepthwiseConvParams*)node.builtin_data;
+      stride_height = params->stride_height;
+      stride_width = params->stride_width;
+      dilation_height = params->dilation_height_factor;
+      dilation_width = params->dilation_width_factor;
+      padding = params->padding;
+    }
+    else {
+      ei_printf("ERR: node %d cannot run band by band\n", (int)i);
+      return kTfLiteError;
+    }
+
+    const int input = node.inputs->data[0];
+    const TfLiteIntArray* in_dims = tensorData[input].dims;
+    const TfLiteIntArray* filter_dims = tensorData[node.inputs->data[1]].dims;
+    const bool chained = inst->depth_first_count == 0 ||
+        (depth_first_tensor(inst, inst->depth_first_count) == input && only_run_by(inst, input, i));
+    if (!chained || node.inputs->size > 3 || node.outputs->size != 1 ||
+        tensorData[input].type != kTfLiteInt8 || in_dims->size != 4 || in_dims->data[0] != 1) {
+      ei_printf("ERR: node %d cannot run band by band\n", (int)i);
+      return kTfLiteError;
+    }
+
+    int out_height, out_width;
+    TfLitePaddingValues values = ComputePaddingHeightWidth(
+        stride_height, stride_width, dilation_height, dilation_width, in_dims->data[1], in_dims->data[2],
+        filter_dims->data[1], filter_dims->data[2], padding, &out_height, &out_width);
+
+    depth_first_node_t* n = &inst->depth_first_nodes[inst->depth_first_count++];
+    n->node = i;
+    n->stride = stride_height;
+    n->filter_height = (filter_dims->data[1] - 1) * dilation_height + 1;
+    n->padding = values.height;
+    n->input_rows = in_dims->data[1];
+  }
+
+  if (inst->depth_first_count == 0) {
+    return kTfLiteOk;
+  }
+  int first[kDepthFirstLastNode + 2];
+  int end[kDepthFirstLastNode + 2];
+  const int rows = tensorData[depth_first_tensor(inst, inst->depth_first_count)].dims->data[1];
+  for (int row = 0; row < rows; row += kDepthFirstBandRows) {
+    band_rows(inst, row, first, end);
+    for (size_t c = 1; c < inst->depth_first_count; c++) {
+      const int tensor = depth_first_tensor(inst, c);
+      if ((end[c] - first[c]) * row_bytes(tensor) > tensorData[tensor].bytes) {
+        ei_printf("ERR: band of tensor %d does not fit in the arena plan\n", tensor);
+        return kTfLiteError;
+      }
+    }
+  }
+  return kTfLiteOk;
+}
+#endif // EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST
+
+static TfLiteStatus init_instance(EonInstance* inst, void*(*alloc_fnc)(size_t,size_t)) {
 #ifdef EI_CLASSIFIER_ALLOCATION_HEAP
-  tensor_arena = (uint8_t*) alloc_fnc(16, kTensorArenaSize);
-  if (!tensor_arena) {
+  inst->tensor_arena = (uint8_t*) alloc_fnc(16, kTensorArenaSize);
+  inst->owns_arena = true;
+#else
+  // the static arena belongs to the default instance, others get one from the heap
+  if (inst == &default_instance) {
+    inst->tensor_arena = tensor_arena;
+    inst->owns_arena = false;
+    memset(inst->tensor_arena, 0, kTensorArenaSize);
+  }
+  else {
+    inst->tensor_arena = (uint8_t*) alloc_fnc(16, kTensorArenaSize);
+    inst->owns_arena = true;
+  }
+#endif
+  if (!inst->tensor_arena) {
     ei_printf("ERR: failed to allocate tensor arena\n");
     return kTfLiteError;
   }
-#else
-  memset(tensor_arena, 0, kTensorArenaSize);
-#endif
-  tensor_boundary = tensor_arena;
-  current_location = tensor_arena + kTensorArenaSize;
+  inst->tensor_boundary = inst->tensor_arena;
+  inst->current_location = inst->tensor_arena + kTensorArenaSize;
+  inst->overflow_buffers_ix = 0;
+  inst->scratch_buffers_ix = 0;
 
-  EonMicroContext micro_context_;
-  
   // Set microcontext as the context ptr
-  ctx.impl_ = static_cast<void*>(&micro_context_);
+  inst->ctx.impl_ = static_cast<void*>(&inst->micro_context);
   // Setup tflitecontext functions
-  ctx.AllocatePersistentBuffer = &AllocatePersistentBufferImpl;
-  ctx.RequestScratchBufferInArena = &RequestScratchBufferInArenaImpl;
-  ctx.GetScratchBuffer = &GetScratchBufferImpl;
-  ctx.GetTensor = &GetTensorImpl;
-  ctx.GetEvalTensor = &GetEvalTensorImpl;
-  ctx.ReportError = &MicroContextReportOpError;
-
-  ctx.tensors_size = 71;
+  inst->ctx.AllocatePersistentBuffer = &AllocatePersistentBufferImpl;
+  inst->ctx.RequestScratchBufferInArena = &RequestScratchBufferInArenaImpl;
+  inst->ctx.GetScratchBuffer = &GetScratchBufferImpl;
+  inst->ctx.GetTensor = &GetTensorImpl;
+  inst->ctx.GetEvalTensor = &GetEvalTensorImpl;
+  inst->ctx.ReportError = &MicroContextReportOpError;
+
+  inst->ctx.tensors_size = 71;
   for (size_t i = 0; i < 71; ++i) {
     TfLiteTensor tensor;
-    init_tflite_tensor(i, &tensor);
+    init_tflite_tensor(inst, i, &tensor);
     if (tensor.allocation_type == kTfLiteArenaRw) {
       auto data_end_ptr = (uint8_t*)tensor.data.data + tensorData[i].bytes;
-      if (data_end_ptr > tensor_boundary) {
-        tensor_boundary = data_end_ptr;
+      if (data_end_ptr > inst->tensor_boundary) {
+        inst->tensor_boundary = data_end_ptr;
       }
     }
   }
 
-  if (tensor_boundary > current_location /* end of arena size */) {
+  if (inst->tensor_boundary > inst->current_location /* end of arena size */) {
     ei_printf("ERR: tensor arena is too small, does not fit model - even without scratch buffers\n");
     return kTfLiteError;
   }
 
-  registrations[OP_CONV_2D] = Register_CONV_2D();
-  registrations[OP_DEPTHWISE_CONV_2D] = Register_DEPTHWISE_CONV_2D();
-  registrations[OP_PAD] = Register_PAD();
-  registrations[OP_ADD] = Register_ADD();
-  registrations[OP_SOFTMAX] = Register_SOFTMAX();
+  inst->registrations[OP_CONV_2D] = Register_CONV_2D();
+  inst->registrations[OP_DEPTHWISE_CONV_2D] = Register_DEPTHWISE_CONV_2D();
+  inst->registrations[OP_PAD] = Register_PAD();
+  inst->registrations[OP_ADD] = Register_ADD();
+  inst->registrations[OP_SOFTMAX] = Register_SOFTMAX();
+
+  memcpy(inst->nodes, tflNodes, sizeof(tflNodes));
+  memset(inst->fused_node, 0, sizeof(inst->fused_node));
+#if EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT == 1
+  inst->uint8_input = false;
+#endif // EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT
+
+  TfLiteStatus fuse_status = fuse_pad_nodes(inst);
+  if (fuse_status != kTfLiteOk) {
+    return fuse_status;
+  }
 
   for (size_t g = 0; g < 1; ++g) {
-    current_subgraph_index = g;
+    inst->current_subgraph_index = g;
     for(size_t i = tflNodes_subgraph_index[g]; i < tflNodes_subgraph_index[g+1]; ++i) {
-      if (registrations[used_ops[i]].init) {
-        tflNodes[i].user_data = registrations[used_ops[i]].init(&ctx, (const char*)tflNodes[i].builtin_data, 0);
+      if (inst->fused_node[i]) {
+        continue;
+      }
+      if (inst->registrations[used_ops[i]].init) {
+        inst->nodes[i].user_data = inst->registrations[used_ops[i]].init(&inst->ctx, (const char*)inst->nodes[i].builtin_data, 0);
       }
     }
   }
-  current_subgraph_index = 0;
+  inst->current_subgraph_index = 0;
 
   for(size_t g = 0; g < 1; ++g) {
-    current_subgraph_index = g;
+    inst->current_subgraph_index = g;
     for(size_t i = tflNodes_subgraph_index[g]; i < tflNodes_subgraph_index[g+1]; ++i) {
-      if (registrations[used_ops[i]].prepare) {
-        ResetTensors();
-        TfLiteStatus status = registrations[used_ops[i]].prepare(&ctx, &tflNodes[i]);
+      if (inst->fused_node[i]) {
+        continue;
+      }
+      if (inst->registrations[used_ops[i]].prepare) {
+        ResetTensors(inst);
+        TfLiteStatus status = inst->registrations[used_ops[i]].prepare(&inst->ctx, &inst->nodes[i]);
         if (status != kTfLiteOk) {
           return status;
         }
       }
     }
   }
-  current_subgraph_index = 0;
+  inst->current_subgraph_index = 0;
 
-  return kTfLiteOk;
-}
-
-TfLiteStatus tflite_learn_4_input(int index, TfLiteTensor *tensor) {
-  init_tflite_tensor(in_tensor_indices[index], tensor);
-  return kTfLiteOk;
-}
+#if EI_CLASSIFIER_TFLITE_FUSE_RESIDUAL_ADD == 1
+  fuse_add_nodes(inst);
+#endif // EI_CLASSIFIER_TFLITE_FUSE_RESIDUAL_ADD
 
-TfLiteStatus tflite_learn_4_output(int index, TfLiteTensor *tensor) {
-  init_tflite_tensor(out_tensor_indices[index], tensor);
-  return kTfLiteOk;
-}
+  init_softmax_logits(inst);
 
-TfLiteStatus tflite_learn_4_invoke() {
-  for (size_t i = 0; i < 27; ++i) {
-    ResetTensors();
+#if EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT == 1
+  TfLiteStatus uint8_input_status = fold_input_zero_point(inst);
+  if (uint8_input_status != kTfLiteOk) {
+    return uint8_input_status;
+  }
+#endif // EI_CLASSIFIER_TFLITE_EON_UINT8_INPUT
 
-    TfLiteStatus status = registrations[used_ops[i]].invoke(&ctx, &tflNodes[i]);
+#if EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+  TfLiteStatus depth_first_status = init_depth_first(inst);
+  if (depth_first_status != kTfLiteOk) {
+    return depth_first_status;
+  }
+#endif // EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST
 
-#if EI_CLASSIFIER_PRINT_STATE
-    ei_printf("layer %lu\n", i);
-    ei_printf("    inputs:\n");
-    for (size_t ix = 0; ix < tflNodes[i].inputs->size; ix++) {
-      auto d = tensorData[tflNodes[i].inputs->data[ix]];
+#if EI_CLASSIFIER_TFLITE_EON_PROFILE
+  init_layer_info(inst);
+#endif // EI_CLASSIFIER_TFLITE_EON_PROFILE
 
-      size_t data_ptr = (size_t)d.data;
+  return kTfLiteOk;
+}
 
-      if (d.allocation_type == kTfLiteArenaRw) {
-        data_ptr = (size_t)tensor_arena + data_ptr;
+#if EI_CLASSIFIER_PRINT_STATE
+static void print_tensors(EonInstance* inst, const TfLiteIntArray* indices) {
+  for (size_t ix = 0; ix < indices->size; ix++) {
+    auto d = tensorData[indices->data[ix]];
+    TfLiteAllocationType allocation_type;
+    void* data_ptr = tensor_data_ptr(inst, indices->data[ix], &allocation_type);
+
+    if (d.type == TfLiteType::kTfLiteInt8) {
+      int8_t* data = (int8_t*)data_ptr;
+      ei_printf("        %lu (%zu bytes, ptr=%p, alloc_type=%d, type=%d): ", ix, d.bytes, data, (int)allocation_type, (int)d.type);
+      for (size_t jx = 0; jx < d.bytes; jx++) {
+        ei_printf("%d ", data[jx]);
       }
-
-      if (d.type == TfLiteType::kTfLiteInt8) {
-        int8_t* data = (int8_t*)data_ptr;
-        ei_printf("        %lu (%zu bytes, ptr=%p, alloc_type=%d, type=%d): ", ix, d.bytes, data, (int)d.allocation_type, (int)d.type);
-        for (size_t jx = 0; jx < d.bytes; jx++) {
-          ei_printf("%d ", data[jx]);
-        }
+    }
+    else if (d.type == TfLiteType::kTfLiteUInt8) {
+      uint8_t* data = (uint8_t*)data_ptr;
+      ei_printf("        %lu (%zu bytes, ptr=%p, alloc_type=%d, type=%d): ", ix, d.bytes, data, (int)allocation_type, (int)d.type);
+      for (size_t jx = 0; jx < d.bytes; jx++) {
+        ei_printf("%u ", data[jx]);
       }
-      else {
-        float* data = (float*)data_ptr;
-        ei_printf("        %lu (%zu bytes, ptr=%p, alloc_type=%d, type=%d): ", ix, d.bytes, data, (int)d.allocation_type, (int)d.type);
-        for (size_t jx = 0; jx < d.bytes / 4; jx++) {
-          ei_printf("%f ", data[jx]);
-        }
+    }
+    else {
+      float* data = (float*)data_ptr;
+      ei_printf("        %lu (%zu bytes, ptr=%p, alloc_type=%d, type=%d): ", ix, d.bytes, data, (int)allocation_type, (int)d.type);
+      for (size_t jx = 0; jx < d.bytes / 4; jx++) {
+        ei_printf("%f ", data[jx]);
       }
-      ei_printf("\n");
     }
     ei_printf("\n");
+  }
+  ei_printf("\n");
+}
+#endif // EI_CLASSIFIER_PRINT_STATE
 
-    ei_printf("    outputs:\n");
-    for (size_t ix = 0; ix < tflNodes[i].outputs->size; ix++) {
-      auto d = tensorData[tflNodes[i].outputs->data[ix]];
+#if EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS == 1
+// Runs the kernel of node i: the conv and depthwise conv nodes call their Eval
+// directly, the 3x3 ones instantiated for the stride and depths of the layer
+static TfLiteStatus invoke_kernel(EonInstance* inst, size_t i) {
+  TfLiteContext* ctx = &inst->ctx;
+  TfLiteNode* node = &inst->nodes[i];
+  switch (i) {
+    case 0: return tflite::Conv3x3Eval<2, 3, 16>(ctx, node);
+    case 1: return tflite::DepthwiseConv3x3Eval<1, 16>(ctx, node);
+    case 5: return tflite::DepthwiseConv3x3Eval<2, 48>(ctx, node);
+    case 8: return tflite::DepthwiseConv3x3Eval<1, 48>(ctx, node);
+    case 13: return tflite::DepthwiseConv3x3Eval<2, 48>(ctx, node);
+    case 16: return tflite::DepthwiseConv3x3Eval<1, 96>(ctx, node);
+    case 20: return tflite::DepthwiseConv3x3Eval<1, 96>(ctx, node);
+    case 2: case 3: case 6: case 7: case 9: case 11: case 14: case 15:
+    case 17: case 19: case 21: case 23: case 24: case 25:
+      return tflite::ConvEval(ctx, node);
+    default: return inst->registrations[used_ops[i]].invoke(ctx, node);
+  }
+}
+#endif // EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS
 
-      size_t data_ptr = (size_t)d.data;
+static TfLiteStatus invoke_node(EonInstance* inst, size_t i) {
+  ResetTensors(inst);
 
-      if (d.allocation_type == kTfLiteArenaRw) {
-        data_ptr = (size_t)tensor_arena + data_ptr;
-      }
+#if EI_CLASSIFIER_TFLITE_EON_PROFILE
+  const ei_layer_info_t* layer = &inst->layers[i];
+#if EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+  if (inst->window_count > 0) {
+    layer = &inst->band_layer;
+  }
+#endif // EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST
+  uint32_t event = inst->profiler ? inst->profiler->BeginLayer(layer) : 0;
+#endif // EI_CLASSIFIER_TFLITE_EON_PROFILE
 
-      if (d.type == TfLiteType::kTfLiteInt8) {
-        int8_t* data = (int8_t*)data_ptr;
-        ei_printf("        %lu (%zu bytes, ptr=%p, alloc_type=%d, type=%d): ", ix, d.bytes, data, (int)d.allocation_type, (int)d.type);
-        for (size_t jx = 0; jx < d.bytes; jx++) {
-          ei_printf("%d ", data[jx]);
-        }
+#if EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS == 1
+  TfLiteStatus status = invoke_kernel(inst, i);
+#else
+  TfLiteStatus status = inst->registrations[used_ops[i]].invoke(&inst->ctx, &inst->nodes[i]);
+#endif // EI_CLASSIFIER_TFLITE_EON_SPECIALIZED_KERNELS
+
+#if EI_CLASSIFIER_TFLITE_EON_PROFILE
+  if (inst->profiler) {
+    inst->profiler->EndEvent(event);
+  }
+#endif // EI_CLASSIFIER_TFLITE_EON_PROFILE
+
+#if EI_CLASSIFIER_PRINT_STATE
+  ei_printf("layer %lu\n", i);
+  ei_printf("    inputs:\n");
+  print_tensors(inst, inst->nodes[i].inputs);
+
+  ei_printf("    outputs:\n");
+  print_tensors(inst, inst->nodes[i].outputs);
+#endif // EI_CLASSIFIER_PRINT_STATE
+
+  return status;
+}
+
+#if EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+// Runs the depth-first nodes band by band of the last output. For each band a
+// node only computes the rows the next node reads (neighbouring bands overlap
+// by the filter halo, those rows are computed twice), on windows of its input
+// and output that start at the band and with its top padding cut to match.
+// Every output row is computed from the same input rows as when the nodes run
+// whole, so the output is identical.
+static TfLiteStatus invoke_depth_first(EonInstance* inst) {
+  const size_t count = inst->depth_first_count;
+  const int rows = count ? tensorData[depth_first_tensor(inst, count)].dims->data[1] : 0;
+  int first[kDepthFirstLastNode + 2];
+  int end[kDepthFirstLastNode + 2];
+  TfLiteStatus status = kTfLiteOk;
+
+  for (int row = 0; row < rows && status == kTfLiteOk; row += kDepthFirstBandRows) {
+    band_rows(inst, row, first, end);
+    for (size_t c = 0; c < count && status == kTfLiteOk; c++) {
+      const depth_first_node_t& n = inst->depth_first_nodes[c];
+      TfLiteNode* node = &inst->nodes[n.node];
+      const int padding = first[c] - (first[c + 1] * n.stride - n.padding);
+      if (used_ops[n.node] == OP_CONV_2D) {
+        ConvSetPaddingHeight(node, padding);
       }
       else {
-        float* data = (float*)data_ptr;
-        ei_printf("        %lu (%zu bytes, ptr=%p, alloc_type=%d, type=%d): ", ix, d.bytes, data, (int)d.allocation_type, (int)d.type);
-        for (size_t jx = 0; jx < d.bytes / 4; jx++) {
-          ei_printf("%f ", data[jx]);
-        }
+        DepthwiseConvSetPaddingHeight(node, padding);
       }
-      ei_printf("\n");
+      set_window(inst, &inst->windows[0], c, first[c], end[c]);
+      set_window(inst, &inst->windows[1], c + 1, first[c + 1], end[c + 1]);
+      inst->window_count = 2;
+
+#if EI_CLASSIFIER_TFLITE_EON_PROFILE
+      const int output_rows = tensorData[depth_first_tensor(inst, c + 1)].dims->data[1];
+      inst->band_layer = inst->layers[n.node];
+      inst->band_layer.macs = inst->band_layer.macs * (end[c + 1] - first[c + 1]) / output_rows;
+      inst->band_layer.input_bytes = (uint32_t)((end[c] - first[c]) * row_bytes(depth_first_tensor(inst, c)));
+      inst->band_layer.output_bytes = (uint32_t)((end[c + 1] - first[c + 1]) * row_bytes(depth_first_tensor(inst, c + 1)));
+#endif // EI_CLASSIFIER_TFLITE_EON_PROFILE
+
+      status = invoke_node(inst, n.node);
     }
-    ei_printf("\n");
-#endif // EI_CLASSIFIER_PRINT_STATE
-
+  }
+  inst->window_count = 0;
+  return status;
+}
+#endif // EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST
+
+static TfLiteStatus invoke_instance(EonInstance* inst) {
+  const size_t node_count = inst->skip_softmax ? 26 : 27;
+  size_t i = 0;
+#if EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST == 1
+  TfLiteStatus depth_first_status = invoke_depth_first(inst);
+  if (depth_first_status != kTfLiteOk) {
+    return depth_first_status;
+  }
+  i = kDepthFirstLastNode + 1;
+#endif // EI_CLASSIFIER_TFLITE_EON_DEPTH_FIRST
+  for (; i < node_count; ++i) {
+    if (inst->fused_node[i]) {
+      continue;
+    }
+    TfLiteStatus status = invoke_node(inst, i);
     if (status != kTfLiteOk) {
       return status;
     }
@@ -1732,18 +2446,133 @@ TfLiteStatus tflite_learn_4_invoke() {
   return kTfLiteOk;
 }
 
-TfLiteStatus tflite_learn_4_reset( void (*free_fnc)(void* ptr) ) {
-#ifdef EI_CLASSIFIER_ALLOCATION_HEAP
-  free_fnc(tensor_arena);
-#endif
+static TfLiteStatus softmax_logits(EonInstance* inst, bool enable, TfLiteTensor* logits, SoftmaxParams* params) {
+  if (!enable) {
+    inst->skip_softmax = false;
+    return kTfLiteOk;
+  }
+  if (!inst->has_softmax_logits) {
+    return kTfLiteError;
+  }
+  inst->skip_softmax = true;
+  if (logits) {
+    init_tflite_tensor(inst, inst->nodes[tflNodes_subgraph_index[1] - 1].inputs->data[0], logits);
+  }
+  if (params) {
+    *params = inst->softmax_params;
+  }
+  return kTfLiteOk;
+}
+
+static TfLiteStatus set_profiler(EonInstance* inst, ei::LayerProfiler* profiler) {
+#if EI_CLASSIFIER_TFLITE_EON_PROFILE
+  inst->profiler = profiler;
+  return kTfLiteOk;
+#else
+  ei_printf("ERR: profiling is disabled, build with EI_CLASSIFIER_TFLITE_EON_PROFILE=1\n");
+  return kTfLiteError;
+#endif // EI_CLASSIFIER_TFLITE_EON_PROFILE
+}
+
+static TfLiteStatus reset_instance(EonInstance* inst, void (*free_fnc)(void* ptr)) {
+  if (inst->owns_arena) {
+    free_fnc(inst->tensor_arena);
+  }
+  inst->tensor_arena = nullptr;
+  inst->owns_arena = false;
 
   // scratch buffers are allocated within the arena, so just reset the counter so memory can be reused
-  scratch_buffers_ix = 0;
+  inst->scratch_buffers_ix = 0;
 
   // overflow buffers are on the heap, so free them first
-  for (size_t ix = 0; ix < overflow_buffers_ix; ix++) {
-    ei_free(overflow_buffers[ix]);
+  for (size_t ix = 0; ix < inst->overflow_buffers_ix; ix++) {
+    ei_free(inst->overflow_buffers[ix]);
   }
-  overflow_buffers_ix = 0;
+  inst->overflow_buffers_ix = 0;
+  return kTfLiteOk;
+}
+
+} // namespace
+
+TfLiteStatus tflite_learn_4_init( void*(*alloc_fnc)(size_t,size_t) ) {
+  return init_instance(&default_instance, alloc_fnc);
+}
+
+TfLiteStatus tflite_learn_4_input(int index, TfLiteTensor *tensor) {
+  init_tflite_tensor(&default_instance, in_tensor_indices[index], tensor);
+  return kTfLiteOk;
+}
+
+TfLiteStatus tflite_learn_4_output(int index, TfLiteTensor *tensor) {
+  init_tflite_tensor(&default_instance, out_tensor_indices[index], tensor);
+  return kTfLiteOk;
+}
+
+TfLiteStatus tflite_learn_4_invoke() {
+  return invoke_instance(&default_instance);
+}
+
+TfLiteStatus tflite_learn_4_softmax_logits(bool enable, TfLiteTensor *logits, tflite::SoftmaxParams *params) {
+  return softmax_logits(&default_instance, enable, logits, params);
+}
+
+TfLiteStatus tflite_learn_4_set_profiler(ei::LayerProfiler* profiler) {
+  return set_profiler(&default_instance, profiler);
+}
+
+TfLiteStatus tflite_learn_4_reset( void (*free_fnc)(void* ptr) ) {
+  return reset_instance(&default_instance, free_fnc);
+}
+
+TfLiteStatus tflite_learn_4_instance_create( void **instance, void*(*alloc_fnc)(size_t,size_t), void (*free_fnc)(void* ptr) ) {
+  *instance = nullptr;
+  void *mem = alloc_fnc(16, sizeof(EonInstance));
+  if (!mem) {
+    ei_printf("ERR: failed to allocate model instance\n");
+    return kTfLiteError;
+  }
+  EonInstance *inst = new (mem) EonInstance();
+
+  TfLiteStatus status = init_instance(inst, alloc_fnc);
+  if (status != kTfLiteOk) {
+    // nothing of a failed instance is left to the caller
+    tflite_learn_4_instance_destroy(inst, free_fnc);
+    return status;
+  }
+  *instance = inst;
+  return kTfLiteOk;
+}
+
+TfLiteStatus tflite_learn_4_instance_input(void *instance, int index, TfLiteTensor *tensor) {
+  init_tflite_tensor(static_cast<EonInstance*>(instance), in_tensor_indices[index], tensor);
+  return kTfLiteOk;
+}
+
+TfLiteStatus tflite_learn_4_instance_output(void *instance, int index, TfLiteTensor *tensor) {
+  init_tflite_tensor(static_cast<EonInstance*>(instance), out_tensor_indices[index], tensor);
+  return kTfLiteOk;
+}
+
+TfLiteStatus tflite_learn_4_instance_invoke(void *instance) {
+  return invoke_instance(static_cast<EonInstance*>(instance));
+}
+
+TfLiteStatus tflite_learn_4_instance_softmax_logits(void *instance, bool enable, TfLiteTensor *logits, tflite::SoftmaxParams *params) {
+  return softmax_logits(static_cast<EonInstance*>(instance), enable, logits, params);
+}
+
+TfLiteStatus tflite_learn_4_instance_set_profiler(void *instance, ei::LayerProfiler* profiler) {
+  return set_profiler(static_cast<EonInstance*>(instance), profiler);
+}
+
+TfLiteStatus tflite_learn_4_instance_destroy( void *instance, void (*free_fnc)(void* ptr) ) {
+  if (!instance) {
+    return kTfLiteOk;
+  }
+  EonInstance *inst = static_cast<EonInstance*>(instance);
+
+  reset_instance(inst, free_fnc);
+  inst->~EonInstance();
+  free_fnc(inst);
   return kTfLiteOk;
 }
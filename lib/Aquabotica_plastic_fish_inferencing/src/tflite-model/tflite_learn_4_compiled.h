@@ -35,6 +35,13 @@
 
 #include "edge-impulse-sdk/tensorflow/lite/c/common.h"
 
+namespace ei {
+class LayerProfiler;
+}
+namespace tflite {
+struct SoftmaxParams;
+}
+
 // Sets up the model with init and prepare steps.
 TfLiteStatus tflite_learn_4_init( void*(*alloc_fnc)(size_t,size_t) );
 // Returns the input tensor with the given index.
@@ -43,9 +50,34 @@ TfLiteStatus tflite_learn_4_input(int index, TfLiteTensor* tensor);
 TfLiteStatus tflite_learn_4_output(int index, TfLiteTensor* tensor);
 // Runs inference for the model.
 TfLiteStatus tflite_learn_4_invoke();
+// Makes invokes stop before the final SOFTMAX (enable) or run it again. When
+// enabled, returns the softmax input and params so the FOMO decoder can run it
+// on the cells it needs; fails if the model doesn't end in an int8 SOFTMAX.
+TfLiteStatus tflite_learn_4_softmax_logits(bool enable, TfLiteTensor *logits, tflite::SoftmaxParams *params);
+// Records every layer into profiler on each invoke, nullptr to stop
+// (needs EI_CLASSIFIER_TFLITE_EON_PROFILE=1).
+TfLiteStatus tflite_learn_4_set_profiler(ei::LayerProfiler* profiler);
 //Frees memory allocated
 TfLiteStatus tflite_learn_4_reset( void (*free)(void* ptr) );
 
+// Instances own their arena, tensors and kernel state, so separate
+// instances can be invoked concurrently (e.g. one per worker thread).
+// Creates an instance and runs the init and prepare steps on it. If they
+// fail, *instance is nullptr and nothing is left to free.
+TfLiteStatus tflite_learn_4_instance_create( void **instance, void*(*alloc_fnc)(size_t,size_t), void (*free)(void* ptr) );
+// Returns the input tensor with the given index of an instance.
+TfLiteStatus tflite_learn_4_instance_input(void *instance, int index, TfLiteTensor* tensor);
+// Returns the output tensor with the given index of an instance.
+TfLiteStatus tflite_learn_4_instance_output(void *instance, int index, TfLiteTensor* tensor);
+// Runs inference on an instance.
+TfLiteStatus tflite_learn_4_instance_invoke(void *instance);
+// tflite_learn_4_softmax_logits on an instance.
+TfLiteStatus tflite_learn_4_instance_softmax_logits(void *instance, bool enable, TfLiteTensor *logits, tflite::SoftmaxParams *params);
+// Records every layer of an instance into profiler, nullptr to stop.
+TfLiteStatus tflite_learn_4_instance_set_profiler(void *instance, ei::LayerProfiler* profiler);
+// Frees an instance and all memory allocated for it.
+TfLiteStatus tflite_learn_4_instance_destroy( void *instance, void (*free)(void* ptr) );
+
 
 // Returns the number of input tensors.
 inline size_t tflite_learn_4_inputs() {
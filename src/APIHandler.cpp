@@ -81,9 +81,6 @@ APIHandler::api_response_code_t APIHandler::fetchData(const String &name,
 
         // Parse response (extract calories value)
         result = _parseCalories(response);
-    } else {
-        Serial.print("Error on HTTP request: ");
-        Serial.println(httpResponseCode);
     }
 
     _http.end(); // End the HTTP connection
@@ -100,8 +97,6 @@ float APIHandler::_parseCalories(String &data)
     DeserializationError error = deserializeJson(doc, data);
 
     if (error) {
-        Serial.print(F("deserializeJson() failed: "));
-        Serial.println(error.f_str());
         return 0; // Return 0 if parsing fails
     }
 
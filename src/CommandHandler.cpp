@@ -1,80 +1,236 @@
 #include "CommandHandler.hpp"
 
+#include <string.h>
+
+// FNV-1a, fed one uppercased character at a time
+#define ROUTE_HASH_SEED 2166136261u
+#define ROUTE_HASH_PRIME 16777619u
+
+static inline uint32_t hashStep(uint32_t hash, char c)
+{
+    return (hash ^ (uint8_t)c) * ROUTE_HASH_PRIME;
+}
+
+// Same character set as String::trim()
+static inline bool isBlank(char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline char toUpper(char c)
+{
+    return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+}
+
 // Constructor
 CommandHandler::CommandHandler(Stream &serialStream)
-    : serial(serialStream), numRoutes(0), bufferIndex(0)
+    : numRoutes(0), serial(serialStream), bufferIndex(0), discardLine(false),
+      binary(false), txSeq(0)
 {
+    memset(table, -1, sizeof(table));
     memset(commandBuffer, 0, sizeof(commandBuffer));
 }
 
 // Register a command and its handler
-bool CommandHandler::registerRoute(const String &command,
+bool CommandHandler::registerRoute(const char *command,
                                    CommandFunction handler)
 {
-    if (numRoutes >= MAX_COMMANDS) {
+    if (numRoutes >= MAX_COMMANDS || !command || !handler) {
         return false; // Command table full
     }
-    routes[numRoutes].command = command;
-    routes[numRoutes].handler = handler;
+
+    // Normalise the name the way incoming commands are
+    size_t start = 0;
+    size_t end = strlen(command);
+    while (start < end && isBlank(command[start])) {
+        start++;
+    }
+    while (end > start && isBlank(command[end - 1])) {
+        end--;
+    }
+    size_t length = end - start;
+    if (length == 0 || length >= COMMAND_NAME_SIZE) {
+        return false;
+    }
+
+    CommandRoute &route = routes[numRoutes];
+    uint32_t hash = ROUTE_HASH_SEED;
+    for (size_t i = 0; i < length; i++) {
+        char c = toUpper(command[start + i]);
+        if (c == ' ') {
+            return false; // Would never match, the name ends at a space
+        }
+        route.command[i] = c;
+        hash = hashStep(hash, c);
+    }
+    route.command[length] = '\0';
+
+    if (findRoute(route.command, length, hash)) {
+        return false; // Already registered
+    }
+
+    route.length = (uint8_t)length;
+    route.hash = hash;
+    route.handler = handler;
+
+    uint32_t slot = hash & (COMMAND_TABLE_SIZE - 1);
+    while (table[slot] >= 0) {
+        slot = (slot + 1) & (COMMAND_TABLE_SIZE - 1);
+    }
+    table[slot] = (int8_t)numRoutes;
     numRoutes++;
     return true;
 }
 
+const CommandHandler::CommandRoute *
+CommandHandler::findRoute(const char *command, size_t length,
+                          uint32_t hash) const
+{
+    // The table never fills up, so the probe always reaches an empty slot
+    uint32_t slot = hash & (COMMAND_TABLE_SIZE - 1);
+    while (table[slot] >= 0) {
+        const CommandRoute &route = routes[table[slot]];
+        if (route.hash == hash && route.length == length &&
+            memcmp(route.command, command, length) == 0) {
+            return &route;
+        }
+        slot = (slot + 1) & (COMMAND_TABLE_SIZE - 1);
+    }
+    return nullptr;
+}
+
+// Trims and uppercases the line in place, the command is hashed on the way
+// and the arguments are handed over as a view into the buffer
+void CommandHandler::dispatch(char *line, size_t length)
+{
+    size_t start = 0;
+    while (start < length && isBlank(line[start])) {
+        start++;
+    }
+    while (length > start && isBlank(line[length - 1])) {
+        length--;
+    }
+    line[length] = '\0';
+
+    char *command = line + start;
+    size_t commandLength = 0;
+    uint32_t hash = ROUTE_HASH_SEED;
+    while (start + commandLength < length && command[commandLength] != ' ') {
+        command[commandLength] = toUpper(command[commandLength]);
+        hash = hashStep(hash, command[commandLength]);
+        commandLength++;
+    }
+
+    // Parse arguments (uppercased as well, as they always were)
+    CommandArgs args = {line + length, 0};
+    if (start + commandLength < length) {
+        args.data = command + commandLength + 1;
+        args.length = length - (start + commandLength + 1);
+        for (size_t i = 0; i < args.length; i++) {
+            command[commandLength + 1 + i] = toUpper(args.data[i]);
+        }
+    }
+
+    // Find and execute the corresponding handler
+    const CommandRoute *route = findRoute(command, commandLength, hash);
+    if (route) {
+        route->handler(args);
+    }
+}
+
 // Parse and execute an incoming command (non-blocking)
 void CommandHandler::handleIncomingCommand()
 {
     while (serial.available()) {
-        char incomingChar = serial.read();
+        char incomingChar = (char)serial.read();
+
+        // Frames carry command lines, other types are for the controller
+        if (binary && (!linkDecoder.idle() ||
+                       (uint8_t)incomingChar == LINK_FRAME_START)) {
+            if (linkDecoder.push((uint8_t)incomingChar) ==
+                    LinkFrameDecoder::LINK_FRAME_OK &&
+                linkDecoder.type() == LINK_MSG_COMMAND) {
+                dispatch((char *)linkDecoder.payload(), linkDecoder.length());
+            }
+            continue;
+        }
 
         // Handle newline character (end of command)
         if (incomingChar == '\n') {
-            commandBuffer[bufferIndex] = '\0'; // Null-terminate the buffer
-            String command = String(commandBuffer);
-            command.trim();        // Remove leading/trailing whitespace
-            command.toUpperCase(); // Convert to uppercase
-
-            // Parse command and arguments
-            int spaceIndex = command.indexOf(' ');
-            String cmd = command.substring(0, spaceIndex);
-            String args =
-                (spaceIndex != -1) ? command.substring(spaceIndex + 1) : "";
-
-            // Find and execute the corresponding handler
-            for (int i = 0; i < numRoutes; i++) {
-                String toCompare = routes[i].command;
-
-                toCompare.trim();
-                toCompare.toUpperCase();
-
-                if (toCompare == cmd) {
-                    routes[i].handler(args);
-                    break;
-                }
+            if (!discardLine) {
+                dispatch(commandBuffer, bufferIndex);
             }
 
             // Reset the buffer for the next command
             bufferIndex = 0;
-            memset(commandBuffer, 0, sizeof(commandBuffer));
+            discardLine = false;
+        } else if (bufferIndex < COMMAND_BUFFER_SIZE - 1) {
+            commandBuffer[bufferIndex++] = incomingChar;
         } else {
-            // Add character to buffer with overflow protection
-            if (bufferIndex < COMMAND_BUFFER_SIZE - 1) {
-                commandBuffer[bufferIndex++] = incomingChar;
-            } else {
-                // Reset buffer on overflow to prevent undefined behavior
-                bufferIndex = 0;
-                memset(commandBuffer, 0, sizeof(commandBuffer));
-            }
+            // Drop an overlong line up to its newline rather than run its tail
+            discardLine = true;
         }
     }
 }
 
 // Send a command with optional arguments
-void CommandHandler::sendCommand(const String &command, const String &args)
+void CommandHandler::sendCommand(const char *command, const char *args)
 {
-    String fullCommand = command;
-    if (!args.isEmpty()) {
-        fullCommand += " ";
-        fullCommand += args;
+    if (binary) {
+        const uint8_t *parts[3] = {(const uint8_t *)command,
+                                   (const uint8_t *)" ",
+                                   (const uint8_t *)args};
+        size_t lengths[3] = {strlen(command), 1, args ? strlen(args) : 0};
+        if (lengths[0] + 1 + lengths[2] <= LINK_MAX_PAYLOAD) {
+            writeFrame(LINK_MSG_COMMAND, parts, lengths, lengths[2] ? 3 : 1);
+        }
+        return;
+    }
+
+    serial.write((const uint8_t *)command, strlen(command));
+    if (args && *args) {
+        serial.write((const uint8_t *)" ", 1);
+        serial.write((const uint8_t *)args, strlen(args));
     }
-    serial.println(fullCommand);
+    serial.write((const uint8_t *)"\r\n", 2);
+}
+
+void CommandHandler::setBinary(bool enable)
+{
+    if (enable && !binary) {
+        linkDecoder.reset();
+        txSeq = 0;
+    }
+    binary = enable;
+}
+
+bool CommandHandler::sendFrame(uint8_t type, const uint8_t *payload,
+                               size_t length)
+{
+    if (!binary || length > LINK_MAX_PAYLOAD) {
+        return false;
+    }
+    writeFrame(type, &payload, &length, 1);
+    return true;
+}
+
+// Writes header, payload parts and CRC, without assembling the frame
+void CommandHandler::writeFrame(uint8_t type, const uint8_t *const *parts,
+                                const size_t *lengths, int count)
+{
+    size_t length = 0;
+    for (int i = 0; i < count; i++) {
+        length += lengths[i];
+    }
+
+    uint8_t header[5];
+    uint16_t crc = linkFrameHeader(type, txSeq++, (uint16_t)length, header);
+    serial.write(header, sizeof(header));
+    for (int i = 0; i < count; i++) {
+        crc = linkCrc16(crc, parts[i], lengths[i]);
+        serial.write(parts[i], lengths[i]);
+    }
+
+    uint8_t trailer[2] = {(uint8_t)(crc & 0xff), (uint8_t)(crc >> 8)};
+    serial.write(trailer, sizeof(trailer));
 }
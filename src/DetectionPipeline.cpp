@@ -0,0 +1,257 @@
+#include "DetectionPipeline.hpp"
+
+#include <string.h>
+
+// Camera and lookup wait on I/O most of the time, inference gets core 0 to
+// itself next to the WiFi driver while the main loop keeps core 1
+#ifndef PIPELINE_CAPTURE_CORE
+#define PIPELINE_CAPTURE_CORE 1
+#endif
+#ifndef PIPELINE_INFER_CORE
+#define PIPELINE_INFER_CORE 0
+#endif
+#ifndef PIPELINE_LOOKUP_CORE
+#define PIPELINE_LOOKUP_CORE 1
+#endif
+
+#define PIPELINE_CAPTURE_STACK 4096
+#define PIPELINE_INFER_STACK 16384
+#define PIPELINE_LOOKUP_STACK 8192
+#define PIPELINE_TASK_PRIORITY 1
+
+// How often a waiting stage checks whether the pipeline was stopped
+#define PIPELINE_POLL_MS 50
+
+// Attempt failures are only reported if there is room, final results always
+#define PIPELINE_RESULT_SLOTS (2 * PIPELINE_MAX_JOBS)
+
+static inline uint32_t elapsedUs(uint64_t since)
+{
+    return (uint32_t)(stageMicros() - since);
+}
+
+DetectionPipeline::DetectionPipeline()
+    : running(false), nextJob(0), jobsInFlight(0)
+{
+    memset(&stages, 0, sizeof(stages));
+}
+
+DetectionPipeline::~DetectionPipeline()
+{
+    stop();
+}
+
+bool DetectionPipeline::start(const pipeline_stages_t &stages)
+{
+    if (running) {
+        return false;
+    }
+    this->stages = stages;
+
+    // A request is only ever in one queue, so the job queue never fills up
+    if (!jobs.init(sizeof(Job), PIPELINE_MAX_JOBS) ||
+        !frames.init(sizeof(CapturedFrame), PIPELINE_FRAME_SLOTS) ||
+        !lookups.init(sizeof(pipeline_result_t), PIPELINE_MAX_JOBS) ||
+        !results.init(sizeof(pipeline_result_t), PIPELINE_RESULT_SLOTS)) {
+        return false;
+    }
+
+    running = true;
+    if (!captureTask.start("capture", captureMain, this,
+                           PIPELINE_CAPTURE_STACK, PIPELINE_TASK_PRIORITY,
+                           PIPELINE_CAPTURE_CORE) ||
+        !inferTask.start("infer", inferMain, this, PIPELINE_INFER_STACK,
+                         PIPELINE_TASK_PRIORITY, PIPELINE_INFER_CORE) ||
+        !lookupTask.start("lookup", lookupMain, this, PIPELINE_LOOKUP_STACK,
+                          PIPELINE_TASK_PRIORITY, PIPELINE_LOOKUP_CORE)) {
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void DetectionPipeline::stop()
+{
+    if (!running.exchange(false)) {
+        return;
+    }
+    captureTask.join();
+    inferTask.join();
+    lookupTask.join();
+
+    // Frames still queued go back to their source
+    CapturedFrame captured;
+    while (frames.waiting() && frames.receive(&captured, 0)) {
+        stages.release(stages.ctx, &captured.frame);
+    }
+}
+
+bool DetectionPipeline::submit(uint32_t *job)
+{
+    if (!running || jobsInFlight >= PIPELINE_MAX_JOBS) {
+        return false;
+    }
+
+    Job request = {nextJob++, 1, stageMicros()};
+    if (!jobs.send(&request, 0)) {
+        return false;
+    }
+    jobsInFlight++;
+    if (job) {
+        *job = request.id;
+    }
+    return true;
+}
+
+bool DetectionPipeline::poll(pipeline_result_t &result)
+{
+    if (!results.receive(&result, 0)) {
+        return false;
+    }
+    if (result.final) {
+        jobsInFlight--;
+    }
+    return true;
+}
+
+// Blocking send that gives up once the pipeline is stopped
+bool DetectionPipeline::sendWhileRunning(StageQueue &queue, const void *item)
+{
+    while (running) {
+        if (queue.send(item, PIPELINE_POLL_MS)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Reports the failed attempt, then tries another frame or gives up
+void DetectionPipeline::attemptFailed(const Job &job,
+                                      pipeline_result_t &result)
+{
+    if (result.status != PIPELINE_NOT_RECOG) {
+        // Dropped if loop() is behind, the final result of the job still comes
+        (void)results.send(&result, 0);
+    }
+
+    // The job queue has room for every job in flight, so the retry does not
+    // wait, and is only lost if the pipeline is stopped
+    if (job.attempt < PIPELINE_MAX_ATTEMPTS) {
+        Job retry = job;
+        retry.attempt++;
+        sendWhileRunning(jobs, &retry);
+        return;
+    }
+
+    result.status = PIPELINE_NOT_RECOG;
+    finish(result);
+}
+
+void DetectionPipeline::finish(pipeline_result_t &result)
+{
+    result.final = true;
+    result.totalUs = elapsedUs(result.submittedUs);
+    sendWhileRunning(results, &result);
+}
+
+static void initResult(pipeline_result_t &result, uint32_t job,
+                       uint8_t attempt, uint64_t submittedUs)
+{
+    result.job = job;
+    result.final = false;
+    result.attempt = attempt;
+    result.calories = 0.0f;
+    result.submittedUs = submittedUs;
+    result.captureUs = 0;
+    result.inferUs = 0;
+    result.lookupUs = 0;
+    result.totalUs = 0;
+    result.detectionCount = 0;
+}
+
+void DetectionPipeline::captureMain(void *arg)
+{
+    DetectionPipeline *pipeline = (DetectionPipeline *)arg;
+    CapturedFrame captured;
+
+    while (pipeline->running) {
+        if (!pipeline->jobs.receive(&captured.job, PIPELINE_POLL_MS)) {
+            continue;
+        }
+
+        uint64_t start = stageMicros();
+        bool ok = pipeline->stages.capture(pipeline->stages.ctx,
+                                           &captured.frame);
+        captured.captureUs = elapsedUs(start);
+
+        if (!ok) {
+            pipeline_result_t result;
+            initResult(result, captured.job.id, captured.job.attempt,
+                       captured.job.submittedUs);
+            result.status = PIPELINE_CAPTURE_FAIL;
+            result.captureUs = captured.captureUs;
+            pipeline->attemptFailed(captured.job, result);
+            continue;
+        }
+
+        // Waits for the frame slot, the next capture overlaps inference
+        if (!pipeline->sendWhileRunning(pipeline->frames, &captured)) {
+            pipeline->stages.release(pipeline->stages.ctx, &captured.frame);
+        }
+    }
+}
+
+void DetectionPipeline::inferMain(void *arg)
+{
+    DetectionPipeline *pipeline = (DetectionPipeline *)arg;
+    CapturedFrame captured;
+    pipeline_result_t result;
+
+    while (pipeline->running) {
+        if (!pipeline->frames.receive(&captured, PIPELINE_POLL_MS)) {
+            continue;
+        }
+
+        initResult(result, captured.job.id, captured.job.attempt,
+                   captured.job.submittedUs);
+        result.captureUs = captured.captureUs;
+
+        uint64_t start = stageMicros();
+        bool ok = pipeline->stages.infer(pipeline->stages.ctx,
+                                         &captured.frame, result.detections,
+                                         &result.detectionCount);
+        result.inferUs = elapsedUs(start);
+        pipeline->stages.release(pipeline->stages.ctx, &captured.frame);
+
+        if (!ok) {
+            result.detectionCount = 0;
+            result.status = PIPELINE_AI_FAIL;
+            pipeline->attemptFailed(captured.job, result);
+        } else if (result.detectionCount == 0) {
+            result.status = PIPELINE_NOT_RECOG;
+            pipeline->attemptFailed(captured.job, result);
+        } else {
+            pipeline->sendWhileRunning(pipeline->lookups, &result);
+        }
+    }
+}
+
+void DetectionPipeline::lookupMain(void *arg)
+{
+    DetectionPipeline *pipeline = (DetectionPipeline *)arg;
+    pipeline_result_t result;
+
+    while (pipeline->running) {
+        if (!pipeline->lookups.receive(&result, PIPELINE_POLL_MS)) {
+            continue;
+        }
+
+        uint64_t start = stageMicros();
+        bool ok = pipeline->stages.lookup(pipeline->stages.ctx,
+                                          result.detections[0].label,
+                                          &result.calories);
+        result.lookupUs = elapsedUs(start);
+        result.status = ok ? PIPELINE_FISH_INFO : PIPELINE_LOOKUP_FAIL;
+        pipeline->finish(result);
+    }
+}
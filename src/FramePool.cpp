@@ -0,0 +1,120 @@
+#include "FramePool.hpp"
+
+// Slots start 16-byte aligned
+#define FRAME_POOL_ALIGN 16
+
+FramePool::FramePool()
+    : memory(nullptr), count(0), size(0), outSlots(0), inUse(0), peakInUse(0),
+      acquires(0), waits(0), timeouts(0), waitMaxUs(0), waitTotalUs(0)
+{
+}
+
+FramePool::~FramePool()
+{
+    stageFreeBuffer(memory);
+}
+
+bool FramePool::init(size_t slotCount, size_t slotSize)
+{
+    if (memory || slotCount == 0 || slotCount > FRAME_POOL_MAX_SLOTS ||
+        slotSize == 0) {
+        return false;
+    }
+
+    slotSize = (slotSize + FRAME_POOL_ALIGN - 1) &
+               ~(size_t)(FRAME_POOL_ALIGN - 1);
+    if (!freeSlots.init(sizeof(uint8_t *), slotCount)) {
+        return false;
+    }
+    memory = (uint8_t *)stageAllocBuffer(slotCount * slotSize);
+    if (!memory) {
+        return false;
+    }
+    count = slotCount;
+    size = slotSize;
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t *slot = memory + i * size;
+        freeSlots.send(&slot, 0);
+    }
+    return true;
+}
+
+static inline uint32_t slotBit(const uint8_t *memory, size_t size,
+                               const uint8_t *slot)
+{
+    return (uint32_t)1 << ((slot - memory) / size);
+}
+
+void FramePool::acquired(uint8_t *slot)
+{
+    outSlots.fetch_or(slotBit(memory, size, slot));
+    acquires++;
+    uint32_t used = ++inUse;
+    uint32_t peak = peakInUse;
+    while (used > peak && !peakInUse.compare_exchange_weak(peak, used)) {
+    }
+}
+
+uint8_t *FramePool::acquire(uint32_t timeoutMs)
+{
+    uint8_t *slot;
+
+    if (!memory) {
+        return nullptr;
+    }
+    if (freeSlots.receive(&slot, 0)) {
+        acquired(slot);
+        return slot;
+    }
+
+    // All slots are out, how long until one comes back is what tells
+    // whether the pool is big enough
+    waits++;
+    uint64_t start = stageMicros();
+    bool ok = timeoutMs > 0 && freeSlots.receive(&slot, timeoutMs);
+    uint32_t waited = (uint32_t)(stageMicros() - start);
+
+    waitTotalUs += waited;
+    uint32_t longest = waitMaxUs;
+    while (waited > longest &&
+           !waitMaxUs.compare_exchange_weak(longest, waited)) {
+    }
+
+    if (!ok) {
+        timeouts++;
+        return nullptr;
+    }
+    acquired(slot);
+    return slot;
+}
+
+bool FramePool::release(uint8_t *slot)
+{
+    if (!memory || slot < memory || slot >= memory + count * size ||
+        (size_t)(slot - memory) % size != 0) {
+        return false;
+    }
+    // Only the release that clears the bit gives the slot back, a second one
+    // would hand the same buffer to two owners
+    uint32_t bit = slotBit(memory, size, slot);
+    if (!(outSlots.fetch_and(~bit) & bit)) {
+        return false;
+    }
+    inUse--;
+    // The slot was out, so the queue has room for it
+    freeSlots.send(&slot, 0);
+    return true;
+}
+
+void FramePool::stats(frame_pool_stats_t &stats) const
+{
+    stats.slots = count;
+    stats.inUse = inUse;
+    stats.peakInUse = peakInUse;
+    stats.acquires = acquires;
+    stats.waits = waits;
+    stats.timeouts = timeouts;
+    stats.waitMaxUs = waitMaxUs;
+    stats.waitTotalUs = waitTotalUs;
+}
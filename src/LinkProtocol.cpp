@@ -0,0 +1,179 @@
+#include "LinkProtocol.hpp"
+
+#include <string.h>
+
+static const uint32_t supportedBauds[] = {115200, 230400, 460800, 921600};
+
+uint16_t linkCrc16(uint16_t crc, const uint8_t *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021)
+                                 : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+bool linkBaudSupported(uint32_t baud)
+{
+    for (uint32_t supported : supportedBauds) {
+        if (baud == supported) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint16_t linkFrameHeader(uint8_t type, uint8_t seq, uint16_t length,
+                         uint8_t *out)
+{
+    out[0] = LINK_FRAME_START;
+    out[1] = type;
+    out[2] = seq;
+    out[3] = (uint8_t)(length & 0xff);
+    out[4] = (uint8_t)(length >> 8);
+
+    return linkCrc16(0xFFFF, out + 1, 4);
+}
+
+static inline uint8_t *putU16(uint8_t *out, uint32_t value)
+{
+    if (value > 0xFFFF) {
+        value = 0xFFFF;
+    }
+    out[0] = (uint8_t)(value & 0xff);
+    out[1] = (uint8_t)(value >> 8);
+    return out + 2;
+}
+
+size_t linkPutDetection(uint8_t *out, size_t room, const char *label,
+                        float value, uint32_t x, uint32_t y, uint32_t width,
+                        uint32_t height)
+{
+    size_t labelLength = strlen(label);
+    if (labelLength > 0xFF) {
+        labelLength = 0xFF;
+    }
+
+    size_t size = 1 + labelLength + 1 + 4 * 2;
+    if (size > room) {
+        return 0;
+    }
+
+    uint8_t score;
+    if (value <= 0.0f) {
+        score = 0;
+    } else if (value >= 1.0f) {
+        score = 255;
+    } else {
+        score = (uint8_t)(value * 255.0f + 0.5f);
+    }
+
+    *out++ = (uint8_t)labelLength;
+    memcpy(out, label, labelLength);
+    out += labelLength;
+    *out++ = score;
+    out = putU16(out, x);
+    out = putU16(out, y);
+    out = putU16(out, width);
+    putU16(out, height);
+    return size;
+}
+
+LinkFrameDecoder::LinkFrameDecoder()
+    : state(STATE_START), frameType(0), frameSeq(0), frameLength(0),
+      received(0), crc(0), frameCrc(0), valid(0), lost(0), bad(0)
+{
+    reset();
+}
+
+void LinkFrameDecoder::reset()
+{
+    state = STATE_START;
+    synced = false;
+    nextSeq = 0;
+}
+
+LinkFrameDecoder::status_t LinkFrameDecoder::push(uint8_t byte)
+{
+    switch (state) {
+    case STATE_START:
+        crc = 0xFFFF;
+        state = STATE_TYPE;
+        return LINK_NEED_MORE;
+    case STATE_TYPE:
+        frameType = byte;
+        state = STATE_SEQ;
+        break;
+    case STATE_SEQ:
+        frameSeq = byte;
+        state = STATE_LENGTH_LO;
+        break;
+    case STATE_LENGTH_LO:
+        frameLength = byte;
+        state = STATE_LENGTH_HI;
+        break;
+    case STATE_LENGTH_HI:
+        frameLength |= (uint16_t)byte << 8;
+        if (frameLength > LINK_MAX_PAYLOAD) {
+            // Lost sync or a broken length, look for the next start byte
+            state = STATE_START;
+            bad++;
+            return LINK_ERR_LENGTH;
+        }
+        received = 0;
+        state = frameLength ? STATE_PAYLOAD : STATE_CRC_LO;
+        break;
+    case STATE_PAYLOAD:
+        buffer[received++] = byte;
+        if (received == frameLength) {
+            state = STATE_CRC_LO;
+        }
+        break;
+    case STATE_CRC_LO:
+        frameCrc = byte;
+        state = STATE_CRC_HI;
+        return LINK_NEED_MORE;
+    case STATE_CRC_HI:
+        frameCrc |= (uint16_t)byte << 8;
+        state = STATE_START;
+        if (frameCrc != crc) {
+            bad++;
+            return LINK_ERR_CRC;
+        }
+        // A seq behind the expected one is a resend or a restarted sender
+        if (synced && (uint8_t)(frameSeq - nextSeq) < 0x80) {
+            lost += (uint8_t)(frameSeq - nextSeq);
+        }
+        synced = true;
+        nextSeq = (uint8_t)(frameSeq + 1);
+        valid++;
+        buffer[frameLength] = 0;
+        return LINK_FRAME_OK;
+    }
+
+    crc = linkCrc16(crc, &byte, 1);
+    return LINK_NEED_MORE;
+}
+
+LinkWatchdog::LinkWatchdog() : valid(0), bad(0), lastFrameMs(0) {}
+
+void LinkWatchdog::start(const LinkFrameDecoder &decoder, uint32_t nowMs)
+{
+    valid = decoder.validFrames();
+    bad = decoder.badFrames();
+    lastFrameMs = nowMs;
+}
+
+bool LinkWatchdog::expired(const LinkFrameDecoder &decoder, uint32_t nowMs)
+{
+    // Every valid frame restarts the timeout and the bad frame count
+    if (decoder.validFrames() != valid) {
+        start(decoder, nowMs);
+        return false;
+    }
+    return nowMs - lastFrameMs >= LINK_IDLE_TIMEOUT_MS ||
+           decoder.badFrames() - bad >= LINK_BAD_FRAME_BURST;
+}
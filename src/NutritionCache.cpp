@@ -0,0 +1,331 @@
+#include "NutritionCache.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Revalidation waits on the network, next to the pipeline's lookup stage
+#define NUTRITION_REVALIDATE_CORE 1
+#define NUTRITION_REVALIDATE_STACK 8192
+#define NUTRITION_REVALIDATE_PRIORITY 1
+
+// How often the waiting revalidation task checks whether it was stopped
+#define NUTRITION_POLL_MS 50
+
+NutritionCache::NutritionCache()
+    : ttlUs(0), running(false), changes(0)
+{
+    memset(&source, 0, sizeof(source));
+    memset(entries, 0, sizeof(entries));
+    memset(&counters, 0, sizeof(counters));
+}
+
+NutritionCache::~NutritionCache()
+{
+    stop();
+}
+
+bool NutritionCache::start(const nutrition_source_t &source, uint32_t ttlMs)
+{
+    if (running || !source.fetch) {
+        return false;
+    }
+    this->source = source;
+    ttlUs = (uint64_t)ttlMs * 1000;
+
+    if (!entriesLock.init() || !fetchLock.init() ||
+        !revalidations.init(sizeof(Revalidation), NUTRITION_CACHE_SIZE)) {
+        return false;
+    }
+
+    running = true;
+    if (!revalidateTask.start("revalidate", revalidateMain, this,
+                              NUTRITION_REVALIDATE_STACK,
+                              NUTRITION_REVALIDATE_PRIORITY,
+                              NUTRITION_REVALIDATE_CORE)) {
+        running = false;
+        return false;
+    }
+    return true;
+}
+
+void NutritionCache::stop()
+{
+    if (!running.exchange(false)) {
+        return;
+    }
+    revalidateTask.join();
+}
+
+// With entriesLock held
+NutritionCache::Entry *NutritionCache::find(const char *label)
+{
+    for (size_t i = 0; i < NUTRITION_CACHE_SIZE; i++) {
+        if (entries[i].used && strcmp(entries[i].label, label) == 0) {
+            return &entries[i];
+        }
+    }
+    return nullptr;
+}
+
+// With entriesLock held, takes a free entry or the least recently used one
+NutritionCache::Entry *NutritionCache::insert(const char *label)
+{
+    Entry *entry = &entries[0];
+    for (size_t i = 0; i < NUTRITION_CACHE_SIZE; i++) {
+        if (!entries[i].used) {
+            entry = &entries[i];
+            break;
+        }
+        if (entries[i].lastUsedUs < entry->lastUsedUs) {
+            entry = &entries[i];
+        }
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    strcpy(entry->label, label);
+    entry->used = true;
+    return entry;
+}
+
+// The source is only ever asked one label at a time
+bool NutritionCache::fetch(const char *label, float *calories)
+{
+    fetchLock.lock();
+    bool ok = source.fetch(source.ctx, label, calories);
+    fetchLock.unlock();
+
+    entriesLock.lock();
+    counters.fetches++;
+    if (!ok) {
+        counters.fetchFailures++;
+    }
+    entriesLock.unlock();
+    return ok;
+}
+
+void NutritionCache::store(const char *label, float calories)
+{
+    uint64_t now = stageMicros();
+
+    entriesLock.lock();
+    Entry *entry = find(label);
+    bool changed = !entry || entry->calories != calories;
+    if (!entry) {
+        entry = insert(label);
+        entry->lastUsedUs = now;
+    }
+    entry->calories = calories;
+    entry->fetched = true;
+    entry->revalidating = false;
+    entry->fetchedUs = now;
+    entry->failedUs = 0;
+    entriesLock.unlock();
+
+    if (changed) {
+        changes++;
+    }
+}
+
+// With entriesLock held
+void NutritionCache::queueRevalidation(Entry *entry, uint64_t now)
+{
+    if (entry->revalidating ||
+        (entry->failedUs &&
+         now - entry->failedUs < (uint64_t)NUTRITION_RETRY_MS * 1000)) {
+        return;
+    }
+
+    Revalidation revalidation;
+    strcpy(revalidation.label, entry->label);
+    entry->revalidating = revalidations.send(&revalidation, 0);
+}
+
+bool NutritionCache::lookup(const char *label, float *calories)
+{
+    if (!running) {
+        return false;
+    }
+    // Too long to be a key, asked every time
+    if (strlen(label) >= NUTRITION_LABEL_SIZE) {
+        return fetch(label, calories);
+    }
+
+    uint64_t now = stageMicros();
+    entriesLock.lock();
+    Entry *entry = find(label);
+    if (entry) {
+        *calories = entry->calories;
+        entry->lastUsedUs = now;
+        if (entry->fetched && now - entry->fetchedUs < ttlUs) {
+            counters.hits++;
+        } else {
+            counters.staleHits++;
+            queueRevalidation(entry, now);
+        }
+        entriesLock.unlock();
+        return true;
+    }
+    counters.misses++;
+    entriesLock.unlock();
+
+    if (!fetch(label, calories)) {
+        return false;
+    }
+    store(label, *calories);
+    return true;
+}
+
+size_t NutritionCache::warm(const char *const *labels, size_t count)
+{
+    size_t cached = 0;
+
+    if (!running) {
+        return 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (strlen(labels[i]) >= NUTRITION_LABEL_SIZE) {
+            continue;
+        }
+
+        uint64_t now = stageMicros();
+        entriesLock.lock();
+        Entry *entry = find(labels[i]);
+        if (entry) {
+            if (!entry->fetched || now - entry->fetchedUs >= ttlUs) {
+                queueRevalidation(entry, now);
+            }
+            entriesLock.unlock();
+            cached++;
+            continue;
+        }
+        entriesLock.unlock();
+
+        float calories;
+        if (fetch(labels[i], &calories)) {
+            store(labels[i], calories);
+            cached++;
+        }
+    }
+    return cached;
+}
+
+size_t NutritionCache::save(char *out, size_t size)
+{
+    size_t length = 0;
+
+    if (size == 0) {
+        return 0;
+    }
+    out[0] = '\0';
+
+    entriesLock.lock();
+    for (size_t i = 0; i < NUTRITION_CACHE_SIZE; i++) {
+        if (!entries[i].used) {
+            continue;
+        }
+        int n = snprintf(out + length, size - length, "%s %.6g\n",
+                         entries[i].label, entries[i].calories);
+        if (n < 0 || (size_t)n >= size - length) {
+            length = 0;
+            break;
+        }
+        length += n;
+    }
+    entriesLock.unlock();
+    return length;
+}
+
+size_t NutritionCache::load(const char *text, size_t length)
+{
+    size_t loaded = 0;
+    const char *end = text + length;
+
+    if (!running) {
+        return 0;
+    }
+    while (text < end) {
+        const char *eol = (const char *)memchr(text, '\n', end - text);
+        if (!eol) {
+            eol = end;
+        }
+
+        // "<label> <calories>", the label without spaces
+        char line[NUTRITION_LABEL_SIZE + 32];
+        size_t lineLength = eol - text;
+        if (lineLength >= sizeof(line)) {
+            lineLength = 0;
+        }
+        memcpy(line, text, lineLength);
+        line[lineLength] = '\0';
+        text = eol + 1;
+
+        char *space = strchr(line, ' ');
+        char *valueEnd;
+        if (!space || space == line ||
+            (size_t)(space - line) >= NUTRITION_LABEL_SIZE) {
+            continue;
+        }
+        *space = '\0';
+        float calories = strtof(space + 1, &valueEnd);
+        if (valueEnd == space + 1) {
+            continue;
+        }
+
+        entriesLock.lock();
+        Entry *entry = find(line);
+        // What was fetched since start() is newer than the file
+        if (!entry || !entry->fetched) {
+            if (!entry) {
+                entry = insert(line);
+            }
+            entry->calories = calories;
+            loaded++;
+        }
+        entriesLock.unlock();
+    }
+    return loaded;
+}
+
+void NutritionCache::stats(nutrition_cache_stats_t &stats)
+{
+    entriesLock.lock();
+    stats = counters;
+    stats.entries = 0;
+    for (size_t i = 0; i < NUTRITION_CACHE_SIZE; i++) {
+        if (entries[i].used) {
+            stats.entries++;
+        }
+    }
+    entriesLock.unlock();
+}
+
+void NutritionCache::revalidateMain(void *arg)
+{
+    NutritionCache *cache = (NutritionCache *)arg;
+    Revalidation revalidation;
+
+    while (cache->running) {
+        if (!cache->revalidations.receive(&revalidation, NUTRITION_POLL_MS)) {
+            continue;
+        }
+
+        float calories;
+        if (cache->fetch(revalidation.label, &calories)) {
+            cache->store(revalidation.label, calories);
+            cache->entriesLock.lock();
+            cache->counters.revalidations++;
+            cache->entriesLock.unlock();
+            continue;
+        }
+
+        // The stale value stays, tried again after NUTRITION_RETRY_MS
+        cache->entriesLock.lock();
+        Entry *entry = cache->find(revalidation.label);
+        if (entry) {
+            entry->revalidating = false;
+            entry->failedUs = stageMicros();
+        }
+        cache->entriesLock.unlock();
+    }
+}
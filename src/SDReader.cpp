@@ -84,3 +84,16 @@ String SDReader::readFile(String path)
     file.close();                           // Ensure the file is closed
     return fileContent;
 }
+
+// Replace the contents of a file on the SD card
+bool SDReader::writeFile(String path, const String &content)
+{
+    File file = SD_MMC.open(path, FILE_WRITE);
+    if (!file) {
+        return false; // Return false if the file cannot be created
+    }
+
+    size_t written = file.print(content);
+    file.close();
+    return written == content.length();
+}
@@ -0,0 +1,155 @@
+// ESP32 implementation of StageRuntime.hpp, FreeRTOS queues and tasks pinned
+// to a core
+#ifdef ARDUINO
+
+#include "StageRuntime.hpp"
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+static inline TickType_t toTicks(uint32_t timeoutMs)
+{
+    return timeoutMs == STAGE_WAIT_FOREVER ? portMAX_DELAY
+                                           : pdMS_TO_TICKS(timeoutMs);
+}
+
+StageQueue::~StageQueue()
+{
+    if (impl) {
+        vQueueDelete((QueueHandle_t)impl);
+    }
+}
+
+bool StageQueue::init(size_t itemSize, size_t capacity)
+{
+    if (impl || itemSize == 0 || capacity == 0) {
+        return false;
+    }
+    impl = xQueueCreate(capacity, itemSize);
+    return impl != nullptr;
+}
+
+bool StageQueue::send(const void *item, uint32_t timeoutMs)
+{
+    return xQueueSend((QueueHandle_t)impl, item, toTicks(timeoutMs)) ==
+           pdTRUE;
+}
+
+bool StageQueue::receive(void *item, uint32_t timeoutMs)
+{
+    return xQueueReceive((QueueHandle_t)impl, item, toTicks(timeoutMs)) ==
+           pdTRUE;
+}
+
+size_t StageQueue::waiting() const
+{
+    return uxQueueMessagesWaiting((QueueHandle_t)impl);
+}
+
+StageLock::~StageLock()
+{
+    if (impl) {
+        vSemaphoreDelete((SemaphoreHandle_t)impl);
+    }
+}
+
+bool StageLock::init()
+{
+    if (impl) {
+        return false;
+    }
+    impl = xSemaphoreCreateMutex();
+    return impl != nullptr;
+}
+
+void StageLock::lock()
+{
+    xSemaphoreTake((SemaphoreHandle_t)impl, portMAX_DELAY);
+}
+
+void StageLock::unlock()
+{
+    xSemaphoreGive((SemaphoreHandle_t)impl);
+}
+
+// The task signals done before deleting itself, join() waits on it
+struct FreeRTOSTask {
+    StageFunction fn;
+    void *arg;
+    SemaphoreHandle_t done;
+};
+
+static void taskMain(void *param)
+{
+    FreeRTOSTask *task = (FreeRTOSTask *)param;
+    task->fn(task->arg);
+    xSemaphoreGive(task->done);
+    vTaskDelete(nullptr);
+}
+
+StageTask::~StageTask()
+{
+    join();
+}
+
+bool StageTask::start(const char *name, StageFunction fn, void *arg,
+                      uint32_t stackSize, int priority, int core)
+{
+    if (impl) {
+        return false;
+    }
+
+    FreeRTOSTask *task = new FreeRTOSTask{fn, arg, xSemaphoreCreateBinary()};
+    if (!task->done) {
+        delete task;
+        return false;
+    }
+
+    BaseType_t res = xTaskCreatePinnedToCore(
+        taskMain, name, stackSize, task, priority, nullptr,
+        core < 0 ? tskNO_AFFINITY : core);
+    if (res != pdPASS) {
+        vSemaphoreDelete(task->done);
+        delete task;
+        return false;
+    }
+    impl = task;
+    return true;
+}
+
+void StageTask::join()
+{
+    FreeRTOSTask *task = (FreeRTOSTask *)impl;
+    if (task) {
+        xSemaphoreTake(task->done, portMAX_DELAY);
+        vSemaphoreDelete(task->done);
+        delete task;
+        impl = nullptr;
+    }
+}
+
+uint64_t stageMicros()
+{
+    return (uint64_t)esp_timer_get_time();
+}
+
+void *stageAllocBuffer(size_t size)
+{
+    void *buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!buffer) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    return buffer;
+}
+
+void stageFreeBuffer(void *buffer)
+{
+    heap_caps_free(buffer);
+}
+
+#endif
@@ -0,0 +1,169 @@
+// Host implementation of StageRuntime.hpp, std::thread and a ring buffer under
+// a mutex
+#ifndef ARDUINO
+
+#include "StageRuntime.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+struct ThreadQueue {
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::vector<uint8_t> items;
+    size_t itemSize;
+    size_t capacity;
+    size_t head;
+    size_t count;
+};
+
+template <typename Predicate>
+static bool waitFor(std::condition_variable &cv,
+                    std::unique_lock<std::mutex> &lock, uint32_t timeoutMs,
+                    Predicate ready)
+{
+    if (timeoutMs == STAGE_WAIT_FOREVER) {
+        cv.wait(lock, ready);
+        return true;
+    }
+    return cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), ready);
+}
+
+StageQueue::~StageQueue()
+{
+    delete (ThreadQueue *)impl;
+}
+
+bool StageQueue::init(size_t itemSize, size_t capacity)
+{
+    if (impl || itemSize == 0 || capacity == 0) {
+        return false;
+    }
+
+    ThreadQueue *queue = new ThreadQueue;
+    queue->items.resize(itemSize * capacity);
+    queue->itemSize = itemSize;
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->count = 0;
+    impl = queue;
+    return true;
+}
+
+bool StageQueue::send(const void *item, uint32_t timeoutMs)
+{
+    ThreadQueue *queue = (ThreadQueue *)impl;
+    std::unique_lock<std::mutex> lock(queue->mutex);
+
+    if (!waitFor(queue->notFull, lock, timeoutMs,
+                 [queue] { return queue->count < queue->capacity; })) {
+        return false;
+    }
+    size_t tail = (queue->head + queue->count) % queue->capacity;
+    memcpy(&queue->items[tail * queue->itemSize], item, queue->itemSize);
+    queue->count++;
+    lock.unlock();
+    queue->notEmpty.notify_one();
+    return true;
+}
+
+bool StageQueue::receive(void *item, uint32_t timeoutMs)
+{
+    ThreadQueue *queue = (ThreadQueue *)impl;
+    std::unique_lock<std::mutex> lock(queue->mutex);
+
+    if (!waitFor(queue->notEmpty, lock, timeoutMs,
+                 [queue] { return queue->count > 0; })) {
+        return false;
+    }
+    memcpy(item, &queue->items[queue->head * queue->itemSize],
+           queue->itemSize);
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+    lock.unlock();
+    queue->notFull.notify_one();
+    return true;
+}
+
+size_t StageQueue::waiting() const
+{
+    ThreadQueue *queue = (ThreadQueue *)impl;
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->count;
+}
+
+StageLock::~StageLock()
+{
+    delete (std::mutex *)impl;
+}
+
+bool StageLock::init()
+{
+    if (impl) {
+        return false;
+    }
+    impl = new std::mutex;
+    return true;
+}
+
+void StageLock::lock()
+{
+    ((std::mutex *)impl)->lock();
+}
+
+void StageLock::unlock()
+{
+    ((std::mutex *)impl)->unlock();
+}
+
+StageTask::~StageTask()
+{
+    join();
+}
+
+// Name, stack, priority and core are left to the host scheduler
+bool StageTask::start(const char *, StageFunction fn, void *arg, uint32_t,
+                      int, int)
+{
+    if (impl) {
+        return false;
+    }
+    impl = new std::thread(fn, arg);
+    return true;
+}
+
+void StageTask::join()
+{
+    std::thread *thread = (std::thread *)impl;
+    if (thread) {
+        thread->join();
+        delete thread;
+        impl = nullptr;
+    }
+}
+
+uint64_t stageMicros()
+{
+    static const auto boot = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - boot)
+        .count();
+}
+
+void *stageAllocBuffer(size_t size)
+{
+    return malloc(size);
+}
+
+void stageFreeBuffer(void *buffer)
+{
+    free(buffer);
+}
+
+#endif
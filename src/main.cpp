@@ -3,10 +3,15 @@
 
 #include "APIHandler.hpp"
 #include "CommandHandler.hpp"
+#include "DetectionPipeline.hpp"
+#include "FramePool.hpp"
+#include "NutritionCache.hpp"
 
 #include "config.h"
 #include "edge-impulse-sdk/dsp/image/image.hpp"
 #include "esp_camera.h"
+#include "esp_heap_caps.h"
+#include "esp_jpg_decode.h"
 
 #include <Aquabotica_plastic_fish_inferencing.h>
 
@@ -16,9 +21,20 @@
 #include "camera_pins.h"
 
 /* Constant defines -------------------------------------------------------- */
-#define EI_CAMERA_RAW_FRAME_BUFFER_COLS 320
-#define EI_CAMERA_RAW_FRAME_BUFFER_ROWS 240
-#define EI_CAMERA_FRAME_BYTE_SIZE 3
+// Tallest MCU of a baseline JPEG (4:2:0 subsampling)
+#define EI_CAMERA_JPEG_MCU_ROWS 16
+// FRAMESIZE_QVGA
+#define EI_CAMERA_FRAME_COLS 320
+#define EI_CAMERA_FRAME_ROWS 240
+// One frame being captured, PIPELINE_FRAME_SLOTS waiting and one being
+// inferred
+#define EI_CAMERA_POOL_SLOTS (PIPELINE_FRAME_SLOTS + 2)
+// Well above a QVGA JPEG at quality 12 (10-20 KB)
+#define EI_CAMERA_POOL_SLOT_SIZE                                               \
+    (EI_CAMERA_FRAME_COLS * EI_CAMERA_FRAME_ROWS / 2)
+#define EI_CAMERA_POOL_WAIT_MS 1000
+// Nutrition of the labels seen so far, kept over reboots
+#define NUTRITION_CACHE_FILE "/nutrition.txt"
 
 // Instantiate CommandHandler for communication with ESP32
 CommandHandler commandHandler(Serial);
@@ -26,23 +42,42 @@ CommandHandler commandHandler(Serial);
 SDReader sdReader;
 APIHandler apiHandler;
 
+// Capture, inference and nutrition lookup behind CAPTURE
+DetectionPipeline pipeline;
+// JPEG frames on their way from the camera to inference
+FramePool framePool;
+// Label -> calories in front of the API
+NutritionCache nutritionCache;
+static uint32_t savedNutritionGeneration = 0;
+
 status_t status = STATUS_BOOT;
 
+// Baud rate the serial link runs at, and what tells when its binary mode was
+// lost (LINK_IDLE_TIMEOUT_MS)
+static uint32_t linkBaud = LINK_TEXT_BAUD;
+static LinkWatchdog linkWatchdog;
+
 camera_config_t cameraConfig;
 
 static bool debug_nn = false; // Set this to true to see e.g. features generated
                               // from the raw signal
 static bool is_initialised = false;
 
-uint8_t *snapshot_buf; // points to the output of the capture
+// Row buffers of the resize from the camera frame to the model input, only
+// used by the inference stage
+static uint8_t *resizeBuffer = nullptr;
+static size_t resizeBufferSize = 0;
+
+// Camera frame being decoded into the model input
+typedef struct {
+    const pipeline_frame_t *frame;
+    ei::image::processing::resize_stream_t resize;
+} camera_stream_t;
 
 // ------- Prototypes ------------------------------------------------------- //
-uint8_t *allocateSnapshotBuffer();
-bool captureImage(uint8_t *snapshot_buf);
-bool processImage(uint8_t *snapshot_buf, int &detected);
 void handleBoundingBox(const ei_impulse_result_bounding_box_t &bb);
 // void logError(const String &message, int code = 0);
-void handleCapture(const String &command);
+void handleCapture(const CommandArgs &args);
 
 static camera_config_t camera_config = {
     .pin_pwdn = PWDN_GPIO_NUM,
@@ -73,10 +108,11 @@ static camera_config_t camera_config = {
         FRAMESIZE_QVGA, // QQVGA-UXGA Do not use sizes above QVGA when not JPEG
 
     .jpeg_quality = 12, // 0-63 lower number means higher quality
-    .fb_count =
-        1, // if more than one, i2s runs in continuous mode. Use only with JPEG
+    // two frame buffers, one is filled while the other is copied to the
+    // frame pool (i2s runs in continuous mode, JPEG only)
+    .fb_count = 2,
     .fb_location = CAMERA_FB_IN_PSRAM,
-    .grab_mode = CAMERA_GRAB_WHEN_EMPTY,
+    .grab_mode = CAMERA_GRAB_LATEST,
 };
 
 bool ei_camera_init(void)
@@ -118,7 +154,7 @@ bool ei_camera_init(void)
     return true;
 }
 
-void handleHello(const String &command)
+void handleHello(const CommandArgs &args)
 {
     commandHandler.sendCommand("READY");
 
@@ -127,7 +163,40 @@ void handleHello(const String &command)
     }
 }
 
-void handleReady(const String &command)
+// Switches the serial link once what was sent before has gone out
+static void switchLink(bool binary, uint32_t baud)
+{
+    Serial.flush();
+
+    if (baud != linkBaud) {
+        Serial.updateBaudRate(baud);
+        linkBaud = baud;
+    }
+    commandHandler.setBinary(binary);
+    if (binary) {
+        linkWatchdog.start(commandHandler.link(), millis());
+    }
+}
+
+// LINK <baud> switches the link to binary frames at that baud rate, LINK OFF
+// back to text lines at LINK_TEXT_BAUD, the reply goes out before the switch
+void handleLink(const CommandArgs &args)
+{
+    bool enable = strcmp(args.data, "OFF") != 0;
+    uint32_t baud = enable ? strtoul(args.data, nullptr, 10) : LINK_TEXT_BAUD;
+
+    if (status == STATUS_BOOT || !linkBaudSupported(baud)) {
+        commandHandler.sendCommand("LINK_FAIL");
+        return;
+    }
+
+    char value[12];
+    snprintf(value, sizeof(value), "%lu", (unsigned long)baud);
+    commandHandler.sendCommand("LINK_OK", value);
+    switchLink(enable, baud);
+}
+
+void handleReady(const CommandArgs &args)
 {
     if (status == STATUS_BOOT) {
         status = STATUS_SYNCED;
@@ -135,7 +204,32 @@ void handleReady(const String &command)
     }
 }
 
-void handleInit(const String &command)
+// Only an answer is cached: the calories, or "not found" (0 calories,
+// FISH_INFO as before). Any other code is a failed request, not cached and
+// retried after NUTRITION_RETRY_MS like a server error.
+static bool apiFetch(void *ctx, const char *label, float *calories)
+{
+    APIHandler::api_response_code_t code =
+        apiHandler.fetchData(label, *calories);
+    if (code == HTTP_CODE_NOT_FOUND) {
+        *calories = 0.0f;
+    }
+    return code == HTTP_CODE_OK || code == HTTP_CODE_NOT_FOUND;
+}
+
+// From the main loop only, like every other SD card access
+static void saveNutritionCache()
+{
+    static char text[NUTRITION_CACHE_SIZE * (NUTRITION_LABEL_SIZE + 16)];
+
+    savedNutritionGeneration = nutritionCache.generation();
+    size_t length = nutritionCache.save(text, sizeof(text));
+    if (length > 0 && !sdReader.writeFile(NUTRITION_CACHE_FILE, text)) {
+        ei_printf("ERR: Failed to save the nutrition cache\r\n");
+    }
+}
+
+void handleInit(const CommandArgs &args)
 {
     if (status != STATUS_SYNCED) {
         return;
@@ -194,6 +288,29 @@ void handleInit(const String &command)
         s->set_saturation(s, 0); // lower the saturation
     }
 
+    // Frame buffers for the whole uptime, nothing per frame is left to the
+    // heap (the resize rows are hot, internal RAM)
+    resizeBufferSize = ei::image::processing::resize_stream_buffer_size(
+        EI_CAMERA_FRAME_COLS, EI_CAMERA_FRAME_ROWS, EI_CLASSIFIER_INPUT_WIDTH,
+        EI_CLASSIFIER_INPUT_HEIGHT, ei::image::processing::RGB888_B_SIZE,
+        EI_CLASSIFIER_RESIZE_MODE, EI_CAMERA_JPEG_MCU_ROWS);
+    resizeBuffer = (uint8_t *)heap_caps_malloc(
+        resizeBufferSize, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    bool buffersOk = resizeBuffer != nullptr;
+    if (buffersOk &&
+        !framePool.init(EI_CAMERA_POOL_SLOTS, EI_CAMERA_POOL_SLOT_SIZE)) {
+        // Not kept for the next INIT, which allocates it again
+        heap_caps_free(resizeBuffer);
+        resizeBuffer = nullptr;
+        buffersOk = false;
+    }
+    if (!buffersOk) {
+        ei_printf("ERR: Failed to allocate the frame buffers\r\n");
+        commandHandler.sendCommand("CAM_INIT_FAIL");
+        status = STATUS_CAM_INIT_FAIL;
+        return;
+    }
+
     is_initialised = true;
 
     // APIHandler::api_response_code_t response = apiHandler.pingAPI();
@@ -206,184 +323,271 @@ void handleInit(const String &command)
     //     return;
     // }
 
+    // Every label of the model is cached before the first capture, from the
+    // SD card if it is there (revalidated in the background), else from the
+    // API. A label the API does not know is simply fetched again later.
+    String saved = sdReader.readFile(NUTRITION_CACHE_FILE);
+    nutritionCache.load(saved.c_str(), saved.length());
+    nutritionCache.warm(ei_classifier_inferencing_categories,
+                        EI_CLASSIFIER_LABEL_COUNT);
+    saveNutritionCache();
+
     commandHandler.sendCommand("INIT_SUCCESS");
     status = STATUS_READY;
 }
 
-void statusHandler(const String &command)
+void statusHandler(const CommandArgs &args)
 {
-    commandHandler.sendCommand("STATUS", String(status));
+    char value[12];
+    snprintf(value, sizeof(value), "%d", (int)status);
+    commandHandler.sendCommand("STATUS", value);
 }
 
-bool ei_camera_capture(uint32_t img_width, uint32_t img_height,
-                       uint8_t *out_buf)
+// Frame pool occupancy: slots, in use, peak in use, acquires, waits, timeouts,
+// longest and mean wait in us
+void handlePool(const CommandArgs &args)
 {
-    bool do_resize = false;
+    frame_pool_stats_t stats;
+    framePool.stats(stats);
+
+    unsigned long meanWaitUs =
+        stats.waits ? (unsigned long)(stats.waitTotalUs / stats.waits) : 0;
+    char value[COMMAND_BUFFER_SIZE];
+    snprintf(value, sizeof(value), "%lu %lu %lu %lu %lu %lu %lu %lu",
+             (unsigned long)stats.slots, (unsigned long)stats.inUse,
+             (unsigned long)stats.peakInUse, (unsigned long)stats.acquires,
+             (unsigned long)stats.waits, (unsigned long)stats.timeouts,
+             (unsigned long)stats.waitMaxUs, meanWaitUs);
+    commandHandler.sendCommand("POOL", value);
+}
 
+// Runs on the capture task, a failure reaches loop() as CAPTURE_FAIL
+camera_fb_t *ei_camera_capture()
+{
     if (!is_initialised) {
-        ei_printf("ERR: Camera is not initialized\r\n");
-        return false;
+        return nullptr;
     }
 
-    camera_fb_t *fb = esp_camera_fb_get();
+    return esp_camera_fb_get();
+}
 
-    if (!fb) {
-        ei_printf("Camera capture failed\n");
-        return false;
+static size_t cameraJpegRead(void *arg, size_t index, uint8_t *buf, size_t len)
+{
+    const pipeline_frame_t *frame = ((camera_stream_t *)arg)->frame;
+
+    if (index + len > frame->length) {
+        len = frame->length - index;
+    }
+    if (buf) {
+        memcpy(buf, frame->data + index, len);
+    }
+    return len;
+}
+
+static bool cameraJpegWrite(void *arg, uint16_t x, uint16_t y, uint16_t w,
+                            uint16_t h, uint8_t *data)
+{
+    // called without data at the start and at the end of the image
+    if (!data) {
+        return true;
     }
+    return ei::image::processing::resize_stream_push_block(
+               &((camera_stream_t *)arg)->resize, x, y, w, h, data) ==
+           EIDSP_OK;
+}
 
-    bool converted = fmt2rgb888(fb->buf, fb->len, PIXFORMAT_JPEG, snapshot_buf);
+// Decodes the JPEG frame one MCU row at a time, each row is cropped and
+// resized into the model input rows, which are quantized as they come in
+static int cameraStreamProduce(void *ctx, ei::ei_image_row_writer_t write_row,
+                               void *sink)
+{
+    camera_stream_t *stream = (camera_stream_t *)ctx;
+
+    int res = ei::image::processing::resize_stream_init(
+        &stream->resize, stream->frame->width, stream->frame->height,
+        EI_CLASSIFIER_INPUT_WIDTH, EI_CLASSIFIER_INPUT_HEIGHT,
+        ei::image::processing::RGB888_B_SIZE, EI_CLASSIFIER_RESIZE_MODE,
+        EI_CAMERA_JPEG_MCU_ROWS, write_row, sink, resizeBuffer,
+        resizeBufferSize);
+
+    if (res == EIDSP_OK) {
+        if (esp_jpg_decode(stream->frame->length, JPG_SCALE_NONE,
+                           cameraJpegRead, cameraJpegWrite,
+                           stream) != ESP_OK) {
+            res = ESP_FAIL;
+        } else {
+            res = ei::image::processing::resize_stream_finish(&stream->resize);
+        }
+    }
 
-    esp_camera_fb_return(fb);
+    ei::image::processing::resize_stream_free(&stream->resize);
+    return res;
+}
 
-    if (!converted) {
-        ei_printf("Conversion failed\n");
-        return false;
+#if EI_CLASSIFIER_OBJECT_DETECTION == 1
+// All boxes of a frame in one LINK_MSG_DETECTIONS frame, as many as fit
+static void sendDetections(const pipeline_result_t &result)
+{
+    uint8_t payload[LINK_MAX_PAYLOAD];
+    size_t length = 1;
+
+    payload[0] = 0;
+    for (uint32_t i = 0; i < result.detectionCount; i++) {
+        const pipeline_detection_t &d = result.detections[i];
+        size_t size = linkPutDetection(payload + length,
+                                       sizeof(payload) - length, d.label,
+                                       d.value, d.x, d.y, d.width, d.height);
+        if (size == 0) {
+            break;
+        }
+        length += size;
+        payload[0]++;
     }
+    commandHandler.sendFrame(LINK_MSG_DETECTIONS, payload, length);
+}
+#endif
 
-    if ((img_width != EI_CAMERA_RAW_FRAME_BUFFER_COLS) ||
-        (img_height != EI_CAMERA_RAW_FRAME_BUFFER_ROWS)) {
-        do_resize = true;
+// ------- Pipeline stages, run on the pipeline tasks ----------------------- //
+// The JPEG is copied to a pool slot and the camera gets its buffer back right
+// away, the slot goes with the frame to inference, which releases it
+static bool cameraCapture(void *ctx, pipeline_frame_t *frame)
+{
+    camera_fb_t *fb = ei_camera_capture();
+    if (!fb) {
+        return false;
     }
 
-    if (do_resize) {
-        ei::image::processing::crop_and_interpolate_rgb888(
-            out_buf, EI_CAMERA_RAW_FRAME_BUFFER_COLS,
-            EI_CAMERA_RAW_FRAME_BUFFER_ROWS, out_buf, img_width, img_height);
+    uint8_t *slot = nullptr;
+    if (fb->len <= framePool.slotSize()) {
+        slot = framePool.acquire(EI_CAMERA_POOL_WAIT_MS);
+    }
+    if (!slot) {
+        // Reported from loop() as CAPTURE_FAIL, like a failed capture
+        esp_camera_fb_return(fb);
+        return false;
     }
 
+    memcpy(slot, fb->buf, fb->len);
+    frame->data = slot;
+    frame->length = fb->len;
+    frame->width = fb->width;
+    frame->height = fb->height;
+    frame->handle = slot;
+    esp_camera_fb_return(fb);
     return true;
 }
 
-static int ei_camera_get_data(size_t offset, size_t length, float *out_ptr)
+static void cameraRelease(void *ctx, pipeline_frame_t *frame)
 {
-    // we already have a RGB888 buffer, so recalculate offset into pixel index
-    size_t pixel_ix = offset * 3;
-    size_t pixels_left = length;
-    size_t out_ptr_ix = 0;
-
-    while (pixels_left != 0) {
-        // Swap BGR to RGB here
-        // due to https://github.com/espressif/esp32-camera/issues/379
-        out_ptr[out_ptr_ix] = (snapshot_buf[pixel_ix + 2] << 16) +
-                              (snapshot_buf[pixel_ix + 1] << 8) +
-                              snapshot_buf[pixel_ix];
-
-        // go to the next pixel
-        out_ptr_ix++;
-        pixel_ix += 3;
-        pixels_left--;
-    }
-    // and done!
-    return 0;
+    framePool.release((uint8_t *)frame->handle);
 }
 
-static const int captureTryCount = 5;
-
-void handleCapture(const String &command)
+static bool cameraInfer(void *ctx, const pipeline_frame_t *frame,
+                        pipeline_detection_t *detections, uint32_t *count)
 {
-    const int maxRetries = 5;   // Maximum number of capture retries
-    int retryCount = 0;         // Current retry attempt
-    bool labelDetected = false; // Flag to indicate if a label is detected
-
-    while (retryCount < maxRetries && !labelDetected) {
-        retryCount++;
+    // The frame is decoded straight into the model input, the decoder
+    // writes RGB (fmt2rgb888 swaps it to BGR, see
+    // https://github.com/espressif/esp32-camera/issues/379)
+    camera_stream_t cameraStream;
+    cameraStream.frame = frame;
+
+    ei::image_stream_t image;
+    image.produce = cameraStreamProduce;
+    image.ctx = &cameraStream;
+    image.width = EI_CLASSIFIER_INPUT_WIDTH;
+    image.height = EI_CLASSIFIER_INPUT_HEIGHT;
+    image.format = ei::EI_IMAGE_SIGNAL_RGB888;
+
+    // Run the classifier, the boxes stay on the stack. The decoder scratch is
+    // the one of the SDK, this task is the only one running the model.
+    ei_impulse_result_t result = {0};
+#if EI_CLASSIFIER_OBJECT_DETECTION == 1
+    ei_impulse_result_bounding_box_t boxes[EI_CLASSIFIER_OBJECT_DETECTION_COUNT];
+    EI_IMPULSE_ERROR err = run_classifier_image_stream(
+        &ei_default_impulse, &image, &result, boxes,
+        EI_CLASSIFIER_OBJECT_DETECTION_COUNT, nullptr, debug_nn);
+#else
+    EI_IMPULSE_ERROR err =
+        run_classifier_image_stream(&image, &result, debug_nn);
+#endif
 
-        // Allocate memory for the snapshot buffer
-        snapshot_buf = (uint8_t *)malloc(EI_CAMERA_RAW_FRAME_BUFFER_COLS *
-                                         EI_CAMERA_RAW_FRAME_BUFFER_ROWS *
-                                         EI_CAMERA_FRAME_BYTE_SIZE);
+    *count = 0;
+    if (err != EI_IMPULSE_OK) {
+        return false;
+    }
 
-        if (snapshot_buf == nullptr) {
-            // ei_printf("ERR: Failed to allocate snapshot buffer!\n");
-            commandHandler.sendCommand("CAPTURE_FAIL");
-            return; // Exit if memory allocation fails
+#if EI_CLASSIFIER_OBJECT_DETECTION == 1
+    for (uint32_t i = 0; i < result.bounding_boxes_count &&
+                         *count < PIPELINE_MAX_DETECTIONS;
+         i++) {
+        const ei_impulse_result_bounding_box_t &bb = result.bounding_boxes[i];
+        if (bb.value == 0) {
+            continue; // Skip bounding boxes with zero value
         }
+        pipeline_detection_t &d = detections[(*count)++];
+        strncpy(d.label, bb.label, sizeof(d.label) - 1);
+        d.label[sizeof(d.label) - 1] = '\0';
+        d.value = bb.value;
+        d.x = bb.x;
+        d.y = bb.y;
+        d.width = bb.width;
+        d.height = bb.height;
+    }
+#endif
+    // Only the boxes go back to loop(), nothing is printed from the infer task
+    return true;
+}
 
-        // Set up signal data
-        ei::signal_t signal;
-        signal.total_length =
-            EI_CLASSIFIER_INPUT_WIDTH * EI_CLASSIFIER_INPUT_HEIGHT;
-        signal.get_data = &ei_camera_get_data;
-
-        // Capture image
-        if (!ei_camera_capture((size_t)EI_CLASSIFIER_INPUT_WIDTH,
-                               (size_t)EI_CLASSIFIER_INPUT_HEIGHT,
-                               snapshot_buf)) {
-            commandHandler.sendCommand("CAPTURE_FAIL");
-            free(snapshot_buf);
-            continue; // Retry capture
-        }
+static bool nutritionLookup(void *ctx, const char *label, float *calories)
+{
+    return nutritionCache.lookup(label, calories);
+}
 
-        // Run the classifier
-        ei_impulse_result_t result = {0};
-        EI_IMPULSE_ERROR err = run_classifier(&signal, &result, debug_nn);
+// Queues the capture and returns, the results are sent from loop()
+void handleCapture(const CommandArgs &args)
+{
+    if (!pipeline.submit()) {
+        commandHandler.sendCommand("CAPTURE_BUSY");
+    }
+}
 
-        if (err != EI_IMPULSE_OK) {
-            commandHandler.sendCommand("AI_FAIL");
-            free(snapshot_buf);
-            continue; // Retry if classification fails
-        }
+// Sends what the pipeline has finished, same replies as the blocking capture
+static void sendPipelineResults()
+{
+    static pipeline_result_t result;
 
+    while (pipeline.poll(result)) {
+        switch (result.status) {
+        case PIPELINE_FISH_INFO: {
 #if EI_CLASSIFIER_OBJECT_DETECTION == 1
-        for (uint32_t i = 0; i < result.bounding_boxes_count; i++) {
-            ei_impulse_result_bounding_box_t bb = result.bounding_boxes[i];
-            if (bb.value == 0) {
-                continue; // Skip bounding boxes with zero value
-            }
-
-            // Stop retries as a label is detected
-            labelDetected = true;
-
-            // Process the detected label (e.g., fetch additional data)
-            float calories;
-            if (apiHandler.fetchData(bb.label, calories)) {
-                String args = String(bb.label) + " " + String(calories);
-                commandHandler.sendCommand("FISH_INFO", args);
-            } else {
-                commandHandler.sendCommand("CAPTURE_FAIL");
+            // The binary link gets every box of the frame, not only the first
+            if (commandHandler.isBinary()) {
+                sendDetections(result);
             }
-            break; // Stop processing further bounding boxes
-        }
-#else
-        // Handle predictions (classification mode)
-        ei_printf("Predictions:\r\n");
-        for (uint16_t i = 0; i < EI_CLASSIFIER_LABEL_COUNT; i++) {
-            ei_printf("  %s: ", ei_classifier_inferencing_categories[i]);
-            ei_printf("%.5f\r\n", result.classification[i].value);
-        }
 #endif
-
-#if EI_CLASSIFIER_HAS_ANOMALY
-        // Print anomaly results if applicable
-        ei_printf("Anomaly prediction: %.3f\r\n", result.anomaly);
-#endif
-
-#if EI_CLASSIFIER_HAS_VISUAL_ANOMALY
-        // Print visual anomalies if applicable
-        ei_printf("Visual anomalies:\r\n");
-        for (uint32_t i = 0; i < result.visual_ad_count; i++) {
-            ei_impulse_result_bounding_box_t bb =
-                result.visual_ad_grid_cells[i];
-            if (bb.value == 0) {
-                continue;
-            }
-            ei_printf("  %s (%f) [ x: %u, y: %u, width: %u, height: %u ]\r\n",
-                      bb.label, bb.value, bb.x, bb.y, bb.width, bb.height);
+            char info[COMMAND_BUFFER_SIZE];
+            snprintf(info, sizeof(info), "%s %.2f", result.detections[0].label,
+                     result.calories);
+            commandHandler.sendCommand("FISH_INFO", info);
+            break;
+        }
+        case PIPELINE_LOOKUP_FAIL:
+        case PIPELINE_CAPTURE_FAIL:
+            commandHandler.sendCommand("CAPTURE_FAIL");
+            break;
+        case PIPELINE_AI_FAIL:
+            commandHandler.sendCommand("AI_FAIL");
+            break;
+        case PIPELINE_NOT_RECOG:
+            commandHandler.sendCommand("FISH_NOT_RECOG");
+            break;
         }
-#endif
-
-        free(snapshot_buf); // Free memory after each attempt
-    }
-
-    if (!labelDetected) {
-        commandHandler.sendCommand("FISH_NOT_RECOG");
     }
 }
 
 void setup()
 {
-    Serial.begin(115200);
+    Serial.begin(LINK_TEXT_BAUD);
     delay(1000);
 
     while (!Serial) {
@@ -396,6 +600,18 @@ void setup()
     commandHandler.registerRoute("READY", handleReady);
     commandHandler.registerRoute("STATUS", statusHandler);
     commandHandler.registerRoute("CAPTURE", handleCapture);
+    commandHandler.registerRoute("LINK", handleLink);
+    commandHandler.registerRoute("POOL", handlePool);
+
+    pipeline_stages_t stages = {cameraCapture, cameraRelease, cameraInfer,
+                                nutritionLookup, nullptr};
+    if (!pipeline.start(stages)) {
+        ei_printf("ERR: Failed to start the capture pipeline\r\n");
+    }
+    nutrition_source_t source = {apiFetch, nullptr};
+    if (!nutritionCache.start(source)) {
+        ei_printf("ERR: Failed to start the nutrition cache\r\n");
+    }
 
     commandHandler.sendCommand("HELLO");
 }
@@ -403,6 +619,21 @@ void setup()
 void loop()
 {
     commandHandler.handleIncomingCommand(); // Handle serial commands
+    sendPipelineResults();
+
+    // The controller stopped framing (reset, or back at the text baud rate),
+    // it gets LINK_LOST at LINK_TEXT_BAUD and can negotiate again
+    if (commandHandler.isBinary() &&
+        linkWatchdog.expired(commandHandler.link(), millis())) {
+        switchLink(false, LINK_TEXT_BAUD);
+        commandHandler.sendCommand("LINK_LOST");
+    }
+
+    // Values refreshed in the background are persisted from here
+    if (status == STATUS_READY &&
+        nutritionCache.generation() != savedNutritionGeneration) {
+        saveNutritionCache();
+    }
 
     if (status == STATUS_BOOT) {
         static unsigned long lastHello = 0;